@@ -0,0 +1,85 @@
+#ifndef LEPP2_ADAPTIVE_STRIDE_H__
+#define LEPP2_ADAPTIVE_STRIDE_H__
+
+#include <stdint.h>
+
+#include "deps/easylogging++.h"
+
+namespace lepp {
+
+/**
+ * Chooses the stride by which a source decimates the pixels of its frames
+ * (i.e. only every `stride`-th pixel of every `stride`-th row is kept), so
+ * that the pipeline keeps up with the sensor.
+ *
+ * The source reports the time that the pipeline took for each frame. When the
+ * (smoothed) time exceeds the per-frame budget, the stride is doubled, which
+ * cuts the number of points to a quarter. It is halved again only once the
+ * time, scaled up by the same factor, would comfortably fit into the budget.
+ * The gap between the two thresholds, along with the number of frames that
+ * need to be seen after a switch before the next one, keeps the stride from
+ * oscillating.
+ */
+class AdaptiveStride {
+public:
+  /**
+   * Creates a controller keeping the time per frame within the given budget
+   * (in microseconds) with strides of at most `max_stride`.
+   */
+  AdaptiveStride(uint64_t budget, size_t max_stride)
+      : budget_(budget),
+        max_stride_(max_stride < 1 ? 1 : max_stride),
+        stride_(1),
+        average_(0),
+        frames_(0) {}
+
+  /**
+   * The stride by which the next frame should be decimated.
+   */
+  size_t stride() const { return stride_; }
+
+  /**
+   * Reports the time (in microseconds) that the pipeline took for a frame
+   * decimated by the current stride.
+   */
+  void update(uint64_t frame_time) {
+    // The weight of each new frame in the smoothed time per frame.
+    double const smoothing = .2;
+    // The fraction of the budget that the expected time per frame at the
+    // finer stride needs to fit into.
+    double const headroom = .7;
+    average_ = frames_ == 0
+        ? frame_time
+        : smoothing * frame_time + (1 - smoothing) * average_;
+    if (++frames_ < SETTLE_FRAMES) return;
+
+    if (average_ > budget_ && stride_ * 2 <= max_stride_) {
+      switchTo(stride_ * 2);
+    } else if (stride_ > 1 && 4 * average_ < headroom * budget_) {
+      switchTo(stride_ / 2);
+    }
+  }
+private:
+  void switchTo(size_t stride) {
+    LINFO << "AdaptiveStride: " << average_ / 1e3 << " ms per frame (budget "
+          << budget_ / 1e3 << " ms); switching to stride " << stride;
+    stride_ = stride;
+    // The times measured at the old stride say nothing about the new one.
+    frames_ = 0;
+  }
+
+  /**
+   * The number of frames that are measured at a stride before it may change.
+   */
+  static size_t const SETTLE_FRAMES = 15;
+
+  uint64_t const budget_;
+  size_t const max_stride_;
+  size_t stride_;
+  double average_;
+  size_t frames_;
+};
+
+}  // namespace lepp
+
+#endif
@@ -6,6 +6,8 @@
 
 #include <pcl/visualization/cloud_viewer.h>
 
+#include "lepp2/BaseVideoSource.hpp"
+#include "lepp2/Metrics.hpp"
 #include "lepp2/VideoObserver.hpp"
 #include "lepp2/BaseSegmenter.hpp"
 #include "lepp2/NoopSegmenter.hpp"
@@ -14,13 +16,12 @@
 #include "lepp2/ObjectApproximator.hpp"
 #include "lepp2/MomentOfInertiaApproximator.hpp"
 #include "lepp2/SplitApproximator.hpp"
+#include "lepp2/debug/trace.hpp"
 
 #include "deps/easylogging++.h"
 
 using namespace lepp;
 
-#include "lepp2/debug/timer.hpp"
-
 /**
  * A base class for obstacle detectors.
  *
@@ -80,6 +81,20 @@ public:
       int idx,
       const typename pcl::PointCloud<PointT>::ConstPtr& point_cloud);
 
+  /**
+   * The time spent on the stages of the detection, in microseconds.
+   */
+  struct DetectionTimes {
+    uint64_t segmentation;
+    uint64_t approximation;
+  };
+  /**
+   * The time it took to detect the obstacles in the latest frame. Meant to be
+   * read by the detector's aggregators (i.e. on the thread emitting the
+   * frames).
+   */
+  DetectionTimes const& lastTimes() const { return last_times_; }
+
 protected:
   /// Some convenience typedefs
   typedef pcl::PointCloud<PointT> PointCloud;
@@ -90,6 +105,16 @@ private:
 
   boost::shared_ptr<BaseSegmenter<PointT> > segmenter_;
   boost::shared_ptr<ObjectApproximator<PointT> > approximator_;
+  DetectionTimes last_times_;
+
+  /**
+   * The detector's metrics (see `lepp::MetricsRegistry`).
+   */
+  lepp::Histogram& segmentation_time_;
+  lepp::Histogram& approximation_time_;
+  lepp::Histogram& clusters_;
+  lepp::Histogram& primitives_;
+  lepp::Counter& failures_;
 
   /**
    * Performs a new update of the obstacle approximations.
@@ -102,8 +127,26 @@ template<class PointT>
 BaseObstacleDetector<PointT>::BaseObstacleDetector(
     boost::shared_ptr<ObjectApproximator<PointT> > approx)
       : approximator_(approx),
-        segmenter_(new EuclideanPlaneSegmenter<PointT>()) {
+        segmenter_(new EuclideanPlaneSegmenter<PointT>()),
+        segmentation_time_(lepp::MetricsRegistry::global().histogram(
+              "lepp_segmentation_time_us", "Time taken to segment a frame",
+              lepp::Histogram::exponential(250, 2, 12))),
+        approximation_time_(lepp::MetricsRegistry::global().histogram(
+              "lepp_approximation_time_us",
+              "Time taken to approximate the segments of a frame",
+              lepp::Histogram::exponential(250, 2, 12))),
+        clusters_(lepp::MetricsRegistry::global().histogram(
+              "lepp_clusters", "Segments found in a frame",
+              lepp::Histogram::exponential(1, 2, 8))),
+        primitives_(lepp::MetricsRegistry::global().histogram(
+              "lepp_primitives",
+              "Primitives (spheres and capsules) approximating a frame's segments",
+              lepp::Histogram::exponential(1, 2, 10))),
+        failures_(lepp::MetricsRegistry::global().counter(
+              "lepp_detection_failures_total", "Frames whose detection failed")) {
   // TODO Allow for dependency injection.
+  last_times_.segmentation = 0;
+  last_times_.approximation = 0;
 }
 
 
@@ -116,24 +159,35 @@ void BaseObstacleDetector<PointT>::notifyNewFrame(
     update();
   } catch (...) {
     LERROR << "ObstacleDetector: Obstacle detection failed ...";
+    failures_.inc();
   }
 }
 
 
 template<class PointT>
 void BaseObstacleDetector<PointT>::update() {
-  Timer t;
-  t.start();
+  uint64_t const start = lepp::localTime();
+  lepp::TraceSpan segmentation("segmentation");
   std::vector<PointCloudConstPtr> segments(segmenter_->segment(cloud_));
+  segmentation.end();
+  uint64_t const segmented = lepp::localTime();
 
   // Iteratively approximate the segments
   size_t segment_count = segments.size();
   std::vector<ObjectModelPtr> models;
+  CountVisitor counter;
+  lepp::TraceSpan approximation("approximation");
   for (size_t i = 0; i < segment_count; ++i) {
     models.push_back(approximator_->approximate(segments[i]));
+    models.back()->accept(counter);
   }
-  t.stop();
-  PINFO << "Obstacle detection took " << t.duration();
+  approximation.end();
+  last_times_.segmentation = segmented - start;
+  last_times_.approximation = lepp::localTime() - segmented;
+  segmentation_time_.observe(last_times_.segmentation);
+  approximation_time_.observe(last_times_.approximation);
+  clusters_.observe(segment_count);
+  primitives_.observe(counter.count());
 
   notifyObstacles(models);
 }
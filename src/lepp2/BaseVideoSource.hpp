@@ -3,12 +3,17 @@
 
 #include <vector>
 
+#include <stdint.h>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
 #include <pcl/io/pcd_io.h>
 #include <pcl/point_types.h>
 #include <pcl/io/openni_grabber.h>
 #include <pcl/visualization/cloud_viewer.h>
 
 #include "VideoObserver.hpp"
+#include "debug/trace.hpp"
 
 namespace lepp {
 
@@ -17,6 +22,33 @@ typedef pcl::PointCloud<SimplePoint> SimplePointCloud;
 typedef pcl::PointXYZRGBA ColoredPoint;
 typedef pcl::PointCloud<ColoredPoint> ColoredPointCloud;
 
+/**
+ * Returns the current local time in microseconds since the epoch.
+ */
+inline uint64_t localTime() {
+  boost::posix_time::ptime const epoch(boost::gregorian::date(1970, 1, 1));
+  return (boost::posix_time::microsec_clock::universal_time() - epoch)
+      .total_microseconds();
+}
+
+/**
+ * Returns the (local) time at which a cloud with the given stamp that was
+ * received at the (local) time `now` was captured, in microseconds since the
+ * epoch.
+ *
+ * The cloud's own stamp is used if it is given by the local clock. Some
+ * grabbers stamp the clouds using the device's clock instead, in which case
+ * the time at which the cloud was received is the best approximation.
+ */
+inline uint64_t captureTime(uint64_t stamp, uint64_t now) {
+  // Stamps further in the past than this cannot be on the local clock.
+  uint64_t const max_age = 1000000;
+  if (stamp != 0 && stamp <= now && now - stamp < max_age) {
+    return stamp;
+  }
+  return now;
+}
+
 
 /**
  * The abstract base class for all classes that wish to be sources of point
@@ -50,6 +82,12 @@ public:
    * Starts the video source.
    */
   virtual void open() = 0;
+  /**
+   * Stops the video source. Once it returns, no frames are delivered to the
+   * observers anymore, so they can safely be torn down. Sources without a
+   * thread of their own have nothing to stop.
+   */
+  virtual void close() {}
   /**
    * Attaches a new VideoObserver to the VideoSource instance.
    * Each observer will get notified once the VideoSource has received a new
@@ -102,6 +140,9 @@ template<class PointT>
 void VideoSource<PointT>::setNextFrame(
     const typename PointCloudType::ConstPtr& cloud) {
   ++frame_counter_;
+  // The observers process the frame on this thread, so its whole way through
+  // the pipeline is traced as the frame.
+  TraceFrame frame(frame_counter_);
   notifyObservers(frame_counter_, cloud);
 }
 
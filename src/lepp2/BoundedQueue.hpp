@@ -0,0 +1,81 @@
+#ifndef LEPP2_BOUNDED_QUEUE_H__
+#define LEPP2_BOUNDED_QUEUE_H__
+
+#include <deque>
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace lepp {
+
+/**
+ * A FIFO queue with a fixed capacity that hands items from producer threads
+ * over to consumer threads: producers block while the queue is full and
+ * consumers block while it is empty.
+ *
+ * Closing the queue wakes everyone up: no more items are accepted, while the
+ * items already in the queue can still be taken out.
+ */
+template<class T>
+class BoundedQueue : boost::noncopyable {
+public:
+  explicit BoundedQueue(size_t capacity)
+      : capacity_(capacity > 0 ? capacity : 1), closed_(false) {}
+
+  /**
+   * Appends an item, waiting for room if the queue is full. Returns false
+   * (dropping the item) if the queue is closed.
+   */
+  bool push(T const& item) {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (items_.size() >= capacity_ && !closed_) not_full_.wait(lock);
+    if (closed_) return false;
+    items_.push_back(item);
+    not_empty_.notify_one();
+    return true;
+  }
+
+  /**
+   * Takes the oldest item out of the queue, waiting for one if the queue is
+   * empty. Returns false if the queue is closed and there are no more items.
+   */
+  bool pop(T& item) {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (items_.empty() && !closed_) not_empty_.wait(lock);
+    if (items_.empty()) return false;
+    item = items_.front();
+    items_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+  /**
+   * Closes the queue.
+   */
+  void close() {
+    boost::mutex::scoped_lock lock(mutex_);
+    closed_ = true;
+    not_full_.notify_all();
+    not_empty_.notify_all();
+  }
+
+  /**
+   * The number of items currently in the queue.
+   */
+  size_t size() const {
+    boost::mutex::scoped_lock lock(mutex_);
+    return items_.size();
+  }
+private:
+  size_t const capacity_;
+  std::deque<T> items_;
+  bool closed_;
+  mutable boost::mutex mutex_;
+  boost::condition_variable not_full_;
+  boost::condition_variable not_empty_;
+};
+
+}  // namespace lepp
+
+#endif
@@ -0,0 +1,267 @@
+#ifndef LEPP2_DEPTH_STREAM_SOURCE_H__
+#define LEPP2_DEPTH_STREAM_SOURCE_H__
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <pcl/io/openni2_grabber.h>
+#include <pcl/io/image_depth.h>
+
+#include "lepp2/AdaptiveStride.hpp"
+#include "lepp2/BaseVideoSource.hpp"
+
+namespace lepp {
+
+/**
+ * Back-projects depth images (in millimeters, as given by the sensor) into
+ * point clouds by table lookups.
+ *
+ * The camera is a pinhole camera, so the ray of each pixel is separable into
+ * a component depending only on its column and one depending only on its row,
+ * which are tabulated once for the resolution of the images. The depth
+ * calibration (the map of `SensorCalibrationFilter`) is folded into a second
+ * table, indexed by the raw depth value, which only covers the depths within
+ * the given range: pixels out of range (including those without a reading)
+ * are skipped before any 3D point is made out of them.
+ */
+class DepthProjector {
+public:
+  /**
+   * Creates a projector applying the depth calibration `scale * z + offset`
+   * and keeping only the points whose (calibrated) depth is within
+   * [`min_depth`, `max_depth`] (in meters).
+   */
+  DepthProjector(double scale, double offset, double min_depth, double max_depth);
+
+  /**
+   * Sets up the ray tables for images of the given resolution and focal
+   * length (in pixels). A no-op if they are already set up for them.
+   */
+  void setIntrinsics(size_t width, size_t height, float focal);
+
+  /**
+   * Puts the points of the given depth image, of the resolution given to
+   * `setIntrinsics`, into the given cloud. The resulting cloud is dense (it
+   * contains only the points within the depth range) and therefore
+   * unorganized.
+   *
+   * With a stride greater than 1, only every `stride`-th pixel of every
+   * `stride`-th row is looked at.
+   */
+  template<class PointT>
+  void project(uint16_t const* depth,
+               pcl::PointCloud<PointT>& cloud,
+               size_t stride = 1) const;
+private:
+  /**
+   * The range of the raw depth values covered by the depth tables.
+   */
+  uint16_t min_raw_;
+  uint16_t max_raw_;
+  /**
+   * For each raw depth value (offset by `min_raw_`), the calibrated depth and
+   * the factor by which the pixel's ray is scaled to get the point's x and y.
+   */
+  std::vector<float> depth_;
+  std::vector<float> scale_;
+  /**
+   * The x (resp. y) component of the (unit depth) ray of each column (resp.
+   * row) of the image.
+   */
+  std::vector<float> ray_x_;
+  std::vector<float> ray_y_;
+  float focal_;
+};
+
+inline DepthProjector::DepthProjector(
+    double scale,
+    double offset,
+    double min_depth,
+    double max_depth)
+    : min_raw_(1), max_raw_(0), focal_(0) {
+  if (scale <= 0 || min_depth > max_depth) {
+    throw "Invalid depth calibration or range";
+  }
+  // The calibration is increasing, so the range of raw depths is given by the
+  // inverse calibration of the bounds. (0 means that there is no reading.)
+  double const min_raw = std::ceil((min_depth - offset) / scale * 1000);
+  double const max_raw = std::floor((max_depth - offset) / scale * 1000);
+  min_raw_ = static_cast<uint16_t>(std::max(1., std::min(65535., min_raw)));
+  max_raw_ = static_cast<uint16_t>(std::max(0., std::min(65535., max_raw)));
+  for (uint32_t raw = min_raw_; raw <= max_raw_; ++raw) {
+    double const z = raw / 1000.;
+    double const calibrated = scale * z + offset;
+    depth_.push_back(calibrated);
+    // As by `SensorCalibrationFilter`: x' = x * (scale + offset / z').
+    scale_.push_back(z * (scale + offset / calibrated));
+  }
+}
+
+inline void DepthProjector::setIntrinsics(
+    size_t width,
+    size_t height,
+    float focal) {
+  if (ray_x_.size() == width && ray_y_.size() == height && focal_ == focal) {
+    return;
+  }
+  focal_ = focal;
+  // The center of the image as assumed by the OpenNI grabbers.
+  float const cx = (width >> 1) - .5f;
+  float const cy = (height >> 1) - .5f;
+  ray_x_.resize(width);
+  for (size_t u = 0; u < width; ++u) ray_x_[u] = (u - cx) / focal;
+  ray_y_.resize(height);
+  for (size_t v = 0; v < height; ++v) ray_y_[v] = (v - cy) / focal;
+}
+
+template<class PointT>
+void DepthProjector::project(
+    uint16_t const* depth,
+    pcl::PointCloud<PointT>& cloud,
+    size_t stride) const {
+  size_t const width = ray_x_.size();
+  size_t const height = ray_y_.size();
+  // Shrinking the cloud at the end keeps its capacity for the next frame.
+  cloud.points.resize(((width + stride - 1) / stride) *
+                      ((height + stride - 1) / stride));
+  size_t n = 0;
+  for (size_t v = 0; v < height; v += stride) {
+    float const ray_y = ray_y_[v];
+    uint16_t const* row = depth + v * width;
+    for (size_t u = 0; u < width; u += stride) {
+      uint16_t const raw = row[u];
+      if (raw < min_raw_ || raw > max_raw_) continue;
+      size_t const i = raw - min_raw_;
+      PointT& pt = cloud.points[n++];
+      pt.x = ray_x_[u] * scale_[i];
+      pt.y = ray_y * scale_[i];
+      pt.z = depth_[i];
+    }
+  }
+  cloud.points.resize(n);
+  cloud.width = n;
+  cloud.height = 1;
+  cloud.is_dense = true;
+}
+
+/**
+ * A `VideoSource` that reads the raw depth images of a local RGB-D sensor (or
+ * an .oni recording) and back-projects them itself, using a `DepthProjector`.
+ *
+ * As opposed to the `LiveStreamSource`, where the driver makes an organized
+ * cloud out of every pixel which is then calibrated point by point, only the
+ * points within the depth range are ever made and they come out already
+ * calibrated. Therefore, a `SensorCalibrationFilter` should not be applied to
+ * the clouds of this source.
+ *
+ * Each frame is stamped with the time at which it is received.
+ */
+template<class PointT>
+class DepthStreamSource : public VideoSource<PointT> {
+public:
+  /**
+   * Creates a source reading the given device (the first sensor attached to
+   * the computer if none is given) or .oni file in the given mode. The depth
+   * calibration and range are as given to `DepthProjector`.
+   */
+  DepthStreamSource(
+      std::string const& device,
+      pcl::io::OpenNI2Grabber::Mode mode,
+      double scale,
+      double offset,
+      double min_depth,
+      double max_depth)
+      : interface_(new pcl::io::OpenNI2Grabber(device, mode, mode)),
+        projector_(scale, offset, min_depth, max_depth) {}
+  /**
+   * RAII: stops the grabber.
+   */
+  ~DepthStreamSource() { close(); }
+  /**
+   * `VideoSource` interface implementation. Starts grabbing depth images.
+   */
+  void open();
+  /**
+   * `VideoSource` interface implementation. Stops the grabber.
+   */
+  void close() { interface_->stop(); }
+  /**
+   * Makes the source decimate the depth images by the stride that the given
+   * controller chooses based on the time that the pipeline takes for each
+   * frame. Needs to be set before the source is opened.
+   */
+  void setStrideController(boost::shared_ptr<AdaptiveStride> controller) {
+    controller_ = controller;
+  }
+private:
+  typedef typename pcl::PointCloud<PointT>::Ptr CloudPtr;
+  /**
+   * The callback given to the grabber.
+   */
+  void depth_cb_(boost::shared_ptr<pcl::io::DepthImage> const& image);
+  /**
+   * Returns a cloud that none of the observers holds on to anymore, allocating
+   * a new one only if there is no such cloud.
+   */
+  CloudPtr nextCloud();
+
+  boost::shared_ptr<pcl::Grabber> const interface_;
+  DepthProjector projector_;
+  boost::shared_ptr<AdaptiveStride> controller_;
+  /**
+   * All clouds handed out so far. Only touched by the grabber's thread.
+   */
+  std::vector<CloudPtr> clouds_;
+};
+
+template<class PointT>
+void DepthStreamSource<PointT>::open() {
+  // Only the depth images are asked for, so the grabber neither converts them
+  // to clouds nor streams the color images.
+  typedef void (callback_t)(boost::shared_ptr<pcl::io::DepthImage> const&);
+  boost::function<callback_t> f = boost::bind(
+      &DepthStreamSource::depth_cb_,
+      this, _1);
+  interface_->registerCallback(f);
+
+  interface_->start();
+}
+
+template<class PointT>
+typename DepthStreamSource<PointT>::CloudPtr
+DepthStreamSource<PointT>::nextCloud() {
+  size_t const sz = clouds_.size();
+  for (size_t i = 0; i < sz; ++i) {
+    if (clouds_[i].unique()) return clouds_[i];
+  }
+  CloudPtr cloud(new pcl::PointCloud<PointT>());
+  clouds_.push_back(cloud);
+  return cloud;
+}
+
+template<class PointT>
+void DepthStreamSource<PointT>::depth_cb_(
+    boost::shared_ptr<pcl::io::DepthImage> const& image) {
+  uint64_t const start = localTime();
+  projector_.setIntrinsics(
+      image->getWidth(), image->getHeight(), image->getFocalLength());
+  CloudPtr cloud(nextCloud());
+  projector_.project(image->getData(), *cloud,
+                     controller_ ? controller_->stride() : 1);
+  cloud->header.stamp = start;
+  this->setNextFrame(cloud);
+  // The pipeline processes the frame synchronously.
+  if (controller_) controller_->update(localTime() - start);
+}
+
+}  // namespace lepp
+
+#endif
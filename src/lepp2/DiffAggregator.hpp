@@ -35,7 +35,7 @@ public:
    * after every `frequency` frames.
    */
   DiffAggregator(int frequency)
-      : freq_(frequency), new_cb_(0), mod_cb_(0), del_cb_(0) {}
+      : freq_(frequency), curr_(0), new_cb_(0), mod_cb_(0), del_cb_(0) {}
 
   /**
    * Sets a function that will be called for every new obstacle.
@@ -2,6 +2,7 @@
 #define LEPP2_EUCLIDEAN_PLANE_SEGMENTER_H__
 
 #include "lepp2/BaseSegmenter.hpp"
+#include "lepp2/debug/trace.hpp"
 
 #include <pcl/segmentation/sac_segmentation.h>
 #include <pcl/segmentation/extract_clusters.h>
@@ -190,7 +191,11 @@ std::vector<typename pcl::PointCloud<PointT>::ConstPtr>
 EuclideanPlaneSegmenter<PointT>::segment(
     const typename pcl::PointCloud<PointT>::ConstPtr& cloud) {
   PointCloudPtr cloud_filtered = preprocessCloud(cloud);
-  removePlanes(cloud_filtered);
+  {
+    TraceSpan span("plane removal");
+    removePlanes(cloud_filtered);
+  }
+  TraceSpan span("clustering");
   std::vector<pcl::PointIndices> cluster_indices = getClusters(cloud_filtered);
   return clustersToPointClouds(cloud_filtered, cluster_indices);
 }
@@ -2,8 +2,12 @@
 #define LEPP2_FILTERED_VIDEO_SOURCE_H__
 
 #include "lepp2/BaseVideoSource.hpp"
+#include "lepp2/FrameGate.hpp"
+#include "lepp2/Metrics.hpp"
 #include "lepp2/VideoObserver.hpp"
+#include "lepp2/debug/trace.hpp"
 #include "lepp2/filter/PointFilter.hpp"
+#include "lepp2/filter/FusedPointFilter.hpp"
 
 #include <algorithm>
 #include <numeric>
@@ -12,8 +16,7 @@
 #include <boost/unordered_set.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/circular_buffer.hpp>
-
-#include "lepp2/debug/timer.hpp"
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include "deps/easylogging++.h"
 
@@ -84,13 +87,22 @@ public:
    *
    * The FilteredVideoSource instance does not assume ownership of the given
    * source, but shares it.
+   *
+   * The source's metrics carry its `name` as their `source` label, so that
+   * several filtered sources (such as the sensors of a fusion source) can be
+   * told apart.
    */
-  FilteredVideoSource(boost::shared_ptr<VideoSource<PointT> > source)
-      : source_(source) {}
+  FilteredVideoSource(
+      boost::shared_ptr<VideoSource<PointT> > source,
+      std::string const& name = "main");
   /**
    * Implementation of the VideoSource interface.
    */
   virtual void open();
+  /**
+   * Implementation of the VideoSource interface. Stops the wrapped source.
+   */
+  virtual void close();
   /**
    * Implementation of the VideoObserver interface.
    */
@@ -106,6 +118,20 @@ public:
     point_filters_.push_back(filter);
   }
 
+  /**
+   * Makes the source ask the given gate about each frame before filtering it:
+   * skipped frames are not emitted at all and only every other point of every
+   * other row of downgraded frames is looked at. Needs to be set before the
+   * source is opened.
+   */
+  void setGate(boost::shared_ptr<FrameGate> gate) { gate_ = gate; }
+
+  /**
+   * The time it took to filter the latest frame, in microseconds. Meant to be
+   * read by the source's observers (i.e. on the thread emitting the frames).
+   */
+  uint64_t lastFilterTime() const { return last_filter_time_; }
+
 protected:
   /**
    * A hook method that concrete implementations of the `FilteredVideoSource`
@@ -134,6 +160,12 @@ protected:
   virtual void getFiltered(PointCloudType& filtered) = 0;
 
 private:
+  /**
+   * Returns the (local) time at which the given cloud was captured, in
+   * microseconds since the epoch (see `lepp::captureTime`).
+   */
+  static uint64_t captureTime(typename pcl::PointCloud<PointT>::ConstPtr const& cloud);
+
   /**
    * The VideoSource instance that will be filtered by this instance.
    */
@@ -144,8 +176,75 @@ private:
    * implementation.
    */
   std::vector<boost::shared_ptr<PointFilter<PointT> > > point_filters_;
+  /**
+   * The `point_filters_` compiled for the current frame.
+   */
+  FusedPointFilter<PointT> fused_filter_;
+  boost::shared_ptr<FrameGate> gate_;
+  uint64_t last_filter_time_;
+
+  /**
+   * The source's metrics (see `lepp::MetricsRegistry`): the frames it was
+   * given and those that the gate skipped or downgraded, the points of the
+   * frames after each stage of the filtering and the time that it took.
+   */
+  lepp::Counter& frames_in_;
+  lepp::Counter& frames_skipped_;
+  lepp::Counter& frames_downgraded_;
+  lepp::Counter& points_in_;
+  lepp::Counter& points_finite_;
+  lepp::Counter& points_kept_;
+  lepp::Counter& points_out_;
+  lepp::Histogram& filter_time_;
+
+  /**
+   * The labels of a metric of the source of the given name, made of its
+   * `source` label followed by the given ones.
+   */
+  static std::string metricLabels(
+      std::string const& name, std::string const& labels) {
+    return "source=\"" + name + "\"" + (labels.empty() ? "" : ",") + labels;
+  }
 };
 
+template<class PointT>
+FilteredVideoSource<PointT>::FilteredVideoSource(
+    boost::shared_ptr<VideoSource<PointT> > source,
+    std::string const& name)
+    : source_(source),
+      last_filter_time_(0),
+      frames_in_(lepp::MetricsRegistry::global().counter(
+            "lepp_filter_frames_total", "Frames given to the filtered source",
+            metricLabels(name, ""))),
+      frames_skipped_(lepp::MetricsRegistry::global().counter(
+            "lepp_filter_frames_gated_total",
+            "Frames skipped or downgraded by the frame gate",
+            metricLabels(name, "verdict=\"skip\""))),
+      frames_downgraded_(lepp::MetricsRegistry::global().counter(
+            "lepp_filter_frames_gated_total",
+            "Frames skipped or downgraded by the frame gate",
+            metricLabels(name, "verdict=\"downgrade\""))),
+      points_in_(lepp::MetricsRegistry::global().counter(
+            "lepp_filter_points_total",
+            "Points of the frames after each filtering stage",
+            metricLabels(name, "stage=\"in\""))),
+      points_finite_(lepp::MetricsRegistry::global().counter(
+            "lepp_filter_points_total",
+            "Points of the frames after each filtering stage",
+            metricLabels(name, "stage=\"finite\""))),
+      points_kept_(lepp::MetricsRegistry::global().counter(
+            "lepp_filter_points_total",
+            "Points of the frames after each filtering stage",
+            metricLabels(name, "stage=\"point_filters\""))),
+      points_out_(lepp::MetricsRegistry::global().counter(
+            "lepp_filter_points_total",
+            "Points of the frames after each filtering stage",
+            metricLabels(name, "stage=\"out\""))),
+      filter_time_(lepp::MetricsRegistry::global().histogram(
+            "lepp_filter_time_us", "Time taken to filter a frame",
+            lepp::Histogram::exponential(250, 2, 12),
+            metricLabels(name, ""))) {}
+
 template<class PointT>
 void FilteredVideoSource<PointT>::open() {
   // Start the wrapped VideoSource and make sure that this instance is notified
@@ -154,19 +253,36 @@ void FilteredVideoSource<PointT>::open() {
   source_->open();
 }
 
+template<class PointT>
+void FilteredVideoSource<PointT>::close() {
+  source_->close();
+}
+
 template<class PointT>
 void FilteredVideoSource<PointT>::notifyNewFrame(
     int idx,
     const typename pcl::PointCloud<PointT>::ConstPtr& cloud) {
-  Timer t;
-  t.start();
+  lepp::TraceSpan span("filter");
+  uint64_t const start = lepp::localTime();
+  frames_in_.inc();
+
+  uint64_t const stamp = captureTime(cloud);
+  FrameGate::Verdict const verdict = gate_ ? gate_->judge(stamp) : FrameGate::PASS;
+  if (verdict == FrameGate::SKIP) {
+    LTRACE << "FilteredVideoSource: Skipping frame " << idx;
+    frames_skipped_.inc();
+    return;
+  }
+  if (verdict == FrameGate::DOWNGRADE) frames_downgraded_.inc();
 
   // Prepare the point-wise filters for a new frame.
   {
     size_t sz = point_filters_.size();
     for (size_t i = 0; i < sz; ++i) {
+      point_filters_[i]->setFrameStamp(stamp);
       point_filters_[i]->prepareNext();
     }
+    fused_filter_.compile(point_filters_);
   }
   // Prepare the concrete cloud filter implementation for a new frame.
   this->newFrame();
@@ -177,43 +293,66 @@ void FilteredVideoSource<PointT>::notifyNewFrame(
   PointCloudType& filtered = *cloud_filtered;
   cloud_filtered->is_dense = true;
   cloud_filtered->sensor_origin_ = cloud->sensor_origin_;
+  // The filtered frame is stamped with the (local) capture time of the frame.
+  cloud_filtered->header = cloud->header;
+  cloud_filtered->header.stamp = stamp;
 
   // Apply point-wise filters to each received point and then pass it to the
   // concrete implementation to figure out how to filter the entire cloud.
-  for (typename pcl::PointCloud<PointT>::const_iterator it = cloud->begin();
-        it != cloud->end();
-        ++it) {
-    PointT p = *it;
-    // Filter out NaN points already, since we're already iterating through the
-    // cloud.
-    if (!pcl_isfinite(p.x) || !pcl_isfinite(p.y) || !pcl_isfinite(p.z)) {
-      continue;
-    }
-
-    // Now apply point-wise filters.
-    size_t const sz = point_filters_.size();
-    bool valid = true;
-    for (size_t i = 0; i < sz; ++i) {
-      if (!point_filters_[i]->apply(p)) {
-        valid = false;
-        break;
+  // If the filters reject all points anyway, there's no need to look at them.
+  // Of a downgraded frame, only every other point of every other row is taken
+  // (every fourth point, if the cloud is not organized).
+  bool const organized = cloud->height > 1;
+  size_t const stride = verdict == FrameGate::DOWNGRADE ? 2 : 1;
+  size_t const width = organized ? cloud->width : cloud->size();
+  size_t const height = fused_filter_.rejectsAll() || cloud->empty() ? 0
+      : organized ? cloud->height : 1;
+  size_t const step = organized ? stride : stride * stride;
+  size_t finite = 0;
+  size_t kept = 0;
+  for (size_t v = 0; v < height; v += stride) {
+    PointT const* row = &cloud->points[v * width];
+    for (size_t u = 0; u < width; u += step) {
+      PointT p = row[u];
+      // Filter out NaN points already, since we're already iterating through
+      // the cloud.
+      if (!pcl_isfinite(p.x) || !pcl_isfinite(p.y) || !pcl_isfinite(p.z)) {
+        continue;
+      }
+      ++finite;
+
+      // Now apply point-wise filters, fused into as few operations as
+      // possible. And pass such a filtered/modified point to the cloud-level
+      // filter.
+      if (fused_filter_.apply(p)) {
+        ++kept;
+        this->newPoint(p, filtered);
       }
     }
-    // And pass such a filtered/modified point to the cloud-level filter.
-    if (valid) this->newPoint(p, filtered);
   }
 
   // Now we obtain the fully filtered cloud...
   this->getFiltered(filtered);
   // ...and we're done!
-  t.stop();
+  last_filter_time_ = lepp::localTime() - start;
 
   LTRACE << "Total included points " << cloud_filtered->size();
-  PINFO << "Filtering took " << t.duration();
+  points_in_.inc(cloud->size());
+  points_finite_.inc(finite);
+  points_kept_.inc(kept);
+  points_out_.inc(cloud_filtered->size());
+  filter_time_.observe(last_filter_time_);
+  span.end();
   // Finally, the cloud that is emitted by this instance is the filtered cloud.
   this->setNextFrame(cloud_filtered);
 }
 
+template<class PointT>
+uint64_t FilteredVideoSource<PointT>::captureTime(
+    typename pcl::PointCloud<PointT>::ConstPtr const& cloud) {
+  return lepp::captureTime(cloud->header.stamp, lepp::localTime());
+}
+
 /**
  * An implementation of a `FilteredVideoSource` that only applies the
  * point-wise filters, without performing any additional cloud-level filtering.
@@ -223,8 +362,10 @@ class SimpleFilteredVideoSource : public FilteredVideoSource<PointT> {
 public:
   using typename FilteredVideoSource<PointT>::PointCloudType;
 
-  SimpleFilteredVideoSource(boost::shared_ptr<VideoSource<PointT> > source)
-      : FilteredVideoSource<PointT>(source) {}
+  SimpleFilteredVideoSource(
+      boost::shared_ptr<VideoSource<PointT> > source,
+      std::string const& name = "main")
+      : FilteredVideoSource<PointT>(source, name) {}
 protected:
   void newFrame() {}
   void newPoint(PointT& p, PointCloudType& filtered) { filtered.push_back(p); }
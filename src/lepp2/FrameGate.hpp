@@ -0,0 +1,41 @@
+#ifndef LEPP2_FRAME_GATE_H__
+#define LEPP2_FRAME_GATE_H__
+
+#include <stdint.h>
+
+namespace lepp {
+
+/**
+ * An interface for classes that decide, before a frame is filtered, whether
+ * it is worth processing in full (see `FilteredVideoSource::setGate`), e.g.
+ * based on how the sensor was moving when it was captured.
+ */
+class FrameGate {
+public:
+  enum Verdict {
+    /**
+     * The frame is processed in full.
+     */
+    PASS,
+    /**
+     * Only a fraction of the frame's points is processed.
+     */
+    DOWNGRADE,
+    /**
+     * The frame is dropped before it is filtered, so the pipeline keeps the
+     * results of the previous frame.
+     */
+    SKIP
+  };
+
+  virtual ~FrameGate() {}
+  /**
+   * Judges the frame captured at the given (local) time, in microseconds since
+   * the epoch.
+   */
+  virtual Verdict judge(uint64_t stamp) = 0;
+};
+
+}  // namespace lepp
+
+#endif
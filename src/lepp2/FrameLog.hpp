@@ -0,0 +1,307 @@
+#ifndef LEPP2_FRAME_LOG_H__
+#define LEPP2_FRAME_LOG_H__
+
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "lepp2/BaseVideoSource.hpp"
+#include "lepp2/VideoObserver.hpp"
+
+namespace lepp {
+
+/**
+ * The on-disk format of a frame log: a sequence of point clouds stored so that
+ * they can be replayed straight from a memory mapping of the file.
+ *
+ * The file starts with a `FrameLogHeader`. The points of each frame follow as
+ * a single block, in exactly the in-memory layout of the point type (i.e. an
+ * array of `PointT`), starting at an offset aligned to `FRAME_LOG_ALIGNMENT`.
+ * The file ends with a table of `FrameLogEntry` (one per frame) and a
+ * `FrameLogTrailer` pointing to the table.
+ *
+ * Since the points are stored in their in-memory layout, a frame log can only
+ * be read with the same point type that it was written with; the size of the
+ * point type is stored in the header and checked by the reader.
+ */
+struct FrameLogHeader {
+  char magic[8];
+  uint32_t version;
+  /**
+   * `sizeof(PointT)` of the points stored in the log.
+   */
+  uint32_t point_size;
+};
+
+struct FrameLogEntry {
+  /**
+   * The offset of the frame's points from the start of the file.
+   */
+  uint64_t offset;
+  /**
+   * The local time at which the frame was captured, in microseconds since the
+   * epoch.
+   */
+  uint64_t time;
+  /**
+   * The cloud's own stamp (`pcl::PCLHeader::stamp`).
+   */
+  uint64_t stamp;
+  uint32_t width;
+  uint32_t height;
+  uint32_t is_dense;
+  uint32_t reserved;
+};
+
+struct FrameLogTrailer {
+  uint64_t table_offset;
+  uint64_t count;
+  char magic[8];
+};
+
+/**
+ * The alignment of the point blocks within the file (and thus within the
+ * mapping, which is page-aligned).
+ */
+size_t const FRAME_LOG_ALIGNMENT = 64;
+char const FRAME_LOG_MAGIC[8] = { 'L', 'E', 'P', 'P', 'F', 'R', 'M', '\0' };
+char const FRAME_LOG_TABLE_MAGIC[8] = { 'L', 'E', 'P', 'P', 'T', 'B', 'L', '\0' };
+uint32_t const FRAME_LOG_VERSION = 1;
+
+/**
+ * Writes a frame log. Can be attached directly to a `VideoSource` in order to
+ * record all of its frames.
+ */
+template<class PointT>
+class FrameLogWriter : public VideoObserver<PointT>, boost::noncopyable {
+public:
+  /**
+   * Creates (or truncates) the frame log at the given path. Throws if the file
+   * cannot be opened.
+   */
+  explicit FrameLogWriter(std::string const& file_path);
+  /**
+   * RAII: closes the log.
+   */
+  ~FrameLogWriter() { close(); }
+  /**
+   * Appends the given cloud, captured at the given local time, to the log.
+   */
+  void append(pcl::PointCloud<PointT> const& cloud, uint64_t time);
+  /**
+   * `VideoObserver` interface implementation.
+   */
+  void notifyNewFrame(
+      int idx,
+      const typename pcl::PointCloud<PointT>::ConstPtr& cloud) {
+    append(*cloud, captureTime(cloud->header.stamp, localTime()));
+  }
+  /**
+   * Writes the frame table and closes the file.
+   */
+  void close();
+  /**
+   * The number of frames written so far.
+   */
+  size_t size() const { return table_.size(); }
+private:
+  /**
+   * Pads the file up to the next multiple of `FRAME_LOG_ALIGNMENT`.
+   */
+  void pad();
+
+  std::ofstream fout_;
+  uint64_t offset_;
+  std::vector<FrameLogEntry> table_;
+  bool closed_;
+};
+
+template<class PointT>
+FrameLogWriter<PointT>::FrameLogWriter(std::string const& file_path)
+    : fout_(file_path.c_str(), std::ios::binary | std::ios::trunc),
+      offset_(0),
+      closed_(false) {
+  if (!fout_.is_open()) {
+    throw "Unable to open the frame log for writing";
+  }
+  FrameLogHeader header;
+  memcpy(header.magic, FRAME_LOG_MAGIC, sizeof header.magic);
+  header.version = FRAME_LOG_VERSION;
+  header.point_size = sizeof(PointT);
+  fout_.write(reinterpret_cast<char const*>(&header), sizeof header);
+  offset_ = sizeof header;
+}
+
+template<class PointT>
+void FrameLogWriter<PointT>::pad() {
+  static char const padding[FRAME_LOG_ALIGNMENT] = {};
+  size_t const sz = (FRAME_LOG_ALIGNMENT - offset_ % FRAME_LOG_ALIGNMENT) %
+      FRAME_LOG_ALIGNMENT;
+  fout_.write(padding, sz);
+  offset_ += sz;
+}
+
+template<class PointT>
+void FrameLogWriter<PointT>::append(
+    pcl::PointCloud<PointT> const& cloud,
+    uint64_t time) {
+  if (closed_) return;
+  pad();
+
+  size_t const sz = cloud.size();
+  FrameLogEntry entry;
+  entry.offset = offset_;
+  entry.time = time;
+  entry.stamp = cloud.header.stamp;
+  entry.width = cloud.width;
+  entry.height = cloud.height;
+  // Clouds put together point by point need not have their dimensions set.
+  if (static_cast<size_t>(entry.width) * entry.height != sz) {
+    entry.width = sz;
+    entry.height = 1;
+  }
+  entry.is_dense = cloud.is_dense;
+  entry.reserved = 0;
+  if (sz != 0) {
+    fout_.write(reinterpret_cast<char const*>(&cloud.points[0]), sz * sizeof(PointT));
+  }
+  offset_ += sz * sizeof(PointT);
+  table_.push_back(entry);
+}
+
+template<class PointT>
+void FrameLogWriter<PointT>::close() {
+  if (closed_) return;
+  closed_ = true;
+  // The table is read in place from the mapping, so it needs to be aligned too.
+  pad();
+
+  FrameLogTrailer trailer;
+  trailer.table_offset = offset_;
+  trailer.count = table_.size();
+  memcpy(trailer.magic, FRAME_LOG_TABLE_MAGIC, sizeof trailer.magic);
+  if (!table_.empty()) {
+    fout_.write(reinterpret_cast<char const*>(&table_[0]),
+                table_.size() * sizeof(FrameLogEntry));
+  }
+  fout_.write(reinterpret_cast<char const*>(&trailer), sizeof trailer);
+  fout_.close();
+}
+
+/**
+ * Reads a frame log by mapping it into memory. Opening a log only validates
+ * the header and the frame table; the points are never parsed, but are read
+ * straight from the mapping (and thus paged in by the OS) when a frame is
+ * copied out.
+ */
+template<class PointT>
+class FrameLogReader : boost::noncopyable {
+public:
+  /**
+   * Maps the frame log at the given path. Throws if the file cannot be mapped
+   * or is not a (complete) frame log of `PointT` points.
+   */
+  explicit FrameLogReader(std::string const& file_path);
+
+  /**
+   * The number of frames in the log.
+   */
+  size_t size() const { return count_; }
+  /**
+   * The table entry of the i-th frame.
+   */
+  FrameLogEntry const& entry(size_t i) const { return table_[i]; }
+  /**
+   * The points of the i-th frame, pointing directly into the mapping.
+   */
+  PointT const* points(size_t i) const {
+    return reinterpret_cast<PointT const*>(base_ + table_[i].offset);
+  }
+  /**
+   * Puts the i-th frame into the given cloud. The points are copied with a
+   * single `memcpy` from the mapping; if the cloud already has the capacity
+   * for them, no memory is allocated.
+   */
+  void read(size_t i, pcl::PointCloud<PointT>& cloud) const;
+private:
+  boost::interprocess::file_mapping file_;
+  boost::interprocess::mapped_region region_;
+  char const* base_;
+  FrameLogEntry const* table_;
+  size_t count_;
+};
+
+template<class PointT>
+FrameLogReader<PointT>::FrameLogReader(std::string const& file_path)
+    : base_(0), table_(0), count_(0) {
+  try {
+    boost::interprocess::file_mapping file(
+        file_path.c_str(), boost::interprocess::read_only);
+    boost::interprocess::mapped_region region(
+        file, boost::interprocess::read_only);
+    file_.swap(file);
+    region_.swap(region);
+  } catch (boost::interprocess::interprocess_exception const&) {
+    throw "Unable to map the frame log";
+  }
+  base_ = static_cast<char const*>(region_.get_address());
+  size_t const size = region_.get_size();
+
+  if (size < sizeof(FrameLogHeader) + sizeof(FrameLogTrailer)) {
+    throw "Not a frame log";
+  }
+  FrameLogHeader header;
+  memcpy(&header, base_, sizeof header);
+  if (memcmp(header.magic, FRAME_LOG_MAGIC, sizeof header.magic) != 0) {
+    throw "Not a frame log";
+  }
+  if (header.version != FRAME_LOG_VERSION) {
+    throw "Unsupported frame log version";
+  }
+  if (header.point_size != sizeof(PointT)) {
+    throw "The frame log holds a different point type";
+  }
+
+  FrameLogTrailer trailer;
+  memcpy(&trailer, base_ + size - sizeof trailer, sizeof trailer);
+  if (memcmp(trailer.magic, FRAME_LOG_TABLE_MAGIC, sizeof trailer.magic) != 0 ||
+      trailer.table_offset + trailer.count * sizeof(FrameLogEntry) +
+          sizeof trailer != size ||
+      trailer.table_offset % sizeof(uint64_t) != 0) {
+    throw "The frame log is incomplete (it was not closed cleanly)";
+  }
+  table_ = reinterpret_cast<FrameLogEntry const*>(base_ + trailer.table_offset);
+  count_ = trailer.count;
+  for (size_t i = 0; i < count_; ++i) {
+    uint64_t const bytes =
+        static_cast<uint64_t>(table_[i].width) * table_[i].height * sizeof(PointT);
+    if (table_[i].offset + bytes > trailer.table_offset) {
+      throw "The frame log is corrupted";
+    }
+  }
+}
+
+template<class PointT>
+void FrameLogReader<PointT>::read(size_t i, pcl::PointCloud<PointT>& cloud) const {
+  FrameLogEntry const& entry = table_[i];
+  size_t const sz = static_cast<size_t>(entry.width) * entry.height;
+  cloud.points.resize(sz);
+  if (sz != 0) {
+    memcpy(&cloud.points[0], points(i), sz * sizeof(PointT));
+  }
+  cloud.width = entry.width;
+  cloud.height = entry.height;
+  cloud.is_dense = entry.is_dense != 0;
+  cloud.header.stamp = entry.stamp;
+}
+
+}  // namespace lepp
+
+#endif
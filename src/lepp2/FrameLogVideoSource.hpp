@@ -0,0 +1,126 @@
+#ifndef LEPP2_FRAME_LOG_VIDEO_SOURCE_H__
+#define LEPP2_FRAME_LOG_VIDEO_SOURCE_H__
+
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "lepp2/BaseVideoSource.hpp"
+#include "lepp2/FrameLog.hpp"
+#include "lepp2/FramePacer.hpp"
+
+#include "deps/easylogging++.h"
+
+namespace lepp {
+
+/**
+ * A `VideoSource` that replays a frame log (see `FrameLogReader`).
+ *
+ * The log is memory mapped, so opening it takes no time regardless of its
+ * size, and each frame is put into a cloud by a single copy straight out of
+ * the mapping. (A `pcl::PointCloud` always owns its points, so the clouds
+ * cannot point into the mapping itself.) The clouds are recycled once none of
+ * the observers holds on to them anymore, so a running replay does not
+ * allocate any memory either.
+ *
+ * Each frame is stamped with the time at which it is emitted.
+ */
+template<class PointT>
+class FrameLogVideoSource : public VideoSource<PointT> {
+public:
+  /**
+   * Creates a new source replaying the frame log at the given path. Throws if
+   * the log cannot be opened.
+   */
+  FrameLogVideoSource(std::string const& file_path, FramePacer::Pace pace)
+      : reader_(file_path), pacer_(pace), stopped_(false) {}
+  /**
+   * RAII: stops the replay.
+   */
+  ~FrameLogVideoSource();
+  /**
+   * `VideoSource` interface implementation. Starts the replay on a background
+   * thread.
+   */
+  void open();
+  /**
+   * `VideoSource` interface implementation. Stops the replay.
+   */
+  void close();
+private:
+  typedef typename pcl::PointCloud<PointT>::Ptr CloudPtr;
+  /**
+   * The function executed by the replay thread.
+   */
+  void run();
+  /**
+   * Returns a cloud that none of the observers holds on to anymore, allocating
+   * a new one only if there is no such cloud.
+   */
+  CloudPtr nextCloud();
+
+  FrameLogReader<PointT> reader_;
+  FramePacer pacer_;
+  /**
+   * All clouds handed out so far.
+   */
+  std::vector<CloudPtr> clouds_;
+  boost::thread thread_;
+  volatile bool stopped_;
+};
+
+template<class PointT>
+FrameLogVideoSource<PointT>::~FrameLogVideoSource() {
+  close();
+}
+
+template<class PointT>
+void FrameLogVideoSource<PointT>::close() {
+  stopped_ = true;
+  thread_.interrupt();
+  thread_.join();
+}
+
+template<class PointT>
+void FrameLogVideoSource<PointT>::open() {
+  thread_ = boost::thread(boost::bind(&FrameLogVideoSource::run, this));
+}
+
+template<class PointT>
+typename FrameLogVideoSource<PointT>::CloudPtr
+FrameLogVideoSource<PointT>::nextCloud() {
+  size_t const sz = clouds_.size();
+  for (size_t i = 0; i < sz; ++i) {
+    if (clouds_[i].unique()) return clouds_[i];
+  }
+  CloudPtr cloud(new pcl::PointCloud<PointT>());
+  clouds_.push_back(cloud);
+  return cloud;
+}
+
+template<class PointT>
+void FrameLogVideoSource<PointT>::run() {
+  Tracer::global().nameThread("frame log source");
+  uint64_t const start = localTime();
+  size_t frames = 0;
+  size_t const sz = reader_.size();
+  for (size_t i = 0; i < sz && !stopped_; ++i) {
+    if (!pacer_.wait(reader_.entry(i).time)) break;
+    CloudPtr cloud(nextCloud());
+    reader_.read(i, *cloud);
+    cloud->header.stamp = localTime();
+    this->setNextFrame(cloud);
+    ++frames;
+  }
+
+  double const elapsed = (localTime() - start) / 1e6;
+  LINFO << "FrameLogVideoSource: Replayed " << frames << " frames in "
+        << elapsed << " s ("
+        << (elapsed > 0 ? frames / elapsed : 0) << " fps; "
+        << clouds_.size() << " clouds allocated)";
+}
+
+}  // namespace lepp
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef LEPP2_FRAME_PACER_H__
+#define LEPP2_FRAME_PACER_H__
+
+#include <stdint.h>
+
+#include <boost/thread/thread.hpp>
+
+#include "lepp2/BaseVideoSource.hpp"
+
+namespace lepp {
+
+/**
+ * Paces the emission of recorded frames by sources that replay a recording.
+ *
+ * With the `ORIGINAL` pace, each frame is held back until as much time has
+ * passed since the first frame as had passed between the two when they were
+ * recorded. With the `FAST` pace, frames are never held back, so that they
+ * are emitted as fast as the pipeline consumes them (e.g. for benchmarking).
+ */
+class FramePacer {
+public:
+  enum Pace {
+    ORIGINAL,
+    FAST
+  };
+
+  explicit FramePacer(Pace pace) : pace_(pace), started_(false) {}
+
+  /**
+   * Blocks until the frame recorded at the given time (in microseconds) is
+   * due. Returns false if the waiting thread was interrupted.
+   */
+  bool wait(uint64_t time) {
+    if (!started_) {
+      started_ = true;
+      start_ = localTime();
+      first_time_ = time;
+    }
+    if (pace_ == FAST || time < first_time_) return true;
+    uint64_t const due = start_ + (time - first_time_);
+    uint64_t const now = localTime();
+    if (due <= now) return true;
+    try {
+      boost::this_thread::sleep(boost::posix_time::microseconds(due - now));
+    } catch (boost::thread_interrupted const&) {
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * Starts over, i.e. the next frame is emitted immediately and the ones after
+   * it are paced relative to it.
+   */
+  void restart() { started_ = false; }
+
+  Pace pace() const { return pace_; }
+private:
+  Pace const pace_;
+  bool started_;
+  /**
+   * The local time at which the first frame was emitted and the time at which
+   * it had been recorded.
+   */
+  uint64_t start_;
+  uint64_t first_time_;
+};
+
+}  // namespace lepp
+
+#endif
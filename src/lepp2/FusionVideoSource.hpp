@@ -0,0 +1,306 @@
+#ifndef LEPP2_FUSION_VIDEO_SOURCE_H__
+#define LEPP2_FUSION_VIDEO_SOURCE_H__
+
+#include <algorithm>
+#include <vector>
+
+#include <stdint.h>
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "lepp2/BaseVideoSource.hpp"
+#include "lepp2/VideoObserver.hpp"
+
+#include "deps/easylogging++.h"
+
+namespace lepp {
+
+/**
+ * A `VideoSource` that fuses the frames of several sensors into a single
+ * cloud.
+ *
+ * Each sensor is given as a source of its own, usually a `FilteredVideoSource`
+ * with the sensor's own calibration and its own transformation into the common
+ * (e.g. odometry) coordinate system. Such a source filters the frames on the
+ * thread of its sensor, so the sensors' frames are filtered in parallel.
+ *
+ * The frames are time-aligned by their capture times: a fused frame is made
+ * once there is a new frame from each sensor, provided that they were all
+ * captured within `max_skew` of the newest one; older frames are dropped in
+ * favor of the sensor's next one. A sensor that has not delivered a frame for
+ * longer than `timeout` is left out of the fused frames until it recovers, so
+ * that a failing sensor does not stall the others.
+ *
+ * The fused frames are emitted on a thread of their own, so the sensors can
+ * go on filtering their next frames while the pipeline processes the fused
+ * one. Each fused frame is stamped with the capture time of the oldest of the
+ * frames that it is made of.
+ */
+template<class PointT>
+class FusionVideoSource : public VideoSource<PointT> {
+public:
+  /**
+   * Creates a new source fusing frames with a skew of at most `max_skew` and
+   * leaving out sensors silent for longer than `timeout` (both in
+   * microseconds).
+   */
+  FusionVideoSource(uint64_t max_skew, uint64_t timeout)
+      : max_skew_(max_skew), timeout_(timeout), stopped_(false) {}
+  /**
+   * RAII: stops the fusion.
+   */
+  ~FusionVideoSource();
+  /**
+   * Adds the source of the frames of another sensor. Needs to be called before
+   * the source is opened.
+   */
+  void addSource(boost::shared_ptr<VideoSource<PointT> > source);
+  /**
+   * `VideoSource` interface implementation. Opens all sensors' sources and
+   * starts the fusion.
+   */
+  void open();
+  /**
+   * `VideoSource` interface implementation. Stops the sensors and the fusion.
+   */
+  void close();
+private:
+  typedef typename pcl::PointCloud<PointT>::Ptr CloudPtr;
+  typedef typename pcl::PointCloud<PointT>::ConstPtr CloudConstPtr;
+
+  /**
+   * Hands the frames of one of the sensors to the fusion.
+   */
+  class Input : public VideoObserver<PointT> {
+  public:
+    Input(FusionVideoSource& fusion, size_t index)
+        : fusion_(fusion), index_(index) {}
+    void notifyNewFrame(int idx, CloudConstPtr const& cloud) {
+      fusion_.deposit(index_, cloud);
+    }
+  private:
+    FusionVideoSource& fusion_;
+    size_t const index_;
+  };
+
+  /**
+   * The newest frame of a sensor.
+   */
+  struct Slot {
+    CloudConstPtr cloud;
+    /**
+     * The capture time of the frame and the time at which it was received.
+     */
+    uint64_t time;
+    uint64_t received;
+    /**
+     * Whether the frame is yet to be fused.
+     */
+    bool fresh;
+    /**
+     * Whether the sensor delivered its last frame within the timeout.
+     */
+    bool alive;
+  };
+
+  /**
+   * Called (on a sensor's thread) for each new frame of the i-th sensor.
+   */
+  void deposit(size_t i, CloudConstPtr const& cloud);
+  /**
+   * The function executed by the fusion thread.
+   */
+  void run();
+  /**
+   * Takes out the frames that make up the next fused frame, if there is one
+   * yet. Must be called with `mutex_` held.
+   */
+  bool collect(std::vector<CloudConstPtr>& parts, uint64_t& stamp);
+  /**
+   * Returns a cloud that none of the observers holds on to anymore, allocating
+   * a new one only if there is no such cloud.
+   */
+  CloudPtr nextCloud();
+
+  uint64_t const max_skew_;
+  uint64_t const timeout_;
+
+  boost::mutex mutex_;
+  boost::condition_variable cond_;
+  std::vector<Slot> slots_;
+  bool stopped_;
+
+  /**
+   * All clouds handed out so far. Only touched by the fusion thread.
+   */
+  std::vector<CloudPtr> clouds_;
+  /**
+   * The sensors' sources, which deliver their frames on their own threads.
+   * They come after the members that they use, so that they are destroyed
+   * (and stopped) before those.
+   */
+  std::vector<boost::shared_ptr<VideoSource<PointT> > > sources_;
+  std::vector<boost::shared_ptr<Input> > inputs_;
+  boost::thread thread_;
+};
+
+template<class PointT>
+FusionVideoSource<PointT>::~FusionVideoSource() {
+  close();
+}
+
+template<class PointT>
+void FusionVideoSource<PointT>::close() {
+  // The sensors stop depositing frames first.
+  for (size_t i = 0; i < sources_.size(); ++i) sources_[i]->close();
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    stopped_ = true;
+  }
+  cond_.notify_all();
+  thread_.join();
+}
+
+template<class PointT>
+void FusionVideoSource<PointT>::addSource(
+    boost::shared_ptr<VideoSource<PointT> > source) {
+  boost::shared_ptr<Input> input(new Input(*this, sources_.size()));
+  source->attachObserver(input);
+  sources_.push_back(source);
+  inputs_.push_back(input);
+}
+
+template<class PointT>
+void FusionVideoSource<PointT>::open() {
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    Slot slot;
+    slot.time = 0;
+    // Each sensor is given until the timeout to deliver its first frame.
+    slot.received = localTime();
+    slot.fresh = false;
+    slot.alive = true;
+    slots_.assign(sources_.size(), slot);
+  }
+  thread_ = boost::thread(boost::bind(&FusionVideoSource::run, this));
+  for (size_t i = 0; i < sources_.size(); ++i) sources_[i]->open();
+}
+
+template<class PointT>
+void FusionVideoSource<PointT>::deposit(size_t i, CloudConstPtr const& cloud) {
+  uint64_t const now = localTime();
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    Slot& slot = slots_[i];
+    // A frame that was not fused yet is superseded by the newer one.
+    slot.cloud = cloud;
+    slot.time = captureTime(cloud->header.stamp, now);
+    slot.received = now;
+    slot.fresh = true;
+  }
+  cond_.notify_one();
+}
+
+template<class PointT>
+bool FusionVideoSource<PointT>::collect(
+    std::vector<CloudConstPtr>& parts,
+    uint64_t& stamp) {
+  uint64_t const now = localTime();
+  size_t const sz = slots_.size();
+
+  uint64_t newest = 0;
+  for (size_t i = 0; i < sz; ++i) {
+    if (slots_[i].fresh) newest = std::max(newest, slots_[i].time);
+  }
+  bool ready = true;
+  for (size_t i = 0; i < sz; ++i) {
+    Slot& slot = slots_[i];
+    // Too old to be fused with the newest frame.
+    if (slot.fresh && newest - slot.time > max_skew_) {
+      slot.fresh = false;
+      slot.cloud.reset();
+    }
+    bool const alive = now < slot.received || now - slot.received <= timeout_;
+    if (alive != slot.alive) {
+      slot.alive = alive;
+      if (alive) {
+        LINFO << "FusionVideoSource: Sensor " << i << " is back";
+      } else {
+        LWARNING << "FusionVideoSource: Sensor " << i << " delivered no frame "
+                 << "for " << timeout_ / 1e3 << " ms; leaving it out";
+      }
+    }
+    if (!slot.fresh && alive) ready = false;
+  }
+  if (!ready) return false;
+
+  parts.clear();
+  stamp = 0;
+  for (size_t i = 0; i < sz; ++i) {
+    Slot& slot = slots_[i];
+    if (!slot.fresh) continue;
+    parts.push_back(slot.cloud);
+    stamp = stamp == 0 ? slot.time : std::min(stamp, slot.time);
+    slot.fresh = false;
+    slot.cloud.reset();
+  }
+  return !parts.empty();
+}
+
+template<class PointT>
+typename FusionVideoSource<PointT>::CloudPtr
+FusionVideoSource<PointT>::nextCloud() {
+  size_t const sz = clouds_.size();
+  for (size_t i = 0; i < sz; ++i) {
+    if (clouds_[i].unique()) return clouds_[i];
+  }
+  CloudPtr cloud(new pcl::PointCloud<PointT>());
+  clouds_.push_back(cloud);
+  return cloud;
+}
+
+template<class PointT>
+void FusionVideoSource<PointT>::run() {
+  Tracer::global().nameThread("fusion source");
+  std::vector<CloudConstPtr> parts;
+  uint64_t stamp;
+  while (true) {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (!stopped_ && !collect(parts, stamp)) {
+        // Wake up at least once per timeout to notice silent sensors.
+        cond_.timed_wait(lock, boost::posix_time::microseconds(timeout_));
+      }
+      if (stopped_) return;
+    }
+
+    CloudPtr cloud(nextCloud());
+    size_t total = 0;
+    bool dense = true;
+    for (size_t i = 0; i < parts.size(); ++i) {
+      total += parts[i]->size();
+      dense = dense && parts[i]->is_dense;
+    }
+    cloud->points.clear();
+    cloud->points.reserve(total);
+    for (size_t i = 0; i < parts.size(); ++i) {
+      cloud->points.insert(cloud->points.end(),
+                           parts[i]->points.begin(), parts[i]->points.end());
+    }
+    cloud->width = total;
+    cloud->height = 1;
+    cloud->is_dense = dense;
+    cloud->header.stamp = stamp;
+    // The sensors' frames are not needed anymore.
+    parts.clear();
+    this->setNextFrame(cloud);
+  }
+}
+
+}  // namespace lepp
+
+#endif
@@ -1,7 +1,10 @@
 #ifndef GRABBER_VIDEO_SOURCE_H_
 #define GRABBER_VIDEO_SOURCE_H_
 
+#include <string>
+
 #include "BaseVideoSource.hpp"
+#include "lepp2/AdaptiveStride.hpp"
 #include <pcl/io/openni_grabber.h>
 
 namespace lepp {
@@ -25,11 +28,25 @@ public:
       : interface_(interface) {}
   virtual ~GeneralGrabberVideoSource();
   virtual void open();
+  virtual void close();
+  /**
+   * Makes the source decimate the (organized) clouds of the grabber by the
+   * stride that the given controller chooses based on the time that the
+   * pipeline takes for each frame. Needs to be set before the source is
+   * opened.
+   */
+  void setStrideController(boost::shared_ptr<AdaptiveStride> controller) {
+    controller_ = controller;
+  }
 private:
   /**
    * A reference to the Grabber instance that the VideoSource wraps.
    */
   const boost::shared_ptr<pcl::Grabber> interface_;
+  /**
+   * Chooses the stride by which the clouds are decimated, if set.
+   */
+  boost::shared_ptr<AdaptiveStride> controller_;
 
   /**
    * Member function which is registered as a callback of the Grabber.
@@ -42,13 +59,45 @@ private:
 template<class PointT>
 GeneralGrabberVideoSource<PointT>::~GeneralGrabberVideoSource() {
   // RAII: make sure to stop any running Grabber
+  close();
+}
+
+template<class PointT>
+void GeneralGrabberVideoSource<PointT>::close() {
   interface_->stop();
 }
 
 template<class PointT>
 void GeneralGrabberVideoSource<PointT>::cloud_cb_(
     const typename pcl::PointCloud<PointT>::ConstPtr& cloud) {
-  this->setNextFrame(cloud);
+  if (!controller_) {
+    this->setNextFrame(cloud);
+    return;
+  }
+
+  size_t const stride = controller_->stride();
+  uint64_t const start = localTime();
+  if (stride == 1 || cloud->height <= 1) {
+    this->setNextFrame(cloud);
+  } else {
+    // Keep every `stride`-th point of every `stride`-th row.
+    typename pcl::PointCloud<PointT>::Ptr decimated(
+        new pcl::PointCloud<PointT>());
+    decimated->header = cloud->header;
+    decimated->sensor_origin_ = cloud->sensor_origin_;
+    decimated->width = (cloud->width + stride - 1) / stride;
+    decimated->height = (cloud->height + stride - 1) / stride;
+    decimated->is_dense = cloud->is_dense;
+    decimated->points.reserve(decimated->width * decimated->height);
+    for (size_t v = 0; v < cloud->height; v += stride) {
+      for (size_t u = 0; u < cloud->width; u += stride) {
+        decimated->points.push_back(cloud->points[v * cloud->width + u]);
+      }
+    }
+    this->setNextFrame(decimated);
+  }
+  // The pipeline processes the frame synchronously.
+  controller_->update(localTime() - start);
 }
 
 template<class PointT>
@@ -63,18 +112,39 @@ void GeneralGrabberVideoSource<PointT>::open() {
   interface_->start();
 }
 
+/**
+ * Returns the capture mode of an OpenNI grabber (`pcl::OpenNIGrabber` or
+ * `pcl::io::OpenNI2Grabber`) with the given name: the resolution followed by
+ * the frame rate, e.g. `qvga_30` or `vga_30`. Throws if there is no such mode.
+ */
+template<class Grabber>
+typename Grabber::Mode openNIMode(std::string const& name) {
+  if (name == "default") return Grabber::OpenNI_Default_Mode;
+  if (name == "sxga_15") return Grabber::OpenNI_SXGA_15Hz;
+  if (name == "vga_30") return Grabber::OpenNI_VGA_30Hz;
+  if (name == "vga_25") return Grabber::OpenNI_VGA_25Hz;
+  if (name == "qvga_25") return Grabber::OpenNI_QVGA_25Hz;
+  if (name == "qvga_30") return Grabber::OpenNI_QVGA_30Hz;
+  if (name == "qvga_60") return Grabber::OpenNI_QVGA_60Hz;
+  if (name == "qqvga_25") return Grabber::OpenNI_QQVGA_25Hz;
+  if (name == "qqvga_30") return Grabber::OpenNI_QQVGA_30Hz;
+  if (name == "qqvga_60") return Grabber::OpenNI_QQVGA_60Hz;
+  throw "Unknown OpenNI mode";
+}
+
 /**
  * A convenience class for a live stream captured from a local RGB-D sensor.
  *
  * The implementation leverages the GeneralGrabberVideoSource wrapping a
- * PCL-based OpenNIGrabber instance.
+ * PCL-based OpenNIGrabber instance, capturing in the given mode.
  */
 template<class PointT>
 class LiveStreamSource : public GeneralGrabberVideoSource<PointT> {
 public:
-  LiveStreamSource()
+  LiveStreamSource(
+      pcl::OpenNIGrabber::Mode mode = pcl::OpenNIGrabber::OpenNI_QVGA_30Hz)
       : GeneralGrabberVideoSource<PointT>(boost::shared_ptr<pcl::Grabber>(
-            new pcl::OpenNIGrabber("", pcl::OpenNIGrabber::OpenNI_QVGA_30Hz))) {
+            new pcl::OpenNIGrabber("", mode))) {
     // Empty... All work performed in the initializer list.
   }
 };
@@ -0,0 +1,266 @@
+#ifndef LEPP2_METRICS_H__
+#define LEPP2_METRICS_H__
+
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <stdint.h>
+
+namespace lepp {
+
+/**
+ * The base class of the metrics kept by the `MetricsRegistry`.
+ *
+ * Updating a metric is lock-free (a few relaxed atomic operations), so the
+ * stages of the pipeline can update them for each frame at no noticeable
+ * cost. Only registering them takes a lock.
+ */
+class Metric {
+public:
+  virtual ~Metric() {}
+  /**
+   * Writes out the samples of the metric with the given name and labels, in
+   * the Prometheus text format.
+   */
+  virtual void write(
+      std::ostream& out,
+      std::string const& name,
+      std::string const& labels) const = 0;
+protected:
+  /**
+   * Writes out a single sample, adding the extra label (if any) to the
+   * metric's labels.
+   */
+  static void writeSample(
+      std::ostream& out,
+      std::string const& name,
+      std::string const& labels,
+      std::string const& extra,
+      uint64_t value) {
+    out << name;
+    if (!labels.empty() || !extra.empty()) {
+      out << '{' << labels << (!labels.empty() && !extra.empty() ? "," : "")
+          << extra << '}';
+    }
+    out << ' ' << value << '\n';
+  }
+};
+
+/**
+ * A value that only ever goes up, e.g. the number of frames processed.
+ */
+class Counter : public Metric {
+public:
+  Counter() : value_(0) {}
+  void inc(uint64_t n = 1) { value_.fetch_add(n, boost::memory_order_relaxed); }
+  uint64_t value() const { return value_.load(boost::memory_order_relaxed); }
+
+  void write(
+      std::ostream& out,
+      std::string const& name,
+      std::string const& labels) const {
+    writeSample(out, name, labels, "", value());
+  }
+private:
+  boost::atomic<uint64_t> value_;
+};
+
+/**
+ * A value that goes up and down, e.g. the number of tracked obstacles.
+ */
+class Gauge : public Metric {
+public:
+  Gauge() : value_(0) {}
+  void set(int64_t value) { value_.store(value, boost::memory_order_relaxed); }
+  void add(int64_t delta) { value_.fetch_add(delta, boost::memory_order_relaxed); }
+  int64_t value() const { return value_.load(boost::memory_order_relaxed); }
+
+  void write(
+      std::ostream& out,
+      std::string const& name,
+      std::string const& labels) const {
+    out << name;
+    if (!labels.empty()) out << '{' << labels << '}';
+    out << ' ' << value() << '\n';
+  }
+private:
+  boost::atomic<int64_t> value_;
+};
+
+/**
+ * Counts the observed values (e.g. the times a stage took, in microseconds)
+ * in buckets with fixed upper bounds, along with their sum.
+ */
+class Histogram : public Metric {
+public:
+  /**
+   * Creates a histogram with the given (ascending) upper bounds of its
+   * buckets; larger values fall into an implicit last bucket.
+   */
+  explicit Histogram(std::vector<uint64_t> const& bounds)
+      : bounds_(bounds),
+        counts_(new boost::atomic<uint64_t>[bounds.size() + 1]),
+        sum_(0) {
+    for (size_t i = 0; i <= bounds_.size(); ++i) counts_[i].store(0);
+  }
+
+  /**
+   * Returns `count` bounds, starting at `start` and growing by `factor`.
+   */
+  static std::vector<uint64_t> exponential(
+      uint64_t start, uint64_t factor, size_t count) {
+    std::vector<uint64_t> bounds;
+    for (size_t i = 0; i < count; ++i, start *= factor) bounds.push_back(start);
+    return bounds;
+  }
+
+  void observe(uint64_t value) {
+    size_t i = 0;
+    size_t const sz = bounds_.size();
+    while (i < sz && value > bounds_[i]) ++i;
+    counts_[i].fetch_add(1, boost::memory_order_relaxed);
+    sum_.fetch_add(value, boost::memory_order_relaxed);
+  }
+
+  void write(
+      std::ostream& out,
+      std::string const& name,
+      std::string const& labels) const {
+    // The buckets of the text format are cumulative.
+    uint64_t count = 0;
+    for (size_t i = 0; i <= bounds_.size(); ++i) {
+      count += counts_[i].load(boost::memory_order_relaxed);
+      std::ostringstream le;
+      le << "le=\"";
+      if (i < bounds_.size()) le << bounds_[i]; else le << "+Inf";
+      le << '"';
+      writeSample(out, name + "_bucket", labels, le.str(), count);
+    }
+    writeSample(out, name + "_sum", labels, "",
+                sum_.load(boost::memory_order_relaxed));
+    writeSample(out, name + "_count", labels, "", count);
+  }
+private:
+  std::vector<uint64_t> const bounds_;
+  boost::scoped_array<boost::atomic<uint64_t> > counts_;
+  boost::atomic<uint64_t> sum_;
+};
+
+/**
+ * The process-wide registry of metrics, which the stages of the pipeline
+ * register their metrics with (normally when they are constructed) and keep
+ * references to. The metrics live as long as the process, so the references
+ * never dangle.
+ *
+ * A metric is identified by its name and labels (e.g. `stage="in"`);
+ * registering one that already exists returns the existing one, so all
+ * instances of a stage share their metrics.
+ *
+ * The registry is written out in the Prometheus text format (see
+ * `lola/MetricsServer.h`).
+ */
+class MetricsRegistry {
+public:
+  /**
+   * The registry of the process.
+   */
+  static MetricsRegistry& global() {
+    static MetricsRegistry registry;
+    return registry;
+  }
+
+  Counter& counter(
+      std::string const& name,
+      std::string const& help,
+      std::string const& labels = "") {
+    boost::mutex::scoped_lock lock(mutex_);
+    boost::shared_ptr<Metric>& metric = find(name, help, "counter", labels);
+    if (!metric) metric.reset(new Counter);
+    return static_cast<Counter&>(*metric);
+  }
+
+  Gauge& gauge(
+      std::string const& name,
+      std::string const& help,
+      std::string const& labels = "") {
+    boost::mutex::scoped_lock lock(mutex_);
+    boost::shared_ptr<Metric>& metric = find(name, help, "gauge", labels);
+    if (!metric) metric.reset(new Gauge);
+    return static_cast<Gauge&>(*metric);
+  }
+
+  Histogram& histogram(
+      std::string const& name,
+      std::string const& help,
+      std::vector<uint64_t> const& bounds,
+      std::string const& labels = "") {
+    boost::mutex::scoped_lock lock(mutex_);
+    boost::shared_ptr<Metric>& metric = find(name, help, "histogram", labels);
+    if (!metric) metric.reset(new Histogram(bounds));
+    return static_cast<Histogram&>(*metric);
+  }
+
+  /**
+   * Writes out all metrics in the Prometheus text format.
+   */
+  void write(std::ostream& out) const {
+    boost::mutex::scoped_lock lock(mutex_);
+    for (std::map<std::string, Family>::const_iterator it = families_.begin();
+         it != families_.end(); ++it) {
+      Family const& family = it->second;
+      out << "# HELP " << it->first << ' ' << family.help << '\n'
+          << "# TYPE " << it->first << ' ' << family.type << '\n';
+      for (Family::Metrics::const_iterator m = family.metrics.begin();
+           m != family.metrics.end(); ++m) {
+        m->second->write(out, it->first, m->first);
+      }
+    }
+  }
+private:
+  /**
+   * The metrics of the same name, which only differ in their labels.
+   */
+  struct Family {
+    typedef std::map<std::string, boost::shared_ptr<Metric> > Metrics;
+    std::string help;
+    std::string type;
+    Metrics metrics;
+  };
+
+  MetricsRegistry() {}
+
+  /**
+   * Returns the slot of the metric with the given name and labels, which is
+   * empty if the metric is new. Throws if the name is already taken by a
+   * metric of another type.
+   */
+  boost::shared_ptr<Metric>& find(
+      std::string const& name,
+      std::string const& help,
+      std::string const& type,
+      std::string const& labels) {
+    Family& family = families_[name];
+    if (family.type.empty()) {
+      family.help = help;
+      family.type = type;
+    } else if (family.type != type) {
+      throw "MetricsRegistry: A metric of another type has the same name";
+    }
+    return family.metrics[labels];
+  }
+
+  mutable boost::mutex mutex_;
+  std::map<std::string, Family> families_;
+};
+
+}  // namespace lepp
+
+#endif
@@ -0,0 +1,325 @@
+#ifndef LEPP2_PCD_SEQUENCE_VIDEO_SOURCE_H__
+#define LEPP2_PCD_SEQUENCE_VIDEO_SOURCE_H__
+
+#include <algorithm>
+#include <cctype>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <pcl/io/pcd_io.h>
+
+#include "lepp2/BaseVideoSource.hpp"
+#include "lepp2/BoundedQueue.hpp"
+#include "lepp2/FramePacer.hpp"
+
+#include "deps/easylogging++.h"
+
+namespace lepp {
+
+/**
+ * A `VideoSource` that plays back a sequence of PCD files, one frame per file,
+ * in the (lexicographic) order of their names.
+ *
+ * The files are parsed ahead of time by a pool of reader threads, so that
+ * parsing the files does not hold up the pipeline: with the `FAST` pace, the
+ * frames are emitted as fast as the pipeline consumes them. With the
+ * `ORIGINAL` pace, they are emitted either at a fixed frame rate or, if none
+ * is given, at the times at which they were captured, as given by the ISO
+ * timestamps (`YYYYMMDDTHHMMSS.ffffff`) in the names of the files (which is
+ * how PCL's recording tools name them). Files without a timestamp are spaced
+ * as by the `pcl::PCDGrabber`, i.e. 20 fps.
+ *
+ * Each frame is stamped with the time at which it is emitted.
+ */
+template<class PointT>
+class PcdSequenceVideoSource : public VideoSource<PointT> {
+public:
+  /**
+   * Creates a new source playing back the given files, in the given order.
+   *
+   * `threads` is the number of reader threads and `frame_rate` the fixed rate
+   * at which the frames are paced; a rate of 0 makes the source use the
+   * files' timestamps instead.
+   */
+  PcdSequenceVideoSource(
+      std::vector<std::string> const& files,
+      size_t threads,
+      FramePacer::Pace pace,
+      double frame_rate = 0);
+  /**
+   * RAII: stops the playback.
+   */
+  ~PcdSequenceVideoSource();
+  /**
+   * `VideoSource` interface implementation. Starts the reader threads and the
+   * playback.
+   */
+  void open();
+  /**
+   * `VideoSource` interface implementation. Stops the playback.
+   */
+  void close();
+
+  /**
+   * Returns the files matched by the given pattern, sorted by name. The
+   * pattern is either a directory (matching all `.pcd` files in it) or a path
+   * whose last component may contain the wildcards `*` and `?` (e.g.
+   * `recording/frame_*.pcd`). Throws if the directory cannot be read.
+   */
+  static std::vector<std::string> findFiles(std::string const& pattern);
+private:
+  typedef typename pcl::PointCloud<PointT>::Ptr CloudPtr;
+  /**
+   * A parsed file. The cloud is null if the file could not be read.
+   */
+  struct Frame {
+    CloudPtr cloud;
+  };
+  /**
+   * The number of frames that are read ahead by each reader thread.
+   */
+  static size_t const FRAMES_AHEAD = 4;
+
+  /**
+   * The function executed by the i-th reader thread: it reads every
+   * `threads`-th file, starting with the i-th one, into its own queue.
+   */
+  void read(size_t i);
+  /**
+   * The function executed by the playback thread: takes the frames out of the
+   * readers' queues in turn, which puts them back into the order of the files.
+   */
+  void run();
+  /**
+   * Returns the time (in microseconds) at which the i-th frame is due,
+   * relative to the others.
+   */
+  uint64_t frameTime(size_t i) const;
+
+  /**
+   * Parses the ISO timestamp in the given file name into microseconds since
+   * the epoch. Returns false if the name does not contain one.
+   */
+  static bool parseTime(std::string const& file_path, uint64_t& time);
+  /**
+   * Whether the given name matches the pattern with the `*` and `?` wildcards.
+   */
+  static bool matches(char const* pattern, char const* name);
+
+  std::vector<std::string> const files_;
+  /**
+   * The capture times of the files, if all of them have one.
+   */
+  std::vector<uint64_t> times_;
+  double const frame_rate_;
+  FramePacer pacer_;
+
+  /**
+   * Each reader thread has its own queue.
+   */
+  std::vector<boost::shared_ptr<BoundedQueue<Frame> > > queues_;
+  boost::thread_group readers_;
+  boost::thread thread_;
+  volatile bool stopped_;
+};
+
+/**
+ * Whether the given path names a sequence of PCD files (as understood by
+ * `PcdSequenceVideoSource::findFiles`) rather than a single file.
+ */
+inline bool isPcdSequence(std::string const& path) {
+  return path.find_first_of("*?") != std::string::npos ||
+      boost::filesystem::is_directory(path);
+}
+
+template<class PointT>
+PcdSequenceVideoSource<PointT>::PcdSequenceVideoSource(
+    std::vector<std::string> const& files,
+    size_t threads,
+    FramePacer::Pace pace,
+    double frame_rate)
+    : files_(files),
+      frame_rate_(frame_rate),
+      pacer_(pace),
+      stopped_(false) {
+  if (files_.empty()) {
+    throw "No PCD files to play back";
+  }
+  threads = std::max<size_t>(1, std::min(threads, files_.size()));
+  for (size_t i = 0; i < threads; ++i) {
+    queues_.push_back(boost::shared_ptr<BoundedQueue<Frame> >(
+        new BoundedQueue<Frame>(FRAMES_AHEAD)));
+  }
+
+  if (frame_rate_ <= 0 && pace == FramePacer::ORIGINAL) {
+    for (size_t i = 0; i < files_.size(); ++i) {
+      uint64_t time;
+      if (!parseTime(files_[i], time)) {
+        LWARNING << "PcdSequenceVideoSource: " << files_[i]
+                 << " has no timestamp; playing back at 20 fps";
+        times_.clear();
+        break;
+      }
+      times_.push_back(time);
+    }
+  }
+}
+
+template<class PointT>
+PcdSequenceVideoSource<PointT>::~PcdSequenceVideoSource() {
+  close();
+}
+
+template<class PointT>
+void PcdSequenceVideoSource<PointT>::close() {
+  stopped_ = true;
+  for (size_t i = 0; i < queues_.size(); ++i) queues_[i]->close();
+  readers_.interrupt_all();
+  thread_.interrupt();
+  readers_.join_all();
+  thread_.join();
+}
+
+template<class PointT>
+void PcdSequenceVideoSource<PointT>::open() {
+  for (size_t i = 0; i < queues_.size(); ++i) {
+    readers_.create_thread(boost::bind(&PcdSequenceVideoSource::read, this, i));
+  }
+  thread_ = boost::thread(boost::bind(&PcdSequenceVideoSource::run, this));
+}
+
+template<class PointT>
+void PcdSequenceVideoSource<PointT>::read(size_t i) {
+  BoundedQueue<Frame>& queue = *queues_[i];
+  for (size_t j = i; j < files_.size() && !stopped_; j += queues_.size()) {
+    Frame frame;
+    frame.cloud.reset(new pcl::PointCloud<PointT>());
+    if (pcl::io::loadPCDFile(files_[j], *frame.cloud) < 0) {
+      frame.cloud.reset();
+    }
+    if (!queue.push(frame)) break;
+  }
+  queue.close();
+}
+
+template<class PointT>
+uint64_t PcdSequenceVideoSource<PointT>::frameTime(size_t i) const {
+  if (!times_.empty()) return times_[i];
+  double const rate = frame_rate_ > 0 ? frame_rate_ : 20;
+  return static_cast<uint64_t>(i * 1e6 / rate);
+}
+
+template<class PointT>
+void PcdSequenceVideoSource<PointT>::run() {
+  Tracer::global().nameThread("pcd sequence source");
+  uint64_t const start = localTime();
+  size_t frames = 0;
+
+  for (size_t i = 0; i < files_.size() && !stopped_; ++i) {
+    Frame frame;
+    if (!queues_[i % queues_.size()]->pop(frame)) break;
+    if (!frame.cloud) {
+      LERROR << "PcdSequenceVideoSource: Unable to read " << files_[i];
+      continue;
+    }
+    if (!pacer_.wait(frameTime(i))) break;
+    frame.cloud->header.stamp = localTime();
+    this->setNextFrame(frame.cloud);
+    ++frames;
+  }
+
+  double const elapsed = (localTime() - start) / 1e6;
+  LINFO << "PcdSequenceVideoSource: Played back " << frames << " frames in "
+        << elapsed << " s ("
+        << (elapsed > 0 ? frames / elapsed : 0) << " fps)";
+}
+
+template<class PointT>
+bool PcdSequenceVideoSource<PointT>::parseTime(
+    std::string const& file_path,
+    uint64_t& time) {
+  std::string const name = boost::filesystem::path(file_path).filename().string();
+  // Look for the `T` separating the 8 digits of the date from the 6 digits of
+  // the time of day.
+  for (size_t t = 8; t + 6 < name.size(); ++t) {
+    if (name[t] != 'T') continue;
+    bool digits = true;
+    for (size_t k = t - 8; k < t + 7 && digits; ++k) {
+      if (k != t && !isdigit(static_cast<unsigned char>(name[k]))) {
+        digits = false;
+      }
+    }
+    if (!digits) continue;
+
+    size_t end = t + 7;
+    if (end < name.size() && name[end] == '.') {
+      ++end;
+      while (end < name.size() && isdigit(static_cast<unsigned char>(name[end]))) {
+        ++end;
+      }
+    }
+    try {
+      boost::posix_time::ptime const stamp =
+          boost::posix_time::from_iso_string(name.substr(t - 8, end - (t - 8)));
+      boost::posix_time::ptime const epoch(boost::gregorian::date(1970, 1, 1));
+      time = (stamp - epoch).total_microseconds();
+      return true;
+    } catch (std::exception const&) {
+      continue;
+    }
+  }
+  return false;
+}
+
+template<class PointT>
+bool PcdSequenceVideoSource<PointT>::matches(char const* pattern, char const* name) {
+  if (*pattern == '\0') return *name == '\0';
+  if (*pattern == '*') {
+    do {
+      if (matches(pattern + 1, name)) return true;
+    } while (*name++ != '\0');
+    return false;
+  }
+  if (*name == '\0') return false;
+  if (*pattern != '?' && *pattern != *name) return false;
+  return matches(pattern + 1, name + 1);
+}
+
+template<class PointT>
+std::vector<std::string> PcdSequenceVideoSource<PointT>::findFiles(
+    std::string const& pattern) {
+  namespace fs = boost::filesystem;
+  fs::path dir(pattern);
+  std::string glob = "*.pcd";
+  if (!fs::is_directory(dir)) {
+    glob = dir.filename().string();
+    dir = dir.parent_path();
+    if (dir.empty()) dir = ".";
+  }
+
+  std::vector<std::string> files;
+  try {
+    for (fs::directory_iterator it(dir), end; it != end; ++it) {
+      if (fs::is_regular_file(it->status()) &&
+          matches(glob.c_str(), it->path().filename().string().c_str())) {
+        files.push_back(it->path().string());
+      }
+    }
+  } catch (fs::filesystem_error const&) {
+    throw "Unable to read the PCD directory";
+  }
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+}  // namespace lepp
+
+#endif
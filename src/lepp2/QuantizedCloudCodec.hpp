@@ -0,0 +1,232 @@
+#ifndef LEPP2_QUANTIZED_CLOUD_CODEC_H__
+#define LEPP2_QUANTIZED_CLOUD_CODEC_H__
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include <stdint.h>
+
+#include "lepp2/BaseVideoSource.hpp"
+
+namespace lepp {
+
+/**
+ * A compact encoding of point clouds, for recordings.
+ *
+ * Each coordinate is quantized to a multiple of a fixed resolution (e.g. 1 cm,
+ * which is all the precision the pipeline keeps anyway; see `TruncateFilter`)
+ * and stored as the difference to the same coordinate of the previous valid
+ * point. Neighbouring points of a sensor's (organized) cloud lie close to each
+ * other, so the differences are small numbers, which are stored as zigzag
+ * varints: a difference below 64 quantization steps takes a single byte.
+ * Invalid (NaN) points are not stored at all; instead, the stream alternates
+ * between the lengths of runs of invalid and valid points, so the organization
+ * of the cloud is kept.
+ *
+ * An encoded cloud is a `QuantizedCloudHeader` followed by the stream:
+ *
+ *   (varint invalid_run, varint valid_run, valid_run * (dx, dy, dz))*
+ *
+ * Only the x, y and z coordinates of the points are encoded.
+ */
+struct QuantizedCloudHeader {
+  uint32_t width;
+  uint32_t height;
+  /**
+   * The size of a quantization step, in meters.
+   */
+  float resolution;
+  /**
+   * The number of valid points.
+   */
+  uint32_t valid;
+};
+
+class QuantizedCloudCodec {
+public:
+  /**
+   * Appends the encoding of the given cloud to `out`.
+   */
+  template<class PointT>
+  static void encode(
+      pcl::PointCloud<PointT> const& cloud,
+      float resolution,
+      std::vector<char>& out);
+  /**
+   * Decodes the encoded cloud found in the given buffer into `cloud`. Returns
+   * false if the buffer does not hold a valid encoding. The points' capacity
+   * is reused, so decoding into the same cloud over and over does not
+   * allocate.
+   */
+  template<class PointT>
+  static bool decode(
+      char const* data,
+      size_t size,
+      pcl::PointCloud<PointT>& cloud);
+private:
+  static uint32_t zigzag(int32_t v) {
+    return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+  }
+  static int32_t unzigzag(uint32_t v) {
+    return static_cast<int32_t>(v >> 1) ^ -static_cast<int32_t>(v & 1);
+  }
+  static char* putVarint(char* out, uint32_t v) {
+    while (v >= 0x80) {
+      *out++ = static_cast<char>(v | 0x80);
+      v >>= 7;
+    }
+    *out++ = static_cast<char>(v);
+    return out;
+  }
+  /**
+   * Reads a varint, advancing `in`. Returns false if the varint does not end
+   * before `end`.
+   */
+  static bool getVarint(unsigned char const*& in, unsigned char const* end, uint32_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 35 && in != end; shift += 7) {
+      unsigned char const byte = *in++;
+      v |= static_cast<uint32_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+  }
+  static int32_t quantize(float v, float inv_resolution) {
+    double const q = std::floor(v * inv_resolution + 0.5);
+    // Coordinates this far out can only be garbage, but must not overflow.
+    double const limit = 1 << 30;
+    return static_cast<int32_t>(q > limit ? limit : (q < -limit ? -limit : q));
+  }
+  template<class PointT>
+  static bool isValid(PointT const& pt) {
+    return pcl_isfinite(pt.x) && pcl_isfinite(pt.y) && pcl_isfinite(pt.z);
+  }
+  /**
+   * The largest number of bytes that a varint takes up.
+   */
+  static size_t const MAX_VARINT = 5;
+};
+
+template<class PointT>
+void QuantizedCloudCodec::encode(
+    pcl::PointCloud<PointT> const& cloud,
+    float resolution,
+    std::vector<char>& out) {
+  size_t const sz = cloud.size();
+  float const inv_resolution = 1 / resolution;
+
+  // The stream is put together in a small block on the stack, which is
+  // appended to `out` whenever it might not fit another point. Unlike making
+  // room for the worst case in `out` up front, this does not zero-fill
+  // megabytes that get trimmed right after, and a reused `out` keeps its
+  // capacity, so steady state encoding does not allocate.
+  size_t const start = out.size();
+  out.resize(start + sizeof(QuantizedCloudHeader));
+  char block[4096];
+  char* const block_end = block + sizeof block - (2 + 3) * MAX_VARINT;
+  char* p = block;
+
+  uint32_t valid = 0;
+  int32_t prev[3] = { 0, 0, 0 };
+  size_t i = 0;
+  while (i < sz) {
+    size_t const invalid_start = i;
+    while (i < sz && !isValid(cloud[i])) ++i;
+    size_t const valid_start = i;
+    while (i < sz && isValid(cloud[i])) ++i;
+    p = putVarint(p, valid_start - invalid_start);
+    p = putVarint(p, i - valid_start);
+    for (size_t j = valid_start; j < i; ++j) {
+      if (p >= block_end) {
+        out.insert(out.end(), block, p);
+        p = block;
+      }
+      PointT const& pt = cloud[j];
+      int32_t const q[3] = {
+        quantize(pt.x, inv_resolution),
+        quantize(pt.y, inv_resolution),
+        quantize(pt.z, inv_resolution),
+      };
+      for (int k = 0; k < 3; ++k) {
+        p = putVarint(p, zigzag(q[k] - prev[k]));
+        prev[k] = q[k];
+      }
+    }
+    valid += i - valid_start;
+    if (p >= block_end) {
+      out.insert(out.end(), block, p);
+      p = block;
+    }
+  }
+  out.insert(out.end(), block, p);
+
+  QuantizedCloudHeader header;
+  header.width = cloud.width;
+  header.height = cloud.height;
+  // Clouds put together point by point need not have their dimensions set.
+  if (static_cast<size_t>(header.width) * header.height != sz) {
+    header.width = sz;
+    header.height = 1;
+  }
+  header.resolution = resolution;
+  header.valid = valid;
+  memcpy(&out[start], &header, sizeof header);
+}
+
+template<class PointT>
+bool QuantizedCloudCodec::decode(
+    char const* data,
+    size_t size,
+    pcl::PointCloud<PointT>& cloud) {
+  if (size < sizeof(QuantizedCloudHeader)) return false;
+  QuantizedCloudHeader header;
+  memcpy(&header, data, sizeof header);
+  size_t const sz = static_cast<size_t>(header.width) * header.height;
+  float const resolution = header.resolution;
+  float const nan = std::numeric_limits<float>::quiet_NaN();
+
+  cloud.points.resize(sz);
+  cloud.width = header.width;
+  cloud.height = header.height;
+  cloud.is_dense = header.valid == sz;
+
+  unsigned char const* in =
+      reinterpret_cast<unsigned char const*>(data) + sizeof header;
+  unsigned char const* const end = reinterpret_cast<unsigned char const*>(data) + size;
+  int32_t prev[3] = { 0, 0, 0 };
+  size_t i = 0;
+  while (i < sz) {
+    uint32_t invalid_run;
+    uint32_t valid_run;
+    if (!getVarint(in, end, invalid_run) || !getVarint(in, end, valid_run) ||
+        invalid_run > sz - i || valid_run > sz - i - invalid_run) {
+      return false;
+    }
+    for (size_t const stop = i + invalid_run; i < stop; ++i) {
+      PointT& pt = cloud[i];
+      pt.x = pt.y = pt.z = nan;
+    }
+    for (size_t const stop = i + valid_run; i < stop; ++i) {
+      uint32_t d[3];
+      if (!getVarint(in, end, d[0]) ||
+          !getVarint(in, end, d[1]) ||
+          !getVarint(in, end, d[2])) {
+        return false;
+      }
+      for (int k = 0; k < 3; ++k) prev[k] += unzigzag(d[k]);
+      PointT& pt = cloud[i];
+      pt.x = prev[0] * resolution;
+      pt.y = prev[1] * resolution;
+      pt.z = prev[2] * resolution;
+    }
+    // A stream that makes no progress would never end.
+    if (invalid_run == 0 && valid_run == 0) return false;
+  }
+  return true;
+}
+
+}  // namespace lepp
+
+#endif
@@ -6,6 +6,8 @@
 #include <map>
 
 #include "lepp2/BaseObstacleDetector.hpp"
+#include "lepp2/Metrics.hpp"
+#include "lepp2/debug/trace.hpp"
 
 #include "deps/easylogging++.h"
 
@@ -182,10 +184,22 @@ private:
    * Current count of the number of frames processed by the aggregator.
    */
   int frame_cnt_;
+
+  /**
+   * The number of obstacles being tracked and the number of those that are
+   * considered real (see `lepp::MetricsRegistry`).
+   */
+  Gauge& tracks_;
+  Gauge& materialized_;
 };
 
 SmoothObstacleAggregator::SmoothObstacleAggregator()
-    : next_model_id_(0), frame_cnt_(0) {}
+    : next_model_id_(0),
+      frame_cnt_(0),
+      tracks_(MetricsRegistry::global().gauge(
+            "lepp_tracks", "Obstacles being tracked")),
+      materialized_(MetricsRegistry::global().gauge(
+            "lepp_obstacles", "Tracked obstacles considered real")) {}
 
 SmoothObstacleAggregator::model_id_t SmoothObstacleAggregator::nextModelId() {
   return next_model_id_++;
@@ -370,8 +384,9 @@ std::vector<ObjectModelPtr> SmoothObstacleAggregator::copyMaterialized() {
 
 void SmoothObstacleAggregator::updateObstacles(
     std::vector<ObjectModelPtr> const& obstacles) {
+  TraceSpan span("tracking");
   ++frame_cnt_;
-  LINFO << "SmoothAggregator: Initial objects in frame #" << frame_cnt_ << " == " << obstacles.size();
+  LTRACE << "SmoothAggregator: Initial objects in frame #" << frame_cnt_ << " == " << obstacles.size();
 
   std::map<model_id_t, size_t> correspondence = matchToPrevious(obstacles);
   updateLostAndFound(correspondence);
@@ -380,7 +395,9 @@ void SmoothObstacleAggregator::updateObstacles(
   materializeFoundObjects();
   std::vector<ObjectModelPtr> smooth_obstacles(copyMaterialized());
 
-  LINFO << "SmoothAggregator: Real objects in frame #" << frame_cnt_ << " == " << smooth_obstacles.size();
+  LTRACE << "SmoothAggregator: Real objects in frame #" << frame_cnt_ << " == " << smooth_obstacles.size();
+  tracks_.set(tracked_models_.size());
+  materialized_.set(smooth_obstacles.size());
   notifyObstacles(smooth_obstacles);
 }
 
@@ -0,0 +1,464 @@
+#ifndef LEPP2_SYNTHETIC_VIDEO_SOURCE_H__
+#define LEPP2_SYNTHETIC_VIDEO_SOURCE_H__
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "lepp2/BaseVideoSource.hpp"
+#include "lepp2/FramePacer.hpp"
+
+#include "deps/easylogging++.h"
+
+namespace lepp {
+
+/**
+ * The parameters of a procedurally generated scene (see
+ * `SyntheticVideoSource`).
+ *
+ * All lengths are in meters.
+ */
+struct SyntheticScene {
+  /**
+   * The resolution of the generated (organized) clouds. The focal length is
+   * that of a Kinect, scaled to the width.
+   */
+  size_t width;
+  size_t height;
+  /**
+   * The rate at which the scene is sampled (and, with the `ORIGINAL` pace, at
+   * which the frames are emitted).
+   */
+  double frame_rate;
+  /**
+   * The number of frames after which the source stops; 0 for no limit.
+   */
+  size_t frames;
+
+  /**
+   * The room: a floor `camera_height` below the camera, a wall `room_depth`
+   * in front of it and a wall on either side, `room_width` apart.
+   */
+  float room_width;
+  float room_depth;
+  float camera_height;
+
+  /**
+   * The number of obstacles of each kind, which are strewn on the floor.
+   */
+  size_t boxes;
+  size_t cylinders;
+  size_t spheres;
+  /**
+   * The fraction of the obstacles that move back and forth.
+   */
+  float moving;
+
+  /**
+   * The sensor noise: the standard deviation of the depth error is
+   * `noise * depth^2` (the error model of structured light sensors), and
+   * each point is lost with a probability of `dropout`. Points further away
+   * than `max_range` are lost, too.
+   */
+  float noise;
+  float dropout;
+  float max_range;
+
+  /**
+   * The seed from which the scene and the noise are generated: the same seed
+   * always gives the same sequence of frames.
+   */
+  unsigned seed;
+
+  SyntheticScene()
+      : width(640), height(480), frame_rate(30), frames(0),
+        room_width(4), room_depth(5), camera_height(1),
+        boxes(4), cylinders(2), spheres(2), moving(.5),
+        noise(.0015), dropout(0), max_range(4.5),
+        seed(1) {}
+};
+
+/**
+ * A `VideoSource` that generates the frames by raycasting a procedurally
+ * generated scene: a room with obstacles (boxes, cylinders and spheres)
+ * strewn on its floor, some of which move, seen through a noisy sensor.
+ *
+ * As opposed to the recorded datasets, the complexity of the scene (the
+ * number of obstacles and points) can be set arbitrarily, which makes the
+ * source suitable for scaling benchmarks of the pipeline.
+ *
+ * The clouds are given in the frame of the camera (x to the right, y down, z
+ * forward), like the clouds of the real sensor. The scene is a function of
+ * the frame index alone, so that the same frames are generated regardless of
+ * the pace. Each frame is stamped with the time at which it is emitted.
+ */
+template<class PointT>
+class SyntheticVideoSource : public VideoSource<PointT> {
+public:
+  SyntheticVideoSource(SyntheticScene const& scene, FramePacer::Pace pace);
+  /**
+   * RAII: stops the generation of the frames.
+   */
+  ~SyntheticVideoSource();
+  /**
+   * `VideoSource` interface implementation. Starts generating the frames on a
+   * background thread.
+   */
+  void open();
+  /**
+   * `VideoSource` interface implementation. Stops generating the frames.
+   */
+  void close();
+private:
+  typedef typename pcl::PointCloud<PointT>::Ptr CloudPtr;
+  /**
+   * An obstacle of the scene.
+   */
+  struct Shape {
+    enum Kind {
+      BOX,
+      CYLINDER,
+      SPHERE
+    };
+    Kind kind;
+    /**
+     * The position (on the floor) around which the obstacle moves.
+     */
+    float x;
+    float z;
+    /**
+     * The half-extents of the obstacle: of the box along each axis; the
+     * radius and the half-height of the cylinder; the radius of the sphere.
+     */
+    float a;
+    float b;
+    float c;
+    /**
+     * The motion of the obstacle: it oscillates along the direction
+     * (`dx`, `dz`) with the given amplitude and angular frequency.
+     */
+    float amplitude;
+    float omega;
+    float phase;
+    float dx;
+    float dz;
+  };
+
+  /**
+   * Strews the obstacles on the floor.
+   */
+  void generateScene();
+  /**
+   * The function executed by the generating thread.
+   */
+  void run();
+  /**
+   * Renders the scene, as it is at the given time (in seconds), into the
+   * given cloud.
+   */
+  void render(double time, pcl::PointCloud<PointT>& cloud);
+  /**
+   * Casts the ray of each pixel in the given rectangle at the given obstacle
+   * and keeps the nearest hits in `depth_`. The obstacle is at (`x`, `z`).
+   */
+  void castAt(Shape const& shape, float x, float z,
+              size_t u0, size_t u1, size_t v0, size_t v1);
+  /**
+   * Returns the distance (along the ray (`dx`, `dy`, 1)) at which the ray
+   * hits the given obstacle at (`x`, `z`), or infinity if it misses it.
+   */
+  float intersect(Shape const& shape, float x, float z,
+                  float dx, float dy) const;
+  /**
+   * Returns a cloud that none of the observers holds on to anymore, allocating
+   * a new one only if there is no such cloud.
+   */
+  CloudPtr nextCloud();
+
+  SyntheticScene const scene_;
+  std::vector<Shape> shapes_;
+  /**
+   * The intrinsics of the camera.
+   */
+  float focal_;
+  float cx_;
+  float cy_;
+  /**
+   * The nearest hit of each pixel's ray, as the depth (z) of the hit.
+   */
+  std::vector<float> depth_;
+  boost::random::mt19937 rng_;
+
+  FramePacer pacer_;
+  std::vector<CloudPtr> clouds_;
+  boost::thread thread_;
+  volatile bool stopped_;
+};
+
+template<class PointT>
+SyntheticVideoSource<PointT>::SyntheticVideoSource(
+    SyntheticScene const& scene,
+    FramePacer::Pace pace)
+    : scene_(scene),
+      // The Kinect's focal length at 640x480.
+      focal_(525.f * scene.width / 640),
+      cx_((scene.width - 1) / 2.f),
+      cy_((scene.height - 1) / 2.f),
+      depth_(scene.width * scene.height),
+      rng_(scene.seed),
+      pacer_(pace),
+      stopped_(false) {
+  if (scene_.width == 0 || scene_.height == 0 || scene_.frame_rate <= 0) {
+    throw "Invalid synthetic scene";
+  }
+  generateScene();
+}
+
+template<class PointT>
+SyntheticVideoSource<PointT>::~SyntheticVideoSource() {
+  close();
+}
+
+template<class PointT>
+void SyntheticVideoSource<PointT>::close() {
+  stopped_ = true;
+  thread_.interrupt();
+  thread_.join();
+}
+
+template<class PointT>
+void SyntheticVideoSource<PointT>::open() {
+  thread_ = boost::thread(boost::bind(&SyntheticVideoSource::run, this));
+}
+
+template<class PointT>
+void SyntheticVideoSource<PointT>::generateScene() {
+  typedef boost::random::uniform_real_distribution<float> Uniform;
+  float const pi = 3.14159265f;
+  size_t const counts[] = { scene_.boxes, scene_.cylinders, scene_.spheres };
+  for (int kind = Shape::BOX; kind <= Shape::SPHERE; ++kind) {
+    for (size_t i = 0; i < counts[kind]; ++i) {
+      Shape shape;
+      shape.kind = static_cast<typename Shape::Kind>(kind);
+      if (shape.kind == Shape::BOX) {
+        shape.a = Uniform(.05f, .25f)(rng_);
+        shape.b = Uniform(.05f, .25f)(rng_);
+        shape.c = Uniform(.05f, .25f)(rng_);
+      } else if (shape.kind == Shape::CYLINDER) {
+        shape.a = Uniform(.05f, .15f)(rng_);
+        shape.b = Uniform(.1f, .4f)(rng_);
+        shape.c = shape.a;
+      } else {
+        shape.a = shape.b = shape.c = Uniform(.05f, .2f)(rng_);
+      }
+      // Keep the obstacles within the room and out of the camera's way.
+      float const half_width = scene_.room_width / 2 - shape.a;
+      shape.x = half_width > 0 ? Uniform(-half_width, half_width)(rng_) : 0;
+      float const near = 1;
+      float const far = std::max(near, scene_.room_depth - shape.c);
+      shape.z = Uniform(near, far)(rng_);
+
+      if (Uniform(0, 1)(rng_) < scene_.moving) {
+        shape.amplitude = Uniform(.1f, .5f)(rng_);
+        shape.omega = 2 * pi / Uniform(1, 4)(rng_);
+        shape.phase = Uniform(0, 2 * pi)(rng_);
+        float const angle = Uniform(0, 2 * pi)(rng_);
+        shape.dx = std::cos(angle);
+        shape.dz = std::sin(angle);
+      } else {
+        shape.amplitude = 0;
+        shape.omega = shape.phase = shape.dx = shape.dz = 0;
+      }
+      shapes_.push_back(shape);
+    }
+  }
+}
+
+template<class PointT>
+typename SyntheticVideoSource<PointT>::CloudPtr
+SyntheticVideoSource<PointT>::nextCloud() {
+  size_t const sz = clouds_.size();
+  for (size_t i = 0; i < sz; ++i) {
+    if (clouds_[i].unique()) return clouds_[i];
+  }
+  CloudPtr cloud(new pcl::PointCloud<PointT>());
+  clouds_.push_back(cloud);
+  return cloud;
+}
+
+template<class PointT>
+void SyntheticVideoSource<PointT>::run() {
+  Tracer::global().nameThread("synthetic source");
+  uint64_t const start = localTime();
+  size_t frames = 0;
+  for (size_t i = 0; (scene_.frames == 0 || i < scene_.frames) && !stopped_; ++i) {
+    double const time = i / scene_.frame_rate;
+    CloudPtr cloud(nextCloud());
+    render(time, *cloud);
+    if (!pacer_.wait(static_cast<uint64_t>(time * 1e6))) break;
+    cloud->header.stamp = localTime();
+    this->setNextFrame(cloud);
+    ++frames;
+  }
+
+  double const elapsed = (localTime() - start) / 1e6;
+  LINFO << "SyntheticVideoSource: Generated " << frames << " frames with "
+        << shapes_.size() << " obstacles in " << elapsed << " s ("
+        << (elapsed > 0 ? frames / elapsed : 0) << " fps)";
+}
+
+template<class PointT>
+void SyntheticVideoSource<PointT>::render(
+    double time,
+    pcl::PointCloud<PointT>& cloud) {
+  size_t const width = scene_.width;
+  size_t const height = scene_.height;
+  float const inf = std::numeric_limits<float>::infinity();
+  float const half_width = scene_.room_width / 2;
+
+  // The room: each ray ends at the floor or at one of the walls. (The ray of
+  // each pixel is (dx, dy, 1), so the distance along it is the depth.)
+  for (size_t v = 0; v < height; ++v) {
+    float const dy = (v - cy_) / focal_;
+    float const floor = dy > 0 ? scene_.camera_height / dy : inf;
+    for (size_t u = 0; u < width; ++u) {
+      float const dx = (u - cx_) / focal_;
+      float const wall = dx != 0 ? half_width / std::fabs(dx) : inf;
+      depth_[v * width + u] =
+          std::min(std::min(floor, wall), scene_.room_depth);
+    }
+  }
+
+  // The obstacles: only the rays within the projection of each obstacle's
+  // bounding box are cast at it.
+  for (size_t i = 0; i < shapes_.size(); ++i) {
+    Shape const& shape = shapes_[i];
+    float const offset =
+        shape.amplitude * std::sin(shape.omega * time + shape.phase);
+    float const x = shape.x + offset * shape.dx;
+    float const z = shape.z + offset * shape.dz;
+    float const near = z - shape.c;
+    if (near <= 0) {
+      // Too close to the camera for its projection to be bounded.
+      castAt(shape, x, z, 0, width, 0, height);
+      continue;
+    }
+    float const top = scene_.camera_height - 2 * shape.b;
+    float const far = z + shape.c;
+    float const umin = focal_ * std::min((x - shape.a) / near, (x - shape.a) / far) + cx_;
+    float const umax = focal_ * std::max((x + shape.a) / near, (x + shape.a) / far) + cx_;
+    float const vmin = focal_ * std::min(top / near, top / far) + cy_;
+    float const vmax = focal_ * std::max(scene_.camera_height / near,
+                                         scene_.camera_height / far) + cy_;
+    if (umax < 0 || vmax < 0 || umin >= width || vmin >= height) continue;
+    castAt(shape, x, z,
+           static_cast<size_t>(std::max(0.f, umin)),
+           static_cast<size_t>(std::min<float>(width - 1, umax)) + 1,
+           static_cast<size_t>(std::max(0.f, vmin)),
+           static_cast<size_t>(std::min<float>(height - 1, vmax)) + 1);
+  }
+
+  // The sensor.
+  boost::random::normal_distribution<float> gauss;
+  boost::random::uniform_real_distribution<float> uniform;
+  float const nan = std::numeric_limits<float>::quiet_NaN();
+  cloud.points.resize(width * height);
+  cloud.width = width;
+  cloud.height = height;
+  cloud.is_dense = false;
+  for (size_t v = 0; v < height; ++v) {
+    for (size_t u = 0; u < width; ++u) {
+      PointT& pt = cloud.points[v * width + u];
+      float const depth = depth_[v * width + u];
+      if (depth > scene_.max_range ||
+          (scene_.dropout > 0 && uniform(rng_) < scene_.dropout)) {
+        pt.x = pt.y = pt.z = nan;
+        continue;
+      }
+      float const z = depth + scene_.noise * depth * depth * gauss(rng_);
+      pt.x = (u - cx_) / focal_ * z;
+      pt.y = (v - cy_) / focal_ * z;
+      pt.z = z;
+    }
+  }
+}
+
+template<class PointT>
+void SyntheticVideoSource<PointT>::castAt(
+    Shape const& shape, float x, float z,
+    size_t u0, size_t u1, size_t v0, size_t v1) {
+  size_t const width = scene_.width;
+  for (size_t v = v0; v < v1; ++v) {
+    float const dy = (v - cy_) / focal_;
+    for (size_t u = u0; u < u1; ++u) {
+      float const dx = (u - cx_) / focal_;
+      float& depth = depth_[v * width + u];
+      depth = std::min(depth, intersect(shape, x, z, dx, dy));
+    }
+  }
+}
+
+template<class PointT>
+float SyntheticVideoSource<PointT>::intersect(
+    Shape const& shape, float x, float z,
+    float dx, float dy) const {
+  float const inf = std::numeric_limits<float>::infinity();
+  float const floor = scene_.camera_height;
+  float const y = floor - shape.b;
+  if (shape.kind == Shape::BOX) {
+    // The slab method: the ray is within the box between the last of its
+    // entries into and the first of its exits from the three slabs.
+    float near = (z - shape.c);
+    float far = (z + shape.c);
+    float const dirs[] = { dx, dy };
+    float const centers[] = { x, y };
+    float const halves[] = { shape.a, shape.b };
+    for (int k = 0; k < 2; ++k) {
+      if (dirs[k] == 0) {
+        if (std::fabs(centers[k]) > halves[k]) return inf;
+        continue;
+      }
+      float t0 = (centers[k] - halves[k]) / dirs[k];
+      float t1 = (centers[k] + halves[k]) / dirs[k];
+      if (t0 > t1) std::swap(t0, t1);
+      near = std::max(near, t0);
+      far = std::min(far, t1);
+    }
+    return near <= far && near > 0 ? near : inf;
+  } else if (shape.kind == Shape::CYLINDER) {
+    // The side of the (upright) cylinder...
+    float const a = dx * dx + 1;
+    float const b = -2 * (dx * x + z);
+    float const c = x * x + z * z - shape.a * shape.a;
+    float const disc = b * b - 4 * a * c;
+    if (disc < 0) return inf;
+    float const t = (-b - std::sqrt(disc)) / (2 * a);
+    if (t > 0 && std::fabs(t * dy - y) <= shape.b) return t;
+    // ...or its top (the bottom stands on the floor).
+    if (dy == 0) return inf;
+    float const top = (floor - 2 * shape.b) / dy;
+    float const px = top * dx - x;
+    float const pz = top - z;
+    return top > 0 && px * px + pz * pz <= shape.a * shape.a ? top : inf;
+  } else {
+    float const cy = floor - shape.a;
+    float const a = dx * dx + dy * dy + 1;
+    float const b = -2 * (dx * x + dy * cy + z);
+    float const c = x * x + cy * cy + z * z - shape.a * shape.a;
+    float const disc = b * b - 4 * a * c;
+    if (disc < 0) return inf;
+    float const t = (-b - std::sqrt(disc)) / (2 * a);
+    return t > 0 ? t : inf;
+  }
+}
+
+}  // namespace lepp
+
+#endif
@@ -0,0 +1,417 @@
+#ifndef LEPP2_DEBUG_TRACE_H__
+#define LEPP2_DEBUG_TRACE_H__
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <time.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+#include "deps/easylogging++.h"
+
+namespace lepp {
+
+/**
+ * Escapes the given string for a JSON string literal.
+ */
+inline std::string jsonEscape(std::string const& str) {
+  std::ostringstream out;
+  for (size_t i = 0; i < str.size(); ++i) {
+    unsigned char const c = str[i];
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if (c < 0x20) {
+      out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+          << static_cast<int>(c) << std::dec;
+    } else {
+      out << c;
+    }
+  }
+  return out.str();
+}
+
+/**
+ * Returns the time of the trace clock (a monotonic one), in nanoseconds.
+ */
+inline uint64_t traceClock() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * A single span of time recorded by the `Tracer`.
+ */
+struct TraceEvent {
+  /**
+   * The name of the span; always a string literal.
+   */
+  char const* name;
+  uint64_t start;
+  uint64_t duration;
+  /**
+   * The frame that the thread worked on, or -1.
+   */
+  int frame;
+  /**
+   * Whether the span is not bound to the thread that recorded it, e.g. the
+   * time that a message waits to be written out.
+   */
+  bool async;
+};
+
+/**
+ * The events recorded by a single thread.
+ *
+ * Only the thread itself ever appends to its buffer, which it publishes by
+ * the (release) store of the number of events, so that recording an event
+ * never takes a lock. Once the buffer is full, the events of the session are
+ * dropped instead.
+ */
+class TraceBuffer {
+public:
+  static size_t const CAPACITY = 1 << 16;
+
+  explicit TraceBuffer(int tid)
+      : tid_(tid), frame_(-1), session_(0), size_(0), dropped_(0) {}
+
+  void record(TraceEvent const& event, uint32_t session) {
+    if (session_.load(boost::memory_order_relaxed) != session) {
+      // The first event of a new session: the old events are already out.
+      // The buffer is emptied before it is published as the new session's,
+      // so that whoever sees the new session never sees the old size.
+      size_.store(0, boost::memory_order_relaxed);
+      dropped_.store(0, boost::memory_order_relaxed);
+      session_.store(session, boost::memory_order_release);
+    }
+    size_t const size = size_.load(boost::memory_order_relaxed);
+    if (size == CAPACITY) {
+      dropped_.fetch_add(1, boost::memory_order_relaxed);
+      return;
+    }
+    // The memory is only taken once the thread records its first event.
+    if (!events_) events_.reset(new TraceEvent[CAPACITY]);
+    events_[size] = event;
+    size_.store(size + 1, boost::memory_order_release);
+  }
+
+  /**
+   * The frame that the thread currently works on (see `TraceFrame`); only
+   * touched by the thread itself.
+   */
+  int& frame() { return frame_; }
+
+  int tid() const { return tid_; }
+  std::string const& name() const { return name_; }
+  void setName(std::string const& name) { name_ = name; }
+  uint32_t session() const { return session_.load(boost::memory_order_acquire); }
+  size_t size() const { return size_.load(boost::memory_order_acquire); }
+  size_t dropped() const { return dropped_.load(boost::memory_order_relaxed); }
+  TraceEvent const& operator[](size_t i) const { return events_[i]; }
+private:
+  int const tid_;
+  std::string name_;
+  int frame_;
+  boost::scoped_array<TraceEvent> events_;
+  boost::atomic<uint32_t> session_;
+  boost::atomic<size_t> size_;
+  boost::atomic<size_t> dropped_;
+};
+
+/**
+ * The process-wide tracer, which records the time spent in the stages of the
+ * pipeline (see `TraceSpan`) by all threads, in sessions that are started
+ * and stopped at runtime (e.g. by a signal). At the end of each session, the
+ * events are written out as a Chrome trace (JSON), which can be loaded into
+ * Perfetto (https://ui.perfetto.dev) or `chrome://tracing`.
+ *
+ * While no session is running, a span costs a single (relaxed) atomic load.
+ */
+class Tracer {
+public:
+  /**
+   * The tracer of the process. It is never destroyed, so that the threads
+   * still running at exit can keep using it.
+   */
+  static Tracer& global() {
+    static Tracer* tracer = new Tracer;
+    return *tracer;
+  }
+
+  bool enabled() const { return enabled_.load(boost::memory_order_relaxed); }
+  uint32_t session() const { return session_.load(boost::memory_order_relaxed); }
+
+  /**
+   * Sets the path of the file that the sessions are written to; the number of
+   * each session is added before its extension.
+   */
+  void setFilePath(std::string const& file_path) {
+    boost::mutex::scoped_lock lock(mutex_);
+    file_path_ = file_path;
+  }
+
+  /**
+   * Starts a new session, unless one is already running.
+   */
+  void start() {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (enabled()) return;
+    session_.fetch_add(1, boost::memory_order_relaxed);
+    enabled_.store(true, boost::memory_order_release);
+    LINFO << "Tracer: Started session " << session();
+  }
+
+  /**
+   * Stops the running session (if any) and writes out its events.
+   */
+  void stop() {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (!enabled()) return;
+    enabled_.store(false, boost::memory_order_release);
+    write();
+  }
+
+  /**
+   * Starts a new session, or stops the running one.
+   */
+  void toggle() {
+    if (enabled()) stop(); else start();
+  }
+
+  /**
+   * Gives the calling thread a name by which it is shown in the trace.
+   */
+  void nameThread(std::string const& name) {
+    TraceBuffer& buffer = threadBuffer();
+    boost::mutex::scoped_lock lock(mutex_);
+    buffer.setName(name);
+  }
+
+  /**
+   * The buffer of the calling thread, which is created on its first use.
+   */
+  TraceBuffer& threadBuffer() {
+    TraceBuffer* buffer = current_.get();
+    if (!buffer) {
+      boost::mutex::scoped_lock lock(mutex_);
+      buffers_.push_back(boost::shared_ptr<TraceBuffer>(
+            new TraceBuffer(buffers_.size() + 1)));
+      buffer = buffers_.back().get();
+      current_.reset(buffer);
+    }
+    return *buffer;
+  }
+private:
+  Tracer()
+      : current_(&Tracer::release),
+        file_path_("lola-trace.json"),
+        enabled_(false),
+        session_(0) {}
+
+  /**
+   * The buffers are owned by the tracer (their events outlive the threads),
+   * so nothing is released with a thread.
+   */
+  static void release(TraceBuffer*) {}
+
+  /**
+   * Writes out the events of the session that just stopped. The mutex must
+   * be held.
+   */
+  void write() {
+    uint32_t const session = this->session();
+    std::string path = file_path_;
+    std::ostringstream suffix;
+    suffix << '-' << session;
+    size_t const dot = path.rfind('.');
+    size_t const slash = path.rfind('/');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+      path.insert(dot, suffix.str());
+    } else {
+      path += suffix.str();
+    }
+
+    std::ofstream out(path.c_str());
+    if (!out) {
+      LERROR << "Tracer: Unable to write the trace to " << path;
+      return;
+    }
+    int const pid = getpid();
+    size_t events = 0;
+    size_t dropped = 0;
+    uint64_t next_id = 0;
+    out << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n";
+    bool first = true;
+    for (size_t i = 0; i < buffers_.size(); ++i) {
+      TraceBuffer const& buffer = *buffers_[i];
+      std::ostringstream name;
+      if (buffer.name().empty()) name << "thread " << buffer.tid();
+      else name << buffer.name();
+      out << (first ? "" : ",\n")
+          << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+          << ",\"tid\":" << buffer.tid()
+          << ",\"args\":{\"name\":\"" << jsonEscape(name.str()) << "\"}}";
+      first = false;
+      // A buffer that is still left over from an earlier session is not
+      // taken for this one. Once the session is seen, so is the emptying of
+      // the buffer that preceded it (see `TraceBuffer::record`), hence the
+      // size read after it is the session's own. (A thread may only move
+      // its buffer on to a new session once this one is written out.)
+      if (buffer.session() != session) continue;
+      size_t const size = buffer.size();
+      if (buffer.session() != session) continue;
+      for (size_t j = 0; j < size; ++j) {
+        writeEvent(out, buffer[j], pid, buffer.tid(), next_id);
+      }
+      events += size;
+      dropped += buffer.dropped();
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    LINFO << "Tracer: Wrote " << events << " events of session " << session
+          << " to " << path;
+    if (dropped != 0) {
+      LWARNING << "Tracer: Dropped " << dropped << " events of full buffers";
+    }
+  }
+
+  static void writeEvent(
+      std::ostream& out,
+      TraceEvent const& event,
+      int pid,
+      int tid,
+      uint64_t& next_id) {
+    double const start = event.start / 1e3;
+    double const duration = event.duration / 1e3;
+    if (event.async) {
+      // An async span becomes a begin and an end event on a track of its own.
+      uint64_t const id = ++next_id;
+      out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"lepp\""
+          << ",\"ph\":\"b\",\"id\":" << id << ",\"pid\":" << pid
+          << ",\"tid\":" << tid << ",\"ts\":" << start << "}"
+          << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"lepp\""
+          << ",\"ph\":\"e\",\"id\":" << id << ",\"pid\":" << pid
+          << ",\"tid\":" << tid << ",\"ts\":" << start + duration << "}";
+      return;
+    }
+    out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"lepp\""
+        << ",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << tid
+        << ",\"ts\":" << start << ",\"dur\":" << duration;
+    if (event.frame >= 0) out << ",\"args\":{\"frame\":" << event.frame << "}";
+    out << "}";
+  }
+
+  boost::thread_specific_ptr<TraceBuffer> current_;
+  /**
+   * Guards the list of buffers, the names of the threads and the file path,
+   * and serializes the starting and stopping of the sessions.
+   */
+  mutable boost::mutex mutex_;
+  std::vector<boost::shared_ptr<TraceBuffer> > buffers_;
+  std::string file_path_;
+  boost::atomic<bool> enabled_;
+  boost::atomic<uint32_t> session_;
+};
+
+/**
+ * Records the time from its construction until its destruction (or `end`)
+ * as a span of the calling thread, e.g. a stage of the pipeline:
+ *
+ *   TraceSpan span("segmentation");
+ *
+ * Spans that are nested on the same thread nest in the trace as well.
+ */
+class TraceSpan {
+public:
+  explicit TraceSpan(char const* name) : name_(name), buffer_(0), start_(0) {
+    Tracer& tracer = Tracer::global();
+    if (tracer.enabled()) {
+      buffer_ = &tracer.threadBuffer();
+      start_ = traceClock();
+    }
+  }
+  ~TraceSpan() { end(); }
+
+  /**
+   * Ends the span before it goes out of scope.
+   */
+  void end() {
+    if (!buffer_) return;
+    TraceEvent const event = {
+      name_, start_, traceClock() - start_, buffer_->frame(), false
+    };
+    buffer_->record(event, Tracer::global().session());
+    buffer_ = 0;
+  }
+private:
+  char const* const name_;
+  TraceBuffer* buffer_;
+  uint64_t start_;
+};
+
+/**
+ * Marks the frame that the calling thread works on while it is in scope, as
+ * a span named "frame"; the spans recorded meanwhile are tagged with the
+ * frame. The frames of the sources that are derived from another one (e.g.
+ * the filtered source) are nested in the frame of the original source, so
+ * that only the outermost one is recorded.
+ */
+class TraceFrame {
+public:
+  explicit TraceFrame(int frame) : buffer_(0), start_(0) {
+    Tracer& tracer = Tracer::global();
+    if (tracer.enabled()) {
+      TraceBuffer& buffer = tracer.threadBuffer();
+      if (buffer.frame() < 0) {
+        buffer_ = &buffer;
+        buffer_->frame() = frame;
+        start_ = traceClock();
+      }
+    }
+  }
+  ~TraceFrame() {
+    if (!buffer_) return;
+    TraceEvent const event = {
+      "frame", start_, traceClock() - start_, buffer_->frame(), false
+    };
+    buffer_->record(event, Tracer::global().session());
+    buffer_->frame() = -1;
+  }
+private:
+  TraceBuffer* buffer_;
+  uint64_t start_;
+};
+
+/**
+ * Returns the start of an async span (see `traceInterval`), or 0 if there is
+ * no session running.
+ */
+inline uint64_t traceStart() {
+  return Tracer::global().enabled() ? traceClock() : 0;
+}
+
+/**
+ * Records an async span, from the given start (see `traceStart`) until now:
+ * a period that is not spent by a single thread, such as a message waiting
+ * in a queue. Does nothing if the start is 0.
+ */
+inline void traceInterval(char const* name, uint64_t start) {
+  if (start == 0) return;
+  Tracer& tracer = Tracer::global();
+  if (!tracer.enabled()) return;
+  TraceEvent const event = { name, start, traceClock() - start, -1, true };
+  tracer.threadBuffer().record(event, tracer.session());
+}
+
+}  // namespace lepp
+
+#endif
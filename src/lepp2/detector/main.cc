@@ -12,6 +12,7 @@
 #include "lepp2/BaseVideoSource.hpp"
 #include "lepp2/VideoObserver.hpp"
 #include "lepp2/FilteredVideoSource.hpp"
+#include "lepp2/PcdSequenceVideoSource.hpp"
 #include "lepp2/SmoothObstacleAggregator.hpp"
 
 #include "lepp2/visualization/EchoObserver.hpp"
@@ -37,7 +38,9 @@ namespace {
 void PrintUsage() {
   std::cout << "usage: detector [--pcd file | --oni file | --stream]"
       << std::endl;
-  std::cout << "--pcd    : " << "read the input from a .pcd file" << std::endl;
+  std::cout << "--pcd    : " << "read the input from a .pcd file (or a sequence"
+      << " of them, given as a directory or a pattern such as frame_*.pcd)"
+      << std::endl;
   std::cout << "--oni    : " << "read the input from an .oni file" << std::endl;
   std::cout << "--stream : " << "read the input from a live stream based on a"
       << " sensor attached to the computer" << std::endl;
@@ -84,6 +87,14 @@ boost::shared_ptr<VideoSource<PointT> > GetVideoSource(int argc, char* argv[]) {
         new LiveStreamSource<PointT>());
   } else if (option == "--pcd" && argc >= 3) {
     std::string const file_path = argv[2];
+    // A directory or a pattern is played back as a sequence of frames.
+    if (isPcdSequence(file_path)) {
+      return boost::shared_ptr<VideoSource<PointT> >(
+          new PcdSequenceVideoSource<PointT>(
+            PcdSequenceVideoSource<PointT>::findFiles(file_path),
+            2,
+            FramePacer::ORIGINAL));
+    }
     boost::shared_ptr<pcl::Grabber> interface(new pcl::PCDGrabber<PointT>(
       file_path,
       20.,
@@ -0,0 +1,223 @@
+#ifndef LEPP2_FILTER_FUSED_POINT_FILTER_H__
+#define LEPP2_FILTER_FUSED_POINT_FILTER_H__
+
+#include "lepp2/filter/PointFilter.hpp"
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+namespace lepp {
+
+/**
+ * Applies a chain of `PointFilter`s to points in the form of a (usually much
+ * shorter) list of fused operations.
+ *
+ * Once per frame, after all filters are prepared for it, the chain is compiled
+ * based on the `PointFilterForm` of each filter: consecutive affine maps are
+ * composed into one, a depth calibration followed by an affine map becomes a
+ * single calibrated affine map, and a filter rejecting all points short-cuts
+ * the whole frame. Opaque filters are still applied as they are. For instance,
+ * the default LOLA chain (sensor calibration, odometry transform, truncation)
+ * boils down to two operations: a calibrated affine map (the depth
+ * calibration, which is not affine itself as it scales x and y by a factor
+ * depending on z, followed by one matrix-vector product) and a quantization.
+ *
+ * The result of applying the fused operations is the same as applying the
+ * filters one after the other, up to floating point rounding.
+ */
+template<class PointT>
+class FusedPointFilter {
+public:
+  FusedPointFilter() : reject_all_(false) {}
+  /**
+   * Compiles the given chain of filters, which need to have already been
+   * prepared for the next frame.
+   */
+  void compile(std::vector<boost::shared_ptr<PointFilter<PointT> > > const& filters);
+  /**
+   * Whether the compiled chain rejects all points, i.e. there is no point in
+   * applying it to any of them.
+   */
+  bool rejectsAll() const { return reject_all_; }
+  /**
+   * Applies the compiled chain to the given point. Returns false if the point
+   * is rejected by one of the filters.
+   */
+  bool apply(PointT& pt) const;
+  /**
+   * The number of operations that the compiled chain consists of.
+   */
+  size_t size() const { return ops_.size(); }
+private:
+  struct Op {
+    enum Kind {
+      /**
+       * Calls an opaque filter's `apply`.
+       */
+      FILTER,
+      AFFINE,
+      CALIBRATION,
+      /**
+       * A depth calibration immediately followed by an affine map.
+       */
+      CALIBRATED_AFFINE,
+      QUANTIZE
+    };
+    Kind kind;
+    PointFilter<PointT>* filter;
+    double A[3][3];
+    double t[3];
+    double scale;
+    double offset;
+    double factor;
+  };
+
+  /**
+   * Composes the given affine map after the affine part of the given
+   * operation.
+   */
+  static void composeAffine(Op& op, PointFilterForm const& form);
+
+  /**
+   * The compiled operations. Cleared (but not deallocated) for each frame.
+   */
+  std::vector<Op> ops_;
+  bool reject_all_;
+};
+
+template<class PointT>
+void FusedPointFilter<PointT>::compile(
+    std::vector<boost::shared_ptr<PointFilter<PointT> > > const& filters) {
+  ops_.clear();
+  reject_all_ = false;
+  size_t const sz = filters.size();
+  for (size_t i = 0; i < sz; ++i) {
+    PointFilterForm const form = filters[i]->form();
+    Op* last = ops_.empty() ? 0 : &ops_.back();
+    switch (form.kind) {
+      case PointFilterForm::REJECT_ALL:
+        // Nothing else matters.
+        ops_.clear();
+        reject_all_ = true;
+        return;
+      case PointFilterForm::AFFINE:
+        if (last && (last->kind == Op::AFFINE ||
+                     last->kind == Op::CALIBRATED_AFFINE)) {
+          composeAffine(*last, form);
+          break;
+        }
+        if (last && last->kind == Op::CALIBRATION) {
+          last->kind = Op::CALIBRATED_AFFINE;
+          for (int r = 0; r < 3; ++r) {
+            for (int c = 0; c < 3; ++c) last->A[r][c] = form.A[r][c];
+            last->t[r] = form.t[r];
+          }
+          break;
+        }
+        {
+          Op op;
+          op.kind = Op::AFFINE;
+          for (int r = 0; r < 3; ++r) {
+            for (int c = 0; c < 3; ++c) op.A[r][c] = form.A[r][c];
+            op.t[r] = form.t[r];
+          }
+          ops_.push_back(op);
+        }
+        break;
+      case PointFilterForm::DEPTH_CALIBRATION:
+        {
+          Op op;
+          op.kind = Op::CALIBRATION;
+          op.scale = form.scale;
+          op.offset = form.offset;
+          ops_.push_back(op);
+        }
+        break;
+      case PointFilterForm::QUANTIZE:
+        {
+          Op op;
+          op.kind = Op::QUANTIZE;
+          op.factor = form.factor;
+          ops_.push_back(op);
+        }
+        break;
+      case PointFilterForm::OPAQUE:
+      default:
+        {
+          Op op;
+          op.kind = Op::FILTER;
+          op.filter = filters[i].get();
+          ops_.push_back(op);
+        }
+        break;
+    }
+  }
+}
+
+template<class PointT>
+void FusedPointFilter<PointT>::composeAffine(Op& op, PointFilterForm const& form) {
+  // In pseudo-code (if matrix operations were supported):
+  // A = form.A * A; t = form.A * t + form.t
+  double A[3][3];
+  double t[3];
+  for (int r = 0; r < 3; ++r) {
+    t[r] = form.t[r];
+    for (int c = 0; c < 3; ++c) {
+      A[r][c] = 0;
+      for (int k = 0; k < 3; ++k) A[r][c] += form.A[r][k] * op.A[k][c];
+      t[r] += form.A[r][c] * op.t[c];
+    }
+  }
+  for (int r = 0; r < 3; ++r) {
+    for (int c = 0; c < 3; ++c) op.A[r][c] = A[r][c];
+    op.t[r] = t[r];
+  }
+}
+
+template<class PointT>
+bool FusedPointFilter<PointT>::apply(PointT& pt) const {
+  if (reject_all_) return false;
+  size_t const sz = ops_.size();
+  for (size_t i = 0; i < sz; ++i) {
+    Op const& op = ops_[i];
+    switch (op.kind) {
+      case Op::FILTER:
+        if (!op.filter->apply(pt)) return false;
+        break;
+      case Op::CALIBRATION: {
+        pt.z = op.scale*pt.z + op.offset;
+        double const k = op.scale + op.offset/pt.z;
+        pt.x *= k;
+        pt.y *= k;
+        break;
+      }
+      case Op::CALIBRATED_AFFINE:
+      case Op::AFFINE: {
+        double x = pt.x;
+        double y = pt.y;
+        double z = pt.z;
+        if (op.kind == Op::CALIBRATED_AFFINE) {
+          z = op.scale*z + op.offset;
+          double const k = op.scale + op.offset/z;
+          x *= k;
+          y *= k;
+        }
+        pt.x = op.t[0] + op.A[0][0]*x + op.A[0][1]*y + op.A[0][2]*z;
+        pt.y = op.t[1] + op.A[1][0]*x + op.A[1][1]*y + op.A[1][2]*z;
+        pt.z = op.t[2] + op.A[2][0]*x + op.A[2][1]*y + op.A[2][2]*z;
+        break;
+      }
+      case Op::QUANTIZE:
+        pt.x = static_cast<int>(pt.x * op.factor) / op.factor;
+        pt.y = static_cast<int>(pt.y * op.factor) / op.factor;
+        pt.z = static_cast<int>(pt.z * op.factor) / op.factor;
+        break;
+    }
+  }
+  return true;
+}
+
+}  // namespace lepp
+
+#endif
@@ -1,13 +1,100 @@
 #ifndef LEPP2_FILTER_POINT_FILTER_H__
 #define LEPP2_FILTER_POINT_FILTER_H__
 
+#include <stdint.h>
+
 namespace lepp {
 
+/**
+ * Describes the mathematical form of the map that a `PointFilter` applies to
+ * the points of the current frame. Knowing the form allows consecutive filters
+ * to be composed into a single map once per frame (see `FusedPointFilter`),
+ * rather than each of them being applied to each point separately.
+ */
+struct PointFilterForm {
+  enum Kind {
+    /**
+     * Nothing is known about the filter; its `apply` method needs to be called.
+     */
+    OPAQUE,
+    /**
+     * p' = A * p + t
+     */
+    AFFINE,
+    /**
+     * z' = scale * z + offset; x' = x * (scale + offset / z'); y' likewise.
+     */
+    DEPTH_CALIBRATION,
+    /**
+     * Each coordinate is truncated to a multiple of 1 / factor.
+     */
+    QUANTIZE,
+    /**
+     * All points are rejected.
+     */
+    REJECT_ALL
+  };
+
+  static PointFilterForm Opaque() {
+    PointFilterForm form;
+    form.kind = OPAQUE;
+    return form;
+  }
+  static PointFilterForm Affine(double const A[3][3], double const t[3]) {
+    PointFilterForm form;
+    form.kind = AFFINE;
+    for (int i = 0; i < 3; ++i) {
+      for (int j = 0; j < 3; ++j) form.A[i][j] = A[i][j];
+      form.t[i] = t[i];
+    }
+    return form;
+  }
+  static PointFilterForm DepthCalibration(double scale, double offset) {
+    PointFilterForm form;
+    form.kind = DEPTH_CALIBRATION;
+    form.scale = scale;
+    form.offset = offset;
+    return form;
+  }
+  static PointFilterForm Quantize(int factor) {
+    PointFilterForm form;
+    form.kind = QUANTIZE;
+    form.factor = factor;
+    return form;
+  }
+  static PointFilterForm RejectAll() {
+    PointFilterForm form;
+    form.kind = REJECT_ALL;
+    return form;
+  }
+
+  Kind kind;
+  /**
+   * The parameters of the map; only those relevant to the `kind` are set.
+   */
+  double A[3][3];
+  double t[3];
+  double scale;
+  double offset;
+  int factor;
+};
+
 template<class PointT>
 class PointFilter {
 public:
   virtual bool apply(PointT& pt) = 0;
   virtual void prepareNext() = 0;
+  /**
+   * Informs the filter of the (local) time at which the frame that is about to
+   * be filtered was captured, in microseconds since the epoch. Called right
+   * before `prepareNext`. By default, filters do not depend on the time.
+   */
+  virtual void setFrameStamp(uint64_t stamp) {}
+  /**
+   * Describes the map that `apply` performs until the next `prepareNext` call.
+   * Called right after `prepareNext`. By default, filters are opaque.
+   */
+  virtual PointFilterForm form() const { return PointFilterForm::Opaque(); }
 };
 
 }  // namespace lepp
@@ -0,0 +1,65 @@
+#ifndef LEPP2_FILTER_RIGID_TRANSFORM_FILTER_H__
+#define LEPP2_FILTER_RIGID_TRANSFORM_FILTER_H__
+
+#include <cmath>
+
+#include "lepp2/filter/PointFilter.hpp"
+
+/**
+ * Applies a fixed rigid transformation (a rotation followed by a translation)
+ * to the points, e.g. in order to bring the points of an additional sensor
+ * into the coordinate system of the main one, given the pose in which it is
+ * mounted relative to the main one.
+ */
+template<class PointT>
+class RigidTransformFilter : public PointFilter<PointT> {
+public:
+  /**
+   * Creates a new filter rotating the points by the given roll, pitch and yaw
+   * angles (in degrees; around the x, y and z axis, respectively, applied in
+   * that order) and then translating them by (`x`, `y`, `z`).
+   */
+  RigidTransformFilter(double x, double y, double z,
+                       double roll, double pitch, double yaw) {
+    double const deg = 3.14159265358979323846 / 180;
+    double const cr = std::cos(roll * deg), sr = std::sin(roll * deg);
+    double const cp = std::cos(pitch * deg), sp = std::sin(pitch * deg);
+    double const cy = std::cos(yaw * deg), sy = std::sin(yaw * deg);
+    // R = Rz(yaw) * Ry(pitch) * Rx(roll)
+    A_[0][0] = cy * cp;
+    A_[0][1] = cy * sp * sr - sy * cr;
+    A_[0][2] = cy * sp * cr + sy * sr;
+    A_[1][0] = sy * cp;
+    A_[1][1] = sy * sp * sr + cy * cr;
+    A_[1][2] = sy * sp * cr - cy * sr;
+    A_[2][0] = -sp;
+    A_[2][1] = cp * sr;
+    A_[2][2] = cp * cr;
+    t_[0] = x;
+    t_[1] = y;
+    t_[2] = z;
+  }
+  /**
+   * Implementation of the `PointFilter` interface.
+   */
+  bool apply(PointT& pt) {
+    double const x = pt.x;
+    double const y = pt.y;
+    double const z = pt.z;
+    pt.x = A_[0][0] * x + A_[0][1] * y + A_[0][2] * z + t_[0];
+    pt.y = A_[1][0] * x + A_[1][1] * y + A_[1][2] * z + t_[1];
+    pt.z = A_[2][0] * x + A_[2][1] * y + A_[2][2] * z + t_[2];
+    return true;
+  }
+
+  void prepareNext() {}
+  /**
+   * Implementation of the `PointFilter` interface.
+   */
+  PointFilterForm form() const { return PointFilterForm::Affine(A_, t_); }
+private:
+  double A_[3][3];
+  double t_[3];
+};
+
+#endif
@@ -31,6 +31,12 @@ public:
   }
 
   void prepareNext() {}
+  /**
+   * Implementation of the `PointFilter` interface.
+   */
+  PointFilterForm form() const {
+    return PointFilterForm::DepthCalibration(scale_, offset_);
+  }
 private:
   double const scale_;
   double const offset_;
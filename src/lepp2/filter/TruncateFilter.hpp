@@ -35,6 +35,10 @@ public:
   }
 
   void prepareNext() {}
+  /**
+   * Implementation of the `PointFilter` interface.
+   */
+  PointFilterForm form() const { return PointFilterForm::Quantize(factor_); }
 private:
   int const factor_;
 };
@@ -235,5 +235,20 @@ private:
   std::vector<ObjectModel*> objs_;
 };
 
+/**
+ * A `ModelVisitor` implementation that counts the primitive parts of the
+ * models that it visits, like a `FlattenVisitor` would find them, but without
+ * collecting (and allocating for) them.
+ */
+class CountVisitor : public ModelVisitor {
+public:
+  CountVisitor() : count_(0) {}
+  void visitSphere(SphereModel&) { ++count_; }
+  void visitCapsule(CapsuleModel&) { ++count_; }
+  size_t count() const { return count_; }
+private:
+  size_t count_;
+};
+
 }  // namespace lepp
 #endif
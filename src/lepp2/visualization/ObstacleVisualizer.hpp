@@ -1,13 +1,24 @@
 #ifndef LEPP2_VISUALIZATION_OBSTACLE_VISUALIZER_H__
 #define LEPP2_VISUALIZATION_OBSTACLE_VISUALIZER_H__
 
+#include <cmath>
+#include <map>
 #include <sstream>
+#include <vector>
 
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <pcl/filters/voxel_grid.h>
 #include <pcl/visualization/cloud_viewer.h>
 #include <pcl/visualization/pcl_visualizer.h>
 
 #include "lepp2/VideoObserver.hpp"
 #include "lepp2/ObstacleAggregator.hpp"
+#include "lepp2/debug/trace.hpp"
 #include "lepp2/models/ObjectModel.h"
 
 namespace lepp {
@@ -21,6 +32,12 @@ namespace lepp {
  *
  * The `ModelDrawer` should be able to represent any `ObjectModel` instance.
  *
+ * The drawer keeps the shapes that it drew, keyed by the obstacle (see
+ * `setObstacle`) and the index of the part within it, across frames. Creating
+ * the viewer's actors is expensive, so a shape that is drawn again is only
+ * updated in place (or left alone, if it moved by less than `tolerance()`), and
+ * only the shapes of obstacles (or parts) that appeared are added. Those that
+ * were not drawn again since `beginFrame` are removed by `endFrame`.
  */
 class ModelDrawer : public ModelVisitor {
 public:
@@ -29,7 +46,25 @@ public:
    * visits onto the given viewer.
    */
   ModelDrawer(pcl::visualization::PCLVisualizer& viewer)
-      : viewer_(viewer), total_(0) {}
+      : viewer_(viewer), obstacle_(0), part_(0), frame_(0) {}
+
+  /**
+   * Starts drawing a new set of obstacles.
+   */
+  void beginFrame() { ++frame_; }
+  /**
+   * Makes the parts of the models visited next belong to the obstacle with the
+   * given key (e.g. its id).
+   */
+  void setObstacle(int key) {
+    obstacle_ = key;
+    part_ = 0;
+  }
+  /**
+   * Removes the shapes of the obstacles (and parts) that were not drawn since
+   * the last `beginFrame` call.
+   */
+  void endFrame();
 
   /**
    * Implementation of the `ModelVisitor` interface. It will draw the given
@@ -39,104 +74,191 @@ public:
   void visitCapsule(lepp::CapsuleModel& capsule);
 private:
   /**
-   * The instance to which the drawer will draw all models.
+   * The change of a shape's parameters (in meters) below which the shape is
+   * not redrawn.
    */
-  pcl::visualization::PCLVisualizer& viewer_;
+  static double tolerance() { return .002; }
+
   /**
-   * Counts how many models have been drawn by the drawer.
+   * A shape that is currently displayed.
    */
-  int total_;
+  struct Shape {
+    /**
+     * The center and radius of a sphere, or the coefficients of a cylinder.
+     */
+    std::vector<float> params;
+    /**
+     * The frame in which the shape was last drawn.
+     */
+    unsigned frame;
+  };
+
+  /**
+   * Returns the name of the next part of the current obstacle.
+   */
+  std::string nextPart();
+  /**
+   * Looks up the shape of the given name, adding it if it is new. Returns
+   * whether it needs to be (re)drawn with the given parameters, i.e. whether
+   * it is new or its parameters changed by more than the tolerance.
+   */
+  bool refresh(std::string const& name, std::vector<float> const& params, bool& added);
+  void drawSphere(std::string const& name,
+                  Coordinate const& center, double radius,
+                  float r, float g, float b, double opacity);
+
+  /**
+   * The instance to which the drawer will draw all models.
+   */
+  pcl::visualization::PCLVisualizer& viewer_;
+  std::map<std::string, Shape> shapes_;
+  int obstacle_;
+  int part_;
+  unsigned frame_;
 };
 
-void ModelDrawer::visitSphere(lepp::SphereModel& sphere) {
-  // We count how many object have been drawn in total, in order to make sure
-  // we don't use any duplicate names.
-  // The drawer relies on there not being any objects with a prefix "obstacle"
-  // in their name before its instantiation.
-  ++total_;
-
-  Coordinate const& center = sphere.center();
-  std::ostringstream ss; ss << "obstacle " << total_;
-  std::string const name = ss.str();
-
-  // Add it to the view...
-  viewer_.addSphere(
-      pcl::PointXYZ(center.x, center.y, center.z),
-      sphere.radius(),
-      0, .5, .5,    // r, g, b
-      name);
-  // ...and set opacity to 30%
+std::string ModelDrawer::nextPart() {
+  std::ostringstream ss;
+  ss << "obstacle " << obstacle_ << "/" << part_++;
+  return ss.str();
+}
+
+bool ModelDrawer::refresh(
+    std::string const& name,
+    std::vector<float> const& params,
+    bool& added) {
+  std::map<std::string, Shape>::iterator it = shapes_.find(name);
+  added = it == shapes_.end();
+  if (added) {
+    it = shapes_.insert(std::make_pair(name, Shape())).first;
+  }
+  Shape& shape = it->second;
+  shape.frame = frame_;
+  if (!added && shape.params.size() == params.size()) {
+    bool changed = false;
+    for (size_t i = 0; i < params.size() && !changed; ++i) {
+      changed = std::fabs(shape.params[i] - params[i]) > tolerance();
+    }
+    if (!changed) return false;
+  }
+  shape.params = params;
+  return true;
+}
+
+void ModelDrawer::drawSphere(
+    std::string const& name,
+    Coordinate const& center,
+    double radius,
+    float r, float g, float b,
+    double opacity) {
+  std::vector<float> params(4);
+  params[0] = center.x;
+  params[1] = center.y;
+  params[2] = center.z;
+  params[3] = radius;
+  bool added;
+  if (!refresh(name, params, added)) return;
+
+  pcl::PointXYZ const point(center.x, center.y, center.z);
+  if (!added) {
+    viewer_.updateSphere(point, radius, r, g, b, name);
+    return;
+  }
+  viewer_.addSphere(point, radius, r, g, b, name);
   viewer_.setShapeRenderingProperties(
       pcl::visualization::PCL_VISUALIZER_OPACITY,
-      0.3,
+      opacity,
       name);
 }
 
+void ModelDrawer::visitSphere(lepp::SphereModel& sphere) {
+  // Add it to the view, at 30% opacity.
+  drawSphere(nextPart(), sphere.center(), sphere.radius(), 0, .5, .5, 0.3);
+}
+
 void ModelDrawer::visitCapsule(lepp::CapsuleModel& capsule) {
-  ++total_;
-  std::ostringstream ss; ss << "obstacle " << total_;
-  std::string const name = ss.str();
+  std::string const name = nextPart();
 
-  pcl::ModelCoefficients cylinder_coeff;
+  std::vector<float> cylinder(7);
   // We need 7 values for a cylinder.
-  cylinder_coeff.values.resize(7);
-  cylinder_coeff.values[0] = capsule.first().x;
-  cylinder_coeff.values[1] = capsule.first().y;
-  cylinder_coeff.values[2] = capsule.first().z;
-  cylinder_coeff.values[3] = capsule.second().x - capsule.first().x;
-  cylinder_coeff.values[4] = capsule.second().y - capsule.first().y;
-  cylinder_coeff.values[5] = capsule.second().z - capsule.first().z;
-  cylinder_coeff.values[6] = capsule.radius();
+  cylinder[0] = capsule.first().x;
+  cylinder[1] = capsule.first().y;
+  cylinder[2] = capsule.first().z;
+  cylinder[3] = capsule.second().x - capsule.first().x;
+  cylinder[4] = capsule.second().y - capsule.first().y;
+  cylinder[5] = capsule.second().z - capsule.first().z;
+  cylinder[6] = capsule.radius();
 
   float const r = .5;
   float const g = 0;
   float const b = .5;
-  // First, we add the cylinder.
-  viewer_.addCylinder(cylinder_coeff, name);
-  viewer_.setShapeRenderingProperties(
-      pcl::visualization::PCL_VISUALIZER_OPACITY, 0.3, name);
-  viewer_.setShapeRenderingProperties(
-      pcl::visualization::PCL_VISUALIZER_COLOR,
-      r, g, b,
-      name);
+  // First, we add the cylinder. The viewer cannot update a cylinder in place,
+  // so one that moved is replaced.
+  bool added;
+  if (refresh(name, cylinder, added)) {
+    if (!added) viewer_.removeShape(name);
+    pcl::ModelCoefficients cylinder_coeff;
+    cylinder_coeff.values = cylinder;
+    viewer_.addCylinder(cylinder_coeff, name);
+    viewer_.setShapeRenderingProperties(
+        pcl::visualization::PCL_VISUALIZER_OPACITY, 0.3, name);
+    viewer_.setShapeRenderingProperties(
+        pcl::visualization::PCL_VISUALIZER_COLOR,
+        r, g, b,
+        name);
+  }
 
   // And now the two spheres at either end of the capsule.
-  viewer_.addSphere(
-      pcl::PointXYZ(capsule.first().x, capsule.first().y, capsule.first().z),
-      capsule.radius(),
-      r, g, b,
-      name + "s1");
-  viewer_.setShapeRenderingProperties(
-      pcl::visualization::PCL_VISUALIZER_OPACITY, 0.3, name + "s1");
-  viewer_.addSphere(
-      pcl::PointXYZ(capsule.second().x, capsule.second().y, capsule.second().z),
-      capsule.radius(),
-      r, g, b,
-      name + "s2");
-  viewer_.setShapeRenderingProperties(
-      pcl::visualization::PCL_VISUALIZER_OPACITY, 0.2, name + "s2");
+  drawSphere(name + "s1", capsule.first(), capsule.radius(), r, g, b, 0.3);
+  drawSphere(name + "s2", capsule.second(), capsule.radius(), r, g, b, 0.2);
+}
+
+void ModelDrawer::endFrame() {
+  std::map<std::string, Shape>::iterator it = shapes_.begin();
+  while (it != shapes_.end()) {
+    if (it->second.frame == frame_) {
+      ++it;
+      continue;
+    }
+    viewer_.removeShape(it->first);
+    shapes_.erase(it++);
+  }
 }
+
 /**
  * Visualizes the obstacles detected by a particular obstacle detector by
  * overlaying them onto a point cloud feed coming from a video source.
  *
  * Implements the VideoObserver and ObstacleAggregator interfaces.
+ *
+ * The visualizer never holds up the pipeline: the newest cloud and the newest
+ * obstacles are only put into a slot (replacing any that were not displayed
+ * yet), which the visualizer's own thread drains at most `max_rate` times per
+ * second. That thread also thins out the displayed cloud with a voxel grid,
+ * if given a voxel size.
  */
 template<class PointT>
 class ObstacleVisualizer
   : public VideoObserver<PointT>,
     public ObstacleAggregator {
 public:
-  ObstacleVisualizer() : viewer_("ObstacleVisualizer") {}
+  /**
+   * Creates a new visualizer refreshing the view at most `max_rate` times per
+   * second and, if `voxel_size` (in meters) is positive, displaying only a
+   * single point of each voxel of the cloud.
+   */
+  ObstacleVisualizer(double max_rate = 10, double voxel_size = 0);
+  /**
+   * RAII: stops the visualizer's thread.
+   */
+  ~ObstacleVisualizer();
 
   /**
    * VideoObserver interface implementation: processes the current point cloud.
    */
   virtual void notifyNewFrame(
       int idx,
-      const typename pcl::PointCloud<PointT>::ConstPtr& pointCloud) {
-    viewer_.showCloud(pointCloud);
-  }
+      const typename pcl::PointCloud<PointT>::ConstPtr& pointCloud);
 
   /**
    * ObstacleAggregator interface implementation: processes detected obstacles.
@@ -144,6 +266,17 @@ public:
   virtual void updateObstacles(std::vector<ObjectModelPtr> const& obstacles);
 
 private:
+  typedef typename pcl::PointCloud<PointT>::ConstPtr CloudConstPtr;
+
+  /**
+   * The function executed by the visualizer's thread.
+   */
+  void run();
+  /**
+   * Returns the cloud to display for the given one.
+   */
+  CloudConstPtr decimate(CloudConstPtr const& cloud) const;
+
   /**
    * Used for the visualization of the scene.
    */
@@ -155,30 +288,145 @@ private:
    */
   void drawShapes(std::vector<ObjectModelPtr> obstacles,
                   pcl::visualization::PCLVisualizer& viewer);
+
+  /**
+   * The minimum time between two refreshes of the view.
+   */
+  boost::posix_time::time_duration const period_;
+  double const voxel_size_;
+
+  /**
+   * The newest cloud and obstacles that are yet to be displayed.
+   */
+  boost::mutex mutex_;
+  boost::condition_variable cond_;
+  CloudConstPtr cloud_;
+  std::vector<ObjectModelPtr> obstacles_;
+  bool obstacles_pending_;
+  bool stopped_;
+
+  /**
+   * Draws the obstacles; only used on the viewer's thread.
+   */
+  boost::scoped_ptr<ModelDrawer> drawer_;
+
+  boost::thread thread_;
 };
 
 template<class PointT>
-void ObstacleVisualizer<PointT>::drawShapes(
-    std::vector<ObjectModelPtr> obstacles,
-    pcl::visualization::PCLVisualizer& viewer) {
-  // Remove all old shapes...
-  viewer.removeAllShapes();
+ObstacleVisualizer<PointT>::ObstacleVisualizer(double max_rate, double voxel_size)
+    : viewer_("ObstacleVisualizer"),
+      period_(boost::posix_time::microseconds(
+            max_rate > 0 ? static_cast<int64_t>(1e6 / max_rate) : 0)),
+      voxel_size_(voxel_size),
+      obstacles_pending_(false),
+      stopped_(false) {
+  thread_ = boost::thread(boost::bind(&ObstacleVisualizer::run, this));
+}
 
-  // ...and draw all the new ones.
-  ModelDrawer drawer(viewer);
-  size_t const sz = obstacles.size();
-  for (size_t i = 0; i < sz; ++i) {
-    obstacles[i]->accept(drawer);
+template<class PointT>
+ObstacleVisualizer<PointT>::~ObstacleVisualizer() {
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    stopped_ = true;
+  }
+  cond_.notify_one();
+  thread_.interrupt();
+  thread_.join();
+}
+
+template<class PointT>
+void ObstacleVisualizer<PointT>::notifyNewFrame(
+    int idx,
+    const typename pcl::PointCloud<PointT>::ConstPtr& pointCloud) {
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    cloud_ = pointCloud;
   }
+  cond_.notify_one();
 }
 
 template<class PointT>
 void ObstacleVisualizer<PointT>::updateObstacles(
     std::vector<ObjectModelPtr> const& obstacles) {
-  pcl::visualization::CloudViewer::VizCallable obstacle_visualization =
-      boost::bind(&ObstacleVisualizer::drawShapes,
-                  this, obstacles, _1);
-  viewer_.runOnVisualizationThreadOnce(obstacle_visualization);
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    // Reuses the slot's storage.
+    obstacles_.assign(obstacles.begin(), obstacles.end());
+    obstacles_pending_ = true;
+  }
+  cond_.notify_one();
+}
+
+template<class PointT>
+typename ObstacleVisualizer<PointT>::CloudConstPtr
+ObstacleVisualizer<PointT>::decimate(CloudConstPtr const& cloud) const {
+  if (voxel_size_ <= 0) return cloud;
+  // The viewer renders the cloud on a thread of its own, so each displayed
+  // cloud needs to be a new one.
+  typename pcl::PointCloud<PointT>::Ptr decimated(new pcl::PointCloud<PointT>());
+  pcl::VoxelGrid<PointT> grid;
+  grid.setInputCloud(cloud);
+  grid.setLeafSize(voxel_size_, voxel_size_, voxel_size_);
+  grid.filter(*decimated);
+  return decimated;
+}
+
+template<class PointT>
+void ObstacleVisualizer<PointT>::run() {
+  Tracer::global().nameThread("visualizer");
+  CloudConstPtr cloud;
+  std::vector<ObjectModelPtr> obstacles;
+  while (true) {
+    bool draw = false;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (!stopped_ && !cloud_ && !obstacles_pending_) cond_.wait(lock);
+      if (stopped_) return;
+      cloud.swap(cloud_);
+      if (obstacles_pending_) {
+        obstacles.swap(obstacles_);
+        obstacles_pending_ = false;
+        draw = true;
+      }
+    }
+
+    TraceSpan span("visualization");
+    if (cloud) {
+      viewer_.showCloud(decimate(cloud));
+      cloud.reset();
+    }
+    if (draw) {
+      pcl::visualization::CloudViewer::VizCallable obstacle_visualization =
+          boost::bind(&ObstacleVisualizer::drawShapes,
+                      this, obstacles, _1);
+      viewer_.runOnVisualizationThreadOnce(obstacle_visualization);
+    }
+    // Anything arriving in the meantime replaces what is in the slot.
+    boost::this_thread::sleep(period_);
+  }
+}
+
+template<class PointT>
+void ObstacleVisualizer<PointT>::drawShapes(
+    std::vector<ObjectModelPtr> obstacles,
+    pcl::visualization::PCLVisualizer& viewer) {
+  // The drawer keeps the shapes that are displayed from one call to the next,
+  // so it lives as long as the viewer.
+  if (!drawer_) drawer_.reset(new ModelDrawer(viewer));
+
+  // Update the shapes of the obstacles that are still there, add those of the
+  // new ones...
+  drawer_->beginFrame();
+  size_t const sz = obstacles.size();
+  for (size_t i = 0; i < sz; ++i) {
+    // Obstacles without an id are keyed by their position instead.
+    int const id = obstacles[i]->id();
+    drawer_->setObstacle(id != 0 ? id : -static_cast<int>(i) - 1);
+    obstacles[i]->accept(*drawer_);
+  }
+  // ...and remove those of the ones that are gone.
+  drawer_->endFrame();
 }
 
 } // namespace lepp
@@ -0,0 +1,53 @@
+#ifndef LOLA_CLOUD_STREAM_H__
+#define LOLA_CLOUD_STREAM_H__
+
+#include <stdint.h>
+
+/**
+ * The protocol by which clouds are streamed from the computer that the sensor
+ * is attached to (see `CloudStreamPublisher`) to the one that processes them
+ * (see `CloudStreamSource`).
+ *
+ * Each cloud is sent as a message: a `CloudStreamHeader` followed by the
+ * payload of a session log cloud record (see `SessionLog.h`), i.e. either the
+ * raw x, y, z floats of each point or, if the publisher is given a
+ * resolution, the points quantized and delta coded by the
+ * `lepp::QuantizedCloudCodec`, which makes a message several times smaller.
+ *
+ * Over TCP, the messages simply follow each other on the stream. Over UDP,
+ * each message is split into chunks (see `DatagramChunks.h`).
+ *
+ * All values are in the host's byte order.
+ */
+enum CloudStreamTransport {
+  CLOUD_STREAM_TCP,
+  CLOUD_STREAM_UDP
+};
+
+uint32_t const CLOUD_STREAM_MAGIC = 0x3153434c;  // "LCS1"
+
+struct CloudStreamHeader {
+  uint32_t magic;
+  /**
+   * The type of the session log record whose payload follows: a
+   * `SessionLogRecord::CLOUD` or `SessionLogRecord::QUANTIZED_CLOUD`.
+   */
+  uint32_t type;
+  /**
+   * The sequence number of the message, which lets the receiver tell how many
+   * clouds it missed.
+   */
+  uint32_t seq;
+  /**
+   * The size of the payload following the header, in bytes.
+   */
+  uint32_t size;
+};
+
+/**
+ * The largest payload that a receiver accepts, which protects it from
+ * allocating arbitrary amounts of memory when given garbage.
+ */
+uint32_t const CLOUD_STREAM_MAX_SIZE = 64 * 1024 * 1024;
+
+#endif
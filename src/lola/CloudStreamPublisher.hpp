@@ -0,0 +1,276 @@
+#ifndef LOLA_CLOUD_STREAM_PUBLISHER_H__
+#define LOLA_CLOUD_STREAM_PUBLISHER_H__
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "lepp2/BaseVideoSource.hpp"
+#include "lepp2/VideoObserver.hpp"
+
+#include "lola/CloudStream.h"
+#include "lola/DatagramChunks.h"
+#include "lola/SessionCloud.hpp"
+
+#include "deps/easylogging++.h"
+
+/**
+ * Streams the clouds of the `VideoSource` it is attached to to a
+ * `CloudStreamSource` on another computer (see `CloudStream.h`).
+ *
+ * The clouds are encoded and sent on a thread of the publisher's own, so the
+ * source is never held up by the network. When the network cannot keep up,
+ * only the newest cloud waits to be sent; older ones are dropped. Over TCP,
+ * the publisher (re)connects to the receiver until it succeeds.
+ */
+template<class PointT>
+class CloudStreamPublisher : public lepp::VideoObserver<PointT> {
+public:
+  struct Stats {
+    size_t sent;
+    /**
+     * The clouds that were superseded by a newer one before they were sent.
+     */
+    size_t dropped;
+    uint64_t bytes;
+  };
+
+  /**
+   * Creates a new publisher sending the clouds to the receiver at the given
+   * address, quantizing the points to the given resolution (in meters) if it
+   * is positive.
+   */
+  CloudStreamPublisher(
+      std::string const& ip,
+      int port,
+      CloudStreamTransport transport,
+      float resolution);
+  /**
+   * RAII: stops sending.
+   */
+  ~CloudStreamPublisher();
+
+  /**
+   * `VideoObserver` interface implementation.
+   */
+  void notifyNewFrame(
+      int idx,
+      const typename pcl::PointCloud<PointT>::ConstPtr& cloud);
+
+  Stats stats() const;
+private:
+  typedef typename pcl::PointCloud<PointT>::ConstPtr CloudConstPtr;
+
+  /**
+   * Starts connecting to the receiver (over TCP).
+   */
+  void connect();
+  void handleConnect(boost::system::error_code const& error);
+  /**
+   * Sends the pending cloud, if there is one and nothing is being sent. Only
+   * called on the publisher's thread.
+   */
+  void sendNext();
+  void handleWrite(boost::system::error_code const& error, size_t bytes);
+  /**
+   * Sends the encoded message as a sequence of datagrams.
+   */
+  void sendChunks();
+
+  CloudStreamTransport const transport_;
+  float const resolution_;
+
+  boost::asio::io_service io_service_;
+  boost::scoped_ptr<boost::asio::io_service::work> work_;
+  boost::asio::ip::tcp::endpoint tcp_endpoint_;
+  boost::asio::ip::tcp::socket tcp_socket_;
+  boost::asio::ip::udp::endpoint udp_endpoint_;
+  boost::asio::ip::udp::socket udp_socket_;
+  boost::asio::deadline_timer retry_timer_;
+
+  /**
+   * The newest cloud that is yet to be sent.
+   */
+  mutable boost::mutex mutex_;
+  CloudConstPtr pending_;
+
+  /**
+   * The state of the sending, only touched by the publisher's thread.
+   */
+  bool connected_;
+  bool sending_;
+  uint32_t const session_;
+  uint32_t seq_;
+  std::vector<char> message_;
+  std::vector<char> payload_;
+  std::vector<char> datagram_;
+
+  boost::atomic<size_t> sent_;
+  boost::atomic<size_t> dropped_;
+  boost::atomic<uint64_t> bytes_;
+
+  boost::thread thread_;
+};
+
+template<class PointT>
+CloudStreamPublisher<PointT>::CloudStreamPublisher(
+    std::string const& ip,
+    int port,
+    CloudStreamTransport transport,
+    float resolution)
+    : transport_(transport),
+      resolution_(resolution),
+      work_(new boost::asio::io_service::work(io_service_)),
+      tcp_endpoint_(boost::asio::ip::address::from_string(ip), port),
+      tcp_socket_(io_service_),
+      udp_endpoint_(boost::asio::ip::address::from_string(ip), port),
+      udp_socket_(io_service_),
+      retry_timer_(io_service_),
+      connected_(false),
+      sending_(false),
+      session_(newChunkSession()),
+      seq_(0),
+      sent_(0),
+      dropped_(0),
+      bytes_(0) {
+  if (transport_ == CLOUD_STREAM_UDP) {
+    udp_socket_.open(udp_endpoint_.protocol());
+    connected_ = true;
+  } else {
+    io_service_.post(boost::bind(&CloudStreamPublisher::connect, this));
+  }
+  thread_ = boost::thread(
+      boost::bind(&boost::asio::io_service::run, &io_service_));
+}
+
+template<class PointT>
+CloudStreamPublisher<PointT>::~CloudStreamPublisher() {
+  work_.reset();
+  io_service_.stop();
+  thread_.join();
+}
+
+template<class PointT>
+void CloudStreamPublisher<PointT>::notifyNewFrame(
+    int idx,
+    const typename pcl::PointCloud<PointT>::ConstPtr& cloud) {
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (pending_) dropped_.fetch_add(1, boost::memory_order_relaxed);
+    pending_ = cloud;
+  }
+  io_service_.post(boost::bind(&CloudStreamPublisher::sendNext, this));
+}
+
+template<class PointT>
+typename CloudStreamPublisher<PointT>::Stats
+CloudStreamPublisher<PointT>::stats() const {
+  Stats stats;
+  stats.sent = sent_.load(boost::memory_order_relaxed);
+  stats.dropped = dropped_.load(boost::memory_order_relaxed);
+  stats.bytes = bytes_.load(boost::memory_order_relaxed);
+  return stats;
+}
+
+template<class PointT>
+void CloudStreamPublisher<PointT>::connect() {
+  tcp_socket_.async_connect(
+      tcp_endpoint_,
+      boost::bind(&CloudStreamPublisher::handleConnect, this,
+                  boost::asio::placeholders::error));
+}
+
+template<class PointT>
+void CloudStreamPublisher<PointT>::handleConnect(
+    boost::system::error_code const& error) {
+  if (error) {
+    boost::system::error_code ignored;
+    tcp_socket_.close(ignored);
+    retry_timer_.expires_from_now(boost::posix_time::seconds(1));
+    retry_timer_.async_wait(
+        boost::bind(&CloudStreamPublisher::connect, this));
+    return;
+  }
+  LINFO << "CloudStreamPublisher: Connected to " << tcp_endpoint_;
+  tcp_socket_.set_option(boost::asio::ip::tcp::no_delay(true));
+  connected_ = true;
+  sendNext();
+}
+
+template<class PointT>
+void CloudStreamPublisher<PointT>::sendNext() {
+  if (!connected_ || sending_) return;
+  CloudConstPtr cloud;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    cloud.swap(pending_);
+  }
+  if (!cloud) return;
+
+  CloudStreamHeader header;
+  header.magic = CLOUD_STREAM_MAGIC;
+  header.type = encodeSessionCloud(*cloud, resolution_, payload_);
+  header.seq = seq_++;
+  header.size = payload_.size();
+  message_.resize(sizeof header + payload_.size());
+  memcpy(&message_[0], &header, sizeof header);
+  memcpy(&message_[sizeof header], &payload_[0], payload_.size());
+
+  if (transport_ == CLOUD_STREAM_UDP) {
+    sendChunks();
+    return;
+  }
+  sending_ = true;
+  boost::asio::async_write(
+      tcp_socket_,
+      boost::asio::buffer(message_),
+      boost::bind(&CloudStreamPublisher::handleWrite, this,
+                  boost::asio::placeholders::error,
+                  boost::asio::placeholders::bytes_transferred));
+}
+
+template<class PointT>
+void CloudStreamPublisher<PointT>::handleWrite(
+    boost::system::error_code const& error,
+    size_t bytes) {
+  sending_ = false;
+  if (error) {
+    LWARNING << "CloudStreamPublisher: Lost the connection to "
+             << tcp_endpoint_ << ": " << error.message();
+    boost::system::error_code ignored;
+    tcp_socket_.close(ignored);
+    connected_ = false;
+    connect();
+    return;
+  }
+  sent_.fetch_add(1, boost::memory_order_relaxed);
+  bytes_.fetch_add(bytes, boost::memory_order_relaxed);
+  sendNext();
+}
+
+template<class PointT>
+void CloudStreamPublisher<PointT>::sendChunks() {
+  size_t const count = chunkCount(message_.size());
+  for (size_t i = 0; i < count; ++i) {
+    makeChunk(CLOUD_STREAM_MAGIC, session_, seq_ - 1, message_, i, datagram_);
+    boost::system::error_code error;
+    udp_socket_.send_to(boost::asio::buffer(datagram_), udp_endpoint_, 0, error);
+    if (error) {
+      LWARNING << "CloudStreamPublisher: Unable to send to " << udp_endpoint_
+               << ": " << error.message();
+      return;
+    }
+  }
+  sent_.fetch_add(1, boost::memory_order_relaxed);
+  bytes_.fetch_add(message_.size(), boost::memory_order_relaxed);
+}
+
+#endif
@@ -0,0 +1,321 @@
+#ifndef LOLA_CLOUD_STREAM_SOURCE_H__
+#define LOLA_CLOUD_STREAM_SOURCE_H__
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "lepp2/BaseVideoSource.hpp"
+
+#include "lola/CloudStream.h"
+#include "lola/DatagramChunks.h"
+#include "lola/SessionCloud.hpp"
+
+#include "deps/easylogging++.h"
+
+/**
+ * A `VideoSource` that receives the clouds streamed by a
+ * `CloudStreamPublisher` on another computer (see `CloudStream.h`).
+ *
+ * Over TCP, it accepts a single publisher at a time and waits for the next
+ * one once it disconnects. Over UDP, it takes the datagrams of any publisher;
+ * there should only be one.
+ *
+ * The clouds are emitted on the source's own thread, with the stamps that the
+ * publisher gave them. Those are on the clock of the publisher's computer, so
+ * they are not comparable to the times of the local poses unless the clocks
+ * of the two computers are synchronized. (A stamp that is not within a second
+ * of the local time is replaced by the time of arrival; see
+ * `lepp::captureTime`.)
+ */
+template<class PointT>
+class CloudStreamSource : public lepp::VideoSource<PointT> {
+public:
+  /**
+   * Creates a new source receiving the clouds on the given port.
+   */
+  CloudStreamSource(int port, CloudStreamTransport transport)
+      : port_(port),
+        transport_(transport),
+        acceptor_(io_service_),
+        tcp_socket_(io_service_),
+        udp_socket_(io_service_),
+        next_seq_(0),
+        has_seq_(false),
+        assembler_(CLOUD_STREAM_MAGIC,
+                   sizeof(CloudStreamHeader) + CLOUD_STREAM_MAX_SIZE),
+        received_(0),
+        missed_(0) {}
+  /**
+   * RAII: stops receiving.
+   */
+  ~CloudStreamSource();
+  /**
+   * `VideoSource` interface implementation. Starts listening for the
+   * publisher.
+   */
+  void open();
+  /**
+   * `VideoSource` interface implementation. Stops receiving.
+   */
+  void close();
+
+  /**
+   * The number of clouds received so far and the number of clouds that the
+   * publisher sent, but never made it.
+   */
+  size_t received() const { return received_.load(boost::memory_order_relaxed); }
+  size_t missed() const { return missed_.load(boost::memory_order_relaxed); }
+private:
+  typedef typename pcl::PointCloud<PointT>::Ptr CloudPtr;
+
+  void accept();
+  void handleAccept(boost::system::error_code const& error);
+  void readHeader();
+  void handleHeader(boost::system::error_code const& error);
+  void handlePayload(boost::system::error_code const& error);
+  /**
+   * Closes the connection to the publisher and waits for the next one.
+   */
+  void disconnect(boost::system::error_code const& error);
+
+  void receiveChunk();
+  void handleChunk(boost::system::error_code const& error, size_t bytes);
+
+  /**
+   * Decodes the payload of the message with the given header and emits the
+   * cloud. Only called on the source's thread.
+   */
+  void emit(CloudStreamHeader const& header);
+  /**
+   * Returns a cloud that none of the observers holds on to anymore, allocating
+   * a new one only if there is no such cloud.
+   */
+  CloudPtr nextCloud();
+
+  int const port_;
+  CloudStreamTransport const transport_;
+
+  boost::asio::io_service io_service_;
+  boost::asio::ip::tcp::acceptor acceptor_;
+  boost::asio::ip::tcp::socket tcp_socket_;
+  boost::asio::ip::udp::socket udp_socket_;
+  boost::asio::ip::udp::endpoint sender_;
+
+  /**
+   * The message being received. Only touched by the source's thread.
+   */
+  CloudStreamHeader header_;
+  std::vector<char> payload_;
+  /**
+   * The sequence number of the cloud expected next, valid only once a cloud
+   * of the current publisher has been received (`has_seq_`). Gaps are only
+   * counted from there on, since a publisher that reconnects keeps counting
+   * where it left off.
+   */
+  uint32_t next_seq_;
+  bool has_seq_;
+  /**
+   * The datagram just received over UDP and the reassembly of the message
+   * that it belongs to.
+   */
+  std::vector<char> datagram_;
+  ChunkAssembler assembler_;
+
+  /**
+   * All clouds handed out so far. Only touched by the source's thread.
+   */
+  std::vector<CloudPtr> clouds_;
+
+  boost::atomic<size_t> received_;
+  boost::atomic<size_t> missed_;
+
+  boost::thread thread_;
+};
+
+template<class PointT>
+CloudStreamSource<PointT>::~CloudStreamSource() {
+  close();
+}
+
+template<class PointT>
+void CloudStreamSource<PointT>::close() {
+  io_service_.stop();
+  thread_.join();
+}
+
+template<class PointT>
+void CloudStreamSource<PointT>::open() {
+  if (transport_ == CLOUD_STREAM_UDP) {
+    boost::asio::ip::udp::endpoint const endpoint(boost::asio::ip::udp::v4(), port_);
+    udp_socket_.open(endpoint.protocol());
+    // A whole message arrives in a burst of datagrams, which need to fit in
+    // the socket's buffer until they are taken out.
+    boost::system::error_code ignored;
+    udp_socket_.set_option(
+        boost::asio::socket_base::receive_buffer_size(8 * 1024 * 1024), ignored);
+    udp_socket_.bind(endpoint);
+    datagram_.resize(sizeof(DatagramChunk) + DATAGRAM_CHUNK_SIZE);
+    receiveChunk();
+  } else {
+    boost::asio::ip::tcp::endpoint const endpoint(boost::asio::ip::tcp::v4(), port_);
+    acceptor_.open(endpoint.protocol());
+    acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+    acceptor_.bind(endpoint);
+    acceptor_.listen();
+    accept();
+  }
+  LINFO << "CloudStreamSource: Listening on port " << port_;
+  thread_ = boost::thread(
+      boost::bind(&boost::asio::io_service::run, &io_service_));
+}
+
+template<class PointT>
+void CloudStreamSource<PointT>::accept() {
+  acceptor_.async_accept(
+      tcp_socket_,
+      boost::bind(&CloudStreamSource::handleAccept, this,
+                  boost::asio::placeholders::error));
+}
+
+template<class PointT>
+void CloudStreamSource<PointT>::handleAccept(
+    boost::system::error_code const& error) {
+  if (error) {
+    LERROR << "CloudStreamSource: Unable to accept a publisher: "
+           << error.message();
+    return;
+  }
+  LINFO << "CloudStreamSource: Publisher connected from "
+        << tcp_socket_.remote_endpoint();
+  tcp_socket_.set_option(boost::asio::ip::tcp::no_delay(true));
+  // The first cloud of the publisher sets the sequence to expect.
+  has_seq_ = false;
+  readHeader();
+}
+
+template<class PointT>
+void CloudStreamSource<PointT>::readHeader() {
+  boost::asio::async_read(
+      tcp_socket_,
+      boost::asio::buffer(&header_, sizeof header_),
+      boost::bind(&CloudStreamSource::handleHeader, this,
+                  boost::asio::placeholders::error));
+}
+
+template<class PointT>
+void CloudStreamSource<PointT>::handleHeader(
+    boost::system::error_code const& error) {
+  if (error) {
+    disconnect(error);
+    return;
+  }
+  if (header_.magic != CLOUD_STREAM_MAGIC || header_.size > CLOUD_STREAM_MAX_SIZE) {
+    LERROR << "CloudStreamSource: Invalid message header; dropping the publisher";
+    disconnect(boost::system::error_code());
+    return;
+  }
+  payload_.resize(header_.size);
+  boost::asio::async_read(
+      tcp_socket_,
+      boost::asio::buffer(payload_),
+      boost::bind(&CloudStreamSource::handlePayload, this,
+                  boost::asio::placeholders::error));
+}
+
+template<class PointT>
+void CloudStreamSource<PointT>::handlePayload(
+    boost::system::error_code const& error) {
+  if (error) {
+    disconnect(error);
+    return;
+  }
+  emit(header_);
+  readHeader();
+}
+
+template<class PointT>
+void CloudStreamSource<PointT>::disconnect(
+    boost::system::error_code const& error) {
+  if (error == boost::asio::error::eof) {
+    LINFO << "CloudStreamSource: Publisher disconnected";
+  } else if (error) {
+    LWARNING << "CloudStreamSource: Publisher disconnected: " << error.message();
+  }
+  boost::system::error_code ignored;
+  tcp_socket_.close(ignored);
+  accept();
+}
+
+template<class PointT>
+void CloudStreamSource<PointT>::receiveChunk() {
+  udp_socket_.async_receive_from(
+      boost::asio::buffer(datagram_),
+      sender_,
+      boost::bind(&CloudStreamSource::handleChunk, this,
+                  boost::asio::placeholders::error,
+                  boost::asio::placeholders::bytes_transferred));
+}
+
+template<class PointT>
+void CloudStreamSource<PointT>::handleChunk(
+    boost::system::error_code const& error,
+    size_t bytes) {
+  if (error) {
+    LERROR << "CloudStreamSource: Unable to receive: " << error.message();
+    return;
+  }
+  if (assembler_.add(&datagram_[0], bytes)) {
+    std::vector<char> const& message = assembler_.message();
+    CloudStreamHeader header;
+    if (message.size() >= sizeof header) {
+      memcpy(&header, &message[0], sizeof header);
+    }
+    if (message.size() >= sizeof header &&
+        header.magic == CLOUD_STREAM_MAGIC &&
+        header.size == message.size() - sizeof header) {
+      payload_.assign(message.begin() + sizeof header, message.end());
+      emit(header);
+    } else {
+      LWARNING << "CloudStreamSource: Dropping a malformed message";
+    }
+  }
+  receiveChunk();
+}
+
+template<class PointT>
+typename CloudStreamSource<PointT>::CloudPtr
+CloudStreamSource<PointT>::nextCloud() {
+  size_t const sz = clouds_.size();
+  for (size_t i = 0; i < sz; ++i) {
+    if (clouds_[i].unique()) return clouds_[i];
+  }
+  CloudPtr cloud(new pcl::PointCloud<PointT>());
+  clouds_.push_back(cloud);
+  return cloud;
+}
+
+template<class PointT>
+void CloudStreamSource<PointT>::emit(CloudStreamHeader const& header) {
+  CloudPtr cloud(nextCloud());
+  if (!decodeSessionCloud(header.type, payload_, *cloud)) {
+    LWARNING << "CloudStreamSource: Dropping a malformed cloud";
+    return;
+  }
+  // Gaps in the sequence are the clouds that were lost on the way (or by a
+  // publisher that restarted).
+  if (has_seq_ && header.seq > next_seq_) {
+    missed_.fetch_add(header.seq - next_seq_, boost::memory_order_relaxed);
+  }
+  next_seq_ = header.seq + 1;
+  has_seq_ = true;
+  received_.fetch_add(1, boost::memory_order_relaxed);
+  this->setNextFrame(cloud);
+}
+
+#endif
@@ -0,0 +1,1100 @@
+#ifndef LOLA_CONTEXT_H__
+#define LOLA_CONTEXT_H__
+
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <sstream>
+#include <map>
+
+#include <pcl/io/openni2_grabber.h>
+#include <pcl/io/pcd_grabber.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include "lepp2/BaseObstacleDetector.hpp"
+#include "lepp2/DepthStreamSource.hpp"
+#include "lepp2/GrabberVideoSource.hpp"
+#include "lepp2/BaseVideoSource.hpp"
+#include "lepp2/VideoObserver.hpp"
+#include "lepp2/FilteredVideoSource.hpp"
+#include "lepp2/FrameLogVideoSource.hpp"
+#include "lepp2/FusionVideoSource.hpp"
+#include "lepp2/PcdSequenceVideoSource.hpp"
+#include "lepp2/SmoothObstacleAggregator.hpp"
+#include "lepp2/SplitApproximator.hpp"
+#include "lepp2/SyntheticVideoSource.hpp"
+#include "lepp2/debug/trace.hpp"
+
+#include "lepp2/visualization/EchoObserver.hpp"
+#include "lepp2/visualization/ObstacleVisualizer.hpp"
+
+#include "lepp2/filter/RigidTransformFilter.hpp"
+#include "lepp2/filter/TruncateFilter.hpp"
+#include "lepp2/filter/SensorCalibrationFilter.hpp"
+
+#include "lola/CloudStreamPublisher.hpp"
+#include "lola/CloudStreamSource.hpp"
+#include "lola/OdoCoordinateTransformer.hpp"
+#include "lola/Splitters.hpp"
+#include "lola/LolaAggregator.h"
+#include "lola/MetricsServer.h"
+#include "lola/MotionGate.h"
+#include "lola/NetworkReactor.h"
+#include "lola/PoseService.h"
+#include "lola/ReplayVideoSource.hpp"
+#include "lola/RobotService.h"
+#include "lola/SelfOcclusionFilter.hpp"
+#include "lola/SessionRecorder.hpp"
+#include "lola/TelemetryPublisher.hpp"
+
+#include "deps/easylogging++.h"
+
+// The containers that put together the vision pipeline of LOLA.
+//
+// Like some of the lepp2 headers that it includes, this header defines
+// functions that are not inline, so it can only be included by a single
+// translation unit of any executable.
+
+/**
+ * An ABC that represents the context of the execution. Essentially, it is a
+ * container for all parts of the robot's vision pipeline. The parts are
+ * exposed via public accessor methods.
+ *
+ * The ABC provides convenience methods for building up the context so that
+ * different concrete implementations can be provided in a simple and
+ * straightforward manner.
+ */
+template<class PointT>
+class Context {
+public:
+  /// VideoSource-related accessors
+  boost::shared_ptr<VideoSource<PointT> > raw_source() { return raw_source_; }
+  boost::shared_ptr<FilteredVideoSource<PointT> > filtered_source() { return filtered_source_; }
+  boost::shared_ptr<VideoSource<PointT> > source() {
+    if (filtered_source_) {
+      return filtered_source_;
+    } else {
+      return raw_source_;
+    }
+  }
+
+  /// Robot-related accessors
+  boost::shared_ptr<NetworkReactor> reactor() { return reactor_; }
+  boost::shared_ptr<Robot> robot() { return robot_; }
+  boost::shared_ptr<PoseService> pose_service() { return pose_service_; }
+  boost::shared_ptr<RobotService> robot_service() { return robot_service_; }
+
+  /// The obstacle detector accessor
+  boost::shared_ptr<IObstacleDetector> detector() { return detector_; }
+
+  /**
+   * Stops the video source and then all network communication with the
+   * robot. Once the method returns, no frames are delivered to the pipeline
+   * anymore and none of the network components is used by any background
+   * thread, so the context can safely be destroyed.
+   */
+  void shutdown() {
+    if (raw_source_) raw_source_->close();
+    if (reactor_) {
+      reactor_->stop();
+      reactor_->join();
+    }
+  }
+
+protected:
+  /**
+   * A template method for performing the initialization of a Context.
+   *
+   * The concrete implementations that opt into using this helper only need to
+   * provide implementations of methods that initialize some parts of the
+   * context, rather than worrying about all of them. It is still possible to
+   * perform completely custom initialization by avoiding the use of this
+   * convenience method.
+   */
+  void init() {
+    // Prepare all the robot parts
+    buildRobot();
+    // Now get our video source ready...
+    initRawSource();
+    // ...along with any possible filters
+    buildFilteredSource();
+    // Initialize the obstacle detector
+    initDetector();
+
+    // Attach additional video source observers...
+    addObservers();
+    // ...and additional obstacle processors.
+    addAggregators();
+
+    // Finally, optionally visualize everything in a local GUI
+    initVisualizer();
+  }
+
+  /// Robot initialization
+  virtual void buildRobot() {
+    initNetworkReactor();
+    initPoseService();
+    initVisionService();
+    initRobot();
+  }
+  /**
+   * Initialize (and start) the `NetworkReactor` that runs the I/O of all
+   * network components. Must set the `reactor_` member.
+   * The default implementation uses a single, unpinned thread.
+   */
+  virtual void initNetworkReactor() {
+    reactor_.reset(new NetworkReactor);
+    reactor_->start();
+  }
+  /// Initialize the PoseService. Must set the `pose_service_` member.
+  virtual void initPoseService() = 0;
+  /// Initialize the `RobotService`. Must set the `robot_service_` member.
+  virtual void initVisionService() = 0;
+  /**
+   * Initialize the `Robot`. Must se the `robot_` member.
+   * A default implementation pieces a default robot together based on the
+   * previously created `PoseService` and `RobotService`.
+   */
+  virtual void initRobot() {
+    robot_.reset(new Robot(*pose_service(), 1.44));
+  }
+
+  /// Video source initialization
+  /// Initialize a raw video source. Must set the `raw_source_` member.
+  virtual void initRawSource() = 0;
+  /**
+   * A template method for building up a filtered video source. First
+   * initializes a new filtered video source and then attaches a number of
+   * point-wise filters to it.
+   */
+  virtual void buildFilteredSource() {
+    // First create the basic filtered video source instance...
+    initFilteredVideoSource();
+    // Now set the point filters that should be used.
+    addFilters();
+  }
+
+  /// Initialize a `FilteredVideoSource`. Must set the `filtered_source_` member.
+  virtual void initFilteredVideoSource() = 0;
+  /**
+   * Add point-wise filters to the `filtered_source_`.
+   * The default implementation does not add any pointwise filters.
+   */
+  virtual void addFilters() {}
+
+  /// Obstacle detector initialization
+
+  /// Returns a simple approximator instance: will be used to approximate parts
+  /// of objects.
+  virtual boost::shared_ptr<ObjectApproximator<PointT> > getApproximator() {
+    return boost::shared_ptr<ObjectApproximator<PointT> >(
+        new MomentOfInertiaObjectApproximator<PointT>);
+  }
+  /// Builds a `SplitStrategy` instance that the approximator will use for
+  /// deciding which objects to split.
+  virtual boost::shared_ptr<SplitStrategy<PointT> > buildSplitStrategy() {
+    boost::shared_ptr<CompositeSplitStrategy<PointT> > strat(
+        new CompositeSplitStrategy<PointT>);
+    strat->addSplitCondition(boost::shared_ptr<SplitCondition<PointT> >(
+        new DepthLimitSplitCondition<PointT>(1)));
+
+    return strat;
+  }
+
+  /// Initialize the `ObstacleDetector`. Must set the `detector_` member.
+  virtual void initDetector() = 0;
+
+  /// Provide hooks for adding more observers and aggregators.
+  /// By default no extra observers or aggregators are added.
+  virtual void addObservers() {}
+  virtual void addAggregators() {}
+
+  /// A hook for conveniently adding a visualizer, if required.
+  /// Provides a default implementation that does not initialize any local
+  /// visualization.
+  virtual void initVisualizer() {}
+
+protected:
+  /// The members are exposed directly to concrete implementations for
+  /// convenience.
+  boost::shared_ptr<VideoSource<PointT> > raw_source_;
+  boost::shared_ptr<FilteredVideoSource<PointT> > filtered_source_;
+
+  boost::shared_ptr<NetworkReactor> reactor_;
+  boost::shared_ptr<PoseService> pose_service_;
+  boost::shared_ptr<RobotService> robot_service_;
+  boost::shared_ptr<Robot> robot_;
+
+  boost::shared_ptr<IObstacleDetector> detector_;
+
+  boost::shared_ptr<ObstacleVisualizer<PointT> > visualizer_;
+};
+
+/**
+ * A `Context` implementation that reads the configuration from a config file
+ * (given as a parameter at construct time).
+ *
+ * A headless context builds the same pipeline without any of its outputs: it
+ * neither opens a visualizer nor talks to the robot or the viewers, i.e. the
+ * `PoseService` is not started (it can still be fed by a `replay` source),
+ * there is no `RobotService` and the aggregators are skipped. Nothing is
+ * recorded, streamed, traced or served either. This allows the pipeline to be
+ * run offline, e.g. for benchmarking, without any I/O in its timings.
+ */
+template<class PointT>
+class FileConfigContext : public Context<PointT> {
+public:
+  /**
+   * Create a new `FileConfigContext` that will read its configuration from the
+   * given config file.
+   *
+   * If the file cannot be opened, there is an error parsing it, or one of the
+   * components is misconfigured, the constructor will throw.
+   */
+  FileConfigContext(std::string const& file_name, bool headless = false)
+      : file_name_(file_name),
+        fin_(file_name.c_str()),
+        curr_line_(0),
+        headless_(headless),
+        replay_poses_(false) {
+    if (!fin_.is_open()) {
+      throw "Unable to open the config file";
+    }
+    // Now read in the whole file...
+    readConfigFile();
+
+    this->init();
+  }
+
+  /**
+   * The detector to which the video source is attached (which, unlike the
+   * smoothed-out `detector`, is given every frame).
+   */
+  boost::shared_ptr<BaseObstacleDetector<PointT> > base_detector() {
+    return base_detector_;
+  }
+protected:
+  void initRobot() {
+    expectLine("[Robot]");
+    double bubble_size = expectKey<double>("bubble_size");
+    this->robot_.reset(new Robot(*this->pose_service(), bubble_size));
+  }
+
+  /// Implementations of initialization of various parts of the pipeline.
+  void initRawSource() {
+    expectLine("[VideoSource]");
+    std::string const type = expectKey<std::string>("type");
+    if (type == "fusion") {
+      this->raw_source_ = getFusionSource();
+    } else {
+      this->raw_source_ = getSource(type);
+    }
+  }
+
+  void initFilteredVideoSource() {
+    expectLine("[FilteredVideoSource]");
+    std::string type = expectKey<std::string>("type");
+
+    if (type == "simple") {
+      this->filtered_source_.reset(
+          new SimpleFilteredVideoSource<PointT>(this->raw_source_));
+    } else if (type == "prob") {
+      this->filtered_source_.reset(
+          new ProbFilteredVideoSource<PointT>(this->raw_source_));
+    } else if (type == "pt1") {
+      this->filtered_source_.reset(
+          new Pt1FilteredVideoSource<PointT>(this->raw_source_));
+    } else {
+      throw "Invalid FilteredVideoSource configuration";
+    }
+  }
+
+  void addFilters() {
+    bool self_occlusion = false;
+    while (nextLineMatches("[[FilteredVideoSource.filters]]")) {
+      addNextFilter(*this->filtered_source_, true, self_occlusion);
+    }
+    returnToPreviousLine();
+
+    // The gate is optional; without it, all frames are processed in full.
+    if (nextLineMatches("[FilteredVideoSource.MotionGate]")) {
+      double downgrade_rate = 0.5;
+      double skip_rate = 1.5;
+      double stance_window = 100;
+      optionalKey("downgrade_rate", downgrade_rate);
+      optionalKey("skip_rate", skip_rate);
+      optionalKey("stance_window", stance_window);
+      this->filtered_source_->setGate(boost::shared_ptr<FrameGate>(
+          new MotionGate(
+            this->pose_service_,
+            downgrade_rate,
+            skip_rate,
+            static_cast<uint64_t>(stance_window * 1000))));
+    } else {
+      returnToPreviousLine();
+    }
+  }
+
+  void initNetworkReactor() {
+    // The section is optional; without it, the defaults are used.
+    size_t threads = 1;
+    std::vector<int> cpus;
+    if (nextLineMatches("[NetworkReactor]")) {
+      threads = expectKey<size_t>("threads");
+      // A comma-separated list of the CPUs to which the threads are pinned.
+      if (nextKeyMatches("cpus")) {
+        std::vector<std::string> parts;
+        std::string const list = expectKey<std::string>("cpus");
+        boost::algorithm::split(parts, list, boost::algorithm::is_any_of(","));
+        for (size_t i = 0; i < parts.size(); ++i) {
+          cpus.push_back(atoi(parts[i].c_str()));
+        }
+      }
+    } else {
+      returnToPreviousLine();
+    }
+
+    this->reactor_.reset(new NetworkReactor(threads, cpus));
+    this->reactor_->start();
+  }
+
+  void initPoseService() {
+    expectLine("[PoseService]");
+    std::string ip = expectKey<std::string>("ip");
+    int port = expectKey<int>("port");
+    // In replay mode, the poses come from the replayed session log instead of
+    // the network.
+    if (nextKeyMatches("replay")) {
+      replay_poses_ = expectKey<std::string>("replay") == "true";
+    }
+
+    this->pose_service_.reset(
+        new PoseService(this->reactor_->io_service(), ip, port));
+    if (!replay_poses_ && !headless_) {
+      this->pose_service_->start();
+    }
+  }
+
+  void initVisionService() {
+    expectLine("[RobotService]");
+    std::string ip = expectKey<std::string>("ip");
+    int port = expectKey<int>("port");
+    int delay = expectKey<int>("delay");
+    if (headless_) return;
+
+    boost::shared_ptr<AsyncRobotService> async_robot_service(
+        new AsyncRobotService(this->reactor_->io_service(), ip, port, delay));
+    async_robot_service->start();
+    this->robot_service_ = async_robot_service;
+  }
+
+  virtual boost::shared_ptr<SplitStrategy<PointT> > buildSplitStrategy() {
+    expectLine("[SplitStrategy]");
+    boost::shared_ptr<CompositeSplitStrategy<PointT> > split_strat(
+        new CompositeSplitStrategy<PointT>);
+
+    // First find the axis on which the splits should be made
+    std::string axis_id = expectKey<std::string>("split_axis");
+    if (axis_id == "largest") {
+      split_strat->set_split_axis(SplitStrategy<PointT>::Largest);
+    } else if (axis_id == "middle") {
+      split_strat->set_split_axis(SplitStrategy<PointT>::Middle);
+    } else if (axis_id == "smallest") {
+      split_strat->set_split_axis(SplitStrategy<PointT>::Smallest);
+    } else {
+      throw "Invalid axis identifier";
+    }
+
+    // Now add all conditions
+    while (nextLineMatches("[[SplitStrategy.conditions]]")) {
+      std::string type = expectKey<std::string>("type");
+      if (type == "SizeLimit") {
+        double size = expectKey<int>("size");
+        split_strat->addSplitCondition(boost::shared_ptr<SplitCondition<PointT> >(
+              new SizeLimitSplitCondition<PointT>(size)));
+      } else if (type == "DepthLimit") {
+        int depth = expectKey<int>("depth");
+        split_strat->addSplitCondition(boost::shared_ptr<SplitCondition<PointT> >(
+              new DepthLimitSplitCondition<PointT>(depth)));
+      } else if (type == "DistanceThreshold") {
+        int distance = expectKey<int>("distance_threshold");
+        split_strat->addSplitCondition(boost::shared_ptr<SplitCondition<PointT> >(
+              new DistanceThresholdSplitCondition<PointT>(distance, *this->robot())));
+      } else if (type == "ShapeCondition") {
+        double sphere1 = expectKey<double>("sphere1");
+        double sphere2 = expectKey<double>("sphere2");
+        double cylinder = expectKey<double>("cylinder");
+        split_strat->addSplitCondition(boost::shared_ptr<SplitCondition<PointT> >(
+              new ShapeSplitCondition<PointT>(sphere1, sphere2, cylinder)));
+      } else {
+        throw "Unknown split condition given.";
+      }
+    }
+    returnToPreviousLine();
+
+    return split_strat;
+  }
+
+  void initDetector() {
+    // Prepare the approximator that the detector is to use.
+    // First, the simple approximator...
+    boost::shared_ptr<ObjectApproximator<PointT> > simple_approx(
+        this->getApproximator());
+    // ...then the split strategy
+    boost::shared_ptr<SplitStrategy<PointT> > splitter(
+        this->buildSplitStrategy());
+    // ...finally, wrap those into a `SplitObjectApproximator` that is given
+    // to the detector.
+    boost::shared_ptr<ObjectApproximator<PointT> > approx(
+        new SplitObjectApproximator<PointT>(simple_approx, splitter));
+    // Prepare the base detector...
+    base_detector_.reset(new BaseObstacleDetector<PointT>(approx));
+    this->source()->attachObserver(base_detector_);
+    // Smooth out the basic detector by applying a smooth detector to it
+    boost::shared_ptr<SmoothObstacleAggregator> smooth_detector(
+        new SmoothObstacleAggregator);
+    base_detector_->attachObstacleAggregator(smooth_detector);
+    // Now the detector that is exposed via the context is a smoothed-out
+    // base detector.
+    this->detector_ = smooth_detector;
+  }
+
+  void addObservers() {
+    // The section is optional; without it, nothing is recorded.
+    if (nextLineMatches("[Recorder]")) {
+      std::string const file_path = expectKey<std::string>("file_path");
+      // The clouds are quantized to the given resolution (in meters) when it
+      // is given, and recorded at full precision otherwise.
+      float resolution = 0;
+      if (nextKeyMatches("resolution")) {
+        resolution = expectKey<float>("resolution");
+      }
+      if (!headless_) {
+        recorder_.reset(new SessionRecorder<PointT>(file_path, resolution));
+        // Record the raw clouds, before any filtering, along with the poses.
+        this->raw_source_->attachObserver(recorder_);
+        this->pose_service_->attachObserver(recorder_);
+      }
+    } else {
+      returnToPreviousLine();
+    }
+    // Also optional; streams the raw clouds to another computer.
+    if (nextLineMatches("[CloudStream]")) {
+      std::string const ip = expectKey<std::string>("ip");
+      int const port = expectKey<int>("port");
+      std::string transport = "tcp";
+      float resolution = 0;
+      optionalKey("transport", transport);
+      optionalKey("resolution", resolution);
+      if (!headless_) {
+        cloud_stream_.reset(new CloudStreamPublisher<PointT>(
+              ip, port, getTransport(transport), resolution));
+        this->raw_source_->attachObserver(cloud_stream_);
+      }
+    } else {
+      returnToPreviousLine();
+    }
+    // Also optional; streams a live view of the pipeline to a remote viewer.
+    if (nextLineMatches("[Telemetry]")) {
+      TelemetryTransport transport = TELEMETRY_UDP;
+      std::string address;
+      int port = 0;
+      if (nextKeyMatches("socket")) {
+        transport = TELEMETRY_LOCAL;
+        address = expectKey<std::string>("socket");
+      } else {
+        address = expectKey<std::string>("ip");
+        port = expectKey<int>("port");
+      }
+      double rate = 5;
+      double voxel_size = 0.02;
+      float resolution = 0.005;
+      optionalKey("rate", rate);
+      optionalKey("voxel_size", voxel_size);
+      optionalKey("resolution", resolution);
+      if (!headless_) {
+        telemetry_.reset(new TelemetryPublisher<PointT>(
+              transport, address, port, rate, voxel_size, resolution,
+              *this->filtered_source_, *base_detector_));
+        // Attached after the detector, so the obstacles of each frame are in
+        // by the time the frame reaches the publisher.
+        this->detector_->attachObstacleAggregator(telemetry_);
+        this->source()->attachObserver(telemetry_);
+      }
+    } else {
+      returnToPreviousLine();
+    }
+    // Also optional; serves the metrics of the process to local scrapers.
+    if (nextLineMatches("[Metrics]")) {
+      if (nextKeyMatches("socket")) {
+        std::string const socket_path = expectKey<std::string>("socket");
+        if (!headless_) metrics_server_.reset(new MetricsServer(socket_path));
+      } else {
+        int const port = expectKey<int>("port");
+        if (!headless_) metrics_server_.reset(new MetricsServer(port));
+      }
+    } else {
+      returnToPreviousLine();
+    }
+    // Also optional; where the trace sessions (toggled by SIGUSR1) go and
+    // whether one is already started along with the pipeline.
+    if (nextLineMatches("[Trace]")) {
+      std::string file_path;
+      std::string enabled = "false";
+      optionalKey("file_path", file_path);
+      optionalKey("enabled", enabled);
+      if (enabled != "true" && enabled != "false") {
+        throw "Trace: enabled must be either true or false";
+      }
+      if (!headless_) {
+        if (!file_path.empty()) Tracer::global().setFilePath(file_path);
+        if (enabled == "true") Tracer::global().start();
+      }
+    } else {
+      returnToPreviousLine();
+    }
+  }
+
+  void addAggregators() {
+    while (nextLineMatches("[[aggregators]]")) {
+      if (headless_) {
+        skipKeys();
+        continue;
+      }
+      this->detector_->attachObstacleAggregator(getNextAggregator());
+    }
+
+    returnToPreviousLine();
+  }
+
+  void initVisualizer() {
+    expectLine("[Visualization]");
+    std::string enabled = expectKey<std::string>("enabled");
+    bool visualization = enabled == "true";
+    double max_rate = 10;
+    double voxel_size = 0;
+    optionalKey("max_rate", max_rate);
+    optionalKey("voxel_size", voxel_size);
+    if (visualization && !headless_) {
+      this->visualizer_.reset(
+          new ObstacleVisualizer<PointT>(max_rate, voxel_size));
+      // Attach the visualizer to both the point cloud source...
+      this->source()->attachObserver(this->visualizer_);
+      // ...as well as to the obstacle detector
+      this->detector_->attachObstacleAggregator(this->visualizer_);
+    }
+  }
+private:
+  /// Helper functions for constructing parts of the pipeline.
+  /**
+   * A helper function that adds the next `PointFilter`, as defined in the
+   * following lines of the config file, to the given source's chain.
+   * `self_occlusion` tracks whether the chain already has a
+   * `SelfOcclusionFilter`: it needs the points in the ODO coordinate system,
+   * so an exception is thrown if a `RobotOdoTransformer` follows it.
+   */
+  void addNextFilter(
+      FilteredVideoSource<PointT>& source,
+      bool sets_frame_time,
+      bool& self_occlusion) {
+    boost::shared_ptr<PointFilter<PointT> > filter(getNextFilter(sets_frame_time));
+    if (dynamic_cast<SelfOcclusionFilter<PointT>*>(filter.get())) {
+      self_occlusion = true;
+    } else if (self_occlusion &&
+               dynamic_cast<RobotOdoTransformer<PointT>*>(filter.get())) {
+      throw "The SelfOcclusionFilter needs to come after the RobotOdoTransformer";
+    }
+    source.addFilter(filter);
+  }
+  /**
+   * A helper function that constructs the next `PointFilter` instance,
+   * as defined in the following lines of the config file.
+   * If the lines are invalid, an exception is thrown.
+   */
+  boost::shared_ptr<PointFilter<PointT> > getNextFilter(
+      bool sets_frame_time = true) {
+    std::string const type = expectKey<std::string>("type");
+    if (type == "SensorCalibrationFilter") {
+      double a = expectKey<double>("a");
+      double b = expectKey<double>("b");
+      return boost::shared_ptr<PointFilter<PointT> >(
+          new SensorCalibrationFilter<PointT>(a, b));
+    } else if (type == "RobotOdoTransformer") {
+      return boost::shared_ptr<PointFilter<PointT> >(
+          new RobotOdoTransformer<PointT>(this->pose_service_, sets_frame_time));
+    } else if (type == "TruncateFilter") {
+      int decimals = expectKey<int>("decimal_points");
+      return boost::shared_ptr<PointFilter<PointT> >(
+          new TruncateFilter<PointT>(decimals));
+    } else if (type == "RigidTransformFilter") {
+      double x = expectKey<double>("x");
+      double y = expectKey<double>("y");
+      double z = expectKey<double>("z");
+      double roll = expectKey<double>("roll");
+      double pitch = expectKey<double>("pitch");
+      double yaw = expectKey<double>("yaw");
+      return boost::shared_ptr<PointFilter<PointT> >(
+          new RigidTransformFilter<PointT>(x, y, z, roll, pitch, yaw));
+    } else if (type == "SelfOcclusionFilter") {
+      double margin = 0.03;
+      optionalKey("margin", margin);
+      return boost::shared_ptr<PointFilter<PointT> >(
+          new SelfOcclusionFilter<PointT>(this->pose_service_, margin));
+    } else {
+      std::cerr << "Unknown filter type `" << type << "`" << std::endl;
+      throw "Unknown filter type";
+    }
+  }
+
+  /**
+   * A helper function that constructs the raw source of the given type, as
+   * defined in the following lines of the config file.
+   * If the lines are invalid, an exception is thrown.
+   */
+  boost::shared_ptr<VideoSource<PointT> > getSource(std::string const& type) {
+    if (type == "stream") {
+      std::string mode = "qvga_30";
+      optionalKey("mode", mode);
+      boost::shared_ptr<LiveStreamSource<PointT> > source(
+          new LiveStreamSource<PointT>(openNIMode<pcl::OpenNIGrabber>(mode)));
+      boost::shared_ptr<AdaptiveStride> controller(getStrideController());
+      if (controller) source->setStrideController(controller);
+      return source;
+    } else if (type == "depth_stream") {
+      std::string file_path;
+      std::string mode = "qvga_30";
+      double a = 1;
+      double b = 0;
+      double min_depth = 0;
+      double max_depth = 10;
+      optionalKey("file_path", file_path);
+      optionalKey("mode", mode);
+      optionalKey("a", a);
+      optionalKey("b", b);
+      optionalKey("min_depth", min_depth);
+      optionalKey("max_depth", max_depth);
+      boost::shared_ptr<DepthStreamSource<PointT> > source(
+          new DepthStreamSource<PointT>(
+            file_path,
+            openNIMode<pcl::io::OpenNI2Grabber>(mode),
+            a, b,
+            min_depth, max_depth));
+      boost::shared_ptr<AdaptiveStride> controller(getStrideController());
+      if (controller) source->setStrideController(controller);
+      return source;
+    } else if (type == "pcd") {
+      std::string file_path = expectKey<std::string>("file_path");
+      boost::shared_ptr<pcl::Grabber> interface(new pcl::PCDGrabber<PointT>(
+            file_path,
+            20.,
+            true));
+      return boost::shared_ptr<VideoSource<PointT> >(
+          new GeneralGrabberVideoSource<PointT>(interface));
+    } else if (type == "oni") {
+      std::string file_path = expectKey<std::string>("file_path");
+      boost::shared_ptr<pcl::Grabber> interface(new pcl::io::OpenNI2Grabber(
+            file_path,
+            pcl::io::OpenNI2Grabber::OpenNI_Default_Mode,
+            pcl::io::OpenNI2Grabber::OpenNI_Default_Mode));
+      return boost::shared_ptr<VideoSource<PointT> >(
+          new GeneralGrabberVideoSource<PointT>(interface));
+    } else if (type == "pcd_sequence") {
+      std::string file_path = expectKey<std::string>("file_path");
+      size_t threads = 2;
+      if (nextKeyMatches("threads")) {
+        threads = expectKey<size_t>("threads");
+      }
+      FramePacer::Pace const pace = getPace();
+      double frame_rate = 0;
+      if (nextKeyMatches("frame_rate")) {
+        frame_rate = expectKey<double>("frame_rate");
+      }
+      return boost::shared_ptr<VideoSource<PointT> >(
+          new PcdSequenceVideoSource<PointT>(
+            PcdSequenceVideoSource<PointT>::findFiles(file_path),
+            threads,
+            pace,
+            frame_rate));
+    } else if (type == "framelog") {
+      std::string file_path = expectKey<std::string>("file_path");
+      FramePacer::Pace const pace = getPace();
+      return boost::shared_ptr<VideoSource<PointT> >(
+          new FrameLogVideoSource<PointT>(file_path, pace));
+    } else if (type == "replay") {
+      std::string file_path = expectKey<std::string>("file_path");
+      FramePacer::Pace const pace = getPace();
+      // The recorded poses can only be fed to a service that is not receiving
+      // any of its own.
+      boost::shared_ptr<PoseService> pose_service;
+      if (replay_poses_) {
+        pose_service = this->pose_service_;
+      } else {
+        LWARNING << "FileConfig: The PoseService is not in replay mode; "
+                 << "the recorded poses are not replayed";
+      }
+      return boost::shared_ptr<VideoSource<PointT> >(
+          new ReplayVideoSource<PointT>(file_path, pose_service, pace));
+    } else if (type == "synthetic") {
+      SyntheticScene scene;
+      optionalKey("width", scene.width);
+      optionalKey("height", scene.height);
+      optionalKey("frame_rate", scene.frame_rate);
+      optionalKey("frames", scene.frames);
+      optionalKey("room_width", scene.room_width);
+      optionalKey("room_depth", scene.room_depth);
+      optionalKey("camera_height", scene.camera_height);
+      optionalKey("boxes", scene.boxes);
+      optionalKey("cylinders", scene.cylinders);
+      optionalKey("spheres", scene.spheres);
+      optionalKey("moving", scene.moving);
+      optionalKey("noise", scene.noise);
+      optionalKey("dropout", scene.dropout);
+      optionalKey("max_range", scene.max_range);
+      optionalKey("seed", scene.seed);
+      FramePacer::Pace const pace = getPace();
+      return boost::shared_ptr<VideoSource<PointT> >(
+          new SyntheticVideoSource<PointT>(scene, pace));
+    } else if (type == "cloud_stream") {
+      int const port = expectKey<int>("port");
+      std::string transport = "tcp";
+      optionalKey("transport", transport);
+      boost::shared_ptr<VideoSource<PointT> > source(
+          new CloudStreamSource<PointT>(port, getTransport(transport)));
+      return source;
+    } else {
+      throw "Invalid VideoSource configuration";
+    }
+  }
+
+  /**
+   * Returns the transport of a cloud stream with the given name.
+   */
+  CloudStreamTransport getTransport(std::string const& name) {
+    if (name == "tcp") return CLOUD_STREAM_TCP;
+    if (name == "udp") return CLOUD_STREAM_UDP;
+    throw "Invalid cloud stream transport";
+  }
+
+  /**
+   * A helper function that constructs a source fusing the frames of several
+   * sensors, each given as a `[[VideoSource.sensors]]` section (the same as a
+   * `[VideoSource]` section) followed by the point-wise filters (typically
+   * the calibration and the transformation into the ODO coordinate system)
+   * that are applied to its frames, on its own thread, before they are fused.
+   */
+  boost::shared_ptr<VideoSource<PointT> > getFusionSource() {
+    double max_skew = 20;
+    double timeout = 500;
+    optionalKey("max_skew", max_skew);
+    optionalKey("timeout", timeout);
+    boost::shared_ptr<FusionVideoSource<PointT> > fusion(
+        new FusionVideoSource<PointT>(
+          static_cast<uint64_t>(max_skew * 1000),
+          static_cast<uint64_t>(timeout * 1000)));
+
+    size_t sensors = 0;
+    while (nextLineMatches("[[VideoSource.sensors]]")) {
+      std::string const type = expectKey<std::string>("type");
+      std::ostringstream name;
+      name << "sensor" << sensors;
+      boost::shared_ptr<FilteredVideoSource<PointT> > sensor(
+          new SimpleFilteredVideoSource<PointT>(getSource(type), name.str()));
+      bool self_occlusion = false;
+      while (nextLineMatches("[[VideoSource.sensors.filters]]")) {
+        // The sensors are filtered concurrently, so their transformers cannot
+        // share the frame time of the `PoseService`...
+        addNextFilter(*sensor, false, self_occlusion);
+      }
+      returnToPreviousLine();
+      fusion->addSource(sensor);
+      ++sensors;
+    }
+    returnToPreviousLine();
+    if (sensors == 0) {
+      throw "The fusion VideoSource requires at least one sensor";
+    }
+
+    // ...which is instead set to the capture time of the fused frames.
+    fusion->attachObserver(boost::shared_ptr<VideoObserver<PointT> >(
+        new PoseFrameClock<PointT>(this->pose_service_)));
+    return fusion;
+  }
+
+  /**
+   * A helper function that reads the optional `budget` (the time that the
+   * pipeline may take per frame, in milliseconds) and `max_stride` keys of the
+   * live sources. Returns a controller decimating the frames to keep within
+   * the budget if one is given, a null pointer otherwise.
+   */
+  boost::shared_ptr<AdaptiveStride> getStrideController() {
+    double budget = 0;
+    size_t max_stride = 4;
+    optionalKey("budget", budget);
+    optionalKey("max_stride", max_stride);
+    if (budget <= 0) return boost::shared_ptr<AdaptiveStride>();
+    return boost::shared_ptr<AdaptiveStride>(new AdaptiveStride(
+          static_cast<uint64_t>(budget * 1000), max_stride));
+  }
+
+  /**
+   * A helper function that reads the optional `pace` key of the sources that
+   * replay recordings.
+   */
+  FramePacer::Pace getPace() {
+    if (!nextKeyMatches("pace")) return FramePacer::ORIGINAL;
+    std::string const pace = expectKey<std::string>("pace");
+    if (pace == "original") {
+      return FramePacer::ORIGINAL;
+    } else if (pace == "fast") {
+      return FramePacer::FAST;
+    } else {
+      throw "Invalid replay pace";
+    }
+  }
+
+  /**
+   * A helper function that constructs the next `ObstacleAggregator` instance,
+   * as defined in the following lines of the config file.
+   * If the lines are invalid, an exception is thrown.
+   */
+  boost::shared_ptr<ObstacleAggregator> getNextAggregator() {
+    std::string const type = expectKey<std::string>("type");
+    if (type == "LolaAggregator") {
+      std::string const ip = expectKey<std::string>("ip");
+      int const port = expectKey<int>("port");
+
+      boost::shared_ptr<LolaAggregator> lola_viewer(
+          new LolaAggregator(this->reactor_->io_service(), ip, port));
+      // Any further `ip`/`port` pairs are additional viewers that are sent the
+      // same (once serialized) scene.
+      while (nextKeyMatches("ip")) {
+        std::string const ip = expectKey<std::string>("ip");
+        int const port = expectKey<int>("port");
+        lola_viewer->addEndpoint(ip, port);
+      }
+      // The TTL only matters for multicast groups.
+      if (nextKeyMatches("multicast_ttl")) {
+        lola_viewer->setMulticastTtl(expectKey<int>("multicast_ttl"));
+      }
+      return lola_viewer;
+    } else if (type == "RobotAggregator") {
+      int const frame_rate = expectKey<int>("frame_rate");
+
+      return boost::shared_ptr<RobotAggregator>(
+          new RobotAggregator(*this->robot_service(), frame_rate, *this->robot()));
+    } else {
+      std::cerr << "Unknown aggregator type `" << type << "`" << std::endl;
+      throw "Unknown aggregator type";
+    }
+  }
+
+  /// Helper functions for parsing the config file
+  /**
+   * Reads in the entire config file and places the sanitized lines ito the
+   * `lines_` vector.
+   */
+  void readConfigFile() {
+    while (!fin_.eof()) {
+      lines_.push_back(readNextLine());
+    }
+  }
+
+  /**
+   * Reads the next valid line from the config file.
+   *
+   * The method will never return comments or lines with leading/trailing white
+   * space -- if such lines are found in the input file they are either
+   * discarded or stripped of the whitespace.
+   */
+  std::string readNextLine() {
+    std::string line;
+    while (std::getline(fin_, line)) {
+      boost::algorithm::trim(line);
+      // Ignore empty lines
+      if (line.length() == 0) continue;
+      // Ignore "comments"
+      if (line[0] == '#') continue;
+      // If nothing else is satisfied, we've got a valid line ...
+      break;
+    }
+
+    return line;
+  }
+
+  /**
+   * Moves the parser's cursor to the previous line.
+   */
+  void returnToPreviousLine() {
+    if (curr_line_ == 0) {
+      throw "Cannot go back further in the file";
+    }
+    --curr_line_;
+  }
+
+  /**
+   * Returns the next line from the one at which the parser is currently found.
+   * Advances the current position of the cursor.
+   */
+  std::string const& getNextLine() {
+    if (curr_line_ == lines_.size()) {
+      throw "Not enough lines in config file";
+    }
+
+    return lines_[curr_line_++];
+  }
+
+  /**
+   * Checks whether the next line matches the given string. The line is
+   * considered a match iff the entire string matches *exactly*.
+   *
+   * Advances the parser's cursor.
+   */
+  bool nextLineMatches(std::string const& expect) {
+    std::string const& line = getNextLine();
+    return line == expect;
+  }
+
+  /**
+   * Checks whether the next line is a key-value pair with the given key.
+   *
+   * Does not move the parser's cursor.
+   */
+  bool nextKeyMatches(std::string const& expect) const {
+    if (curr_line_ == lines_.size()) return false;
+    std::istringstream iss(lines_[curr_line_]);
+    std::string key;
+    std::string eq;
+    iss >> key >> eq;
+    return key == expect && eq == "=";
+  }
+
+  /**
+   * Reads the value of the given key into `value` if the next line is a
+   * key-value pair with that key; otherwise, leaves `value` as it is.
+   */
+  template<class V>
+  void optionalKey(std::string const& key, V& value) {
+    if (nextKeyMatches(key)) value = expectKey<V>(key);
+  }
+
+  /**
+   * Moves the parser's cursor past all key-value pairs up to the next section.
+   */
+  void skipKeys() {
+    while (curr_line_ != lines_.size() &&
+           (lines_[curr_line_].empty() || lines_[curr_line_][0] != '[')) {
+      ++curr_line_;
+    }
+  }
+
+  /**
+   * Returns the current line. Does not move the parser's cursor.
+   */
+  std::string const& currentLine() const {
+    return lines_[curr_line_];
+  }
+
+  /**
+   * Reads the next line and makes sure that it matches the given string.
+   * If not, an exception is thrown.
+   */
+  void expectLine(std::string const& expect) {
+    if (!nextLineMatches(expect)) {
+      std::cerr << "FileConfig: Invalid config file: "
+                << "`" << expect << "` expected; "
+                << "`" << currentLine() << "` found."
+                << std::endl;
+      throw "Invalid config file";
+    }
+  }
+
+  /**
+   * Reads the next key-value pair and makes sure that the key matches the
+   * given key string.
+   * If not, an exception is thrown.
+   */
+  template<class V>
+  V expectKey(std::string const& key) {
+    std::pair<std::string, V> keyval = getKeyValue<std::string, V>();
+    if (keyval.first != key) {
+      std::cerr << "Expected key `" << key << "`; "
+                << "found `" << keyval.first << "`" << std::endl;
+      throw "Unexpected key";
+    }
+
+    return keyval.second;
+  }
+
+  /**
+   * Gets the key-value pair from the next line. If the next line is not a
+   * valid key-value pair, an exception is thrown.
+   *
+   * Advances the parser's cursor.
+   */
+  template<class K, class V>
+  std::pair<K, V> getKeyValue() {
+    std::string const& line = getNextLine();
+    K key;
+    V val;
+    std::istringstream iss(line);
+    std::string eq;
+    iss >> key >> eq >> val;
+
+    if (eq != "=") {
+      std::cerr << "Key-value pair expected, found `" << line << "`" << std::endl;
+      throw "Key-value expected";
+    }
+
+    return std::make_pair(key, val);
+  }
+
+  /// Private members
+  std::string const& file_name_;
+  std::ifstream fin_;
+  /**
+   * Contains all valid lines from the config file, i.e. comments are not found
+   * in this vector.
+   */
+  std::vector<std::string> lines_;
+
+  /**
+   * The line at which the parser is currently found.
+   */
+  size_t curr_line_;
+
+  /**
+   * Whether the pipeline is built without any of its outputs.
+   */
+  bool const headless_;
+  /**
+   * Whether the `PoseService` is fed the poses of a replayed session log.
+   */
+  bool replay_poses_;
+  /**
+   * Records the session, if configured.
+   */
+  boost::shared_ptr<SessionRecorder<PointT> > recorder_;
+  /**
+   * Streams the raw clouds to another computer, if configured.
+   */
+  boost::shared_ptr<CloudStreamPublisher<PointT> > cloud_stream_;
+  /**
+   * Streams a live view of the pipeline, if configured.
+   */
+  boost::shared_ptr<TelemetryPublisher<PointT> > telemetry_;
+  /**
+   * Serves the metrics of the process, if configured.
+   */
+  boost::shared_ptr<MetricsServer> metrics_server_;
+
+  /**
+   * The base detector that we attach to the video source and to which, in
+   * turn, the "smooth" detector is attached. The `Context` maintains a
+   * reference to it to make sure it doesn't get destroyed, although it is
+   * never exposed to any outside clients.
+   */
+  boost::shared_ptr<BaseObstacleDetector<PointT> > base_detector_;
+};
+
+#endif
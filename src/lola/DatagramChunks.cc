@@ -0,0 +1,91 @@
+#include "lola/DatagramChunks.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <sys/time.h>
+#include <unistd.h>
+
+size_t chunkCount(size_t size) {
+  return std::max<size_t>(1, (size + DATAGRAM_CHUNK_SIZE - 1) / DATAGRAM_CHUNK_SIZE);
+}
+
+uint32_t newChunkSession() {
+  timeval now;
+  gettimeofday(&now, NULL);
+  // Two publishers of the same process started within the same microsecond
+  // would still differ by the counter.
+  static uint32_t counter = 0;
+  return static_cast<uint32_t>(now.tv_sec) * 1000003u ^
+      static_cast<uint32_t>(now.tv_usec) ^
+      static_cast<uint32_t>(getpid()) << 16 ^
+      ++counter * 2654435761u;
+}
+
+void makeChunk(
+    uint32_t magic,
+    uint32_t session,
+    uint32_t seq,
+    std::vector<char> const& message,
+    size_t i,
+    std::vector<char>& datagram) {
+  size_t const offset = i * DATAGRAM_CHUNK_SIZE;
+  size_t const len = std::min(DATAGRAM_CHUNK_SIZE, message.size() - offset);
+  DatagramChunk chunk;
+  chunk.magic = magic;
+  chunk.session = session;
+  chunk.seq = seq;
+  chunk.index = i;
+  chunk.count = chunkCount(message.size());
+  datagram.resize(sizeof chunk + len);
+  memcpy(&datagram[0], &chunk, sizeof chunk);
+  if (len != 0) memcpy(&datagram[sizeof chunk], &message[offset], len);
+}
+
+ChunkAssembler::ChunkAssembler(uint32_t magic, size_t max_size)
+    : magic_(magic),
+      max_count_(chunkCount(max_size)),
+      session_(0),
+      seq_(0),
+      left_(0) {}
+
+bool ChunkAssembler::add(char const* datagram, size_t size) {
+  DatagramChunk chunk;
+  if (size < sizeof chunk) return false;
+  memcpy(&chunk, datagram, sizeof chunk);
+  size_t const len = size - sizeof chunk;
+  bool const valid =
+      chunk.magic == magic_ &&
+      chunk.index < chunk.count &&
+      chunk.count <= max_count_ &&
+      // Only the last chunk may be shorter.
+      (len == DATAGRAM_CHUNK_SIZE || chunk.index == chunk.count - 1) &&
+      len <= DATAGRAM_CHUNK_SIZE;
+  if (!valid) return false;
+
+  bool const new_session = received_.empty() || chunk.session != session_;
+  if (new_session || chunk.seq != seq_) {
+    // The chunks of older messages that arrive late are of no use anymore.
+    // (The sequence numbers of a new session start over, so they cannot be
+    // compared to the old ones.)
+    if (!new_session && static_cast<int32_t>(chunk.seq - seq_) < 0) {
+      return false;
+    }
+    // A message that is still missing chunks is given up on.
+    session_ = chunk.session;
+    seq_ = chunk.seq;
+    left_ = chunk.count;
+    received_.assign(chunk.count, false);
+    message_.resize(chunk.count * DATAGRAM_CHUNK_SIZE);
+  }
+  if (chunk.count != received_.size() || received_[chunk.index]) return false;
+
+  received_[chunk.index] = true;
+  memcpy(&message_[chunk.index * DATAGRAM_CHUNK_SIZE],
+         datagram + sizeof chunk, len);
+  if (chunk.index == chunk.count - 1) {
+    // The message is only as long as its last chunk reaches.
+    message_.resize(chunk.index * DATAGRAM_CHUNK_SIZE + len);
+  }
+  return --left_ == 0;
+}
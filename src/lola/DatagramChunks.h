@@ -0,0 +1,110 @@
+#ifndef LOLA_DATAGRAM_CHUNKS_H__
+#define LOLA_DATAGRAM_CHUNKS_H__
+
+#include <cstddef>
+#include <vector>
+
+#include <stdint.h>
+
+/**
+ * Messages larger than a datagram are sent over UDP as a sequence of chunks,
+ * each carried by a datagram of its own, prefixed by a `DatagramChunk`. Every
+ * chunk but the last one carries `DATAGRAM_CHUNK_SIZE` bytes of the message.
+ * A message of which any chunk is lost is dropped as a whole.
+ *
+ * All values are in the host's byte order.
+ */
+struct DatagramChunk {
+  /**
+   * Identifies the protocol of the message.
+   */
+  uint32_t magic;
+  /**
+   * Identifies the publisher (see `newChunkSession`), so that the receiver
+   * starts over when a publisher is restarted and its sequence numbers with
+   * it.
+   */
+  uint32_t session;
+  /**
+   * The sequence number of the message that the chunk belongs to.
+   */
+  uint32_t seq;
+  /**
+   * The index of the chunk within the message and the number of chunks that
+   * the message is split into.
+   */
+  uint16_t index;
+  uint16_t count;
+};
+
+/**
+ * The chunks are small enough for their datagrams to fit into the MTU of an
+ * Ethernet link (along with the IP and UDP headers), so that they are never
+ * fragmented: losing a single fragment of a datagram would lose all of it.
+ * The price is a datagram (and a system call) per 1400 bytes of a message.
+ */
+size_t const DATAGRAM_CHUNK_SIZE = 1400;
+
+/**
+ * Returns a new identifier of a publisher's session, which is unlikely to be
+ * the same as that of any earlier session.
+ */
+uint32_t newChunkSession();
+
+/**
+ * Returns the number of chunks that a message of the given size is split into.
+ */
+size_t chunkCount(size_t size);
+/**
+ * Puts the i-th chunk of the given message, including its header, into
+ * `datagram`.
+ */
+void makeChunk(
+    uint32_t magic,
+    uint32_t session,
+    uint32_t seq,
+    std::vector<char> const& message,
+    size_t i,
+    std::vector<char>& datagram);
+
+/**
+ * Reassembles the messages of a single sender from their chunks.
+ *
+ * Only the newest message is ever reassembled: the chunks of a message that
+ * arrive after a chunk of a newer one are dropped, as are the chunks of the
+ * incomplete message. A chunk of a new session (i.e. of a restarted or
+ * another publisher) starts over, whatever its sequence number.
+ */
+class ChunkAssembler {
+public:
+  /**
+   * Creates an assembler of the messages of the given protocol, at most
+   * `max_size` bytes large.
+   */
+  ChunkAssembler(uint32_t magic, size_t max_size);
+  /**
+   * Adds the chunk carried by the given datagram. Returns true if it completes
+   * a message, which is then found in `message()`.
+   */
+  bool add(char const* datagram, size_t size);
+  /**
+   * The last message that was completed.
+   */
+  std::vector<char> const& message() const { return message_; }
+  /**
+   * The session and sequence number of the last message that a chunk was
+   * added for.
+   */
+  uint32_t session() const { return session_; }
+  uint32_t seq() const { return seq_; }
+private:
+  uint32_t const magic_;
+  size_t const max_count_;
+  std::vector<char> message_;
+  std::vector<bool> received_;
+  uint32_t session_;
+  uint32_t seq_;
+  size_t left_;
+};
+
+#endif
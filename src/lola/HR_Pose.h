@@ -0,0 +1,129 @@
+#ifndef LOLA_HR_POSE_H__
+#define LOLA_HR_POSE_H__
+
+#include <stdint.h>
+
+/*!
+  Robot pose data
+
+  vectors given in world coordinate frame
+
+  ub = upper body
+  fl = left foot
+  fr = right foot
+  cl = left camera
+  cr = right camera
+  im = IMU,
+
+  wr = world frame
+  odo = drift frame
+
+  Struct reused verbatim from the original LOLA source code to keep compatibility.
+*/
+#pragma pack(push)
+#pragma pack(1)
+struct HR_Pose
+{
+  enum{RIGHT=0,LEFT=1};
+  //!UDP port
+  enum{PORT=0xD001};
+  //!data rate [ms] (actually determined by hardware trigger!)
+  enum{RATE=50};
+  //!number of segments in detailed robot model.
+  enum{N_SEGMENTS=25};
+
+  //rot = rotation
+  //add = adduction
+  //flx = flexion
+  enum SegmentIndex
+    {
+      //torso
+      seg_torso=0,
+      //pelvis
+      seg_pelvis_rot,seg_pelvis_add,
+      //right leg
+      seg_hip_rot_r,seg_hip_add_r,seg_hip_flx_r,seg_knee_flx_r,seg_ankle_add_r,seg_ankle_flx_r,seg_toe_flx_r,
+      //left leg
+      seg_hip_rot_l,seg_hip_add_l,seg_hip_flx_l,seg_knee_flx_l,seg_ankle_add_l,seg_ankle_flx_l,seg_toe_flx_l,
+      //right arm
+      seg_shoulder_flx_r,seg_shoulder_add_r,seg_elbow_flx_r,
+      //left arm
+      seg_shoulder_flx_l,seg_shoulder_add_l,seg_elbow_flx_l,
+      //head (tilt: both cameras without convergence joint)
+      seg_head_pan, seg_head_tilt
+    };
+
+  //!segment pose
+  struct SegmentPose
+  {
+    //!transform matrix
+    float R[3*3];
+    //!position
+    float t[3];
+  };
+
+  //////////////////////////////////////////////////
+  //// 1 -- header
+  //!data struct version
+  uint32_t version;
+  //! tick counter
+  uint64_t tick_counter;
+  //!<stance leg (RIGHT/LEFT)
+  uint8_t stance;
+  //!<padding
+  uint8_t zero[3];
+
+  uint64_t stamp;
+
+
+  //////////////////////////////////////////////////
+  //// 2 -- simplified /abstract robot model (feet, cameras, upper body)
+  //!vector from world frame to left leg in world frame
+  float t_wr_fr[3];
+  //!vector from world frame to right leg in world frame
+  float t_wr_fl[3];
+  //!vector from world frame to left camera in world frame
+  float t_wr_cl[3];
+  //!vector from world frame to right camera in world frame
+  float t_wr_cr[3];
+
+  //!transformation matrix from left leg to world frame
+  float R_wr_fr[3*3];
+  //!transformation matrix from right leg to world frame
+  float R_wr_fl[3*3];
+  //!transformation matrix from left camera to world frame
+  float R_wr_cl[3*3];
+  //!transformation matrix from right camera to world frame
+  float R_wr_cr[3*3];
+  /*!
+    transformation matrix from upper body coordinate frame
+    to inertial frame measured by IMU (world frame)
+    (identity matrix, if robot is standing upright)
+  */
+  float R_wr_ub[3*3];
+  //!vector from world frame to upper body frame in world frame
+  float t_wr_ub[3];
+
+  //////////////////////////////////////////////////
+  //// 3 -- full robot pose
+  SegmentPose seg_pose[N_SEGMENTS];
+
+  //////////////////////////////////////////////////
+  //// 4 -- "drift pose" (odometry)
+  //!stance leg in drift frame
+  float t_stance_odo[3];
+  //!stance foot rotation in drift frame
+  float phi_z_odo;
+
+  //////////////////////////////////////////////////
+  //// 5 -- "drift pose" (odometry)
+  //!<currently active velocity in x-direction [m/s]
+  float vx_act;
+  //!<currently active velocity in y-direction [m/s]
+  float vy_act;
+  //!<currently active angular velocity [rad/s]
+  float om_act;
+};
+#pragma pack (pop)
+
+#endif
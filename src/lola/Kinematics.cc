@@ -0,0 +1,113 @@
+#include "lola/Kinematics.h"
+
+#include <cmath>
+#include <iostream>
+
+namespace kinematics {
+
+void rotationmatrix(double angle, double matrix[][3]) {
+  double s = sin(angle);
+  double c = cos(angle);
+
+  matrix[0][0] = c; matrix[0][1] = -s; matrix[0][2] = 0;
+  matrix[1][0] = s; matrix[1][1] = c; matrix[1][2] = 0;
+  matrix[2][0] = 0; matrix[2][1] = 0; matrix[2][2] = 1;
+}
+
+void transpose(double const matrix[][3], double transpose[][3]) {
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      transpose[j][i] = matrix[i][j];
+    }
+  }
+}
+
+}  // namespace kinematics
+
+DerivedKinematics deriveKinematics(LolaKinematicsParams const& params) {
+  DerivedKinematics kinematics;
+  kinematics.stamp = params.stamp;
+  kinematics.params = params;
+  kinematics::rotationmatrix(params.phi_z_odo, kinematics.rotation);
+
+  double transposed_matrix[3][3];
+  kinematics::transpose(kinematics.rotation, transposed_matrix);
+
+  // In pseudo-code (if matrix operations were supported):
+  // r_odo_cam = transpose(rotation_matrix) * (t_wr_cl + t_stance_odo)
+  // robot_position = transpose(rotation_matrix) * (t_stance_odo)
+  OdoTransformParameters& transform = kinematics.transform;
+  double position[3];
+  for (int i = 0; i < 3; ++i) {
+    transform.r_odo_cam[i] = 0;
+    position[i] = 0;
+    for (int j = 0; j < 3; ++j) {
+      transform.r_odo_cam[i] +=
+          transposed_matrix[i][j] * (params.t_wr_cl[j] + params.t_stance_odo[j]);
+      position[i] += transposed_matrix[i][j] * params.t_stance_odo[j];
+    }
+  }
+  kinematics.robot_position = lepp::Coordinate(position[0], position[1], position[2]);
+
+  // In pseudo-code (if matrix operations were supported):
+  // A_odo_cam = transpose(R_wr_cl * rotation_matrix)
+  double A_odo_cam_no_trans[3][3];
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      A_odo_cam_no_trans[i][j] = 0;
+      for (int k = 0; k < 3; ++k) {
+        A_odo_cam_no_trans[i][j] += params.R_wr_cl[i][k] * kinematics.rotation[k][j];
+      }
+    }
+  }
+  kinematics::transpose(A_odo_cam_no_trans, transform.A_odo_cam);
+
+  bool all = true;
+  for (int i = 0; i < 3; ++i) {
+    all = all && (transform.r_odo_cam[i] == 0);
+  }
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      all = all && (transform.A_odo_cam[i][j] == 0);
+    }
+  }
+  kinematics.null_transform = all;
+
+  return kinematics;
+}
+
+std::ostream& operator<<(std::ostream& out, LolaKinematicsParams const& param) {
+  out << "stamp #" << param.stamp << std::endl
+      << "phi_z_odo = " << param.phi_z_odo << std::endl
+      << "stance = " << param.stance << std::endl;
+  out << "t_wr_cl = ";
+  for (int i = 0; i < 3; ++i) out << param.t_wr_cl[i] << " "; out << std::endl;
+
+  out << "R_Wr_cl = " << std::endl;
+  for (int i = 0; i < 3; ++i) {
+    out << "  ";
+    for (int j = 0; j < 3; ++j) {
+      out << param.R_wr_cl[i][j] << " ";
+    }
+    out << std::endl;
+  }
+  out << "t_stance_odo = ";
+  for (int i = 0; i < 3; ++i) out << param.t_stance_odo[i] << " "; out << std::endl;
+
+  return out;
+}
+
+std::ostream& operator<<(std::ostream& out, OdoTransformParameters const& param) {
+  out << "r_odo_cam = ";
+  for (int i = 0; i < 3; ++i) out << param.r_odo_cam[i] << " "; out << std::endl;
+  out << "A_odo_cam = " << std::endl;
+  for (int i = 0; i < 3; ++i) {
+    out << "  ";
+    for (int j = 0; j < 3; ++j) {
+      out << param.A_odo_cam[i][j] << " ";
+    }
+    out << std::endl;
+  }
+
+  return out;
+}
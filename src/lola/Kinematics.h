@@ -0,0 +1,94 @@
+#ifndef LOLA_KINEMATICS_H__
+#define LOLA_KINEMATICS_H__
+
+#include "lepp2/models/Coordinate.h"
+
+#include <iosfwd>
+
+/**
+ * A struct wrapping the parameters LOLA-provided kinematics parameters that are
+ * used to construct the transformation matrices between the camera frame and
+ * the world coordinate system as LOLA knows it.
+ */
+struct LolaKinematicsParams {
+  double t_wr_cl[3];
+  double R_wr_cl[3][3];
+  double t_stance_odo[3];
+  double phi_z_odo;
+  double stance;
+  int stamp;
+};
+
+/**
+ * A struct wrapping the parameters for performing a transformation between the
+ * camera coordinate system and the LOLA world coordinate system.
+ */
+struct OdoTransformParameters {
+  double r_odo_cam[3];
+  double A_odo_cam[3][3];
+};
+
+/**
+ * Everything that is derived from a single set of kinematics parameters.
+ *
+ * Computing it takes a handful of trigonometric functions and matrix products,
+ * so it is done once per pose (see `PoseService::getKinematics`) and then
+ * shared by all components that need any part of it.
+ */
+struct DerivedKinematics {
+  /**
+   * The stamp of the pose that the kinematics were derived from.
+   */
+  int stamp;
+  /**
+   * The parameters that everything else was derived from.
+   */
+  LolaKinematicsParams params;
+  /**
+   * The rotation around the z-axis by `params.phi_z_odo`.
+   */
+  double rotation[3][3];
+  /**
+   * The transformation from the camera to the world (ODO) coordinate system.
+   */
+  OdoTransformParameters transform;
+  /**
+   * Whether `transform` is a "null" transform, i.e. maps all points to
+   * (0, 0, 0). This is the case when no pose has been received yet.
+   */
+  bool null_transform;
+  /**
+   * The "World" origin (i.e. the robot's position) in the ODO coordinate
+   * system.
+   */
+  lepp::Coordinate robot_position;
+};
+
+/**
+ * Derives all kinematics-related quantities from the given parameters.
+ */
+DerivedKinematics deriveKinematics(LolaKinematicsParams const& params);
+
+namespace kinematics {
+
+/**
+ * Puts a rotation matrix (around the z-axis) for the given angle in the given
+ * matrix `matrix`.
+ * It is assumed that the given matrix points to a matrix of dimensions 3x3.
+ */
+void rotationmatrix(double angle, double matrix[][3]);
+
+/**
+ * Transposes the given matrix `matrix` and puts the transpose result into the
+ * given `transpose` matrix.
+ *
+ * The matrices are assumed to be 3x3.
+ */
+void transpose(double const matrix[][3], double transpose[][3]);
+
+}  // namespace kinematics
+
+std::ostream& operator<<(std::ostream& out, LolaKinematicsParams const& param);
+std::ostream& operator<<(std::ostream& out, OdoTransformParameters const& param);
+
+#endif
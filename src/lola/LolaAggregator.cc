@@ -1,69 +1,169 @@
 #include "lola/LolaAggregator.h"
 #include "deps/easylogging++.h"
 
+#include <algorithm>
+#include <cstring>
+
 using namespace lepp;
 
 namespace {
+/**
+ * Maps the index of an obstacle to its position in a `LolaAggregator` send
+ * buffer, where a `LolaDatagramHeader` precedes each group of
+ * `per_datagram` obstacles. The buffer is grown as needed; since it never
+ * shrinks, a reused buffer only needs to grow for a scene larger than any
+ * scene it previously held.
+ */
+class DatagramSlots {
+public:
+  DatagramSlots(std::vector<char>& data, size_t per_datagram)
+      : data_(data), per_datagram_(per_datagram) {}
+
+  LolaObstacle& operator()(size_t idx) {
+    size_t const offset = offsetOf(idx);
+    if (offset + sizeof(LolaObstacle) > data_.size()) {
+      data_.resize(std::max(2 * data_.size(), offset + sizeof(LolaObstacle)));
+    }
+    return *reinterpret_cast<LolaObstacle*>(&data_[offset]);
+  }
+
   /**
-   * A dummy WriteHandler for the asnchronous socket write.
-   *
-   * If send were to fail, there's no point in us retrying, so this handler is
-   * just a dummy.
+   * The size of a full datagram.
    */
-  void handler(
-      boost::system::error_code const& error,
-      std::size_t bytes_transferred) {}
-}
+  size_t stride() const {
+    return sizeof(LolaDatagramHeader) + per_datagram_ * sizeof(LolaObstacle);
+  }
 
+  size_t offsetOf(size_t idx) const {
+    return (idx / per_datagram_) * stride()
+        + sizeof(LolaDatagramHeader)
+        + (idx % per_datagram_) * sizeof(LolaObstacle);
+  }
+private:
+  std::vector<char>& data_;
+  size_t const per_datagram_;
+};
 
-namespace {
 /**
  * A `ModelVisitor` implementation used for the implementation of the
- * `LolaAggregator`. Allows us to obtain all information that is required to
- * assemble a message for the visualizer.
+ * `LolaAggregator`. It serializes each primitive model that it visits
+ * directly into its `LolaObstacle` slot in the send buffer, without any
+ * intermediate representation.
  */
-class ParametersVisitor : public lepp::ModelVisitor {
+class ObstacleSerializer : public lepp::ModelVisitor {
 public:
+  ObstacleSerializer(DatagramSlots& slots) : slots_(slots), count_(0) {}
+
   void visitSphere(SphereModel& sphere) {
-    params_.push_back(0); // type
-    params_.push_back(sphere.radius());
-    Coordinate const center = sphere.center();
-    params_.push_back(center.x);
-    params_.push_back(center.y);
-    params_.push_back(center.z);
-    // Now the rest is padding
-    for (size_t i = 0; i < 6; ++i) params_.push_back(0);
+    LolaObstacle& obstacle = nextObstacle();
+    obstacle.type = 0;
+    obstacle.radius = toMillimeters(sphere.radius());
+    Coordinate const& center = sphere.center();
+    obstacle.rest[0] = toMillimeters(center.x);
+    obstacle.rest[1] = toMillimeters(center.y);
+    obstacle.rest[2] = toMillimeters(center.z);
   }
 
   void visitCapsule(CapsuleModel& capsule) {
-    params_.push_back(1); // type
-    params_.push_back(capsule.radius());
-    Coordinate const first = capsule.first();
-    params_.push_back(first.x);
-    params_.push_back(first.y);
-    params_.push_back(first.z);
-    Coordinate const second = capsule.second();
-    params_.push_back(second.x);
-    params_.push_back(second.y);
-    params_.push_back(second.z);
-    // The rest is padding
-    for (size_t i = 0; i < 3; ++i) params_.push_back(0);
+    LolaObstacle& obstacle = nextObstacle();
+    obstacle.type = 1;
+    obstacle.radius = toMillimeters(capsule.radius());
+    Coordinate const& first = capsule.first();
+    obstacle.rest[0] = toMillimeters(first.x);
+    obstacle.rest[1] = toMillimeters(first.y);
+    obstacle.rest[2] = toMillimeters(first.z);
+    Coordinate const& second = capsule.second();
+    obstacle.rest[3] = toMillimeters(second.x);
+    obstacle.rest[4] = toMillimeters(second.y);
+    obstacle.rest[5] = toMillimeters(second.z);
   }
 
-  std::vector<double> params() const { return params_; }
+  /**
+   * Returns the number of obstacles serialized so far.
+   */
+  size_t count() const { return count_; }
 private:
-  std::vector<double> params_;
+  /**
+   * Gets the next (zeroed) obstacle slot that should be filled in.
+   */
+  LolaObstacle& nextObstacle() {
+    LolaObstacle& obstacle = slots_(count_++);
+    memset(&obstacle, 0, sizeof obstacle);
+    return obstacle;
+  }
+  /**
+   * LOLA expects the values to be in milimeters.
+   */
+  static int toMillimeters(double meters) { return meters * 1000; }
+
+  DatagramSlots& slots_;
+  size_t count_;
 };
+
+/**
+ * The initial size of a send buffer: enough for the scenes that are usually
+ * seen, so that the buffers rarely (if ever) need to grow.
+ */
+size_t const INITIAL_BUFFER_SIZE = 16 * 1024;
 }  // namespace <anonymous>
 
+size_t const LolaAggregator::DEFAULT_MAX_DATAGRAM_SIZE;
+int const LolaAggregator::DEFAULT_MULTICAST_TTL;
+
+LolaAggregator::LolaAggregator(
+    boost::asio::io_service& io_service,
+    std::string const& remote_host,
+    int remote_port,
+    size_t max_datagram_size)
+    : socket_(io_service),
+      obstacles_per_datagram_(
+        (max_datagram_size - sizeof(LolaDatagramHeader)) / sizeof(LolaObstacle)),
+      next_scene_(0),
+      queued_(lepp::MetricsRegistry::global().counter(
+            "lola_viewer_datagrams_total", "Datagrams to the LOLA viewers",
+            "state=\"queued\"")),
+      sent_(lepp::MetricsRegistry::global().counter(
+            "lola_viewer_datagrams_total", "Datagrams to the LOLA viewers",
+            "state=\"sent\"")),
+      failed_(lepp::MetricsRegistry::global().counter(
+            "lola_viewer_datagrams_total", "Datagrams to the LOLA viewers",
+            "state=\"failed\"")) {
+  if (max_datagram_size < sizeof(LolaDatagramHeader) + sizeof(LolaObstacle)) {
+    throw "The maximum datagram size cannot fit a single obstacle";
+  }
+  socket_.open(boost::asio::ip::udp::v4());
+  setMulticastTtl(DEFAULT_MULTICAST_TTL);
+  addEndpoint(remote_host, remote_port);
+}
 
+void LolaAggregator::addEndpoint(
+    std::string const& remote_host,
+    int remote_port) {
+  EndpointStats endpoint;
+  endpoint.endpoint = boost::asio::ip::udp::endpoint(
+      boost::asio::ip::address::from_string(remote_host.c_str()),
+      remote_port);
+  if (!endpoint.endpoint.address().is_v4()) {
+    throw "LolaAggregator only supports IPv4 endpoints";
+  }
+  if (endpoint.endpoint.address().is_multicast()) {
+    // Viewers on this machine may also have joined the group.
+    socket_.set_option(boost::asio::ip::multicast::enable_loopback(true));
+    LINFO << "LolaViewer: Sending to multicast group " << endpoint.endpoint;
+  } else {
+    LINFO << "LolaViewer: Sending to " << endpoint.endpoint;
+  }
+  boost::mutex::scoped_lock lock(mutex_);
+  endpoints_.push_back(endpoint);
+}
 
-LolaAggregator::LolaAggregator(std::string const& remote_host, int remote_port)
-    : socket_(io_service_),
-      remote_endpoint_(
-        boost::asio::ip::address::from_string(remote_host.c_str()),
-        remote_port) {
-  socket_.open(boost::asio::ip::udp::v4());
+void LolaAggregator::setMulticastTtl(int ttl) {
+  socket_.set_option(boost::asio::ip::multicast::hops(ttl));
+}
+
+std::vector<LolaAggregator::EndpointStats> LolaAggregator::endpointStats() const {
+  boost::mutex::scoped_lock lock(mutex_);
+  return endpoints_;
 }
 
 LolaAggregator::~LolaAggregator() {
@@ -72,58 +172,104 @@ LolaAggregator::~LolaAggregator() {
 }
 
 void LolaAggregator::updateObstacles(std::vector<ObjectModelPtr> const& obstacles) {
-  LTRACE << "LolaViewer: Sending to " << remote_endpoint_;
-
-  // Builds the payload: a raw byte buffer.
-  std::vector<char> payload(buildPayload(obstacles));
-  // Once the payload is built, initiate an async send.
-  // We don't really care about the result, since there's no point in retrying.
-  socket_.async_send_to(
-      boost::asio::buffer(payload, payload.size()),
-      remote_endpoint_,
-      0,
-      handler);
+  TraceSpan span("viewer serialization");
+  SendBufferPtr buffer(acquireBuffer());
+  buildPayload(obstacles, *buffer);
+  // Once the payload is built, initiate an async send of each datagram to each
+  // of the endpoints, all of them referencing the same buffer.
+  // We don't really care about the result, since there's no point in retrying,
+  // but the completion handler keeps the buffer alive until the send is done.
+  size_t const sz = buffer->datagrams.size();
+  size_t const endpoint_count = endpoints_.size();
+  buffer->pending = sz * endpoint_count;
+  queued_.inc(buffer->pending);
+  for (size_t i = 0; i < sz; ++i) {
+    std::pair<size_t, size_t> const& datagram = buffer->datagrams[i];
+    for (size_t j = 0; j < endpoint_count; ++j) {
+      socket_.async_send_to(
+          boost::asio::buffer(&buffer->data[datagram.first], datagram.second),
+          endpoints_[j].endpoint,
+          0,
+          boost::bind(&LolaAggregator::sendHandler, this, buffer, j, _1, _2));
+    }
+  }
 }
 
-std::vector<char> LolaAggregator::buildPayload(
-    std::vector<ObjectModelPtr> const& obstacles) const {
-  std::vector<char> payload;
-
+void LolaAggregator::buildPayload(
+    std::vector<ObjectModelPtr> const& obstacles,
+    SendBuffer& buffer) {
+  DatagramSlots slots(buffer.data, obstacles_per_datagram_);
+  ObstacleSerializer serializer(slots);
   size_t const sz = obstacles.size();
-  for (int i = 0; i < sz; ++i) {
-    ObjectModel& model = *obstacles[i];
-    // Get the "flattened" model representation.
-    ParametersVisitor parameterizer;
-    model.accept(parameterizer);
-    std::vector<double> params(parameterizer.params());
-
-    // Since the model could have been a composite, we may have more than 1
-    // model's representation in the vector, one after the other.
-    for (size_t model_idx = 0; model_idx < params.size() / 11; ++model_idx) {
-      // Pack each set of coefficients into a struct that should be shipped off
-      // to the viewer.
-      struct {
-        int type;
-        int radius;
-        int rest[9];
-      } obstacle;
-      memset(&obstacle, 0, sizeof(obstacle));
-      obstacle.type = params[11*model_idx + 0];
-      // LOLA expects the values to be in milimeters.
-      obstacle.radius = params[11*model_idx + 1] * 1000;
-      for (size_t i = 0; i < 9; ++i) {
-        obstacle.rest[i] = params[11*model_idx + 2 + i] * 1000;
-      }
-
-      // Now dump the raw bytes extracted from the struct into the payload.
-      char* raw = (char*)&obstacle;
-      for (size_t i = 0; i < sizeof(obstacle); ++i) {
-        payload.push_back(raw[i]);
-      }
+  for (size_t i = 0; i < sz; ++i) {
+    // Composite models visit each of their parts, so each primitive ends up
+    // as a separate obstacle.
+    obstacles[i]->accept(serializer);
+  }
+
+  // Now that the number of obstacles is known, the datagrams can be delimited
+  // and their headers filled in. Even an empty scene gets a (header-only)
+  // datagram, so that the viewer learns that there are no obstacles.
+  size_t const count = serializer.count();
+  size_t const datagram_count =
+      std::max<size_t>(1, (count + obstacles_per_datagram_ - 1) / obstacles_per_datagram_);
+  buffer.used = count == 0
+      ? sizeof(LolaDatagramHeader)
+      : slots.offsetOf(count - 1) + sizeof(LolaObstacle);
+  if (buffer.data.size() < buffer.used) buffer.data.resize(buffer.used);
+  buffer.datagrams.clear();
+  uint32_t const scene = next_scene_++;
+  for (size_t i = 0; i < datagram_count; ++i) {
+    size_t const offset = i * slots.stride();
+    LolaDatagramHeader header;
+    header.scene = scene;
+    header.chunk = i;
+    header.chunk_count = datagram_count;
+    memcpy(&buffer.data[offset], &header, sizeof header);
+    buffer.datagrams.push_back(std::make_pair(
+          offset, std::min(slots.stride(), buffer.used - offset)));
+  }
+}
+
+LolaAggregator::SendBufferPtr LolaAggregator::acquireBuffer() {
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (!free_buffers_.empty()) {
+      SendBufferPtr buffer = free_buffers_.back();
+      free_buffers_.pop_back();
+      return buffer;
     }
   }
+  LTRACE << "LolaViewer: Allocating a new send buffer";
+  SendBufferPtr buffer(new SendBuffer);
+  buffer->data.resize(INITIAL_BUFFER_SIZE);
+  return buffer;
+}
 
-  return payload;
+void LolaAggregator::sendHandler(
+    SendBufferPtr buffer,
+    size_t endpoint,
+    boost::system::error_code const& error,
+    std::size_t bytes_transferred) {
+  boost::mutex::scoped_lock lock(mutex_);
+  EndpointStats& stats = endpoints_[endpoint];
+  if (error) {
+    ++stats.failed;
+    failed_.inc();
+    // Only report the first of a series of failures, so that a viewer that
+    // went away does not flood the log.
+    if (stats.consecutive_failures++ == 0) {
+      LWARNING << "LolaViewer: Send to " << stats.endpoint << " failed: "
+               << error.message();
+    }
+  } else {
+    ++stats.sent;
+    sent_.inc();
+    stats.consecutive_failures = 0;
+  }
+  if (--buffer->pending == 0) {
+    free_buffers_.push_back(buffer);
+  }
 }
 
 namespace {
@@ -132,7 +278,7 @@ namespace {
  * `RobotAggregator`. Allows us to obtain all information that is required to
  * assemble a message for the robot.
  *
- * Similar to the `ParametersVisitor`, but for the sake of convenience of
+ * Similar to the `ObstacleSerializer`, but for the sake of convenience of
  * the two aggregators' implementations, they are not reconciled.
  */
 class CoefsVisitor : public lepp::ModelVisitor {
@@ -3,6 +3,8 @@
 
 #include "lepp2/ObstacleAggregator.hpp"
 #include "lepp2/DiffAggregator.hpp"
+#include "lepp2/Metrics.hpp"
+#include "lepp2/debug/trace.hpp"
 #include "lepp2/models/ObjectModel.h"
 
 #include "lola/RobotService.h"
@@ -10,45 +12,222 @@
 
 #include <boost/array.hpp>
 #include <boost/asio.hpp>
+#include <boost/thread/mutex.hpp>
 
 using namespace lepp;
 
+/**
+ * The representation of a single obstacle in the datagrams sent to the LOLA
+ * viewer: the type of the obstacle (0 for spheres, 1 for capsules), its
+ * radius and up to 9 more coefficients describing it. All lengths are given in
+ * millimeters.
+ */
+#pragma pack(push)
+#pragma pack(1)
+struct LolaObstacle {
+  int type;
+  int radius;
+  int rest[9];
+};
+
+/**
+ * The header found at the start of each datagram sent to the LOLA viewer.
+ *
+ * A single scene (i.e. the list of obstacles found in one frame) may be split
+ * over multiple datagrams in order to respect the network's MTU. All
+ * datagrams of a scene share the same `scene` sequence number, allowing the
+ * viewer to reassemble it (and to detect lost or reordered datagrams).
+ */
+struct LolaDatagramHeader {
+  /**
+   * The sequence number of the scene that the datagram belongs to.
+   */
+  uint32_t scene;
+  /**
+   * The index of the datagram within its scene.
+   */
+  uint16_t chunk;
+  /**
+   * The total number of datagrams that the scene was split into.
+   */
+  uint16_t chunk_count;
+};
+#pragma pack (pop)
+
 /**
  * A LOLA-specific implementation of an `ObstacleAggregator`.
  *
  * It serializes the received obstacles into a format where each obstacle is
- * represented by 11 integers. Each integer is serialized with machine-specific
- * endianess; no care is taken to perform integer serialization for network
- * transfer, i.e. big-endian. In general, this is not the safest assumption to
- * make, but the LOLA controller has been working under this assumption for now,
- * so enforcing a big-endian encoding would just introduce additional complexity.
+ * represented by 11 integers (a `LolaObstacle`). Each integer is serialized
+ * with machine-specific endianess; no care is taken to perform integer
+ * serialization for network transfer, i.e. big-endian. In general, this is not
+ * the safest assumption to make, but the LOLA controller has been working under
+ * this assumption for now, so enforcing a big-endian encoding would just
+ * introduce additional complexity.
+ *
+ * The serialized obstacles are packed into as few datagrams as the maximum
+ * datagram size allows, each of them starting with a `LolaDatagramHeader`, and
+ * sent over UDP to each of the aggregator's endpoints (i.e. viewers). The scene
+ * is serialized only once, regardless of the number of endpoints. An endpoint
+ * may also be a multicast group, in which case a single send reaches all
+ * viewers that joined the group.
  *
- * The serialized representation of each obstacle is packed into a single
- * datagram and sent over UDP to the remote host described by the initial
- * constructor parameters.
+ * Since the sends are asynchronous and never retried, a viewer that is down (or
+ * otherwise failing) does not hold back the others; its failures are only
+ * counted (see `endpointStats`).
+ *
+ * The buffers holding the serialized scenes are pooled and reused: a buffer is
+ * only returned to the pool once all sends referencing it have completed, so
+ * that, once the pool has warmed up, building and sending a scene does not
+ * allocate.
+ *
+ * The sends complete on whichever threads run the `io_service` given at
+ * construct-time (normally the process' `NetworkReactor`), which must be
+ * stopped before the aggregator is destroyed.
  */
 class LolaAggregator : public lepp::ObstacleAggregator {
 public:
+  /**
+   * The default maximum size of a single datagram: the Ethernet MTU minus the
+   * IP and UDP headers, so that the datagrams are never fragmented.
+   */
+  static size_t const DEFAULT_MAX_DATAGRAM_SIZE = 1472;
+  /**
+   * The default TTL of the datagrams sent to multicast groups. A TTL of 1 keeps
+   * them within the local subnet.
+   */
+  static int const DEFAULT_MULTICAST_TTL = 1;
+  /**
+   * Counters describing the sends made to a single endpoint.
+   */
+  struct EndpointStats {
+    EndpointStats() : sent(0), failed(0), consecutive_failures(0) {}
+    boost::asio::ip::udp::endpoint endpoint;
+    /**
+     * The number of datagrams that were successfully sent.
+     */
+    uint64_t sent;
+    /**
+     * The number of datagrams whose send failed.
+     */
+    uint64_t failed;
+    /**
+     * The number of sends that have failed since the last successful one.
+     */
+    uint64_t consecutive_failures;
+  };
   /**
    * Creates a new `LolaAggregator` where the remote host to which the obstacle
    * list is sent is identified by the given host name and port number.
+   * Further endpoints can be added by `addEndpoint`.
+   *
+   * No datagram will be larger than `max_datagram_size` bytes.
    */
-  LolaAggregator(std::string const& remote_host, int remote_port);
+  LolaAggregator(
+      boost::asio::io_service& io_service,
+      std::string const& remote_host,
+      int remote_port,
+      size_t max_datagram_size = DEFAULT_MAX_DATAGRAM_SIZE);
   ~LolaAggregator();
+  /**
+   * Adds another endpoint to which each scene is sent.
+   *
+   * Endpoints should be added before the first scene is sent.
+   */
+  void addEndpoint(std::string const& remote_host, int remote_port);
+  /**
+   * Sets the TTL of the datagrams sent to multicast groups.
+   */
+  void setMulticastTtl(int ttl);
+  /**
+   * Returns a snapshot of the counters of each of the endpoints, in the order
+   * in which the endpoints were added.
+   */
+  std::vector<EndpointStats> endpointStats() const;
   /**
    * `ObstacleAggregator` interface implementation.
    */
   void updateObstacles(std::vector<ObjectModelPtr> const& obstacles);
 private:
   /**
-   * A helper function that builds the datagram payload based on the given
-   * obstacles.
+   * A buffer holding a serialized scene: the raw bytes of all of its
+   * datagrams, laid out one after the other.
    */
-  std::vector<char> buildPayload(std::vector<ObjectModelPtr> const& obstacles) const;
+  struct SendBuffer {
+    SendBuffer() : used(0), pending(0) {}
+    /**
+     * The raw bytes. Only ever grows, so that the buffer can be reused for
+     * subsequent scenes without reallocating.
+     */
+    std::vector<char> data;
+    /**
+     * The number of bytes of `data` that the current scene occupies.
+     */
+    size_t used;
+    /**
+     * The offset and length of each datagram found in `data`.
+     */
+    std::vector<std::pair<size_t, size_t> > datagrams;
+    /**
+     * The number of sends referencing the buffer that have not yet completed.
+     */
+    int pending;
+  };
+  typedef boost::shared_ptr<SendBuffer> SendBufferPtr;
+
+  /**
+   * Serializes the given obstacles into the given buffer, splitting them into
+   * datagrams and filling in their headers.
+   */
+  void buildPayload(
+      std::vector<ObjectModelPtr> const& obstacles,
+      SendBuffer& buffer);
+  /**
+   * Obtains a buffer from the pool or creates a new one if all buffers are
+   * still in use.
+   */
+  SendBufferPtr acquireBuffer();
+  /**
+   * The completion handler of the async sends. Updates the counters of the
+   * endpoint (given by its index) and returns the buffer to the pool once all
+   * of its datagrams have been sent to all endpoints.
+   */
+  void sendHandler(
+      SendBufferPtr buffer,
+      size_t endpoint,
+      boost::system::error_code const& error,
+      std::size_t bytes_transferred);
 
-  boost::asio::io_service io_service_;
   boost::asio::ip::udp::socket socket_;
-  boost::asio::ip::udp::endpoint remote_endpoint_;
+
+  /**
+   * The number of obstacles that fit into a single datagram.
+   */
+  size_t const obstacles_per_datagram_;
+  /**
+   * The sequence number of the next scene.
+   */
+  uint32_t next_scene_;
+  /**
+   * Guards the pool of buffers and the endpoint counters, since both are
+   * updated by the completion handlers.
+   */
+  mutable boost::mutex mutex_;
+  /**
+   * The buffers that are currently not used by any send.
+   */
+  std::vector<SendBufferPtr> free_buffers_;
+  /**
+   * The endpoints to which the scenes are sent, along with their counters.
+   */
+  std::vector<EndpointStats> endpoints_;
+  /**
+   * The process-wide metrics (see `lepp::MetricsRegistry`) of the datagrams
+   * sent to all endpoints.
+   */
+  lepp::Counter& queued_;
+  lepp::Counter& sent_;
+  lepp::Counter& failed_;
 };
 
 /**
@@ -73,6 +252,7 @@ public:
    * `ObstacleAggregator` interface implementation.
    */
   void updateObstacles(std::vector<ObjectModelPtr> const& obstacles) {
+    lepp::TraceSpan span("robot diff");
     // Just pass it on to find the diff!
     diff_.updateObstacles(obstacles);
   }
@@ -0,0 +1,157 @@
+#include "lola/MetricsServer.h"
+
+#include <sstream>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "lepp2/Metrics.hpp"
+
+#include "deps/easylogging++.h"
+
+namespace {
+  /**
+   * The longest request that is read; scrapers send far shorter ones.
+   */
+  size_t const MAX_REQUEST_SIZE = 8192;
+
+  /**
+   * A single connection, which is given the metrics in response to its request
+   * and then closed.
+   */
+  template<class Protocol>
+  class Session : public boost::enable_shared_from_this<Session<Protocol> > {
+  public:
+    Session(boost::asio::io_service& io_service)
+        : socket_(io_service), request_(MAX_REQUEST_SIZE) {}
+
+    typename Protocol::socket& socket() { return socket_; }
+
+    void start() {
+      boost::asio::async_read_until(
+          socket_, request_, "\r\n\r\n",
+          boost::bind(&Session::handleRequest, this->shared_from_this(),
+                      boost::asio::placeholders::error));
+    }
+  private:
+    void handleRequest(boost::system::error_code const& error) {
+      if (error) return;
+      std::istream in(&request_);
+      std::string method;
+      std::string path;
+      in >> method >> path;
+      std::ostringstream body;
+      std::string status = "200 OK";
+      if (method != "GET") {
+        status = "405 Method Not Allowed";
+      } else if (path == "/" || path == "/metrics") {
+        lepp::MetricsRegistry::global().write(body);
+      } else {
+        status = "404 Not Found";
+      }
+      std::ostringstream response;
+      response << "HTTP/1.0 " << status << "\r\n"
+               << "Content-Type: text/plain; version=0.0.4\r\n"
+               << "Content-Length: " << body.str().size() << "\r\n"
+               << "Connection: close\r\n\r\n"
+               << body.str();
+      response_ = response.str();
+      boost::asio::async_write(
+          socket_,
+          boost::asio::buffer(response_),
+          boost::bind(&Session::handleWrite, this->shared_from_this(),
+                      boost::asio::placeholders::error));
+    }
+
+    void handleWrite(boost::system::error_code const&) {
+      // The connection is closed whether the write succeeded or not.
+      boost::system::error_code ignored;
+      socket_.shutdown(Protocol::socket::shutdown_both, ignored);
+      socket_.close(ignored);
+    }
+
+    typename Protocol::socket socket_;
+    boost::asio::streambuf request_;
+    std::string response_;
+  };
+
+  /**
+   * Starts the session of a new connection and then accepts the next one.
+   */
+  template<class Protocol>
+  void handleAccept(
+      boost::shared_ptr<Session<Protocol> > session,
+      boost::function<void()> accept_next,
+      boost::system::error_code const& error) {
+    if (error) {
+      LERROR << "MetricsServer: Unable to accept a connection: "
+             << error.message();
+      return;
+    }
+    session->start();
+    accept_next();
+  }
+}
+
+MetricsServer::MetricsServer(int port)
+    : tcp_acceptor_(io_service_),
+      local_acceptor_(io_service_) {
+  boost::asio::ip::tcp::endpoint const endpoint(
+      boost::asio::ip::address_v4::loopback(), port);
+  tcp_acceptor_.open(endpoint.protocol());
+  tcp_acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+  tcp_acceptor_.bind(endpoint);
+  tcp_acceptor_.listen();
+  accept<boost::asio::ip::tcp>(tcp_acceptor_);
+  LINFO << "MetricsServer: Serving the metrics on " << endpoint;
+  start();
+}
+
+MetricsServer::MetricsServer(std::string const& socket_path)
+    : tcp_acceptor_(io_service_),
+      local_acceptor_(io_service_) {
+  // A socket left behind by an earlier run would keep it from binding, but
+  // anything else found at the path is not ours to remove.
+  struct stat st;
+  if (lstat(socket_path.c_str(), &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      LERROR << "MetricsServer: " << socket_path << " exists and is not a socket";
+      throw "MetricsServer: The socket path is taken by a file that is not a socket";
+    }
+    unlink(socket_path.c_str());
+  }
+  boost::asio::local::stream_protocol::endpoint const endpoint(socket_path);
+  local_acceptor_.open(endpoint.protocol());
+  local_acceptor_.bind(endpoint);
+  local_acceptor_.listen();
+  accept<boost::asio::local::stream_protocol>(local_acceptor_);
+  LINFO << "MetricsServer: Serving the metrics on " << socket_path;
+  start();
+}
+
+MetricsServer::~MetricsServer() {
+  io_service_.stop();
+  thread_.join();
+}
+
+void MetricsServer::start() {
+  thread_ = boost::thread(
+      boost::bind(&boost::asio::io_service::run, &io_service_));
+}
+
+template<class Protocol>
+void MetricsServer::accept(typename Protocol::acceptor& acceptor) {
+  boost::shared_ptr<Session<Protocol> > session(
+      new Session<Protocol>(io_service_));
+  boost::function<void()> const accept_next =
+      boost::bind(&MetricsServer::accept<Protocol>, this, boost::ref(acceptor));
+  acceptor.async_accept(
+      session->socket(),
+      boost::bind(&handleAccept<Protocol>, session, accept_next,
+                  boost::asio::placeholders::error));
+}
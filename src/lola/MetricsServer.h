@@ -0,0 +1,50 @@
+#ifndef LOLA_METRICS_SERVER_H__
+#define LOLA_METRICS_SERVER_H__
+
+#include <string>
+
+#include <boost/asio.hpp>
+#include <boost/thread/thread.hpp>
+
+/**
+ * Serves the process-wide metrics (see `lepp::MetricsRegistry`) over HTTP, in
+ * the Prometheus text format, to scrapers on the same computer only: on a port
+ * of the loopback interface or on a UNIX-domain socket, e.g.
+ *
+ *   curl http://127.0.0.1:9464/metrics
+ *   curl --unix-socket /tmp/lola-metrics http://localhost/metrics
+ *
+ * The requests are served on a thread of the server's own, so a scrape only
+ * costs the pipeline the (relaxed) atomic reads of the metrics.
+ */
+class MetricsServer {
+public:
+  /**
+   * Serves the metrics on the given port of the loopback interface.
+   */
+  explicit MetricsServer(int port);
+  /**
+   * Serves the metrics on a UNIX-domain socket at the given path, replacing
+   * a socket left there by an earlier run. Throws if the path is taken by
+   * anything other than a socket.
+   */
+  explicit MetricsServer(std::string const& socket_path);
+  /**
+   * RAII: stops serving.
+   */
+  ~MetricsServer();
+private:
+  /**
+   * Accepts the next connection on the given acceptor.
+   */
+  template<class Protocol>
+  void accept(typename Protocol::acceptor& acceptor);
+  void start();
+
+  boost::asio::io_service io_service_;
+  boost::asio::ip::tcp::acceptor tcp_acceptor_;
+  boost::asio::local::stream_protocol::acceptor local_acceptor_;
+  boost::thread thread_;
+};
+
+#endif
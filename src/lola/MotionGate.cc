@@ -0,0 +1,103 @@
+#include "lola/MotionGate.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "deps/easylogging++.h"
+
+namespace {
+  /**
+   * The number of frames after which the gate logs how many of them it shed.
+   */
+  uint64_t const REPORT_INTERVAL = 300;
+
+  /**
+   * Whether the given pose was ever received, i.e. is not all zeros.
+   */
+  bool isValid(HR_Pose const& pose) {
+    for (int i = 0; i < 9; ++i) {
+      if (pose.R_wr_cl[i] != 0) return true;
+    }
+    return false;
+  }
+}
+
+MotionGate::MotionGate(
+    boost::shared_ptr<PoseService> service,
+    double downgrade_rate,
+    double skip_rate,
+    uint64_t stance_window)
+    : service_(service),
+      downgrade_rate_(downgrade_rate),
+      skip_rate_(skip_rate),
+      stance_window_(stance_window),
+      passed_(0),
+      downgraded_(0),
+      skipped_(0) {}
+
+double MotionGate::angularRate(HR_Pose const& pose, HR_Pose const& previous) {
+  // The angle of the rotation between the two camera orientations, from the
+  // trace of R_prev^T * R.
+  double trace = 0;
+  for (int i = 0; i < 3; ++i) {
+    for (int k = 0; k < 3; ++k) {
+      trace += previous.R_wr_cl[3*k + i] * pose.R_wr_cl[3*k + i];
+    }
+  }
+  double const cos_angle = std::max(-1., std::min(1., (trace - 1) / 2));
+  double const camera_rate = std::acos(cos_angle) / (HR_Pose::RATE / 1000.);
+  return std::max(camera_rate, std::fabs(static_cast<double>(pose.om_act)));
+}
+
+bool MotionGate::stanceSwitches(uint64_t stamp, uint8_t stance) const {
+  // Every pose received within the window is looked at, not only the ones at
+  // its ends, so that a switch and a switch back are caught as well. At half
+  // the pose period apart, each pose is the nearer one of some lookup, whose
+  // stance leg is the one it takes (see `interpolatePose`).
+  uint64_t const step = HR_Pose::RATE * 1000 / 2;
+  uint64_t const from = stamp > stance_window_ ? stamp - stance_window_ : 0;
+  uint64_t const to = stamp + stance_window_;
+  for (uint64_t t = from; t <= to; t += step) {
+    if (service_->getPoseAt(t).stance != stance) return true;
+  }
+  return false;
+}
+
+lepp::FrameGate::Verdict MotionGate::judge(uint64_t stamp) {
+  uint64_t const period = HR_Pose::RATE * 1000;
+  HR_Pose const pose = service_->getPoseAt(stamp);
+  Verdict verdict = PASS;
+  // Without poses, there is nothing to judge the frames by.
+  if (isValid(pose)) {
+    HR_Pose const previous = service_->getPoseAt(stamp - period);
+    double const rate = isValid(previous) ? angularRate(pose, previous) : 0;
+    if (rate > skip_rate_) {
+      verdict = SKIP;
+    } else if (rate > downgrade_rate_ || stanceSwitches(stamp, pose.stance)) {
+      verdict = DOWNGRADE;
+    }
+    LTRACE << "MotionGate: Angular rate " << rate << " rad/s, stance "
+           << static_cast<int>(pose.stance) << "; verdict " << verdict;
+  }
+
+  switch (verdict) {
+    case PASS: passed_.fetch_add(1, boost::memory_order_relaxed); break;
+    case DOWNGRADE: downgraded_.fetch_add(1, boost::memory_order_relaxed); break;
+    case SKIP: skipped_.fetch_add(1, boost::memory_order_relaxed); break;
+  }
+  Stats const s = stats();
+  if ((s.passed + s.downgraded + s.skipped) % REPORT_INTERVAL == 0) {
+    LINFO << "MotionGate: Of " << s.passed + s.downgraded + s.skipped
+          << " frames, downgraded " << s.downgraded
+          << " and skipped " << s.skipped;
+  }
+  return verdict;
+}
+
+MotionGate::Stats MotionGate::stats() const {
+  Stats stats;
+  stats.passed = passed_.load(boost::memory_order_relaxed);
+  stats.downgraded = downgraded_.load(boost::memory_order_relaxed);
+  stats.skipped = skipped_.load(boost::memory_order_relaxed);
+  return stats;
+}
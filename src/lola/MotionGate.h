@@ -0,0 +1,77 @@
+#ifndef LOLA_MOTION_GATE_H__
+#define LOLA_MOTION_GATE_H__
+
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "lepp2/FrameGate.hpp"
+
+#include "lola/PoseService.h"
+
+/**
+ * A `FrameGate` that sheds the frames captured while the robot's pose is
+ * unreliable and the frames are likely blurred: while the robot turns or the
+ * head moves quickly, or around the switch of the stance leg.
+ *
+ * The angular rate of the camera is the larger of the robot's commanded
+ * turning rate (`HR_Pose::om_act`) and the rate at which the camera's
+ * orientation changed over the last pose period. Frames captured at a rate
+ * above `skip_rate` are skipped; those above `downgrade_rate`, or within
+ * `stance_window` of a stance switch (before or after the capture), are
+ * downgraded.
+ */
+class MotionGate : public lepp::FrameGate {
+public:
+  /**
+   * A snapshot of the gate's counters.
+   */
+  struct Stats {
+    uint64_t passed;
+    uint64_t downgraded;
+    uint64_t skipped;
+  };
+
+  /**
+   * Creates a gate with the given thresholds on the angular rate (in rad/s)
+   * and the time after a stance switch during which frames are downgraded (in
+   * microseconds).
+   */
+  MotionGate(
+      boost::shared_ptr<PoseService> service,
+      double downgrade_rate,
+      double skip_rate,
+      uint64_t stance_window);
+
+  /**
+   * `FrameGate` interface implementation.
+   */
+  Verdict judge(uint64_t stamp);
+
+  /**
+   * Returns a snapshot of the gate's counters. Safe to call from any thread.
+   */
+  Stats stats() const;
+private:
+  /**
+   * The angular rate (in rad/s) of the camera at the time of the given pose,
+   * the previous pose being the one received a pose period before.
+   */
+  static double angularRate(HR_Pose const& pose, HR_Pose const& previous);
+  /**
+   * Whether the stance leg differs from the given one (the stance leg at the
+   * given time) anywhere within `stance_window_` before or after that time,
+   * as far as the poses received so far tell.
+   */
+  bool stanceSwitches(uint64_t stamp, uint8_t stance) const;
+
+  boost::shared_ptr<PoseService> const service_;
+  double const downgrade_rate_;
+  double const skip_rate_;
+  uint64_t const stance_window_;
+
+  boost::atomic<uint64_t> passed_;
+  boost::atomic<uint64_t> downgraded_;
+  boost::atomic<uint64_t> skipped_;
+};
+
+#endif
@@ -0,0 +1,100 @@
+#include "lola/NetworkReactor.h"
+
+#include <sstream>
+
+#include <boost/bind.hpp>
+
+#include "lepp2/debug/trace.hpp"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "deps/easylogging++.h"
+
+NetworkReactor::NetworkReactor(
+    size_t thread_count,
+    std::vector<int> const& cpus)
+    : thread_count_(thread_count),
+      cpus_(cpus),
+      running_(false) {
+  if (thread_count_ == 0) {
+    throw "The NetworkReactor needs at least one thread";
+  }
+}
+
+NetworkReactor::~NetworkReactor() {
+  // RAII
+  stop();
+  join();
+}
+
+void NetworkReactor::start() {
+  boost::mutex::scoped_lock lock(mutex_);
+  if (running_) return;
+  // A previous `stop` leaves the service in the stopped state.
+  io_service_.reset();
+  work_.reset(new boost::asio::io_service::work(io_service_));
+  for (size_t i = 0; i < thread_count_; ++i) {
+    threads_.create_thread(boost::bind(&NetworkReactor::run, this, i));
+  }
+  running_ = true;
+  LINFO << "NetworkReactor: Started " << thread_count_ << " thread(s)";
+}
+
+void NetworkReactor::stop() {
+  boost::mutex::scoped_lock lock(mutex_);
+  if (!running_) return;
+  LINFO << "NetworkReactor: Stopping...";
+  work_.reset();
+  io_service_.stop();
+}
+
+void NetworkReactor::join() {
+  threads_.join_all();
+  boost::mutex::scoped_lock lock(mutex_);
+  running_ = false;
+}
+
+bool NetworkReactor::running() const {
+  boost::mutex::scoped_lock lock(mutex_);
+  return running_;
+}
+
+void NetworkReactor::run(size_t idx) {
+  if (!cpus_.empty()) {
+    pinCurrentThread(cpus_[idx % cpus_.size()]);
+  }
+  std::ostringstream name;
+  name << "network " << idx;
+  lepp::Tracer::global().nameThread(name.str());
+  LINFO << "NetworkReactor: Thread " << idx << " started";
+  // Completion handlers are not supposed to throw; if one does anyway, log it
+  // and keep the loop going rather than losing the thread.
+  while (true) {
+    try {
+      io_service_.run();
+      break;
+    } catch (std::exception const& exc) {
+      LERROR << "NetworkReactor: Handler threw: " << exc.what();
+    } catch (char const* exc) {
+      LERROR << "NetworkReactor: Handler threw: " << exc;
+    }
+  }
+  LINFO << "NetworkReactor: Thread " << idx << " exiting...";
+}
+
+void NetworkReactor::pinCurrentThread(int cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  int const ret = pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+  if (ret != 0) {
+    LWARNING << "NetworkReactor: Unable to pin thread to CPU " << cpu;
+  }
+#else
+  LWARNING << "NetworkReactor: CPU pinning is not supported on this platform";
+#endif
+}
@@ -0,0 +1,95 @@
+#ifndef LOLA_NETWORK_REACTOR_H__
+#define LOLA_NETWORK_REACTOR_H__
+
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
+/**
+ * The process-wide event loop that runs the network I/O of all LOLA-facing
+ * components (the `PoseService`, the `AsyncRobotService` and the
+ * `LolaAggregator`).
+ *
+ * Rather than each of the components owning an `io_service` and a thread of
+ * its own, they all register their async operations with the reactor's
+ * `io_service`. The reactor runs it on a configurable number of threads, each
+ * of which can optionally be pinned to a CPU, which keeps the number of
+ * threads (and thus context switches) low and the latency predictable.
+ *
+ * The reactor also provides the single shutdown path for the network I/O:
+ * once `stop` and `join` return, no more completion handlers of any of the
+ * components are executed, so they can be safely destroyed.
+ */
+class NetworkReactor {
+public:
+  /**
+   * Creates a new reactor that will run its event loop on `thread_count`
+   * threads. If `cpus` is non-empty, the i-th thread is pinned to the CPU
+   * `cpus[i % cpus.size()]`.
+   */
+  NetworkReactor(
+      size_t thread_count = 1,
+      std::vector<int> const& cpus = std::vector<int>());
+  /**
+   * RAII: stops the reactor and waits for its threads to finish.
+   */
+  ~NetworkReactor();
+
+  /**
+   * The `io_service` that the network components should use for their async
+   * operations.
+   */
+  boost::asio::io_service& io_service() { return io_service_; }
+
+  /**
+   * Starts the reactor's threads. The event loop keeps running even when there
+   * are no pending async operations, until `stop` is called.
+   *
+   * Calling `start` on a reactor that is already running has no effect.
+   */
+  void start();
+  /**
+   * Stops the event loop. Pending async operations are abandoned and their
+   * handlers are not invoked. Does not wait for the threads to exit; see
+   * `join`.
+   */
+  void stop();
+  /**
+   * Blocks until all of the reactor's threads have exited.
+   */
+  void join();
+  /**
+   * Returns whether the reactor's threads are currently running.
+   */
+  bool running() const;
+private:
+  /**
+   * The function executed by each of the reactor's threads.
+   */
+  void run(size_t idx);
+  /**
+   * Pins the calling thread to the given CPU.
+   */
+  static void pinCurrentThread(int cpu);
+
+  size_t const thread_count_;
+  std::vector<int> const cpus_;
+
+  boost::asio::io_service io_service_;
+  /**
+   * Prevents the `io_service` from running out of work (and thus the threads
+   * from exiting) while the reactor is running.
+   */
+  boost::scoped_ptr<boost::asio::io_service::work> work_;
+  boost::thread_group threads_;
+  /**
+   * Guards the lifecycle (`start`/`stop`/`join`) of the reactor.
+   */
+  mutable boost::mutex mutex_;
+  bool running_;
+};
+
+#endif
@@ -1,7 +1,9 @@
 #ifndef LEPP2_LOLA_ODO_COORDINATE_TRANSFORMER_H_
 #define LEPP2_LOLA_ODO_COORDINATE_TRANSFORMER_H_
+#include "lepp2/BaseVideoSource.hpp"
 #include "lepp2/filter/PointFilter.hpp"
 
+#include "lola/Kinematics.h"
 #include "lola/PoseService.h"
 
 #include <fstream>
@@ -11,55 +13,6 @@
 #include <pcl/common/pca.h>
 #include <pcl/common/common.h>
 
-namespace {
-
-std::ostream& operator<<(std::ostream& out, LolaKinematicsParams const& param) {
-  out << "stamp #" << param.stamp << std::endl
-      << "phi_z_odo = " << param.phi_z_odo << std::endl
-      << "stance = " << param.stance << std::endl;
-  out << "t_wr_cl = ";
-  for (int i = 0; i < 3; ++i) out << param.t_wr_cl[i] << " "; out << std::endl;
-
-  out << "R_Wr_cl = " << std::endl;
-  for (int i = 0; i < 3; ++i) {
-    out << "  ";
-    for (int j = 0; j < 3; ++j) {
-      out << param.R_wr_cl[i][j] << " ";
-    }
-    out << std::endl;
-  }
-  out << "t_stance_odo = ";
-  for (int i = 0; i < 3; ++i) out << param.t_stance_odo[i] << " "; out << std::endl;
-
-  return out;
-}
-
-/**
- * A struct wrapping the parameters for performing a transformation between the
- * camera coordinate system and the LOLA world coordinate system.
- */
-struct OdoTransformParameters {
-  double r_odo_cam[3];
-  double A_odo_cam[3][3];
-};
-
-std::ostream& operator<<(std::ostream& out, OdoTransformParameters const& param) {
-  out << "r_odo_cam = ";
-  for (int i = 0; i < 3; ++i) out << param.r_odo_cam[i] << " "; out << std::endl;
-  out << "A_odo_cam = " << std::endl;
-  for (int i = 0; i < 3; ++i) {
-    out << "  ";
-    for (int j = 0; j < 3; ++j) {
-      out << param.A_odo_cam[i][j] << " ";
-    }
-    out << std::endl;
-  }
-
-  return out;
-}
-
-}
-
 /**
  * A `PointFilter` implementation that performs a transformation from the camera
  * coordinate system to the LOLA world coordinate system based on the currently
@@ -73,7 +26,7 @@ std::ostream& operator<<(std::ostream& out, OdoTransformParameters const& param)
 template<class PointT>
 class OdoCoordinateTransformer : public lepp::PointFilter<PointT> {
 public:
-  OdoCoordinateTransformer() : current_frame_(0) {}
+  OdoCoordinateTransformer() : current_frame_(0), null_transform_(true) {}
   /**
    * `PointFilter` interface method.
    */
@@ -82,16 +35,21 @@ public:
    * `PointFilter` interface method.
    */
   bool apply(PointT& original);
+  /**
+   * `PointFilter` interface method. The transformation is affine, unless it is
+   * a "null" transform, which rejects all points.
+   */
+  lepp::PointFilterForm form() const;
 protected:
   /**
-   * Gets the kinematics parameters that should be used for constructing the
-   * transformation for the next frame, effectively locking the transformation
-   * for all points for which the `apply` method is called until the next
-   * `getNextParams` call (which happens when the next frame is being processed).
+   * Gets the kinematics that should be used for the transformation of the next
+   * frame, effectively locking the transformation for all points for which the
+   * `apply` method is called until the next `getNextKinematics` call (which
+   * happens when the next frame is being processed).
    *
    * Concrete implementations need to provide the implementation of this method.
    */
-  virtual LolaKinematicsParams getNextParams() = 0;
+  virtual DerivedKinematics getNextKinematics() = 0;
 
   /**
    * Tracks the current frame number. Exposed to concrete implementations.
@@ -104,84 +62,36 @@ private:
    * based on the kinematics data given as a parameter.
    * These parameters will be considered valid until the next `setNext` call.
    */
-  void setNext(LolaKinematicsParams const& params);
+  void setNext(DerivedKinematics const& kinematics);
 
   /**
    * Parameters currently used for point transformations (i.e. by the `apply`
    * method).
    */
   OdoTransformParameters transform_params_;
-};
-
-namespace {
-  /**
-   * Puts a rotation matrix (around the z-axis) for the given angle in the given
-   * matrix `matrix`.
-   * It is assumed that the given matrix points to a matrix of dimensions 3x3.
-   */
-  void rotationmatrix(double angle, double matrix[][3]) {
-    double s = sin(angle);
-    double c = cos(angle);
-
-    matrix[0][0] = c; matrix[0][1] = -s; matrix[0][2] = 0;
-    matrix[1][0] = s; matrix[1][1] = c; matrix[1][2] = 0;
-    matrix[2][0] = 0; matrix[2][1] = 0; matrix[2][2] = 1;
-  }
-
   /**
-   * Transposes the given matrix `matrix` and puts the transpose result into the
-   * given `transpose` matrix.
-   *
-   * The matrices are assumed to be 3x3.
+   * Whether the current transformation is a "null" transform. This would cause
+   * all points to be mapped to (0, 0, 0) so each point is excluded from the
+   * output all together.
    */
-  void transpose(double matrix[][3], double transpose[][3]) {
-    for (int i = 0; i < 3; ++i) {
-      for (int j = 0; j < 3; ++j) {
-        transpose[j][i] = matrix[i][j];
-      }
-    }
-  }
-}
+  bool null_transform_;
+};
 
 template<class PointT>
 void OdoCoordinateTransformer<PointT>::prepareNext() {
   ++current_frame_;
-  LolaKinematicsParams new_params = this->getNextParams();
-  this->setNext(new_params);
+  this->setNext(this->getNextKinematics());
 }
 
 template<class PointT>
-void OdoCoordinateTransformer<PointT>::setNext(LolaKinematicsParams const& params) {
+void OdoCoordinateTransformer<PointT>::setNext(DerivedKinematics const& kinematics) {
   LTRACE << "Setting new transformation for frame " << current_frame_
          << " based on parameters: "
-         << params;
-  double rotation_matrix[3][3];
-  rotationmatrix(params.phi_z_odo, rotation_matrix);
-
-  // In pseudo-code (if matrix operations were supported):
-  // r_odo_cam = transpose(rotation_matrix) * (t_wr_cl + t_stance_odo)
-  double transposed_matrix[3][3];
-  transpose(rotation_matrix, transposed_matrix);
-  for (int i = 0; i < 3; ++i) {
-    transform_params_.r_odo_cam[i] = 0;
-    for (int j = 0; j < 3; ++j) {
-      transform_params_.r_odo_cam[i] +=
-          transposed_matrix[i][j] * (params.t_wr_cl[j] + params.t_stance_odo[j]);
-    }
-  }
-
-  // In pseudo-code (if matrix operations were supported):
-  // A_odo_cam = transpose(R_wr_cl * rotation_matrix)
-  double A_odo_cam_no_trans[3][3];
-  for (int i = 0; i < 3; ++i) {
-    for (int j = 0; j < 3; ++j) {
-      A_odo_cam_no_trans[i][j] = 0;
-      for (int k = 0; k < 3; ++k) {
-        A_odo_cam_no_trans[i][j] += params.R_wr_cl[i][k] * rotation_matrix[k][j];
-      }
-    }
-  }
-  transpose(A_odo_cam_no_trans, transform_params_.A_odo_cam);
+         << kinematics.params;
+  // The transformation itself is derived by the `PoseService`, only once for
+  // each new frame pose, and shared with all other components.
+  transform_params_ = kinematics.transform;
+  null_transform_ = kinematics.null_transform;
 
   LTRACE << "New transformaion matrices calculated: "
          << transform_params_;
@@ -189,19 +99,7 @@ void OdoCoordinateTransformer<PointT>::setNext(LolaKinematicsParams const& param
 
 template<class PointT>
 bool OdoCoordinateTransformer<PointT>::apply(PointT& original) {
-  // This checks if we have a "null" transform. This would cause all points to
-  // be mapped to (0, 0, 0) so we exclude each such point from the output all
-  // together.
-  bool all = true;
-  for (int i = 0; i < 3; ++i) {
-    all = all && (transform_params_.r_odo_cam[i] == 0);
-  }
-  for (int i = 0; i < 3; ++i) {
-    for (int j = 0; j < 3; ++j) {
-      all = all && (transform_params_.A_odo_cam[i][j] == 0);
-    }
-  }
-  if (all) return false;
+  if (null_transform_) return false;
   // world_point = r_odo_cam + (A_odo_cam * original)
   PointT odo_point = original;
   odo_point.x = (transform_params_.r_odo_cam[0])
@@ -222,40 +120,91 @@ bool OdoCoordinateTransformer<PointT>::apply(PointT& original) {
   return true;
 }
 
+template<class PointT>
+lepp::PointFilterForm OdoCoordinateTransformer<PointT>::form() const {
+  if (null_transform_) return lepp::PointFilterForm::RejectAll();
+  return lepp::PointFilterForm::Affine(
+      transform_params_.A_odo_cam, transform_params_.r_odo_cam);
+}
+
 /**
  * A concrete implementation of the transformer, which obtains its kinematics
  * information from the robot. Relies on a `PoseService` instance that it can
- * ask for the newest robot kinematics info when needed.
+ * ask for the robot kinematics info at the time each frame was captured.
+ *
+ * By default, the frame's capture time is also handed on to the `PoseService`,
+ * so that other components (e.g. the `Robot`) see the same pose while the
+ * frame is processed. A transformer filtering the frames of one of several
+ * sensors, concurrently with the others, must not do that; it only looks up
+ * the pose at the capture time of its own frames instead.
  */
 template<class PointT>
 class RobotOdoTransformer : public OdoCoordinateTransformer<PointT> {
 public:
-  RobotOdoTransformer(boost::shared_ptr<PoseService> service)
-      : service_(service) {}
+  RobotOdoTransformer(boost::shared_ptr<PoseService> service,
+                      bool sets_frame_time = true)
+      : service_(service),
+        sets_frame_time_(sets_frame_time),
+        stamp_(0),
+        has_kinematics_(false) {}
+  /**
+   * `PointFilter` interface method.
+   */
+  void setFrameStamp(uint64_t stamp) {
+    stamp_ = stamp;
+    if (sets_frame_time_) service_->setFrameTime(stamp);
+  }
 protected:
-  LolaKinematicsParams getNextParams();
+  DerivedKinematics getNextKinematics();
 private:
   boost::shared_ptr<PoseService> service_;
+  bool const sets_frame_time_;
+  uint64_t stamp_;
+  /**
+   * The kinematics of the last frame, when the frame time is not handed on
+   * (and the kinematics are thus not derived by the `PoseService`), and
+   * whether there has been a last frame.
+   */
+  DerivedKinematics kinematics_;
+  bool has_kinematics_;
 };
 
 template<class PointT>
-LolaKinematicsParams RobotOdoTransformer<PointT>::getNextParams() {
-  HR_Pose pose = service_->getCurrentPose();
-  // Now convert the current raw pose to parameters that are of relevance to the
-  // transformation.
-  LolaKinematicsParams params;
-  for (int i = 0; i < 3; ++i) {
-    params.t_wr_cl[i] = pose.t_wr_cl[i];
-    params.t_stance_odo[i] = pose.t_stance_odo[i];
-    for (int j = 0; j < 3; ++j) {
-      params.R_wr_cl[i][j] = pose.R_wr_cl[3*i + j];
-    }
+DerivedKinematics RobotOdoTransformer<PointT>::getNextKinematics() {
+  // The pose at the time the frame was captured, not the newest one: the
+  // robot keeps moving while the frame waits to be processed.
+  if (sets_frame_time_) return service_->getKinematics();
+  // They are only derived anew when the pose differs from the last frame's,
+  // which it does not while the frames are newer than the newest pose.
+  HR_Pose const pose = service_->getPoseAt(stamp_);
+  if (!has_kinematics_ || static_cast<int>(pose.stamp) != kinematics_.stamp) {
+    kinematics_ = deriveKinematics(PoseService::getParams(pose));
+    has_kinematics_ = true;
   }
-  params.phi_z_odo = pose.phi_z_odo;
-  params.stance = pose.stance;
-  params.stamp = pose.stamp;
-
-  return params;
+  return kinematics_;
 }
 
+/**
+ * Hands the capture time of each frame of the source that it observes on to
+ * the `PoseService`, like the `RobotOdoTransformer` does, for a source whose
+ * frames are already in the ODO coordinate system (e.g. the fusion of several
+ * sensors, each with its own transformer).
+ */
+template<class PointT>
+class PoseFrameClock : public lepp::VideoObserver<PointT> {
+public:
+  PoseFrameClock(boost::shared_ptr<PoseService> service) : service_(service) {}
+  /**
+   * `VideoObserver` interface method.
+   */
+  void notifyNewFrame(
+      int idx,
+      const typename pcl::PointCloud<PointT>::ConstPtr& cloud) {
+    service_->setFrameTime(
+        lepp::captureTime(cloud->header.stamp, lepp::localTime()));
+  }
+private:
+  boost::shared_ptr<PoseService> service_;
+};
+
 #endif
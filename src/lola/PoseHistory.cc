@@ -0,0 +1,182 @@
+#include "lola/PoseHistory.h"
+
+#include <cmath>
+
+namespace {
+/**
+ * If a newly received pose implies a clock offset that differs from the
+ * current estimate by more than this (in microseconds), the robot's clock is
+ * assumed to have been reset (e.g. the controller was restarted) and the
+ * estimate starts over.
+ */
+int64_t const CLOCK_RESET_THRESHOLD = 1000000;
+
+float lerp(float a, float b, double alpha) {
+  return a + alpha * (b - a);
+}
+
+void lerp(float const* a, float const* b, double alpha, size_t n, float* out) {
+  for (size_t i = 0; i < n; ++i) out[i] = lerp(a[i], b[i], alpha);
+}
+
+/**
+ * Interpolates between two angles along the shorter arc.
+ */
+float lerpAngle(float a, float b, double alpha) {
+  double diff = b - a;
+  while (diff > M_PI) diff -= 2 * M_PI;
+  while (diff < -M_PI) diff += 2 * M_PI;
+  return a + alpha * diff;
+}
+
+/**
+ * Turns the given (row-major) 3x3 matrix back into a rotation matrix by a
+ * Gram-Schmidt orthonormalization of its rows. The third row is recomputed as
+ * the cross product of the first two, which keeps the matrix right-handed.
+ */
+void orthonormalize(float* R) {
+  float* r0 = R;
+  float* r1 = R + 3;
+  float* r2 = R + 6;
+  double n0 = std::sqrt(r0[0]*r0[0] + r0[1]*r0[1] + r0[2]*r0[2]);
+  if (n0 == 0) return;
+  for (int i = 0; i < 3; ++i) r0[i] /= n0;
+  double const dot = r0[0]*r1[0] + r0[1]*r1[1] + r0[2]*r1[2];
+  for (int i = 0; i < 3; ++i) r1[i] -= dot * r0[i];
+  double n1 = std::sqrt(r1[0]*r1[0] + r1[1]*r1[1] + r1[2]*r1[2]);
+  if (n1 == 0) return;
+  for (int i = 0; i < 3; ++i) r1[i] /= n1;
+  r2[0] = r0[1]*r1[2] - r0[2]*r1[1];
+  r2[1] = r0[2]*r1[0] - r0[0]*r1[2];
+  r2[2] = r0[0]*r1[1] - r0[1]*r1[0];
+}
+
+void lerpRotation(float const* a, float const* b, double alpha, float* out) {
+  lerp(a, b, alpha, 9, out);
+  orthonormalize(out);
+}
+}  // namespace <anonymous>
+
+HR_Pose interpolatePose(HR_Pose const& a, HR_Pose const& b, double alpha) {
+  // The discrete fields (counters, stance...) come from the nearer pose.
+  HR_Pose ret = alpha < 0.5 ? a : b;
+  ret.stamp = a.stamp + static_cast<int64_t>(alpha * (int64_t)(b.stamp - a.stamp));
+
+  lerp(a.t_wr_fr, b.t_wr_fr, alpha, 3, ret.t_wr_fr);
+  lerp(a.t_wr_fl, b.t_wr_fl, alpha, 3, ret.t_wr_fl);
+  lerp(a.t_wr_cl, b.t_wr_cl, alpha, 3, ret.t_wr_cl);
+  lerp(a.t_wr_cr, b.t_wr_cr, alpha, 3, ret.t_wr_cr);
+  lerp(a.t_wr_ub, b.t_wr_ub, alpha, 3, ret.t_wr_ub);
+  lerpRotation(a.R_wr_fr, b.R_wr_fr, alpha, ret.R_wr_fr);
+  lerpRotation(a.R_wr_fl, b.R_wr_fl, alpha, ret.R_wr_fl);
+  lerpRotation(a.R_wr_cl, b.R_wr_cl, alpha, ret.R_wr_cl);
+  lerpRotation(a.R_wr_cr, b.R_wr_cr, alpha, ret.R_wr_cr);
+  lerpRotation(a.R_wr_ub, b.R_wr_ub, alpha, ret.R_wr_ub);
+  for (int i = 0; i < HR_Pose::N_SEGMENTS; ++i) {
+    lerp(a.seg_pose[i].t, b.seg_pose[i].t, alpha, 3, ret.seg_pose[i].t);
+    lerpRotation(a.seg_pose[i].R, b.seg_pose[i].R, alpha, ret.seg_pose[i].R);
+  }
+
+  // The odometry is given relative to the stance foot, so it jumps whenever
+  // the stance leg changes; there is nothing to interpolate across the jump.
+  if (a.stance == b.stance) {
+    lerp(a.t_stance_odo, b.t_stance_odo, alpha, 3, ret.t_stance_odo);
+    ret.phi_z_odo = lerpAngle(a.phi_z_odo, b.phi_z_odo, alpha);
+  }
+
+  ret.vx_act = lerp(a.vx_act, b.vx_act, alpha);
+  ret.vy_act = lerp(a.vy_act, b.vy_act, alpha);
+  ret.om_act = lerp(a.om_act, b.om_act, alpha);
+
+  return ret;
+}
+
+size_t const PoseHistory::CAPACITY;
+
+PoseHistory::PoseHistory() : head_(0), clock_offset_(0) {}
+
+void PoseHistory::push(HR_Pose const& pose, uint64_t recv_time) {
+  uint64_t const index = head_.load(boost::memory_order_relaxed);
+  Entry entry;
+  entry.index = index;
+  entry.recv_time = recv_time;
+  entry.pose = pose;
+  slots_[index % CAPACITY].store(entry);
+  head_.store(index + 1, boost::memory_order_release);
+
+  int64_t const offset =
+      static_cast<int64_t>(recv_time) - static_cast<int64_t>(pose.stamp);
+  int64_t const current = clock_offset_.load(boost::memory_order_relaxed);
+  if (index == 0 ||
+      offset < current ||
+      offset - current > CLOCK_RESET_THRESHOLD) {
+    clock_offset_.store(offset, boost::memory_order_release);
+  }
+}
+
+bool PoseHistory::readStamp(uint64_t index, uint64_t& stamp) const {
+  StampReader reader;
+  slots_[index % CAPACITY].read(reader);
+  stamp = reader.stamp;
+  return reader.index == index;
+}
+
+bool PoseHistory::readPose(uint64_t index, HR_Pose& pose) const {
+  Entry const entry = slots_[index % CAPACITY].load();
+  if (entry.index != index) return false;
+  pose = entry.pose;
+  return true;
+}
+
+uint64_t PoseHistory::tornReads() const {
+  uint64_t total = 0;
+  for (size_t i = 0; i < CAPACITY; ++i) total += slots_[i].retries();
+  return total;
+}
+
+bool PoseHistory::latest(HR_Pose& pose) const {
+  // The newest pose can only be overwritten by `CAPACITY` more pushes, so
+  // simply retry with the (new) newest one if that happens.
+  while (true) {
+    uint64_t const head = head_.load(boost::memory_order_acquire);
+    if (head == 0) return false;
+    if (readPose(head - 1, pose)) return true;
+  }
+}
+
+bool PoseHistory::poseAt(uint64_t local_time, HR_Pose& pose) const {
+  uint64_t const head = head_.load(boost::memory_order_acquire);
+  if (head == 0) return false;
+  int64_t const robot_time = static_cast<int64_t>(local_time) - clockOffset();
+  uint64_t const oldest = head > CAPACITY ? head - CAPACITY : 0;
+
+  // Walk back from the newest pose until the pair of poses surrounding the
+  // requested time is found. The requested time is usually recent, so only a
+  // few stamps need to be looked at.
+  uint64_t newer = head - 1;
+  uint64_t newer_stamp;
+  if (!readStamp(newer, newer_stamp)) return latest(pose);
+  if (robot_time >= static_cast<int64_t>(newer_stamp)) {
+    return readPose(newer, pose) || latest(pose);
+  }
+  while (newer > oldest) {
+    uint64_t const older = newer - 1;
+    uint64_t older_stamp;
+    // If the older pose was overwritten in the meantime, the time is clamped
+    // to the oldest pose still available.
+    if (!readStamp(older, older_stamp)) break;
+    if (static_cast<int64_t>(older_stamp) <= robot_time) {
+      HR_Pose a;
+      HR_Pose b;
+      if (!readPose(older, a) || !readPose(newer, b)) break;
+      int64_t const span = static_cast<int64_t>(b.stamp - a.stamp);
+      double const alpha = span > 0
+          ? static_cast<double>(robot_time - static_cast<int64_t>(a.stamp)) / span
+          : 1.;
+      pose = interpolatePose(a, b, alpha);
+      return true;
+    }
+    newer = older;
+  }
+  return readPose(newer, pose) || latest(pose);
+}
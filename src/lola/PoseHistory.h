@@ -0,0 +1,130 @@
+#ifndef LOLA_POSE_HISTORY_H__
+#define LOLA_POSE_HISTORY_H__
+
+#include "lola/HR_Pose.h"
+#include "lola/SeqLock.h"
+
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+
+/**
+ * A fixed-size history of the most recent robot poses, each tagged with the
+ * (local) time at which it was received.
+ *
+ * The history makes it possible to find the pose that the robot was in at the
+ * time some event (e.g. the capture of a frame) occurred, rather than using
+ * whatever pose happens to be the newest one when the event is processed.
+ * Since the poses are timestamped by the robot's clock (`HR_Pose::stamp`, in
+ * microseconds), the history keeps an estimate of the offset between the
+ * robot's and the local clock: the smallest difference between the local
+ * receive time and the robot stamp seen so far, i.e. the offset under the
+ * least network delay.
+ *
+ * The history is a ring buffer with a single writer (the thread receiving the
+ * poses) and any number of readers. Each slot is a `SeqLock`, so neither the
+ * writer nor the readers ever block or allocate; a reader that races with the
+ * writer simply retries.
+ */
+class PoseHistory : boost::noncopyable {
+public:
+  /**
+   * The number of poses kept. With a pose every 50 ms, this covers 6.4 s.
+   */
+  static size_t const CAPACITY = 128;
+
+  PoseHistory();
+
+  /**
+   * Appends a new pose to the history, overwriting the oldest one if the
+   * history is full. `recv_time` is the local time at which the pose was
+   * received, given in microseconds since the epoch.
+   *
+   * Must only ever be called from a single thread at a time.
+   */
+  void push(HR_Pose const& pose, uint64_t recv_time);
+
+  /**
+   * Puts the newest pose into `pose`. Returns false (leaving `pose`
+   * unmodified) if no pose has been received yet.
+   */
+  bool latest(HR_Pose& pose) const;
+  /**
+   * Puts the pose that the robot was in at the given local time (in
+   * microseconds since the epoch) into `pose`, interpolating between the two
+   * poses received around that time.
+   *
+   * Times before the oldest pose in the history or after the newest one are
+   * clamped to those poses; the pose is never extrapolated.
+   *
+   * Returns false (leaving `pose` unmodified) if no pose has been received
+   * yet.
+   */
+  bool poseAt(uint64_t local_time, HR_Pose& pose) const;
+
+  /**
+   * The current estimate of the difference between the local clock and the
+   * robot's clock, in microseconds.
+   */
+  int64_t clockOffset() const { return clock_offset_.load(boost::memory_order_acquire); }
+  /**
+   * The number of poses pushed since the history was created.
+   */
+  uint64_t count() const { return head_.load(boost::memory_order_acquire); }
+  /**
+   * The total number of times that readers had to retry reading a slot
+   * because they raced with the writer.
+   */
+  uint64_t tornReads() const;
+private:
+  struct Entry {
+    /**
+     * The position of the pose in the overall sequence of pushed poses. Allows
+     * readers to detect that the slot has been reused for a newer pose.
+     */
+    uint64_t index;
+    uint64_t recv_time;
+    HR_Pose pose;
+  };
+  /**
+   * Reads only the index and the stamp of an entry, sparing the copy of the
+   * whole pose.
+   */
+  struct StampReader {
+    void operator()(Entry const& entry) {
+      index = entry.index;
+      stamp = entry.pose.stamp;
+    }
+    uint64_t index;
+    uint64_t stamp;
+  };
+
+  /**
+   * Reads the stamp of the pose with the given index. Returns false if the
+   * pose has already been overwritten.
+   */
+  bool readStamp(uint64_t index, uint64_t& stamp) const;
+  /**
+   * Copies the pose with the given index. Returns false if the pose has
+   * already been overwritten.
+   */
+  bool readPose(uint64_t index, HR_Pose& pose) const;
+
+  SeqLock<Entry> slots_[CAPACITY];
+  /**
+   * The index that the next pushed pose will get. The newest pose is found at
+   * `head_ - 1`.
+   */
+  boost::atomic<uint64_t> head_;
+  boost::atomic<int64_t> clock_offset_;
+};
+
+/**
+ * Interpolates between the two given poses: `alpha` = 0 gives `a` and
+ * `alpha` = 1 gives `b`. Positions are interpolated linearly, rotation
+ * matrices are interpolated and then re-orthonormalized. The fields that
+ * depend on the stance leg are taken from the nearer pose if the stance leg
+ * changed between the two poses.
+ */
+HR_Pose interpolatePose(HR_Pose const& a, HR_Pose const& b, double alpha);
+
+#endif
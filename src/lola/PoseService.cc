@@ -1,68 +1,66 @@
 #include "lola/PoseService.h"
-#include "boost/thread.hpp"
+#include <boost/bind.hpp>
+
+#include "lepp2/debug/trace.hpp"
 
 #include <cstring>
 #include <iostream>
 
 #include "deps/easylogging++.h"
 
-namespace {
-
-/**
- * Puts a rotation matrix (around the z-axis) for the given angle in the given
- * matrix `matrix`.
- * It is assumed that the given matrix points to a matrix of dimensions 3x3.
- */
-void rotationmatrix(double angle, double matrix[][3]) {
-  double s = sin(angle);
-  double c = cos(angle);
-
-  matrix[0][0] = c; matrix[0][1] = -s; matrix[0][2] = 0;
-  matrix[1][0] = s; matrix[1][1] = c; matrix[1][2] = 0;
-  matrix[2][0] = 0; matrix[2][1] = 0; matrix[2][2] = 1;
-}
+uint64_t const PoseService::STALE_POSE_AGE;
 
-/**
- * Transposes the given matrix `matrix` and puts the transpose result into the
- * given `transpose` matrix.
- *
- * The matrices are assumed to be 3x3.
- */
-void transpose(double matrix[][3], double transpose[][3]) {
-  for (int i = 0; i < 3; ++i) {
-    for (int j = 0; j < 3; ++j) {
-      transpose[j][i] = matrix[i][j];
-    }
-  }
+uint64_t PoseService::now() {
+  boost::posix_time::ptime const epoch(boost::gregorian::date(1970, 1, 1));
+  return (boost::posix_time::microsec_clock::universal_time() - epoch)
+      .total_microseconds();
 }
 
-} // namespace anonymous
-
 void PoseService::read_handler(
     boost::system::error_code const& ec,
     std::size_t bytes_transferred) {
+  if (ec == boost::asio::error::operation_aborted) {
+    // The socket was closed; the service is shutting down.
+    return;
+  }
+  lepp::TraceSpan span("pose");
   LINFO << "Pose Service: Received " << bytes_transferred;
   if (bytes_transferred != sizeof(HR_Pose)) {
     LERROR << "Pose Service: Error: Invalid datagram size."
            << "Expected " << sizeof(HR_Pose);
+    invalid_.fetch_add(1, boost::memory_order_relaxed);
     // If this one fails, we still queue another receive...
     queue_recv();
     return;
   }
-  boost::shared_ptr<HR_Pose> new_pose(new HR_Pose);
   // The copy is thread safe since nothing can be writing to the recv_buffer
   // at this point. No new async read is queued until this callback is complete.
-  memcpy(&*new_pose, &recv_buffer_[0], sizeof(HR_Pose));
-  // This performs an atomic update of the pointer, making it a lock-free,
-  // thread-safe operation.
-  pose_ = new_pose;
+  HR_Pose pose;
+  memcpy(&pose, &recv_buffer_[0], sizeof(HR_Pose));
+  // Remember when the pose arrived, so that it can be matched up with frames
+  // and its age can be tracked.
+  publish(pose, now());
   LINFO << "Pose Service: Updated current pose";
   queue_recv();
 }
 
-void PoseService::service_thread() {
-  LINFO << "Pose Service: Thread started";
-  io_service_.run();
+void PoseService::publish(HR_Pose const& pose, uint64_t recv_time) {
+  TimedPose latest;
+  latest.pose = pose;
+  latest.recv_time = recv_time;
+  // Publish the pose: readers never see a partially updated pose and neither
+  // they nor the publisher ever block or allocate.
+  latest_.store(latest);
+  history_.push(latest.pose, latest.recv_time);
+  received_.fetch_add(1, boost::memory_order_relaxed);
+  poses_received_.inc();
+  updateFrameKinematics();
+
+  boost::mutex::scoped_lock lock(observers_mutex_);
+  size_t const sz = observers_.size();
+  for (size_t i = 0; i < sz; ++i) {
+    observers_[i]->notifyNewPose(pose, recv_time);
+  }
 }
 
 void PoseService::queue_recv() {
@@ -83,55 +81,126 @@ void PoseService::bind() {
 void PoseService::start() {
   bind();
   queue_recv();
-  // Start the thread that will run the associated I/O service.
-  boost::thread(boost::bind(&PoseService::service_thread, this));
 }
 
 
 HR_Pose PoseService::getCurrentPose() const {
-  // This does an atomic copy of the pointer (the refcount is atomically updated)
-  // There can be no race condition since if the service needs to update the
-  // pointer, it will do so atomically and the reader also obtains a copy of the
-  // pointer atomically.
-  boost::shared_ptr<HR_Pose> p = pose_;
-  // Now we are safe to manipulate the object itself, since nothing else needs
-  // to directly touch the instance itself and we have safely obtained a
-  // reference to it.
-  // We just return the object (but this involves a non-atomic copy, hence the
-  // pointer dance).
-
-  if (p) {
-    return *p;
-  } else {
+  TimedPose const latest = latest_.load();
+  if (latest.recv_time == 0) {
+    // No pose received yet.
     HR_Pose pose = {0};
     return pose;
   }
+  recordAge(latest.recv_time);
+  return latest.pose;
 }
 
-lepp::Coordinate PoseService::getRobotPosition() const {
-  LolaKinematicsParams params = getParams();
+void PoseService::recordAge(uint64_t recv_time) const {
+  uint64_t const current = now();
+  uint64_t const age = current > recv_time ? current - recv_time : 0;
+  last_age_.store(age, boost::memory_order_relaxed);
+  pose_age_.observe(age);
+  uint64_t max_age = max_age_.load(boost::memory_order_relaxed);
+  while (age > max_age &&
+         !max_age_.compare_exchange_weak(max_age, age, boost::memory_order_relaxed)) {}
+  if (age > STALE_POSE_AGE) {
+    stale_reads_.fetch_add(1, boost::memory_order_relaxed);
+  }
+}
 
-  double rotation_matrix[3][3];
-  rotationmatrix(params.phi_z_odo, rotation_matrix);
+PoseService::Stats PoseService::stats() const {
+  Stats stats;
+  stats.received = received_.load(boost::memory_order_relaxed);
+  stats.invalid = invalid_.load(boost::memory_order_relaxed);
+  stats.torn_reads = latest_.retries() + history_.tornReads();
+  stats.stale_reads = stale_reads_.load(boost::memory_order_relaxed);
+  stats.last_age = last_age_.load(boost::memory_order_relaxed);
+  stats.max_age = max_age_.load(boost::memory_order_relaxed);
+  stats.kinematics_updates = kinematics_updates_.load(boost::memory_order_relaxed);
+  return stats;
+}
 
-  // In pseudo-code (if matrix operations were supported):
-  // ret = transpose(rotation_matrix) * (t_stance_odo)
-  double transposed_matrix[3][3];
-  transpose(rotation_matrix, transposed_matrix);
-  std::vector<double> ret(3);
-  for (int i = 0; i < 3; ++i) {
-    ret[i] = 0;
-    for (int j = 0; j < 3; ++j) {
-      ret[i] +=
-          transposed_matrix[i][j] * (params.t_stance_odo[j]);
-    }
+HR_Pose PoseService::getPoseAt(uint64_t local_time) const {
+  HR_Pose pose;
+  if (history_.poseAt(local_time, pose)) {
+    return pose;
   }
+  return getCurrentPose();
+}
+
+HR_Pose PoseService::getFramePose() const {
+  uint64_t const frame_time = frame_time_.load(boost::memory_order_acquire);
+  if (frame_time == 0) {
+    return getCurrentPose();
+  }
+  // The frame pose is only as fresh as the newest pose available.
+  TimedPose const latest = latest_.load();
+  if (latest.recv_time != 0) recordAge(latest.recv_time);
+  return getPoseAt(frame_time);
+}
 
-  return lepp::Coordinate(ret[0], ret[1], ret[2]);
+void PoseService::setFrameTime(uint64_t local_time) {
+  frame_time_.store(local_time, boost::memory_order_release);
+  updateFrameKinematics();
+}
+
+void PoseService::updateFrameKinematics() {
+  boost::mutex::scoped_lock lock(kinematics_mutex_);
+  uint64_t const frame_time = frame_time_.load(boost::memory_order_acquire);
+  HR_Pose pose;
+  if (frame_time == 0 || !history_.poseAt(frame_time, pose)) {
+    pose = latest_.load().pose;
+  }
+  // A new pose that did not change the frame pose (e.g. one received after the
+  // frame was captured, while an even newer one was already there) does not
+  // require anything to be derived anew.
+  if (kinematics_valid_ &&
+      static_cast<int>(pose.stamp) == frame_kinematics_.load().stamp) {
+    return;
+  }
+  frame_kinematics_.store(deriveKinematics(getParams(pose)));
+  kinematics_valid_ = true;
+  kinematics_updates_.fetch_add(1, boost::memory_order_relaxed);
+}
+
+namespace {
+/**
+ * Copies out only the robot position of the published kinematics.
+ */
+struct RobotPositionReader {
+  void operator()(DerivedKinematics const& kinematics) {
+    position = kinematics.robot_position;
+  }
+  lepp::Coordinate position;
+};
+/**
+ * Copies out only the parameters of the published kinematics.
+ */
+struct ParamsReader {
+  void operator()(DerivedKinematics const& kinematics) {
+    params = kinematics.params;
+  }
+  LolaKinematicsParams params;
+};
+}  // namespace <anonymous>
+
+DerivedKinematics PoseService::getKinematics() const {
+  return frame_kinematics_.load();
+}
+
+lepp::Coordinate PoseService::getRobotPosition() const {
+  RobotPositionReader reader;
+  frame_kinematics_.read(reader);
+  return reader.position;
 }
 
 LolaKinematicsParams PoseService::getParams() const {
-  HR_Pose pose = getCurrentPose();
+  ParamsReader reader;
+  frame_kinematics_.read(reader);
+  return reader.params;
+}
+
+LolaKinematicsParams PoseService::getParams(HR_Pose const& pose) {
   // Now convert the current raw pose to parameters that are of relevance to the
   // transformation.
   LolaKinematicsParams params;
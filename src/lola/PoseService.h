@@ -1,188 +1,194 @@
 #ifndef LOLA_POSE_SERVICE_H__
 #define LOLA_POSE_SERVICE_H__
 
+#include <vector>
+
 #include <boost/asio.hpp>
 #include <boost/array.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 
+#include "lepp2/Metrics.hpp"
 #include "lepp2/models/Coordinate.h"
+#include "lola/HR_Pose.h"
+#include "lola/Kinematics.h"
+#include "lola/PoseHistory.h"
+#include "lola/SeqLock.h"
 using boost::asio::ip::udp;
 
 /**
- * A struct wrapping the parameters LOLA-provided kinematics parameters that are
- * used to construct the transformation matrices between the camera frame and
- * the world coordinate system as LOLA knows it.
+ * An interface for classes that wish to be notified of each pose received by a
+ * `PoseService`.
  */
-struct LolaKinematicsParams {
-  double t_wr_cl[3];
-  double R_wr_cl[3][3];
-  double t_stance_odo[3];
-  double phi_z_odo;
-  double stance;
-  int stamp;
-};
-
-/*!
-  Robot pose data
-
-  vectors given in world coordinate frame
-
-  ub = upper body
-  fl = left foot
-  fr = right foot
-  cl = left camera
-  cr = right camera
-  im = IMU,
-
-  wr = world frame
-  odo = drift frame
-
-  Struct reused verbatim from the original LOLA source code to keep compatibility.
-*/
-#pragma pack(push)
-#pragma pack(1)
-struct HR_Pose
-{
-  enum{RIGHT=0,LEFT=1};
-  //!UDP port
-  enum{PORT=0xD001};
-  //!data rate [ms] (actually determined by hardware trigger!)
-  enum{RATE=50};
-  //!number of segments in detailed robot model.
-  enum{N_SEGMENTS=25};
-
-  //rot = rotation
-  //add = adduction
-  //flx = flexion
-  enum SegmentIndex
-    {
-      //torso
-      seg_torso=0,
-      //pelvis
-      seg_pelvis_rot,seg_pelvis_add,
-      //right leg
-      seg_hip_rot_r,seg_hip_add_r,seg_hip_flx_r,seg_knee_flx_r,seg_ankle_add_r,seg_ankle_flx_r,seg_toe_flx_r,
-      //left leg
-      seg_hip_rot_l,seg_hip_add_l,seg_hip_flx_l,seg_knee_flx_l,seg_ankle_add_l,seg_ankle_flx_l,seg_toe_flx_l,
-      //right arm
-      seg_shoulder_flx_r,seg_shoulder_add_r,seg_elbow_flx_r,
-      //left arm
-      seg_shoulder_flx_l,seg_shoulder_add_l,seg_elbow_flx_l,
-      //head (tilt: both cameras without convergence joint)
-      seg_head_pan, seg_head_tilt
-    };
-
-  //!segment pose
-  struct SegmentPose
-  {
-    //!transform matrix
-    float R[3*3];
-    //!position
-    float t[3];
-  };
-
-  //////////////////////////////////////////////////
-  //// 1 -- header
-  //!data struct version
-  uint32_t version;
-  //! tick counter
-  uint64_t tick_counter;
-  //!<stance leg (RIGHT/LEFT)
-  uint8_t stance;
-  //!<padding
-  uint8_t zero[3];
-
-  uint64_t stamp;
-
-
-  //////////////////////////////////////////////////
-  //// 2 -- simplified /abstract robot model (feet, cameras, upper body)
-  //!vector from world frame to left leg in world frame
-  float t_wr_fr[3];
-  //!vector from world frame to right leg in world frame
-  float t_wr_fl[3];
-  //!vector from world frame to left camera in world frame
-  float t_wr_cl[3];
-  //!vector from world frame to right camera in world frame
-  float t_wr_cr[3];
-
-  //!transformation matrix from left leg to world frame
-  float R_wr_fr[3*3];
-  //!transformation matrix from right leg to world frame
-  float R_wr_fl[3*3];
-  //!transformation matrix from left camera to world frame
-  float R_wr_cl[3*3];
-  //!transformation matrix from right camera to world frame
-  float R_wr_cr[3*3];
-  /*!
-    transformation matrix from upper body coordinate frame
-    to inertial frame measured by IMU (world frame)
-    (identity matrix, if robot is standing upright)
-  */
-  float R_wr_ub[3*3];
-  //!vector from world frame to upper body frame in world frame
-  float t_wr_ub[3];
-
-  //////////////////////////////////////////////////
-  //// 3 -- full robot pose
-  SegmentPose seg_pose[N_SEGMENTS];
-
-  //////////////////////////////////////////////////
-  //// 4 -- "drift pose" (odometry)
-  //!stance leg in drift frame
-  float t_stance_odo[3];
-  //!stance foot rotation in drift frame
-  float phi_z_odo;
-
-  //////////////////////////////////////////////////
-  //// 5 -- "drift pose" (odometry)
-  //!<currently active velocity in x-direction [m/s]
-  float vx_act;
-  //!<currently active velocity in y-direction [m/s]
-  float vy_act;
-  //!<currently active angular velocity [rad/s]
-  float om_act;
+class PoseObserver {
+public:
+  virtual ~PoseObserver() {}
+  /**
+   * Called for each new pose, along with the local time at which it was
+   * received (in microseconds since the epoch). Invoked on the thread that
+   * received the pose, so implementations need to return quickly.
+   */
+  virtual void notifyNewPose(HR_Pose const& pose, uint64_t recv_time) = 0;
 };
-#pragma pack (pop)
 
 /**
  * A class that provides the ability to run a local service that listens to
  * LOLA pose messages on a particular UDP port. It provides an API for other
  * components to get the current pose information, without worrying about running
  * the networking communication infrastructure or threading.
+ *
+ * The service's I/O is performed by whichever threads run the `io_service`
+ * given at construct-time (normally the process' `NetworkReactor`).
  */
 class PoseService {
 public:
+  /**
+   * Poses older than this (in microseconds) when they are read are considered
+   * stale: the robot sends a new pose every `HR_Pose::RATE` ms, so at least one
+   * pose has been missed.
+   */
+  static uint64_t const STALE_POSE_AGE = 2 * HR_Pose::RATE * 1000;
+  /**
+   * A snapshot of the service's counters. Ages are given in microseconds.
+   */
+  struct Stats {
+    /**
+     * The number of valid poses received.
+     */
+    uint64_t received;
+    /**
+     * The number of datagrams discarded because of their size.
+     */
+    uint64_t invalid;
+    /**
+     * The number of times a reader had to retry reading a pose because it
+     * raced with the service updating it.
+     */
+    uint64_t torn_reads;
+    /**
+     * The number of reads that returned a stale pose (see `STALE_POSE_AGE`).
+     */
+    uint64_t stale_reads;
+    /**
+     * The age of the newest pose at the time of the last read, and the largest
+     * such age seen so far.
+     */
+    uint64_t last_age;
+    uint64_t max_age;
+    /**
+     * The number of times the derived kinematics were (re)computed.
+     */
+    uint64_t kinematics_updates;
+  };
+
   /**
    * Create a new `PoseService` that will listen on the given local (UDP) socket
    * for new pose messages coming from the robot. It does not need to know the
    * network address of the robot itself.
+   *
+   * The async operations of the service are queued on the given `io_service`.
    */
-  PoseService(std::string const& host, int port)
+  PoseService(
+      boost::asio::io_service& io_service,
+      std::string const& host,
+      int port)
       : host_(host),
         port_(port),
-        socket_(io_service_) {}
+        socket_(io_service),
+        frame_time_(0),
+        kinematics_valid_(false),
+        received_(0), invalid_(0), stale_reads_(0), last_age_(0), max_age_(0),
+        kinematics_updates_(0),
+        poses_received_(lepp::MetricsRegistry::global().counter(
+              "lola_poses_received_total", "Valid poses received from the robot")),
+        pose_age_(lepp::MetricsRegistry::global().histogram(
+              "lola_pose_age_us", "Age of the newest pose when it is read",
+              lepp::Histogram::exponential(1000, 2, 10))) {
+    TimedPose none = {};
+    latest_.store(none);
+    HR_Pose const no_pose = {};
+    frame_kinematics_.store(deriveKinematics(getParams(no_pose)));
+  }
   /**
-   * Starts the `PoseService`.
+   * Starts the `PoseService`, binding the local socket and queuing the first
+   * receive operation.
    *
-   * This spins up a thread behind the scenes in order to allow the messages to
-   * be processed asynchronously.
+   * The messages are processed asynchronously, once the `io_service` that the
+   * service was created with is run.
    */
   void start();
+  /**
+   * Attaches an observer that is notified of each new pose.
+   */
+  void attachObserver(boost::shared_ptr<PoseObserver> observer) {
+    boost::mutex::scoped_lock lock(observers_mutex_);
+    observers_.push_back(observer);
+  }
+  /**
+   * Makes the given pose, received at the given local time, the newest pose
+   * known to the service, exactly as if it had been received on the socket.
+   *
+   * Allows poses to be fed from some other source (e.g. a session log being
+   * replayed) to a service that was not started. Must not be called while the
+   * service is receiving poses itself.
+   */
+  void publish(HR_Pose const& pose, uint64_t recv_time);
   /**
    * Obtains the current pose information. Using this method is completely
    * thread safe.
    */
   HR_Pose getCurrentPose() const;
+  /**
+   * Obtains the pose that the robot was in at the given local time, given in
+   * microseconds since the epoch (see `PoseHistory::poseAt`). Falls back to
+   * the current pose if no pose history is available.
+   */
+  HR_Pose getPoseAt(uint64_t local_time) const;
+
+  /**
+   * Sets the (local) capture time of the frame that the vision pipeline is
+   * currently processing, in microseconds since the epoch. Until the next
+   * call, the frame pose (see `getFramePose`) is the pose at that time, and
+   * the kinematics derived from it are published (see `getKinematics`).
+   */
+  void setFrameTime(uint64_t local_time);
+  /**
+   * Obtains the pose that the robot was in when the frame that is currently
+   * being processed was captured. If no frame time was ever set, this is the
+   * current pose.
+   */
+  HR_Pose getFramePose() const;
 
   /**
-   * Returns the "World" origin in ODO coordinate system.
+   * Returns the kinematics derived from the robot pose at the capture of the
+   * frame currently being processed.
+   *
+   * They are derived by whichever thread changes the frame pose, i.e. sets a
+   * new frame time or receives a new pose, and only if it actually changed;
+   * readers merely copy them out. Safe to call from any thread; never blocks.
+   */
+  DerivedKinematics getKinematics() const;
+  /**
+   * Returns the "World" origin in ODO coordinate system, as of the capture of
+   * the frame currently being processed.
    */
   lepp::Coordinate getRobotPosition() const;
   /**
    * Returns the parameters relevant for coordinate system
-   * transformations, extracted from the currently known robot pose.
+   * transformations, extracted from the robot pose at the capture of the
+   * frame currently being processed.
    */
   LolaKinematicsParams getParams() const;
+  /**
+   * Extracts the parameters relevant for coordinate system transformations
+   * from the given pose.
+   */
+  static LolaKinematicsParams getParams(HR_Pose const& pose);
+  /**
+   * Returns a snapshot of the service's counters. Safe to call from any
+   * thread.
+   */
+  Stats stats() const;
 private:
   /**
    * Internal helper method. The callback that is passed to the async receive.
@@ -190,11 +196,6 @@ private:
   void read_handler(
       const boost::system::error_code& ec,
       std::size_t bytes_transferred);
-  /**
-   * Internal helper method. Represents the function that will be ran in the
-   * service thread that is spawned once `start` is called.
-   */
-  void service_thread();
   /**
    * Binds the `socket_` to the local address represented by the parameters
    * given in the constructor.
@@ -215,10 +216,6 @@ private:
    */
   int const port_;
 
-  /**
-   * The IO service that will handle the async reads and callback invocation.
-   */
-  boost::asio::io_service io_service_;
   /**
    * The socket used for UDP communication.
    */
@@ -229,11 +226,76 @@ private:
   boost::array<char, sizeof(HR_Pose)> recv_buffer_;
 
   /**
-   * A pointer to the last known pose information.
+   * Records the age of a pose that has just been read, given the time at
+   * which it was received.
+   */
+  void recordAge(uint64_t recv_time) const;
+  /**
+   * Returns the current local time in microseconds since the epoch.
+   */
+  static uint64_t now();
+  /**
+   * Derives the kinematics of the current frame pose and publishes them in
+   * `frame_kinematics_`, unless that pose is the one they were last derived
+   * from.
+   */
+  void updateFrameKinematics();
+
+  /**
+   * A pose along with the local time at which it was received (0 if no pose
+   * has been received yet).
+   */
+  struct TimedPose {
+    HR_Pose pose;
+    uint64_t recv_time;
+  };
+  /**
+   * The last known pose information.
    * Updated by the service on every newly received packet.
    */
-  boost::shared_ptr<HR_Pose> pose_;
+  SeqLock<TimedPose> latest_;
+  /**
+   * The recently received poses, used to find the pose at a frame's capture
+   * time.
+   */
+  PoseHistory history_;
+  /**
+   * The capture time of the frame currently being processed; 0 if unknown.
+   */
+  boost::atomic<uint64_t> frame_time_;
+  /**
+   * The observers notified of each new pose, and the mutex guarding them.
+   */
+  boost::mutex observers_mutex_;
+  std::vector<boost::shared_ptr<PoseObserver> > observers_;
 
+  /**
+   * The kinematics derived from the frame pose.
+   */
+  SeqLock<DerivedKinematics> frame_kinematics_;
+  /**
+   * Serializes the writers of `frame_kinematics_` (the thread receiving the
+   * poses and the one setting the frame time); readers do not take it.
+   * Whether the kinematics were ever derived from an actual frame pose is
+   * guarded by it as well.
+   */
+  boost::mutex kinematics_mutex_;
+  bool kinematics_valid_;
+
+  /**
+   * The counters exposed by `stats`.
+   */
+  boost::atomic<uint64_t> received_;
+  boost::atomic<uint64_t> invalid_;
+  mutable boost::atomic<uint64_t> stale_reads_;
+  mutable boost::atomic<uint64_t> last_age_;
+  mutable boost::atomic<uint64_t> max_age_;
+  boost::atomic<uint64_t> kinematics_updates_;
+  /**
+   * The process-wide metrics (see `lepp::MetricsRegistry`).
+   */
+  lepp::Counter& poses_received_;
+  lepp::Histogram& pose_age_;
 };
 
 #endif
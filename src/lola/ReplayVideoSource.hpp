@@ -0,0 +1,195 @@
+#ifndef LOLA_REPLAY_VIDEO_SOURCE_H__
+#define LOLA_REPLAY_VIDEO_SOURCE_H__
+
+#include <cstring>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "lepp2/BaseVideoSource.hpp"
+#include "lepp2/BoundedQueue.hpp"
+#include "lepp2/FramePacer.hpp"
+
+#include "lola/PoseService.h"
+#include "lola/SessionCloud.hpp"
+#include "lola/SessionLog.h"
+
+#include "deps/easylogging++.h"
+
+/**
+ * A `VideoSource` that replays a session log recorded by a `SessionRecorder`.
+ *
+ * The clouds are emitted in the recorded order. If a `PoseService` is given,
+ * the recorded poses are published to it (see `PoseService::publish`) in
+ * between the clouds, exactly in the order in which they originally arrived,
+ * so that the whole pipeline, including the `RobotOdoTransformer`, sees the
+ * same data as during the recording. The service must not be started, since
+ * it must not receive any poses of its own.
+ *
+ * The replay either keeps the original pace of the recording or emits the
+ * clouds as fast as the pipeline consumes them (for benchmarking). Either way,
+ * the recorded times are shifted so that each cloud appears to have been
+ * captured at the time it is emitted, while the poses keep their timing
+ * relative to the cloud that follows them.
+ *
+ * The records are read and decoded by a separate thread, a few frames ahead of
+ * the one being emitted, so that decoding (in particular of quantized clouds)
+ * does not eat into the pace of the replay.
+ */
+template<class PointT>
+class ReplayVideoSource : public lepp::VideoSource<PointT> {
+public:
+  /**
+   * Creates a new source replaying the session log at the given path. Throws
+   * if the log cannot be opened.
+   */
+  ReplayVideoSource(
+      std::string const& file_path,
+      boost::shared_ptr<PoseService> pose_service,
+      lepp::FramePacer::Pace pace)
+      : reader_(file_path),
+        pose_service_(pose_service),
+        pacer_(pace),
+        frames_(FRAMES_AHEAD),
+        stopped_(false) {}
+  /**
+   * RAII: stops the replay.
+   */
+  ~ReplayVideoSource();
+  /**
+   * `VideoSource` interface implementation. Starts the replay on background
+   * threads.
+   */
+  void open();
+  /**
+   * `VideoSource` interface implementation. Stops the replay.
+   */
+  void close();
+private:
+  typedef std::pair<HR_Pose, uint64_t> TimedPose;
+  /**
+   * A decoded cloud, along with the poses recorded since the previous one.
+   */
+  struct Frame {
+    typename pcl::PointCloud<PointT>::Ptr cloud;
+    uint64_t time;
+    std::vector<TimedPose> poses;
+  };
+  /**
+   * The number of frames that are decoded ahead of the one being emitted.
+   */
+  static size_t const FRAMES_AHEAD = 8;
+
+  /**
+   * The function executed by the decoder thread: reads and decodes the
+   * records, handing the frames over to the replay thread.
+   */
+  void decode();
+  /**
+   * The function executed by the replay thread: emits the decoded frames at
+   * the requested pace.
+   */
+  void run();
+
+  SessionLogReader reader_;
+  boost::shared_ptr<PoseService> pose_service_;
+  lepp::FramePacer pacer_;
+  lepp::BoundedQueue<Frame> frames_;
+  boost::thread decoder_thread_;
+  boost::thread thread_;
+  volatile bool stopped_;
+};
+
+template<class PointT>
+ReplayVideoSource<PointT>::~ReplayVideoSource() {
+  close();
+}
+
+template<class PointT>
+void ReplayVideoSource<PointT>::close() {
+  stopped_ = true;
+  frames_.close();
+  decoder_thread_.interrupt();
+  thread_.interrupt();
+  decoder_thread_.join();
+  thread_.join();
+}
+
+template<class PointT>
+void ReplayVideoSource<PointT>::open() {
+  decoder_thread_ = boost::thread(boost::bind(&ReplayVideoSource::decode, this));
+  thread_ = boost::thread(boost::bind(&ReplayVideoSource::run, this));
+}
+
+template<class PointT>
+void ReplayVideoSource<PointT>::decode() {
+  lepp::Tracer::global().nameThread("replay decoder");
+  std::vector<char> payload;
+  Frame frame;
+
+  size_t const sz = reader_.size();
+  for (size_t i = 0; i < sz && !stopped_; ++i) {
+    SessionLogIndexEntry const& entry = reader_.entry(i);
+    if (entry.type != SessionLogRecord::POSE &&
+        entry.type != SessionLogRecord::CLOUD &&
+        entry.type != SessionLogRecord::QUANTIZED_CLOUD) {
+      continue;
+    }
+    if (!reader_.read(i, payload)) {
+      LERROR << "ReplayVideoSource: Unable to read record " << i;
+      break;
+    }
+    if (entry.type == SessionLogRecord::POSE) {
+      if (payload.size() != sizeof(HR_Pose)) continue;
+      TimedPose pose;
+      memcpy(&pose.first, &payload[0], sizeof(HR_Pose));
+      pose.second = entry.time;
+      frame.poses.push_back(pose);
+      continue;
+    }
+
+    frame.cloud.reset(new pcl::PointCloud<PointT>());
+    if (!decodeSessionCloud(entry.type, payload, *frame.cloud)) {
+      LERROR << "ReplayVideoSource: Malformed cloud in record " << i;
+      continue;
+    }
+    frame.time = entry.time;
+    if (!frames_.push(frame)) break;
+    frame.poses.clear();
+  }
+  // Lets the replay thread finish once it has emitted everything.
+  frames_.close();
+}
+
+template<class PointT>
+void ReplayVideoSource<PointT>::run() {
+  lepp::Tracer::global().nameThread("replay source");
+  uint64_t const start = lepp::localTime();
+  size_t frames = 0;
+
+  Frame frame;
+  while (!stopped_ && frames_.pop(frame)) {
+    if (!pacer_.wait(frame.time)) break;
+
+    // Shift the recorded times onto the local clock, as of now.
+    int64_t const shift = lepp::localTime() - frame.time;
+    if (pose_service_) {
+      for (size_t j = 0; j < frame.poses.size(); ++j) {
+        pose_service_->publish(frame.poses[j].first, frame.poses[j].second + shift);
+      }
+    }
+    frame.cloud->header.stamp = frame.time + shift;
+
+    this->setNextFrame(frame.cloud);
+    frame.cloud.reset();
+    ++frames;
+  }
+
+  double const elapsed = (lepp::localTime() - start) / 1e6;
+  LINFO << "ReplayVideoSource: Replayed " << frames << " frames in "
+        << elapsed << " s ("
+        << (elapsed > 0 ? frames / elapsed : 0) << " fps)";
+}
+
+#endif
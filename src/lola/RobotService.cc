@@ -1,48 +1,9 @@
 #include "RobotService.h"
-#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <algorithm>
 
 #include "deps/easylogging++.h"
 
-namespace {
-  /**
-   * Callback invoked when the async connect operation completes.
-   */
-  void connect_handler(boost::system::error_code const& error) {
-    if (!error) {
-      LINFO << "AsyncRobotService: Connected to the robot.";
-    } else {
-      LERROR << "AsyncRobotService: Failed to connect to the robot";
-    }
-  }
-
-  /**
-   * A simple function that is used to spin up the io service event loop in a
-   * dedicated thread.
-   * Makes sure that the loop does not end when the service does not have any
-   * work to do (temporarily).
-   */
-  void service_thread(boost::asio::io_service* io_service) {
-    // Prevent the IO service from running out of work (and exitting when no
-    // async operations are queued).
-    boost::asio::io_service::work work(*io_service);
-    io_service->run();
-    LINFO << "AsyncRobotService: Exiting service thread...";
-  }
-
-  /**
-   * A callback for write operations.
-   */
-  void write_handler(boost::system::error_code const& error,
-               std::size_t sent) {
-    if (!error) {
-      LINFO << "AsyncRobotService: Send complete. "
-            << "Sent " << sent << " bytes.";
-    } else {
-      LERROR << "AsyncRobotService: Error sending message.";
-    }
-  }
-}
-
 VisionMessage VisionMessage::DeleteMessage(int model_id) {
   LTRACE << "Constructing delete full message with object_id = " << model_id;
   VisionMessage msg;
@@ -118,34 +79,114 @@ void AsyncRobotService::start() {
   boost::asio::ip::tcp::endpoint endpoint(
     boost::asio::ip::address::from_string(remote_), port_);
   LINFO << "AsyncRobotService: Initiating a connection asynchronously...";
-  socket_.async_connect(endpoint, connect_handler);
-  // Start the service thread in the background...
-  boost::thread(boost::bind(service_thread, &io_service_));
+  socket_.async_connect(
+      endpoint,
+      strand_.wrap(boost::bind(&AsyncRobotService::connect_handler, this, _1)));
 }
 
-void AsyncRobotService::inner_send(VisionMessage const& next_message) {
-  char const* buf = (char const*)&next_message;
+void AsyncRobotService::connect_handler(boost::system::error_code const& error) {
+  if (error == boost::asio::error::operation_aborted) return;
+  if (!error) {
+    LINFO << "AsyncRobotService: Connected to the robot.";
+  } else {
+    // The queued messages are still let through, so that each of them is
+    // accounted for as a failed send.
+    LERROR << "AsyncRobotService: Failed to connect to the robot";
+  }
+  sending_ = false;
+  if (!queue_.empty()) {
+    sending_ = true;
+    send_next();
+  }
+}
+
+void AsyncRobotService::sendMessage(VisionMessage const& msg) {
+  // Just queue another message to be sent by the io_service threads. The
+  // strand makes sure that the queue is only ever touched by one of them at
+  // a time.
+  strand_.post(boost::bind(
+        &AsyncRobotService::enqueue,
+        this,
+        msg,
+        boost::posix_time::microsec_clock::universal_time(),
+        lepp::traceStart()));
+}
+
+void AsyncRobotService::enqueue(
+    VisionMessage const& msg,
+    boost::posix_time::ptime const& queued_at,
+    uint64_t traced_at) {
+  QueuedMessage queued = { msg, queued_at, traced_at };
+  queue_.push_back(queued);
+  queued_.inc();
+  queue_length_.set(queue_.size());
+  if (!sending_) {
+    sending_ = true;
+    send_next();
+  }
+}
+
+void AsyncRobotService::send_next() {
+  QueuedMessage const& next = queue_.front();
+  uint64_t const queue_delay =
+      (boost::posix_time::microsec_clock::universal_time() - next.queued_at)
+          .total_microseconds();
+  {
+    boost::mutex::scoped_lock lock(stats_mutex_);
+    stats_.total_queue_delay += queue_delay;
+    stats_.max_queue_delay = std::max(stats_.max_queue_delay, queue_delay);
+  }
+  queue_delay_.observe(queue_delay);
+  lepp::traceInterval("robot queue", next.traced_at);
+  write_started_ = lepp::traceStart();
   LINFO << "AsyncRobotService: Sending a queued message: "
-        << "msg == " << next_message;
-  // Synchronously send the message, i.e. block until the send is complete.
-  try {
-    socket_.send(
-        boost::asio::buffer(buf, sizeof(VisionMessage)));
-  } catch (...) {
+        << "msg == " << next.msg;
+  // The message stays at the front of the queue (and thus alive) until the
+  // write completes.
+  boost::asio::async_write(
+      socket_,
+      boost::asio::buffer(&next.msg, sizeof(VisionMessage)),
+      strand_.wrap(boost::bind(&AsyncRobotService::write_handler, this, _1, _2)));
+}
+
+void AsyncRobotService::write_handler(
+    boost::system::error_code const& error,
+    std::size_t sent) {
+  lepp::traceInterval("robot write", write_started_);
+  if (!error) {
+    LINFO << "AsyncRobotService: Send complete. "
+          << "Sent " << sent << " bytes.";
+  } else {
     LERROR << "AsyncRobotService: Error sending message.";
   }
+  {
+    boost::mutex::scoped_lock lock(stats_mutex_);
+    if (!error) ++stats_.sent; else ++stats_.failed;
+  }
+  if (!error) sent_.inc(); else failed_.inc();
+  queue_.pop_front();
+  queue_length_.set(queue_.size());
   // After each sent message, we want to wait a pre-defined amount of time
   // before sending the next one.
   // This is because we do not want to overwhelm the robot with a large
   // number of messages all sent in the same time.
-  boost::this_thread::sleep(message_timeout_);
+  delay_started_ = lepp::traceStart();
+  timer_.expires_from_now(message_timeout_);
+  timer_.async_wait(
+      strand_.wrap(boost::bind(&AsyncRobotService::timer_handler, this, _1)));
 }
 
-void AsyncRobotService::sendMessage(VisionMessage const& msg) {
-  // Just queue another message to be sent by the io_service thread.
-  // Since `inner_send` makes sure to wait after it's finished sending
-  // each message (i.e. the io_service thread is blocked), the queued
-  // messages will all be sent with a preset time delay between subsequent
-  // messages.
-  io_service_.post(boost::bind(&AsyncRobotService::inner_send, this, msg));
+void AsyncRobotService::timer_handler(boost::system::error_code const& error) {
+  if (error == boost::asio::error::operation_aborted) return;
+  lepp::traceInterval("robot delay", delay_started_);
+  if (queue_.empty()) {
+    sending_ = false;
+  } else {
+    send_next();
+  }
+}
+
+AsyncRobotService::Stats AsyncRobotService::stats() const {
+  boost::mutex::scoped_lock lock(stats_mutex_);
+  return stats_;
 }
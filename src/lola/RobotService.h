@@ -2,9 +2,14 @@
 #define LOLA_ROBOT_SERVICE_H__
 
 #include <boost/asio.hpp>
+#include <boost/thread/mutex.hpp>
 #include <cstring>
+#include <deque>
 #include <iostream>
 
+#include "lepp2/Metrics.hpp"
+#include "lepp2/debug/trace.hpp"
+
 // The macro creates an ID for a Robot message.
 // The macro is taken from the LOLA source base.
 // TODO Once C++11 can be used, make this a `constexpr` function, instead of a macro.
@@ -80,35 +85,76 @@ public:
  * A class that implements a service which can send vision-related notifications
  * to the robot.
  *
- * It allows clients to asychronously send vision messages to the robot.
+ * It allows clients to asychronously send vision messages to the robot. The
+ * messages are queued and written to the robot one by one, with a preset delay
+ * between subsequent messages. All of the service's I/O is performed by the
+ * threads running the `io_service` given at construct-time (normally the
+ * process' `NetworkReactor`); the pacing is implemented with a timer, so none
+ * of those threads is ever blocked waiting for the next message to be due.
  */
 class AsyncRobotService : public RobotService {
 public:
   /**
-   * Creates a new `AsyncRobotService` instance that will try to send messages
-   * to a robot on the given remote address (host name, port combination).
-   *
-   * No delay between subsequent messages is set.
+   * A snapshot of the counters that the service keeps about the messages it
+   * has handled. Delays are given in microseconds.
    */
-  AsyncRobotService(std::string const& remote, int port)
-      : remote_(remote), port_(port), socket_(io_service_),
-        message_timeout_(0) {}
+  struct Stats {
+    Stats() : sent(0), failed(0), total_queue_delay(0), max_queue_delay(0) {}
+    /**
+     * The number of messages successfully written to the socket.
+     */
+    uint64_t sent;
+    /**
+     * The number of messages for which the write failed.
+     */
+    uint64_t failed;
+    /**
+     * The sum of the times that the messages spent waiting in the service's
+     * queue before the send was attempted.
+     */
+    uint64_t total_queue_delay;
+    /**
+     * The longest time any single message spent in the queue.
+     */
+    uint64_t max_queue_delay;
+  };
 
   /**
    * Creates a new `AsyncRobotService` instance that will try to send messages
    * to a robot on the given remote address (host name, port combination).
    *
    * The delay between each subsequent sent message is set by the `delay`
-   * parameter.
+   * parameter; by default, there is none.
    */
-  AsyncRobotService(std::string const& remote, int port, int delay)
-      : remote_(remote), port_(port), socket_(io_service_),
-        message_timeout_(delay) {}
+  AsyncRobotService(
+      boost::asio::io_service& io_service,
+      std::string const& remote,
+      int port,
+      int delay = 0)
+      : remote_(remote), port_(port),
+        strand_(io_service), socket_(io_service), timer_(io_service),
+        message_timeout_(delay), sending_(true),
+        write_started_(0), delay_started_(0),
+        queued_(lepp::MetricsRegistry::global().counter(
+              "lola_robot_messages_total", "Messages to the robot",
+              "state=\"queued\"")),
+        sent_(lepp::MetricsRegistry::global().counter(
+              "lola_robot_messages_total", "Messages to the robot",
+              "state=\"sent\"")),
+        failed_(lepp::MetricsRegistry::global().counter(
+              "lola_robot_messages_total", "Messages to the robot",
+              "state=\"failed\"")),
+        queue_length_(lepp::MetricsRegistry::global().gauge(
+              "lola_robot_queue_length", "Messages waiting to be sent to the robot")),
+        queue_delay_(lepp::MetricsRegistry::global().histogram(
+              "lola_robot_queue_delay_us",
+              "Time a message to the robot waits in the queue",
+              lepp::Histogram::exponential(1000, 2, 12))) {}
   /**
    * Starts up the service, initiating a connection to the robot.
    *
-   * Behind the scenes, this spins up a thread that will handle the IO for this
-   * service.
+   * Messages sent before the connection is established are queued until it
+   * is.
    */
   void start();
   /**
@@ -117,6 +163,11 @@ public:
    * The call never blocks.
    */
   void sendMessage(VisionMessage const& msg);
+  /**
+   * Returns a snapshot of the service's counters. Safe to call from any
+   * thread.
+   */
+  Stats stats() const;
 private:
   /**
    * The host name of the robot.
@@ -127,13 +178,19 @@ private:
    */
   int const port_;
   /**
-   * The io service that handles the async operations of the communication.
+   * Serializes all of the service's handlers, so that the queue and the
+   * socket need no further synchronization, regardless of how many threads
+   * run the `io_service`.
    */
-  boost::asio::io_service io_service_;
+  boost::asio::io_service::strand strand_;
   /**
    * The socket that is connected to the remote robot endpoint.
    */
   boost::asio::ip::tcp::socket socket_;
+  /**
+   * The timer used to wait out the delay between subsequent messages.
+   */
+  boost::asio::deadline_timer timer_;
 
   /**
    * A number of milliseconds that the service waits between subsequent
@@ -142,12 +199,80 @@ private:
   boost::posix_time::milliseconds message_timeout_;
 
   /**
-   * A helper function that performs the send of the message and then waits
-   * the predefined amount of time before returning. This way, the wait blocks
-   * the (io_service) thread and causes the next message that should be sent
-   * to be delayed the necessary amount of time.
+   * Guards the `stats_`, since they are updated by the io_service thread and
+   * read by arbitrary client threads.
+   */
+  mutable boost::mutex stats_mutex_;
+  /**
+   * The counters describing the messages handled so far.
+   */
+  Stats stats_;
+
+  /**
+   * A message waiting to be sent, along with the time at which it was handed
+   * to `sendMessage`; the latter is used to track how long messages wait in
+   * the queue. `traced_at` is the same time on the trace clock (see
+   * `lepp::traceStart`).
+   */
+  struct QueuedMessage {
+    VisionMessage msg;
+    boost::posix_time::ptime queued_at;
+    uint64_t traced_at;
+  };
+  /**
+   * The messages that are yet to be sent. The front of the queue is the
+   * message currently being written, if any. Only accessed from within the
+   * strand.
+   */
+  std::deque<QueuedMessage> queue_;
+  /**
+   * Whether a new message needs to wait its turn: the service is currently
+   * writing a message or waiting out the delay after one, or the connection
+   * attempt has not completed yet. Only accessed from within the strand.
+   */
+  bool sending_;
+  /**
+   * When the current write and the delay after it started, on the trace clock
+   * (0 when they are not traced). Only accessed from within the strand.
+   */
+  uint64_t write_started_;
+  uint64_t delay_started_;
+  /**
+   * The process-wide metrics (see `lepp::MetricsRegistry`) of the messages
+   * handled by the service.
+   */
+  lepp::Counter& queued_;
+  lepp::Counter& sent_;
+  lepp::Counter& failed_;
+  lepp::Gauge& queue_length_;
+  lepp::Histogram& queue_delay_;
+
+  /**
+   * Callback invoked when the async connect operation completes.
+   */
+  void connect_handler(boost::system::error_code const& error);
+  /**
+   * Adds a message to the queue and, unless a message is already being sent,
+   * starts sending it. Runs within the strand.
+   */
+  void enqueue(
+      VisionMessage const& msg,
+      boost::posix_time::ptime const& queued_at,
+      uint64_t traced_at);
+  /**
+   * Initiates the write of the message found at the front of the queue.
+   * Runs within the strand.
+   */
+  void send_next();
+  /**
+   * Callback invoked when the write of the front message completes. Updates
+   * the counters and arms the timer that delays the next message.
+   */
+  void write_handler(boost::system::error_code const& error, std::size_t sent);
+  /**
+   * Callback invoked once the delay after a message has passed.
    */
-  void inner_send(VisionMessage const& msg);
+  void timer_handler(boost::system::error_code const& error);
 };
 
 #endif
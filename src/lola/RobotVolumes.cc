@@ -0,0 +1,198 @@
+#include "lola/RobotVolumes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "lola/Kinematics.h"
+
+namespace {
+  /**
+   * Capsules of the default model of LOLA. The ends of most capsules are the
+   * joints themselves, which does not depend on how the segments' frames are
+   * oriented; only the ends of the limbs (the toes, the hands and the top of
+   * the torso) are given as offsets.
+   */
+  enum Limb {
+    TORSO,
+    RIGHT_LEG,
+    LEFT_LEG,
+    RIGHT_ARM,
+    LEFT_ARM
+  };
+
+  RobotVolumes::CapsuleSpec capsule(
+      int limb,
+      int from, float fx, float fy, float fz,
+      int to, float tx, float ty, float tz,
+      float radius) {
+    RobotVolumes::CapsuleSpec spec;
+    spec.limb = limb;
+    spec.from.segment = from;
+    spec.from.offset[0] = fx;
+    spec.from.offset[1] = fy;
+    spec.from.offset[2] = fz;
+    spec.to.segment = to;
+    spec.to.offset[0] = tx;
+    spec.to.offset[1] = ty;
+    spec.to.offset[2] = tz;
+    spec.radius = radius;
+    return spec;
+  }
+}
+
+void RobotVolumes::Box::reset() {
+  for (int i = 0; i < 3; ++i) {
+    min[i] = std::numeric_limits<double>::max();
+    max[i] = -std::numeric_limits<double>::max();
+  }
+}
+
+void RobotVolumes::Box::extend(Box const& other) {
+  for (int i = 0; i < 3; ++i) {
+    min[i] = std::min(min[i], other.min[i]);
+    max[i] = std::max(max[i], other.max[i]);
+  }
+}
+
+RobotVolumes::RobotVolumes(std::vector<CapsuleSpec> const& specs, double margin)
+    : specs_(specs), margin_(margin), placed_(false) {
+  for (size_t i = 0; i < specs_.size(); ++i) {
+    CapsuleSpec const& spec = specs_[i];
+    if (spec.from.segment < 0 || spec.from.segment >= HR_Pose::N_SEGMENTS ||
+        spec.to.segment < 0 || spec.to.segment >= HR_Pose::N_SEGMENTS) {
+      throw "Invalid robot segment";
+    }
+    if (limbs_.empty() || specs_[limbs_.back().begin].limb != spec.limb) {
+      Limb limb;
+      limb.begin = i;
+      limbs_.push_back(limb);
+    }
+    limbs_.back().end = i + 1;
+  }
+  capsules_.resize(specs_.size());
+  box_.reset();
+}
+
+std::vector<RobotVolumes::CapsuleSpec> RobotVolumes::lolaModel() {
+  std::vector<CapsuleSpec> model;
+  // The torso, from the pelvis up to the shoulders, and the hips.
+  model.push_back(capsule(TORSO,
+      HR_Pose::seg_torso, 0, 0, 0, HR_Pose::seg_torso, 0, 0, .45f, .18f));
+  model.push_back(capsule(TORSO,
+      HR_Pose::seg_hip_rot_r, 0, 0, 0, HR_Pose::seg_hip_rot_l, 0, 0, 0, .15f));
+  // The legs: the thighs, the shanks, the feet and the toes.
+  model.push_back(capsule(RIGHT_LEG,
+      HR_Pose::seg_hip_flx_r, 0, 0, 0, HR_Pose::seg_knee_flx_r, 0, 0, 0, .09f));
+  model.push_back(capsule(RIGHT_LEG,
+      HR_Pose::seg_knee_flx_r, 0, 0, 0, HR_Pose::seg_ankle_flx_r, 0, 0, 0, .08f));
+  model.push_back(capsule(RIGHT_LEG,
+      HR_Pose::seg_ankle_flx_r, -.08f, 0, -.06f, HR_Pose::seg_toe_flx_r, 0, 0, 0, .1f));
+  model.push_back(capsule(RIGHT_LEG,
+      HR_Pose::seg_toe_flx_r, 0, 0, 0, HR_Pose::seg_toe_flx_r, .08f, 0, 0, .06f));
+  model.push_back(capsule(LEFT_LEG,
+      HR_Pose::seg_hip_flx_l, 0, 0, 0, HR_Pose::seg_knee_flx_l, 0, 0, 0, .09f));
+  model.push_back(capsule(LEFT_LEG,
+      HR_Pose::seg_knee_flx_l, 0, 0, 0, HR_Pose::seg_ankle_flx_l, 0, 0, 0, .08f));
+  model.push_back(capsule(LEFT_LEG,
+      HR_Pose::seg_ankle_flx_l, -.08f, 0, -.06f, HR_Pose::seg_toe_flx_l, 0, 0, 0, .1f));
+  model.push_back(capsule(LEFT_LEG,
+      HR_Pose::seg_toe_flx_l, 0, 0, 0, HR_Pose::seg_toe_flx_l, .08f, 0, 0, .06f));
+  // The arms: the upper arms and the forearms, including the hands.
+  model.push_back(capsule(RIGHT_ARM,
+      HR_Pose::seg_shoulder_flx_r, 0, 0, 0, HR_Pose::seg_elbow_flx_r, 0, 0, 0, .07f));
+  model.push_back(capsule(RIGHT_ARM,
+      HR_Pose::seg_elbow_flx_r, 0, 0, 0, HR_Pose::seg_elbow_flx_r, 0, 0, -.35f, .07f));
+  model.push_back(capsule(LEFT_ARM,
+      HR_Pose::seg_shoulder_flx_l, 0, 0, 0, HR_Pose::seg_elbow_flx_l, 0, 0, 0, .07f));
+  model.push_back(capsule(LEFT_ARM,
+      HR_Pose::seg_elbow_flx_l, 0, 0, 0, HR_Pose::seg_elbow_flx_l, 0, 0, -.35f, .07f));
+  return model;
+}
+
+void RobotVolumes::update(HR_Pose const& pose) {
+  // A pose that was never received has all of its segments collapsed into
+  // the origin.
+  placed_ = false;
+  for (int s = 0; s < HR_Pose::N_SEGMENTS && !placed_; ++s) {
+    for (int i = 0; i < 9; ++i) {
+      if (pose.seg_pose[s].R[i] != 0) placed_ = true;
+    }
+  }
+  if (!placed_) return;
+
+  // The segment poses are in the world frame. They are brought into the ODO
+  // frame the same way as the camera is (see `deriveKinematics`):
+  // p_odo = transpose(Rz(phi_z_odo)) * (p_wr + t_stance_odo)
+  double rotation[3][3];
+  double odo_rotation[3][3];
+  kinematics::rotationmatrix(pose.phi_z_odo, rotation);
+  kinematics::transpose(rotation, odo_rotation);
+
+  box_.reset();
+  for (size_t l = 0; l < limbs_.size(); ++l) {
+    Limb& limb = limbs_[l];
+    limb.box.reset();
+    for (size_t c = limb.begin; c < limb.end; ++c) {
+      CapsuleSpec const& spec = specs_[c];
+      Capsule& capsule = capsules_[c];
+      Anchor const* const anchors[2] = { &spec.from, &spec.to };
+      double ends[2][3];
+      for (int e = 0; e < 2; ++e) {
+        HR_Pose::SegmentPose const& segment = pose.seg_pose[anchors[e]->segment];
+        float const* offset = anchors[e]->offset;
+        double world[3];
+        for (int i = 0; i < 3; ++i) {
+          world[i] = segment.t[i] + pose.t_stance_odo[i];
+          for (int j = 0; j < 3; ++j) world[i] += segment.R[3*i + j] * offset[j];
+        }
+        for (int i = 0; i < 3; ++i) {
+          ends[e][i] = 0;
+          for (int j = 0; j < 3; ++j) ends[e][i] += odo_rotation[i][j] * world[j];
+        }
+      }
+
+      double const radius = spec.radius + margin_;
+      double length2 = 0;
+      for (int i = 0; i < 3; ++i) {
+        capsule.a[i] = ends[0][i];
+        capsule.d[i] = ends[1][i] - ends[0][i];
+        length2 += capsule.d[i] * capsule.d[i];
+        capsule.box.min[i] = std::min(ends[0][i], ends[1][i]) - radius;
+        capsule.box.max[i] = std::max(ends[0][i], ends[1][i]) + radius;
+      }
+      capsule.inv_length2 = length2 > 0 ? 1 / length2 : 0;
+      capsule.radius2 = radius * radius;
+      limb.box.extend(capsule.box);
+    }
+    box_.extend(limb.box);
+  }
+}
+
+bool RobotVolumes::contains(double x, double y, double z) const {
+  double const p[3] = { x, y, z };
+  if (!placed_ || !box_.contains(p)) return false;
+  for (size_t l = 0; l < limbs_.size(); ++l) {
+    Limb const& limb = limbs_[l];
+    if (!limb.box.contains(p)) continue;
+    for (size_t c = limb.begin; c < limb.end; ++c) {
+      Capsule const& capsule = capsules_[c];
+      if (!capsule.box.contains(p)) continue;
+      // The distance to the closest point of the capsule's axis.
+      double v[3];
+      double t = 0;
+      for (int i = 0; i < 3; ++i) {
+        v[i] = p[i] - capsule.a[i];
+        t += v[i] * capsule.d[i];
+      }
+      t = std::max(0., std::min(1., t * capsule.inv_length2));
+      double dist2 = 0;
+      for (int i = 0; i < 3; ++i) {
+        double const diff = v[i] - t * capsule.d[i];
+        dist2 += diff * diff;
+      }
+      if (dist2 <= capsule.radius2) return true;
+    }
+  }
+  return false;
+}
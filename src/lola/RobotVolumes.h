@@ -0,0 +1,115 @@
+#ifndef LOLA_ROBOT_VOLUMES_H__
+#define LOLA_ROBOT_VOLUMES_H__
+
+#include <cstddef>
+#include <vector>
+
+#include "lola/HR_Pose.h"
+
+/**
+ * A coarse model of the volume taken up by the robot's own body, made of
+ * capsules (line segments with a radius) spanned between the robot's
+ * segments, e.g. from the hip to the knee. It is placed according to the
+ * segment poses of a robot pose, in the ODO coordinate system, so that the
+ * points of the robot's own limbs can be told apart from those of the
+ * environment.
+ *
+ * The capsules are grouped by limb. Testing a point first checks it against
+ * the bounding box of the whole robot, then against the box of each limb and
+ * only then against the capsules themselves, so that the vast majority of the
+ * points (those that are nowhere near the robot) costs a handful of
+ * comparisons.
+ */
+class RobotVolumes {
+public:
+  /**
+   * One end of a capsule: the origin of a segment's frame, offset by the
+   * given vector in that frame (in meters).
+   */
+  struct Anchor {
+    int segment;
+    float offset[3];
+  };
+  /**
+   * The description of a capsule of the model.
+   */
+  struct CapsuleSpec {
+    /**
+     * The limb that the capsule belongs to. The capsules of a limb need to be
+     * consecutive.
+     */
+    int limb;
+    Anchor from;
+    Anchor to;
+    float radius;
+  };
+
+  /**
+   * Creates a model of the given capsules, each of them inflated by the given
+   * margin (in meters), which covers the error of the model and the noise of
+   * the points.
+   */
+  RobotVolumes(std::vector<CapsuleSpec> const& specs, double margin);
+  /**
+   * Returns the capsules of the default model of LOLA.
+   */
+  static std::vector<CapsuleSpec> lolaModel();
+
+  /**
+   * Places the capsules as given by the segment poses of the given robot
+   * pose. A pose that was never received (all zeros) leaves the model empty.
+   */
+  void update(HR_Pose const& pose);
+  /**
+   * Whether the model is placed, i.e. `contains` can ever return true.
+   */
+  bool placed() const { return placed_; }
+  /**
+   * Whether the given point (in the ODO coordinate system) is inside one of
+   * the capsules.
+   */
+  bool contains(double x, double y, double z) const;
+private:
+  /**
+   * An axis-aligned bounding box.
+   */
+  struct Box {
+    double min[3];
+    double max[3];
+    void reset();
+    void extend(Box const& other);
+    bool contains(double const p[3]) const {
+      return p[0] >= min[0] && p[0] <= max[0] &&
+             p[1] >= min[1] && p[1] <= max[1] &&
+             p[2] >= min[2] && p[2] <= max[2];
+    }
+  };
+  /**
+   * A capsule as placed for the current pose: the segment from `a` to
+   * `a + d`, along with its bounding box.
+   */
+  struct Capsule {
+    double a[3];
+    double d[3];
+    /**
+     * 1 / |d|^2 (0 for a degenerate capsule, i.e. a sphere).
+     */
+    double inv_length2;
+    double radius2;
+    Box box;
+  };
+  struct Limb {
+    size_t begin;
+    size_t end;
+    Box box;
+  };
+
+  std::vector<CapsuleSpec> const specs_;
+  double const margin_;
+  std::vector<Capsule> capsules_;
+  std::vector<Limb> limbs_;
+  Box box_;
+  bool placed_;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef LOLA_SELF_OCCLUSION_FILTER_H__
+#define LOLA_SELF_OCCLUSION_FILTER_H__
+
+#include <boost/shared_ptr.hpp>
+
+#include "lepp2/filter/PointFilter.hpp"
+
+#include "lola/PoseService.h"
+#include "lola/RobotVolumes.h"
+
+/**
+ * A `PointFilter` that discards the points that fall on the robot itself
+ * (e.g. its feet, when it looks down), so that its own limbs are never
+ * segmented and reported as obstacles.
+ *
+ * The robot's body is modeled by `RobotVolumes`, placed according to the
+ * robot's pose at the capture time of each frame. The points need to already
+ * be in the ODO coordinate system, i.e. the filter needs to come after the
+ * `RobotOdoTransformer`.
+ */
+template<class PointT>
+class SelfOcclusionFilter : public lepp::PointFilter<PointT> {
+public:
+  /**
+   * Creates a filter using the default model of the robot, inflated by the
+   * given margin (in meters).
+   */
+  SelfOcclusionFilter(boost::shared_ptr<PoseService> service, double margin)
+      : service_(service),
+        volumes_(RobotVolumes::lolaModel(), margin),
+        stamp_(0) {}
+  /**
+   * `PointFilter` interface method.
+   */
+  void setFrameStamp(uint64_t stamp) { stamp_ = stamp; }
+  /**
+   * `PointFilter` interface method. Places the robot's body as it was when
+   * the frame was captured.
+   */
+  void prepareNext() { volumes_.update(service_->getPoseAt(stamp_)); }
+  /**
+   * `PointFilter` interface method.
+   */
+  bool apply(PointT& pt) { return !volumes_.contains(pt.x, pt.y, pt.z); }
+  /**
+   * `PointFilter` interface method. Without a pose, there is no body to
+   * discard any points of, so the filter is the identity.
+   */
+  lepp::PointFilterForm form() const {
+    if (volumes_.placed()) return lepp::PointFilterForm::Opaque();
+    double const identity[3][3] = { {1, 0, 0}, {0, 1, 0}, {0, 0, 1} };
+    double const zero[3] = { 0, 0, 0 };
+    return lepp::PointFilterForm::Affine(identity, zero);
+  }
+private:
+  boost::shared_ptr<PoseService> service_;
+  RobotVolumes volumes_;
+  uint64_t stamp_;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef LOLA_SEQ_LOCK_H__
+#define LOLA_SEQ_LOCK_H__
+
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+
+/**
+ * A single-writer/multi-reader publication slot for a value of type `T`,
+ * based on a sequence counter (a "seqlock").
+ *
+ * The writer bumps the counter to an odd value, updates the value and bumps
+ * the counter to an even value again. Readers copy the value out and retry if
+ * the counter was odd or changed during the copy, i.e. if the copy might be
+ * torn. Neither the writer nor the readers ever block or allocate; the writer
+ * is wait-free and a reader only ever retries while a write is in progress.
+ *
+ * `T` needs to be a POD type, since readers may copy it while it is being
+ * modified (the result of such a copy is always discarded).
+ *
+ * `store` must only ever be called from a single thread at a time.
+ */
+template<class T>
+class SeqLock : boost::noncopyable {
+public:
+  SeqLock() : seq_(0), retries_(0) {}
+  explicit SeqLock(T const& initial)
+      : seq_(0), value_(initial), retries_(0) {}
+
+  /**
+   * Publishes a new value.
+   */
+  void store(T const& value) {
+    uint32_t const seq = seq_.load(boost::memory_order_relaxed);
+    seq_.store(seq + 1, boost::memory_order_relaxed);
+    boost::atomic_thread_fence(boost::memory_order_release);
+    value_ = value;
+    seq_.store(seq + 2, boost::memory_order_release);
+  }
+
+  /**
+   * Returns a consistent copy of the most recently published value.
+   */
+  T load() const {
+    Copier copier;
+    read(copier);
+    return copier.value;
+  }
+
+  /**
+   * Invokes `reader(value)` on the published value until it has seen a
+   * consistent (untorn) value. Allows readers to copy out only the parts of a
+   * large value that they are interested in.
+   *
+   * The reader may be invoked several times and must not act on what it sees
+   * other than by copying it; only the copy made by the last invocation is
+   * guaranteed to be consistent.
+   */
+  template<class Reader>
+  void read(Reader& reader) const {
+    while (true) {
+      uint32_t const before = seq_.load(boost::memory_order_acquire);
+      if ((before & 1) == 0) {
+        reader(value_);
+        boost::atomic_thread_fence(boost::memory_order_acquire);
+        if (seq_.load(boost::memory_order_relaxed) == before) return;
+      }
+      retries_.fetch_add(1, boost::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * The number of values published so far.
+   */
+  uint32_t version() const { return seq_.load(boost::memory_order_acquire) / 2; }
+  /**
+   * The number of times a reader had to retry because it raced with the
+   * writer.
+   */
+  uint64_t retries() const { return retries_.load(boost::memory_order_relaxed); }
+private:
+  struct Copier {
+    void operator()(T const& v) { value = v; }
+    T value;
+  };
+
+  boost::atomic<uint32_t> seq_;
+  T value_;
+  mutable boost::atomic<uint64_t> retries_;
+};
+
+#endif
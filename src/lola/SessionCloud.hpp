@@ -0,0 +1,96 @@
+#ifndef LOLA_SESSION_CLOUD_H__
+#define LOLA_SESSION_CLOUD_H__
+
+#include <cstring>
+#include <vector>
+
+#include "lepp2/BaseVideoSource.hpp"
+#include "lepp2/QuantizedCloudCodec.hpp"
+
+#include "lola/SessionLog.h"
+
+/**
+ * Puts the given cloud into the payload of a session log record and returns
+ * the type of the record: a `QUANTIZED_CLOUD` if a (positive) resolution is
+ * given, a plain `CLOUD` otherwise.
+ */
+template<class PointT>
+SessionLogRecord::Type encodeSessionCloud(
+    pcl::PointCloud<PointT> const& cloud,
+    float resolution,
+    std::vector<char>& payload) {
+  size_t const sz = cloud.size();
+  SessionLogCloudHeader header;
+  header.stamp = cloud.header.stamp;
+  header.width = cloud.width;
+  header.height = cloud.height;
+  // Clouds put together point by point need not have their dimensions set.
+  if (static_cast<size_t>(header.width) * header.height != sz) {
+    header.width = sz;
+    header.height = 1;
+  }
+  header.is_dense = cloud.is_dense;
+  header.reserved = 0;
+
+  if (resolution > 0) {
+    payload.resize(sizeof header);
+    memcpy(&payload[0], &header, sizeof header);
+    lepp::QuantizedCloudCodec::encode(cloud, resolution, payload);
+    return SessionLogRecord::QUANTIZED_CLOUD;
+  }
+
+  payload.resize(sizeof header + 3 * sizeof(float) * sz);
+  memcpy(&payload[0], &header, sizeof header);
+  float* xyz = reinterpret_cast<float*>(&payload[sizeof header]);
+  for (size_t i = 0; i < sz; ++i) {
+    PointT const& pt = cloud[i];
+    *xyz++ = pt.x;
+    *xyz++ = pt.y;
+    *xyz++ = pt.z;
+  }
+  return SessionLogRecord::CLOUD;
+}
+
+/**
+ * Puts the cloud held in the payload of a `CLOUD` or `QUANTIZED_CLOUD` record
+ * into the given cloud. Returns false if the payload is malformed.
+ */
+template<class PointT>
+bool decodeSessionCloud(
+    uint32_t type,
+    std::vector<char> const& payload,
+    pcl::PointCloud<PointT>& cloud) {
+  if (payload.size() < sizeof(SessionLogCloudHeader)) return false;
+  SessionLogCloudHeader header;
+  memcpy(&header, &payload[0], sizeof header);
+  size_t const sz = static_cast<size_t>(header.width) * header.height;
+
+  if (type == SessionLogRecord::QUANTIZED_CLOUD) {
+    if (!lepp::QuantizedCloudCodec::decode(&payload[sizeof header],
+                                           payload.size() - sizeof header,
+                                           cloud) ||
+        cloud.size() != sz) {
+      return false;
+    }
+  } else if (type == SessionLogRecord::CLOUD) {
+    if (payload.size() != sizeof header + 3 * sizeof(float) * sz) return false;
+    cloud.points.resize(sz);
+    float const* xyz = reinterpret_cast<float const*>(&payload[sizeof header]);
+    for (size_t i = 0; i < sz; ++i) {
+      PointT& pt = cloud[i];
+      pt.x = *xyz++;
+      pt.y = *xyz++;
+      pt.z = *xyz++;
+    }
+  } else {
+    return false;
+  }
+
+  cloud.width = header.width;
+  cloud.height = header.height;
+  cloud.is_dense = header.is_dense != 0;
+  cloud.header.stamp = header.stamp;
+  return true;
+}
+
+#endif
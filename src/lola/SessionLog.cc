@@ -0,0 +1,273 @@
+#include "lola/SessionLog.h"
+
+#include <cstring>
+
+#include <boost/bind.hpp>
+
+#include "deps/easylogging++.h"
+
+namespace {
+char const FILE_MAGIC[8] = { 'L', 'E', 'P', 'P', 'L', 'O', 'G', '\0' };
+char const INDEX_MAGIC[8] = { 'L', 'E', 'P', 'P', 'I', 'D', 'X', '\0' };
+uint32_t const VERSION = 1;
+/**
+ * The number of written buffers kept around for reuse.
+ */
+size_t const MAX_FREE_BUFFERS = 16;
+}  // namespace <anonymous>
+
+size_t const SessionLogWriter::DEFAULT_MAX_QUEUED_BYTES;
+
+SessionLogWriter::SessionLogWriter(
+    std::string const& file_path,
+    size_t max_queued_bytes)
+    : fout_(file_path.c_str(), std::ios::binary | std::ios::trunc),
+      max_queued_bytes_(max_queued_bytes),
+      offset_(0),
+      queued_bytes_(0),
+      closing_(false),
+      closed_(false),
+      failed_(false),
+      written_(0),
+      dropped_(0) {
+  if (!fout_.is_open()) {
+    throw "Unable to open the session log for writing";
+  }
+  SessionLogFileHeader header;
+  memcpy(header.magic, FILE_MAGIC, sizeof header.magic);
+  header.version = VERSION;
+  header.reserved = 0;
+  fout_.write(reinterpret_cast<char const*>(&header), sizeof header);
+  if (!fout_.good()) {
+    throw "Unable to write the session log";
+  }
+  offset_ = sizeof header;
+
+  thread_ = boost::thread(boost::bind(&SessionLogWriter::run, this));
+}
+
+SessionLogWriter::~SessionLogWriter() {
+  // RAII
+  close();
+}
+
+SessionLogWriter::Buffer SessionLogWriter::acquireBuffer() {
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (!free_buffers_.empty()) {
+      Buffer buffer = free_buffers_.back();
+      free_buffers_.pop_back();
+      buffer->clear();
+      return buffer;
+    }
+  }
+  return Buffer(new std::vector<char>());
+}
+
+void SessionLogWriter::append(
+    SessionLogRecord::Type type,
+    uint64_t time,
+    Buffer const& payload) {
+  Pending pending;
+  pending.record.type = type;
+  pending.record.size = payload->size();
+  pending.record.time = time;
+  pending.payload = payload;
+
+  boost::mutex::scoped_lock lock(mutex_);
+  if (closing_ || failed_) return;
+  if (type != SessionLogRecord::POSE &&
+      queued_bytes_ + payload->size() > max_queued_bytes_) {
+    if (dropped_++ == 0) {
+      LWARNING << "SessionLogWriter: Dropping clouds; the disk cannot keep up";
+    }
+    return;
+  }
+  queued_bytes_ += payload->size();
+  queue_.push_back(pending);
+  cond_.notify_one();
+}
+
+void SessionLogWriter::run() {
+  while (true) {
+    Pending pending;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (queue_.empty() && !closing_) cond_.wait(lock);
+      if (queue_.empty()) return;
+      pending = queue_.front();
+      queue_.pop_front();
+    }
+    if (!write(pending)) {
+      LERROR << "SessionLogWriter: Unable to write to the log (is the disk "
+             << "full?); recording stopped";
+      boost::mutex::scoped_lock lock(mutex_);
+      failed_ = true;
+      queue_.clear();
+      queued_bytes_ = 0;
+      return;
+    }
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      queued_bytes_ -= pending.payload->size();
+      ++written_;
+      if (free_buffers_.size() < MAX_FREE_BUFFERS) {
+        free_buffers_.push_back(pending.payload);
+      }
+    }
+  }
+}
+
+bool SessionLogWriter::write(Pending const& pending) {
+  fout_.write(reinterpret_cast<char const*>(&pending.record), sizeof pending.record);
+  if (!pending.payload->empty()) {
+    fout_.write(&(*pending.payload)[0], pending.payload->size());
+  }
+  // A record is only indexed once it made it to the file in full. (Flushing
+  // each record also keeps the failure from surfacing only with some later
+  // record, which would make the index point past the end of the file.)
+  fout_.flush();
+  if (!fout_.good()) return false;
+  SessionLogIndexEntry entry;
+  entry.offset = offset_ + sizeof pending.record;
+  entry.time = pending.record.time;
+  entry.type = pending.record.type;
+  entry.size = pending.record.size;
+  index_.push_back(entry);
+  offset_ = entry.offset + entry.size;
+  return true;
+}
+
+void SessionLogWriter::close() {
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (closed_) return;
+    closing_ = true;
+    cond_.notify_one();
+  }
+  thread_.join();
+
+  // Only this thread touches the file now. After a failed write, the index
+  // still goes right after the last complete record, in place of whatever
+  // part of the failed one made it to the file, so that the records before
+  // it can be read back.
+  if (failed_) {
+    fout_.clear();
+    fout_.seekp(offset_);
+  }
+  SessionLogTrailer trailer;
+  trailer.index_offset = offset_;
+  trailer.count = index_.size();
+  memcpy(trailer.magic, INDEX_MAGIC, sizeof trailer.magic);
+  if (!index_.empty()) {
+    fout_.write(reinterpret_cast<char const*>(&index_[0]),
+                index_.size() * sizeof(SessionLogIndexEntry));
+  }
+  fout_.write(reinterpret_cast<char const*>(&trailer), sizeof trailer);
+  fout_.close();
+  if (fout_.fail()) {
+    LERROR << "SessionLogWriter: Unable to write the index of the log";
+  }
+
+  boost::mutex::scoped_lock lock(mutex_);
+  closed_ = true;
+  LINFO << "SessionLogWriter: Wrote " << written_ << " records ("
+        << dropped_ << " clouds dropped)";
+}
+
+uint64_t SessionLogWriter::written() const {
+  boost::mutex::scoped_lock lock(mutex_);
+  return written_;
+}
+
+uint64_t SessionLogWriter::dropped() const {
+  boost::mutex::scoped_lock lock(mutex_);
+  return dropped_;
+}
+
+SessionLogReader::SessionLogReader(std::string const& file_path)
+    : fin_(file_path.c_str(), std::ios::binary),
+      file_size_(0) {
+  if (!fin_.is_open()) {
+    throw "Unable to open the session log";
+  }
+  fin_.seekg(0, std::ios::end);
+  file_size_ = fin_.tellg();
+  fin_.seekg(0, std::ios::beg);
+
+  SessionLogFileHeader header;
+  if (!fin_.read(reinterpret_cast<char*>(&header), sizeof header) ||
+      memcmp(header.magic, FILE_MAGIC, sizeof header.magic) != 0) {
+    throw "Not a session log";
+  }
+  if (header.version != VERSION) {
+    throw "Unsupported session log version";
+  }
+
+  if (!loadIndex()) {
+    LWARNING << "SessionLogReader: The log has no index (it was not closed "
+             << "cleanly); scanning the records instead";
+    scanRecords();
+  }
+  LINFO << "SessionLogReader: Opened " << file_path << " with "
+        << index_.size() << " records";
+}
+
+bool SessionLogReader::loadIndex() {
+  if (file_size_ < sizeof(SessionLogFileHeader) + sizeof(SessionLogTrailer)) {
+    return false;
+  }
+  SessionLogTrailer trailer;
+  fin_.seekg(file_size_ - sizeof trailer);
+  if (!fin_.read(reinterpret_cast<char*>(&trailer), sizeof trailer) ||
+      memcmp(trailer.magic, INDEX_MAGIC, sizeof trailer.magic) != 0 ||
+      trailer.index_offset +
+          trailer.count * sizeof(SessionLogIndexEntry) +
+          sizeof trailer != file_size_) {
+    fin_.clear();
+    return false;
+  }
+  index_.resize(trailer.count);
+  fin_.seekg(trailer.index_offset);
+  if (!index_.empty() &&
+      !fin_.read(reinterpret_cast<char*>(&index_[0]),
+                 index_.size() * sizeof(SessionLogIndexEntry))) {
+    fin_.clear();
+    index_.clear();
+    return false;
+  }
+  return true;
+}
+
+void SessionLogReader::scanRecords() {
+  index_.clear();
+  uint64_t offset = sizeof(SessionLogFileHeader);
+  SessionLogRecord record;
+  fin_.seekg(offset);
+  while (offset + sizeof record <= file_size_) {
+    if (!fin_.read(reinterpret_cast<char*>(&record), sizeof record)) break;
+    SessionLogIndexEntry entry;
+    entry.offset = offset + sizeof record;
+    entry.time = record.time;
+    entry.type = record.type;
+    entry.size = record.size;
+    // A record cut short by the crash is dropped.
+    if (entry.offset + entry.size > file_size_) break;
+    index_.push_back(entry);
+    offset = entry.offset + entry.size;
+    fin_.seekg(offset);
+  }
+  fin_.clear();
+}
+
+bool SessionLogReader::read(size_t i, std::vector<char>& payload) {
+  SessionLogIndexEntry const& entry = index_[i];
+  payload.resize(entry.size);
+  if (entry.size == 0) return true;
+  fin_.seekg(entry.offset);
+  if (!fin_.read(&payload[0], entry.size)) {
+    fin_.clear();
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,238 @@
+#ifndef LOLA_SESSION_LOG_H__
+#define LOLA_SESSION_LOG_H__
+
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+/**
+ * The on-disk format of a session log: a single binary file holding all the
+ * raw clouds and robot poses received during a session, in the order in which
+ * they were received, so that the session can be replayed deterministically.
+ *
+ * The file starts with a `SessionLogFileHeader`, followed by any number of
+ * records. Each record is a `SessionLogRecord` header immediately followed by
+ * its payload:
+ *
+ *  - a `CLOUD` record holds a `SessionLogCloudHeader` followed by
+ *    `width * height` points, each given as three floats (x, y, z);
+ *  - a `QUANTIZED_CLOUD` record holds a `SessionLogCloudHeader` followed by
+ *    the points encoded by the `lepp::QuantizedCloudCodec`, which takes up a
+ *    fraction of the space, at the cost of the points' precision;
+ *  - a `POSE` record holds a raw `HR_Pose`, exactly as it was received.
+ *
+ * A cleanly closed log ends with an index of all records (one
+ * `SessionLogIndexEntry` per record) and a `SessionLogTrailer`, so that a
+ * reader can find (and decode) any record without scanning the file. A log
+ * that was not closed cleanly (e.g. the process crashed) lacks the index,
+ * which is then rebuilt by scanning the records.
+ *
+ * All values are stored in the host's byte order.
+ */
+struct SessionLogFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+struct SessionLogRecord {
+  enum Type {
+    CLOUD = 1,
+    POSE = 2,
+    QUANTIZED_CLOUD = 3
+  };
+  uint32_t type;
+  /**
+   * The size of the payload following the header, in bytes.
+   */
+  uint32_t size;
+  /**
+   * The local time of the record, in microseconds since the epoch: the time at
+   * which the cloud was captured or at which the pose was received.
+   */
+  uint64_t time;
+};
+
+struct SessionLogCloudHeader {
+  /**
+   * The cloud's own stamp (`pcl::PCLHeader::stamp`).
+   */
+  uint64_t stamp;
+  uint32_t width;
+  uint32_t height;
+  uint32_t is_dense;
+  uint32_t reserved;
+};
+
+struct SessionLogIndexEntry {
+  /**
+   * The offset of the record's payload from the start of the file.
+   */
+  uint64_t offset;
+  uint64_t time;
+  uint32_t type;
+  uint32_t size;
+};
+
+struct SessionLogTrailer {
+  /**
+   * The offset of the first index entry from the start of the file.
+   */
+  uint64_t index_offset;
+  uint64_t count;
+  char magic[8];
+};
+
+/**
+ * Writes a session log.
+ *
+ * Records can be appended from any thread; they are written to the file in the
+ * order in which they were appended. The writing itself is done by a
+ * background thread, so appending a record never waits for the disk.
+ *
+ * The payloads are passed in buffers obtained from `acquireBuffer`, which are
+ * recycled once they have been written, so a running recording does not
+ * allocate memory for each record.
+ *
+ * If the disk cannot keep up and more than `max_queued_bytes` are waiting to
+ * be written, further clouds are dropped (and counted) until the backlog is
+ * written out. Poses are small and are never dropped.
+ */
+class SessionLogWriter : boost::noncopyable {
+public:
+  typedef boost::shared_ptr<std::vector<char> > Buffer;
+  /**
+   * The default limit on the amount of data waiting to be written.
+   */
+  static size_t const DEFAULT_MAX_QUEUED_BYTES = 256 * 1024 * 1024;
+
+  /**
+   * Creates (or truncates) the log file at the given path and starts the
+   * writer thread. Throws if the file cannot be opened.
+   */
+  SessionLogWriter(
+      std::string const& file_path,
+      size_t max_queued_bytes = DEFAULT_MAX_QUEUED_BYTES);
+  /**
+   * RAII: closes the log.
+   */
+  ~SessionLogWriter();
+
+  /**
+   * Returns an empty buffer into which a record's payload can be placed.
+   */
+  Buffer acquireBuffer();
+  /**
+   * Appends a record with the given type, time and payload to the log.
+   * Ignored once writing to the file has failed.
+   */
+  void append(SessionLogRecord::Type type, uint64_t time, Buffer const& payload);
+  /**
+   * Writes out all pending records, followed by the index, and closes the
+   * file. No more records can be appended afterwards.
+   */
+  void close();
+
+  /**
+   * The number of records written so far and the number of clouds dropped
+   * because the disk could not keep up.
+   */
+  uint64_t written() const;
+  uint64_t dropped() const;
+private:
+  struct Pending {
+    SessionLogRecord record;
+    Buffer payload;
+  };
+  /**
+   * The function executed by the writer thread.
+   */
+  void run();
+  /**
+   * Writes a single record to the file and remembers it in the index.
+   * Returns false if the record could not be written (e.g. the disk is full).
+   */
+  bool write(Pending const& pending);
+
+  std::ofstream fout_;
+  size_t const max_queued_bytes_;
+  /**
+   * The offset at which the next record is going to be written.
+   */
+  uint64_t offset_;
+  std::vector<SessionLogIndexEntry> index_;
+
+  /**
+   * Guards all of the members below.
+   */
+  mutable boost::mutex mutex_;
+  boost::condition_variable cond_;
+  std::deque<Pending> queue_;
+  size_t queued_bytes_;
+  /**
+   * Buffers that have been written and can be reused.
+   */
+  std::vector<Buffer> free_buffers_;
+  bool closing_;
+  bool closed_;
+  /**
+   * Whether writing to the file failed, which stops the recording: all
+   * records appended afterwards are ignored.
+   */
+  bool failed_;
+  uint64_t written_;
+  uint64_t dropped_;
+
+  boost::thread thread_;
+};
+
+/**
+ * Reads a session log written by a `SessionLogWriter`.
+ */
+class SessionLogReader : boost::noncopyable {
+public:
+  /**
+   * Opens the log at the given path and loads its index. Throws if the file
+   * cannot be opened or is not a session log.
+   */
+  explicit SessionLogReader(std::string const& file_path);
+
+  /**
+   * The number of records in the log.
+   */
+  size_t size() const { return index_.size(); }
+  /**
+   * The index entry of the i-th record.
+   */
+  SessionLogIndexEntry const& entry(size_t i) const { return index_[i]; }
+  /**
+   * Reads the payload of the i-th record into the given buffer. Returns false
+   * if the record could not be read (e.g. the file was truncated).
+   */
+  bool read(size_t i, std::vector<char>& payload);
+private:
+  /**
+   * Loads the index written at the end of the log. Returns false if the log
+   * does not have one.
+   */
+  bool loadIndex();
+  /**
+   * Rebuilds the index by scanning all records of the log.
+   */
+  void scanRecords();
+
+  std::ifstream fin_;
+  uint64_t file_size_;
+  std::vector<SessionLogIndexEntry> index_;
+};
+
+#endif
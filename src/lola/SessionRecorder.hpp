@@ -0,0 +1,75 @@
+#ifndef LOLA_SESSION_RECORDER_H__
+#define LOLA_SESSION_RECORDER_H__
+
+#include <cstring>
+
+#include "lepp2/BaseVideoSource.hpp"
+#include "lepp2/VideoObserver.hpp"
+
+#include "lola/PoseService.h"
+#include "lola/SessionCloud.hpp"
+#include "lola/SessionLog.h"
+
+/**
+ * Records a session into a session log (see `SessionLogWriter`): all raw
+ * clouds emitted by the `VideoSource` it is attached to and all poses received
+ * by the `PoseService` it is attached to, in the order in which they arrived.
+ *
+ * Only the x, y and z coordinates of the points are recorded. If a resolution
+ * is given, they are quantized to it (see `lepp::QuantizedCloudCodec`), which
+ * makes the recording several times smaller.
+ *
+ * The recorder should be attached to the raw video source before any other
+ * observer, so that the clouds are logged before the pipeline gets to process
+ * them, i.e. before any pose that arrives while the cloud is processed.
+ */
+template<class PointT>
+class SessionRecorder : public lepp::VideoObserver<PointT>, public PoseObserver {
+public:
+  /**
+   * Creates a new recorder that writes to the session log at the given path,
+   * quantizing the points to the given resolution (in meters) if it is
+   * positive. Throws if the log cannot be created.
+   */
+  SessionRecorder(std::string const& file_path, float resolution = 0)
+      : writer_(file_path), resolution_(resolution) {}
+  /**
+   * `VideoObserver` interface implementation.
+   */
+  void notifyNewFrame(
+      int idx,
+      const typename pcl::PointCloud<PointT>::ConstPtr& cloud);
+  /**
+   * `PoseObserver` interface implementation.
+   */
+  void notifyNewPose(HR_Pose const& pose, uint64_t recv_time);
+  /**
+   * Writes out everything recorded so far and closes the log.
+   */
+  void close() { writer_.close(); }
+private:
+  SessionLogWriter writer_;
+  float const resolution_;
+};
+
+template<class PointT>
+void SessionRecorder<PointT>::notifyNewFrame(
+    int idx,
+    const typename pcl::PointCloud<PointT>::ConstPtr& cloud) {
+  uint64_t const time =
+      lepp::captureTime(cloud->header.stamp, lepp::localTime());
+  SessionLogWriter::Buffer buffer = writer_.acquireBuffer();
+  SessionLogRecord::Type const type =
+      encodeSessionCloud(*cloud, resolution_, *buffer);
+  writer_.append(type, time, buffer);
+}
+
+template<class PointT>
+void SessionRecorder<PointT>::notifyNewPose(HR_Pose const& pose, uint64_t recv_time) {
+  SessionLogWriter::Buffer buffer = writer_.acquireBuffer();
+  buffer->resize(sizeof pose);
+  memcpy(&(*buffer)[0], &pose, sizeof pose);
+  writer_.append(SessionLogRecord::POSE, recv_time, buffer);
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef LOLA_TELEMETRY_H__
+#define LOLA_TELEMETRY_H__
+
+#include <stdint.h>
+
+/**
+ * The protocol by which a `TelemetryPublisher` gives a remote viewer (see the
+ * `lola_telemetry_viewer` tool) a live view of the pipeline, so that the
+ * robot's computer need not render it itself.
+ *
+ * Each sampled frame is sent as a message: a `TelemetryHeader`, followed by
+ * `obstacle_count` `TelemetryObstacle` records and the payload of a session
+ * log cloud record (see `SessionLog.h`) holding the decimated cloud, which is
+ * normally quantized by the `lepp::QuantizedCloudCodec`.
+ *
+ * The messages are split into chunks (see `DatagramChunks.h`) sent over UDP
+ * or, to a viewer on the same computer, a local (Unix domain) datagram
+ * socket.
+ *
+ * All values are in the host's byte order.
+ */
+enum TelemetryTransport {
+  TELEMETRY_UDP,
+  TELEMETRY_LOCAL
+};
+
+uint32_t const TELEMETRY_MAGIC = 0x31544c4c;  // "LLT1"
+
+#pragma pack(push)
+#pragma pack(1)
+struct TelemetryHeader {
+  uint32_t magic;
+  /**
+   * The sequence number of the message.
+   */
+  uint32_t seq;
+  /**
+   * The time at which the frame was captured, in microseconds since the
+   * epoch.
+   */
+  uint64_t stamp;
+  /**
+   * The time (in microseconds) that the stages of the pipeline took for the
+   * frame and the time from its capture until it got through all of them.
+   */
+  uint32_t filter_time;
+  uint32_t segmentation_time;
+  uint32_t approximation_time;
+  uint32_t latency;
+  uint32_t obstacle_count;
+  /**
+   * The type of the session log record whose payload holds the cloud: a
+   * `SessionLogRecord::CLOUD` or `SessionLogRecord::QUANTIZED_CLOUD`.
+   */
+  uint32_t cloud_type;
+};
+
+/**
+ * A single primitive of an obstacle. All lengths are in millimeters.
+ */
+struct TelemetryObstacle {
+  /**
+   * The id of the obstacle that the primitive is a part of.
+   */
+  int32_t id;
+  /**
+   * 0 for spheres, 1 for capsules.
+   */
+  int16_t type;
+  int16_t radius;
+  /**
+   * The center of a sphere, or the centers of the two ends of a capsule.
+   */
+  int32_t coords[6];
+};
+#pragma pack(pop)
+
+/**
+ * The largest message that a viewer accepts.
+ */
+uint32_t const TELEMETRY_MAX_SIZE = 16 * 1024 * 1024;
+
+#endif
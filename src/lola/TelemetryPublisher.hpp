@@ -0,0 +1,388 @@
+#ifndef LOLA_TELEMETRY_PUBLISHER_H__
+#define LOLA_TELEMETRY_PUBLISHER_H__
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <pcl/filters/voxel_grid.h>
+
+#include "lepp2/BaseObstacleDetector.hpp"
+#include "lepp2/BaseVideoSource.hpp"
+#include "lepp2/FilteredVideoSource.hpp"
+#include "lepp2/ObstacleAggregator.hpp"
+#include "lepp2/VideoObserver.hpp"
+#include "lepp2/models/ObjectModel.h"
+
+#include "lola/DatagramChunks.h"
+#include "lola/SessionCloud.hpp"
+#include "lola/Telemetry.h"
+
+#include "deps/easylogging++.h"
+
+/**
+ * A `ModelVisitor` that puts each primitive model that it visits into a
+ * `TelemetryObstacle` record.
+ */
+class TelemetrySerializer : public lepp::ModelVisitor {
+public:
+  TelemetrySerializer(std::vector<TelemetryObstacle>& records)
+      : records_(records), id_(0) {}
+  /**
+   * Makes the primitives visited next belong to the obstacle with the given
+   * id.
+   */
+  void setId(int id) { id_ = id; }
+
+  void visitSphere(lepp::SphereModel& sphere) {
+    TelemetryObstacle& record = nextRecord();
+    record.type = 0;
+    record.radius = toMillimeters(sphere.radius());
+    setCoords(record.coords, sphere.center());
+  }
+
+  void visitCapsule(lepp::CapsuleModel& capsule) {
+    TelemetryObstacle& record = nextRecord();
+    record.type = 1;
+    record.radius = toMillimeters(capsule.radius());
+    setCoords(record.coords, capsule.first());
+    setCoords(record.coords + 3, capsule.second());
+  }
+private:
+  TelemetryObstacle& nextRecord() {
+    records_.push_back(TelemetryObstacle());
+    TelemetryObstacle& record = records_.back();
+    memset(&record, 0, sizeof record);
+    record.id = id_;
+    return record;
+  }
+  static void setCoords(int32_t* coords, lepp::Coordinate const& c) {
+    coords[0] = toMillimeters(c.x);
+    coords[1] = toMillimeters(c.y);
+    coords[2] = toMillimeters(c.z);
+  }
+  static int toMillimeters(double meters) { return meters * 1000; }
+
+  std::vector<TelemetryObstacle>& records_;
+  int id_;
+};
+
+/**
+ * Streams a sample of the pipeline's output to a remote viewer (see
+ * `Telemetry.h`): at most `rate` times per second, the filtered cloud
+ * (thinned out to a point per voxel and quantized), the obstacles found in
+ * it and the time that each stage of the pipeline took for it.
+ *
+ * It is attached both to the filtered source, after the detector, and to the
+ * detector, whose obstacles it turns into records right away, so the records
+ * of a frame are ready once the frame reaches the publisher. The sampled
+ * frames are decimated, encoded and sent on a thread of the publisher's own,
+ * so the pipeline only ever pays for copying the records. When the thread
+ * cannot keep up, only the newest frame waits to be sent.
+ *
+ * The sends never block: the chunks that do not fit into the socket's buffer
+ * (e.g. while a local viewer is not reading them) are dropped.
+ */
+template<class PointT>
+class TelemetryPublisher
+    : public lepp::VideoObserver<PointT>,
+      public lepp::ObstacleAggregator {
+public:
+  struct Stats {
+    size_t sent;
+    /**
+     * The sampled frames that were superseded by a newer one before they were
+     * sent, or that could not be sent.
+     */
+    size_t dropped;
+    uint64_t bytes;
+  };
+
+  /**
+   * Creates a new publisher sending to the viewer at the given address: an IP
+   * and port over UDP, or the path of the viewer's socket for a local one.
+   *
+   * The timings are taken from the given source and detector, which the
+   * publisher needs to be attached to.
+   */
+  TelemetryPublisher(
+      TelemetryTransport transport,
+      std::string const& address,
+      int port,
+      double rate,
+      double voxel_size,
+      float resolution,
+      FilteredVideoSource<PointT> const& source,
+      BaseObstacleDetector<PointT> const& detector);
+  /**
+   * RAII: stops sending.
+   */
+  ~TelemetryPublisher();
+
+  /**
+   * `VideoObserver` interface implementation.
+   */
+  void notifyNewFrame(
+      int idx,
+      const typename pcl::PointCloud<PointT>::ConstPtr& cloud);
+  /**
+   * `ObstacleAggregator` interface implementation.
+   */
+  void updateObstacles(std::vector<lepp::ObjectModelPtr> const& obstacles);
+
+  Stats stats() const;
+private:
+  typedef typename pcl::PointCloud<PointT>::ConstPtr CloudConstPtr;
+
+  /**
+   * A sampled frame waiting to be sent.
+   */
+  struct Frame {
+    TelemetryHeader header;
+    std::vector<TelemetryObstacle> obstacles;
+    CloudConstPtr cloud;
+  };
+
+  /**
+   * Sends the pending frame, if there is one. Only called on the publisher's
+   * thread.
+   */
+  void sendNext();
+  /**
+   * Sends the encoded message as a sequence of datagrams. Returns false if
+   * any of them could not be sent.
+   */
+  bool sendChunks();
+  /**
+   * Sends a single datagram on the socket of the publisher's transport.
+   */
+  void sendDatagram(boost::system::error_code& error);
+
+  TelemetryTransport const transport_;
+  uint64_t const period_;
+  float const voxel_size_;
+  float const resolution_;
+  FilteredVideoSource<PointT> const& source_;
+  BaseObstacleDetector<PointT> const& detector_;
+
+  boost::asio::io_service io_service_;
+  boost::scoped_ptr<boost::asio::io_service::work> work_;
+  boost::asio::ip::udp::endpoint udp_endpoint_;
+  boost::asio::ip::udp::socket udp_socket_;
+  boost::asio::local::datagram_protocol::endpoint local_endpoint_;
+  boost::asio::local::datagram_protocol::socket local_socket_;
+
+  /**
+   * The records of the latest obstacles and the time at which the last frame
+   * was sampled. Only touched by the thread emitting the frames.
+   */
+  std::vector<TelemetryObstacle> obstacles_;
+  uint64_t last_sample_;
+
+  /**
+   * The newest sampled frame that is yet to be sent.
+   */
+  mutable boost::mutex mutex_;
+  Frame pending_;
+
+  /**
+   * The state of the sending, only touched by the publisher's thread.
+   */
+  Frame current_;
+  typename pcl::PointCloud<PointT>::Ptr decimated_;
+  uint32_t const session_;
+  uint32_t seq_;
+  bool failing_;
+  std::vector<char> message_;
+  std::vector<char> payload_;
+  std::vector<char> datagram_;
+
+  boost::atomic<size_t> sent_;
+  boost::atomic<size_t> dropped_;
+  boost::atomic<uint64_t> bytes_;
+
+  boost::thread thread_;
+};
+
+template<class PointT>
+TelemetryPublisher<PointT>::TelemetryPublisher(
+    TelemetryTransport transport,
+    std::string const& address,
+    int port,
+    double rate,
+    double voxel_size,
+    float resolution,
+    FilteredVideoSource<PointT> const& source,
+    BaseObstacleDetector<PointT> const& detector)
+    : transport_(transport),
+      period_(rate > 0 ? 1e6 / rate : 0),
+      voxel_size_(voxel_size),
+      resolution_(resolution),
+      source_(source),
+      detector_(detector),
+      work_(new boost::asio::io_service::work(io_service_)),
+      udp_socket_(io_service_),
+      local_socket_(io_service_),
+      last_sample_(0),
+      decimated_(new pcl::PointCloud<PointT>()),
+      session_(newChunkSession()),
+      seq_(0),
+      failing_(false),
+      sent_(0),
+      dropped_(0),
+      bytes_(0) {
+  if (transport_ == TELEMETRY_LOCAL) {
+    local_endpoint_ = boost::asio::local::datagram_protocol::endpoint(address);
+    local_socket_.open();
+    local_socket_.non_blocking(true);
+  } else {
+    udp_endpoint_ = boost::asio::ip::udp::endpoint(
+        boost::asio::ip::address::from_string(address), port);
+    udp_socket_.open(udp_endpoint_.protocol());
+    udp_socket_.non_blocking(true);
+  }
+  thread_ = boost::thread(
+      boost::bind(&boost::asio::io_service::run, &io_service_));
+}
+
+template<class PointT>
+TelemetryPublisher<PointT>::~TelemetryPublisher() {
+  work_.reset();
+  io_service_.stop();
+  thread_.join();
+}
+
+template<class PointT>
+void TelemetryPublisher<PointT>::updateObstacles(
+    std::vector<lepp::ObjectModelPtr> const& obstacles) {
+  obstacles_.clear();
+  TelemetrySerializer serializer(obstacles_);
+  size_t const sz = obstacles.size();
+  for (size_t i = 0; i < sz; ++i) {
+    // Obstacles without an id still need to be told apart by the viewer.
+    int const id = obstacles[i]->id();
+    serializer.setId(id != 0 ? id : -static_cast<int>(i + 1));
+    obstacles[i]->accept(serializer);
+  }
+}
+
+template<class PointT>
+void TelemetryPublisher<PointT>::notifyNewFrame(
+    int idx,
+    const typename pcl::PointCloud<PointT>::ConstPtr& cloud) {
+  uint64_t const now = lepp::localTime();
+  if (now - last_sample_ < period_) return;
+  last_sample_ = now;
+
+  typename BaseObstacleDetector<PointT>::DetectionTimes const& times =
+      detector_.lastTimes();
+  uint64_t const stamp = lepp::captureTime(cloud->header.stamp, now);
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (pending_.cloud) dropped_.fetch_add(1, boost::memory_order_relaxed);
+    TelemetryHeader& header = pending_.header;
+    header.magic = TELEMETRY_MAGIC;
+    header.stamp = stamp;
+    header.filter_time = source_.lastFilterTime();
+    header.segmentation_time = times.segmentation;
+    header.approximation_time = times.approximation;
+    header.latency = now - stamp;
+    header.obstacle_count = obstacles_.size();
+    pending_.obstacles = obstacles_;
+    pending_.cloud = cloud;
+  }
+  io_service_.post(boost::bind(&TelemetryPublisher::sendNext, this));
+}
+
+template<class PointT>
+typename TelemetryPublisher<PointT>::Stats
+TelemetryPublisher<PointT>::stats() const {
+  Stats stats;
+  stats.sent = sent_.load(boost::memory_order_relaxed);
+  stats.dropped = dropped_.load(boost::memory_order_relaxed);
+  stats.bytes = bytes_.load(boost::memory_order_relaxed);
+  return stats;
+}
+
+template<class PointT>
+void TelemetryPublisher<PointT>::sendNext() {
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (!pending_.cloud) return;
+    current_.header = pending_.header;
+    current_.obstacles.swap(pending_.obstacles);
+    current_.cloud.swap(pending_.cloud);
+    pending_.cloud.reset();
+  }
+
+  pcl::PointCloud<PointT> const* cloud = current_.cloud.get();
+  if (voxel_size_ > 0) {
+    pcl::VoxelGrid<PointT> grid;
+    grid.setInputCloud(current_.cloud);
+    grid.setLeafSize(voxel_size_, voxel_size_, voxel_size_);
+    grid.filter(*decimated_);
+    decimated_->header.stamp = current_.cloud->header.stamp;
+    cloud = decimated_.get();
+  }
+  TelemetryHeader& header = current_.header;
+  header.seq = seq_++;
+  header.cloud_type = encodeSessionCloud(*cloud, resolution_, payload_);
+  current_.cloud.reset();
+
+  size_t const records = current_.obstacles.size() * sizeof(TelemetryObstacle);
+  message_.resize(sizeof header + records + payload_.size());
+  memcpy(&message_[0], &header, sizeof header);
+  if (records != 0) {
+    memcpy(&message_[sizeof header], &current_.obstacles[0], records);
+  }
+  memcpy(&message_[sizeof header + records], &payload_[0], payload_.size());
+
+  if (sendChunks()) {
+    sent_.fetch_add(1, boost::memory_order_relaxed);
+    bytes_.fetch_add(message_.size(), boost::memory_order_relaxed);
+  } else {
+    dropped_.fetch_add(1, boost::memory_order_relaxed);
+  }
+}
+
+template<class PointT>
+bool TelemetryPublisher<PointT>::sendChunks() {
+  size_t const count = chunkCount(message_.size());
+  for (size_t i = 0; i < count; ++i) {
+    makeChunk(TELEMETRY_MAGIC, session_, seq_ - 1, message_, i, datagram_);
+    boost::system::error_code error;
+    sendDatagram(error);
+    if (error) {
+      // The viewer is often not running at all, which is only worth a single
+      // warning.
+      if (!failing_) {
+        LWARNING << "TelemetryPublisher: Unable to send: " << error.message();
+      }
+      failing_ = true;
+      return false;
+    }
+  }
+  if (failing_) LINFO << "TelemetryPublisher: Sending again";
+  failing_ = false;
+  return true;
+}
+
+template<class PointT>
+void TelemetryPublisher<PointT>::sendDatagram(boost::system::error_code& error) {
+  if (transport_ == TELEMETRY_LOCAL) {
+    local_socket_.send_to(
+        boost::asio::buffer(datagram_), local_endpoint_, 0, error);
+  } else {
+    udp_socket_.send_to(
+        boost::asio::buffer(datagram_), udp_endpoint_, 0, error);
+  }
+}
+
+#endif
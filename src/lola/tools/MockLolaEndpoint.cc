@@ -0,0 +1,233 @@
+#include "lola/tools/MockLolaEndpoint.h"
+
+#include <boost/bind.hpp>
+
+#include "deps/easylogging++.h"
+
+namespace {
+  boost::posix_time::ptime now() {
+    return boost::posix_time::microsec_clock::universal_time();
+  }
+}
+
+MockLolaEndpoint::MockLolaEndpoint(
+    boost::asio::io_service& io_service,
+    std::string const& host,
+    int tcp_port,
+    int udp_port)
+    : host_(host),
+      tcp_port_(tcp_port),
+      udp_port_(udp_port),
+      io_service_(io_service),
+      acceptor_(io_service),
+      robot_socket_(io_service),
+      viewer_socket_(io_service),
+      robot_connected_(false) {}
+
+void MockLolaEndpoint::start() {
+  boost::asio::ip::address const address(
+      boost::asio::ip::address::from_string(host_));
+  if (tcp_port_ != 0) {
+    boost::asio::ip::tcp::endpoint local(address, tcp_port_);
+    acceptor_.open(local.protocol());
+    acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+    acceptor_.bind(local);
+    acceptor_.listen();
+    LINFO << "MockLolaEndpoint: Accepting robot messages on " << local;
+    queueAccept();
+  }
+  if (udp_port_ != 0) {
+    boost::asio::ip::udp::endpoint local(address, udp_port_);
+    viewer_socket_.open(local.protocol());
+    viewer_socket_.bind(local);
+    LINFO << "MockLolaEndpoint: Accepting viewer datagrams on " << local;
+    queueUdpRecv();
+  }
+}
+
+void MockLolaEndpoint::queueAccept() {
+  acceptor_.async_accept(
+      robot_socket_,
+      boost::bind(&MockLolaEndpoint::acceptHandler, this, _1));
+}
+
+void MockLolaEndpoint::acceptHandler(boost::system::error_code const& error) {
+  if (error) {
+    LERROR << "MockLolaEndpoint: Accept failed: " << error.message();
+    return;
+  }
+  LINFO << "MockLolaEndpoint: Robot link connected.";
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    robot_connected_ = true;
+  }
+  changed_.notify_all();
+  queueTcpRead();
+}
+
+void MockLolaEndpoint::queueTcpRead() {
+  boost::asio::async_read(
+      robot_socket_,
+      boost::asio::buffer(&robot_msg_, sizeof(VisionMessage)),
+      boost::bind(&MockLolaEndpoint::tcpReadHandler, this, _1, _2));
+}
+
+void MockLolaEndpoint::tcpReadHandler(
+    boost::system::error_code const& error,
+    std::size_t bytes_transferred) {
+  if (error) {
+    // The client went away (or the read failed); go back to waiting for the
+    // next connection.
+    LINFO << "MockLolaEndpoint: Robot link closed: " << error.message();
+    boost::system::error_code ignored;
+    robot_socket_.close(ignored);
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      robot_connected_ = false;
+    }
+    changed_.notify_all();
+    queueAccept();
+    return;
+  }
+
+  Arrival arrival;
+  arrival.time = now();
+  arrival.id = robot_msg_.id;
+  arrival.scene = 0;
+  arrival.chunk = 0;
+  arrival.size = bytes_transferred;
+  arrival.valid = validateVisionMessage(robot_msg_);
+  if (!arrival.valid) {
+    LWARNING << "MockLolaEndpoint: Invalid robot message: " << robot_msg_;
+  }
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    tcp_arrivals_.push_back(arrival);
+    ++stats_.tcp_messages;
+    if (!arrival.valid) ++stats_.tcp_invalid;
+    stats_.bytes += bytes_transferred;
+  }
+  changed_.notify_all();
+  queueTcpRead();
+}
+
+void MockLolaEndpoint::queueUdpRecv() {
+  viewer_socket_.async_receive(
+      boost::asio::buffer(viewer_buffer_),
+      boost::bind(&MockLolaEndpoint::udpRecvHandler, this, _1, _2));
+}
+
+void MockLolaEndpoint::udpRecvHandler(
+    boost::system::error_code const& error,
+    std::size_t bytes_transferred) {
+  if (error) {
+    if (error == boost::asio::error::operation_aborted) return;
+    LERROR << "MockLolaEndpoint: Receive failed: " << error.message();
+    queueUdpRecv();
+    return;
+  }
+
+  Arrival arrival;
+  arrival.time = now();
+  arrival.size = bytes_transferred;
+  LolaDatagramHeader header;
+  arrival.valid = validateObstacleDatagram(
+      &viewer_buffer_[0], bytes_transferred, header, arrival.id);
+  arrival.scene = header.scene;
+  arrival.chunk = header.chunk;
+  if (!arrival.valid) {
+    LWARNING << "MockLolaEndpoint: Invalid viewer datagram of "
+             << bytes_transferred << " bytes";
+  }
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    udp_arrivals_.push_back(arrival);
+    ++stats_.udp_datagrams;
+    if (!arrival.valid) ++stats_.udp_invalid;
+    stats_.udp_obstacles += arrival.id;
+    stats_.bytes += bytes_transferred;
+    if (arrival.valid) {
+      // The scene is complete once all of its datagrams are in.
+      uint16_t& received = partial_scenes_[header.scene];
+      if (++received == header.chunk_count) {
+        ++stats_.udp_scenes;
+        partial_scenes_.erase(header.scene);
+      }
+    }
+  }
+  changed_.notify_all();
+  queueUdpRecv();
+}
+
+bool MockLolaEndpoint::validateVisionMessage(VisionMessage const& msg) const {
+  if (msg.len != sizeof msg.params) return false;
+  return msg.id == VisionMessage::SET_SSV ||
+         msg.id == VisionMessage::MODIFY_SSV ||
+         msg.id == VisionMessage::REMOVE_SSV;
+}
+
+bool MockLolaEndpoint::validateObstacleDatagram(
+    char const* data,
+    size_t size,
+    LolaDatagramHeader& header,
+    uint32_t& count) const {
+  memset(&header, 0, sizeof header);
+  count = 0;
+  if (size < sizeof header) return false;
+  memcpy(&header, data, sizeof header);
+  if (header.chunk >= header.chunk_count) return false;
+
+  size_t const payload = size - sizeof header;
+  count = payload / sizeof(LolaObstacle);
+  if (payload % sizeof(LolaObstacle) != 0) return false;
+  for (size_t i = 0; i < count; ++i) {
+    LolaObstacle obstacle;
+    memcpy(&obstacle,
+           data + sizeof header + i * sizeof(LolaObstacle),
+           sizeof obstacle);
+    // Only spheres (0) and capsules (1) are known to the viewer...
+    if (obstacle.type != 0 && obstacle.type != 1) return false;
+    // ...and neither can have a negative radius.
+    if (obstacle.radius < 0) return false;
+  }
+  return true;
+}
+
+bool MockLolaEndpoint::waitForRobotConnection(
+    boost::posix_time::time_duration timeout) {
+  boost::system_time const deadline = boost::get_system_time() + timeout;
+  boost::mutex::scoped_lock lock(mutex_);
+  while (!robot_connected_) {
+    if (!changed_.timed_wait(lock, deadline)) break;
+  }
+  return robot_connected_;
+}
+
+bool MockLolaEndpoint::waitForCounts(
+    size_t tcp_messages,
+    size_t udp_scenes,
+    boost::posix_time::time_duration timeout) {
+  boost::system_time const deadline = boost::get_system_time() + timeout;
+  boost::mutex::scoped_lock lock(mutex_);
+  while (tcp_arrivals_.size() < tcp_messages ||
+         stats_.udp_scenes < udp_scenes) {
+    if (!changed_.timed_wait(lock, deadline)) break;
+  }
+  return tcp_arrivals_.size() >= tcp_messages &&
+         stats_.udp_scenes >= udp_scenes;
+}
+
+std::vector<MockLolaEndpoint::Arrival> MockLolaEndpoint::tcpArrivals() const {
+  boost::mutex::scoped_lock lock(mutex_);
+  return tcp_arrivals_;
+}
+
+std::vector<MockLolaEndpoint::Arrival> MockLolaEndpoint::udpArrivals() const {
+  boost::mutex::scoped_lock lock(mutex_);
+  return udp_arrivals_;
+}
+
+MockLolaEndpoint::Stats MockLolaEndpoint::stats() const {
+  boost::mutex::scoped_lock lock(mutex_);
+  return stats_;
+}
@@ -0,0 +1,194 @@
+#ifndef LOLA_TOOLS_MOCK_LOLA_ENDPOINT_H__
+#define LOLA_TOOLS_MOCK_LOLA_ENDPOINT_H__
+
+#include "lola/RobotService.h"
+#include "lola/LolaAggregator.h"
+
+#include <map>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/array.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+/**
+ * A loopback stand-in for the two LOLA endpoints that the vision subsystem
+ * talks to: the robot controller, which receives `VisionMessage`s over TCP
+ * (see `AsyncRobotService`), and the LOLA viewer, which receives obstacle
+ * datagrams over UDP (see `LolaAggregator`).
+ *
+ * Every message that arrives is timestamped and validated against the
+ * respective wire format. This makes it possible to measure the throughput
+ * and latency of the robot link without the real robot or viewer being on
+ * the network.
+ *
+ * The endpoint does not run its own thread; all of its work is done by
+ * whichever thread runs the `io_service` given at construct-time.
+ */
+class MockLolaEndpoint {
+public:
+  /**
+   * Describes a single message received by the endpoint.
+   */
+  struct Arrival {
+    /**
+     * The (local) time at which the message was completely received.
+     */
+    boost::posix_time::ptime time;
+    /**
+     * For TCP messages, the `VisionMessage` ID; for UDP datagrams, the number
+     * of obstacles found in the datagram.
+     */
+    uint32_t id;
+    /**
+     * For UDP datagrams, the scene that the datagram belongs to and its index
+     * within that scene (see `LolaDatagramHeader`); unused for TCP messages.
+     */
+    uint32_t scene;
+    uint16_t chunk;
+    /**
+     * The number of bytes that the message consisted of.
+     */
+    size_t size;
+    /**
+     * Whether the message conformed to the expected wire format.
+     */
+    bool valid;
+  };
+
+  /**
+   * Aggregate counters of everything the endpoint has received.
+   */
+  struct Stats {
+    Stats()
+        : tcp_messages(0), tcp_invalid(0),
+          udp_datagrams(0), udp_invalid(0), udp_obstacles(0), udp_scenes(0),
+          bytes(0) {}
+    uint64_t tcp_messages;
+    uint64_t tcp_invalid;
+    uint64_t udp_datagrams;
+    uint64_t udp_invalid;
+    uint64_t udp_obstacles;
+    /**
+     * The number of scenes for which all datagrams have been received.
+     */
+    uint64_t udp_scenes;
+    uint64_t bytes;
+  };
+
+  /**
+   * Creates a new endpoint that will listen on the given local address.
+   * `VisionMessage`s are accepted on `tcp_port` and obstacle datagrams on
+   * `udp_port`. Passing 0 for either of the ports disables that part of the
+   * endpoint.
+   */
+  MockLolaEndpoint(
+      boost::asio::io_service& io_service,
+      std::string const& host,
+      int tcp_port,
+      int udp_port);
+
+  /**
+   * Binds the sockets and queues the initial asynchronous operations.
+   * Throws if any of the ports cannot be bound.
+   */
+  void start();
+
+  /**
+   * Blocks until a client (i.e. a `RobotService`) connects to the TCP port or
+   * the timeout expires. Returns whether the client is connected.
+   */
+  bool waitForRobotConnection(boost::posix_time::time_duration timeout);
+  /**
+   * Blocks until at least the given number of TCP messages and complete
+   * scenes (over UDP) have been received or the timeout expires. Returns
+   * whether the counts were reached.
+   */
+  bool waitForCounts(
+      size_t tcp_messages,
+      size_t udp_scenes,
+      boost::posix_time::time_duration timeout);
+
+  /**
+   * Returns copies of the arrival records collected so far, in the order in
+   * which the messages were received.
+   */
+  std::vector<Arrival> tcpArrivals() const;
+  std::vector<Arrival> udpArrivals() const;
+  /**
+   * Returns a snapshot of the endpoint's counters.
+   */
+  Stats stats() const;
+private:
+  /**
+   * Helper methods that queue the next async operation for each of the
+   * sockets.
+   */
+  void queueAccept();
+  void queueTcpRead();
+  void queueUdpRecv();
+  /**
+   * The completion handlers of the async operations.
+   */
+  void acceptHandler(boost::system::error_code const& error);
+  void tcpReadHandler(
+      boost::system::error_code const& error,
+      std::size_t bytes_transferred);
+  void udpRecvHandler(
+      boost::system::error_code const& error,
+      std::size_t bytes_transferred);
+
+  /**
+   * Checks whether the given message is one that the robot would accept.
+   */
+  bool validateVisionMessage(VisionMessage const& msg) const;
+  /**
+   * Checks whether the given datagram is one that the LOLA viewer would
+   * accept. Puts the number of obstacles found in the datagram into `count`
+   * and its header into `header`.
+   */
+  bool validateObstacleDatagram(
+      char const* data,
+      size_t size,
+      LolaDatagramHeader& header,
+      uint32_t& count) const;
+
+  std::string const host_;
+  int const tcp_port_;
+  int const udp_port_;
+
+  boost::asio::io_service& io_service_;
+  boost::asio::ip::tcp::acceptor acceptor_;
+  boost::asio::ip::tcp::socket robot_socket_;
+  boost::asio::ip::udp::socket viewer_socket_;
+
+  /**
+   * The buffer into which the next `VisionMessage` is read.
+   */
+  VisionMessage robot_msg_;
+  /**
+   * The buffer into which the next datagram is received. Large enough for any
+   * UDP payload.
+   */
+  boost::array<char, 65536> viewer_buffer_;
+
+  /**
+   * Guards all members below, which are shared between the io_service thread
+   * and the clients of the endpoint.
+   */
+  mutable boost::mutex mutex_;
+  boost::condition_variable changed_;
+  bool robot_connected_;
+  std::vector<Arrival> tcp_arrivals_;
+  std::vector<Arrival> udp_arrivals_;
+  /**
+   * Maps the scenes for which only some datagrams were received to the number
+   * of datagrams received so far.
+   */
+  std::map<uint32_t, uint16_t> partial_scenes_;
+  Stats stats_;
+};
+
+#endif
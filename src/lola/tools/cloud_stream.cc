@@ -0,0 +1,204 @@
+/**
+ * A program that streams point clouds to a `cloud_stream` VideoSource (see
+ * `CloudStream.h`).
+ *
+ * In the `send` mode, it streams the clouds of the sensor attached to the
+ * computer that it runs on to the vision subsystem running on another one.
+ *
+ * In the `loopback` mode, it streams the frames of a synthetic scene (QVGA at
+ * 30 Hz, like a sensor's) to a receiver in the same process over the loopback
+ * interface and reports the rate at which they arrive, the bandwidth that
+ * they take up and how many of them are lost, which tells whether a link of a
+ * given capacity can carry the stream.
+ */
+#include <iostream>
+#include <cstdlib>
+
+#include <boost/thread.hpp>
+
+#include "lepp2/GrabberVideoSource.hpp"
+#include "lepp2/SyntheticVideoSource.hpp"
+#include "lepp2/VideoObserver.hpp"
+
+#include "lola/CloudStreamPublisher.hpp"
+#include "lola/CloudStreamSource.hpp"
+
+#include "deps/easylogging++.h"
+_INITIALIZE_EASYLOGGINGPP
+
+using namespace lepp;
+
+namespace {
+
+typedef SimplePoint PointT;
+
+/**
+ * Prints out the expected CLI usage of the program.
+ */
+void PrintUsage() {
+  std::cout << "usage: lola_cloud_stream loopback [options]" << std::endl;
+  std::cout << "       lola_cloud_stream send <ip> <port> [options] [--mode <mode>]"
+      << std::endl;
+  std::cout << "options:" << std::endl;
+  std::cout << "  --udp              : " << "stream over UDP instead of TCP"
+      << std::endl;
+  std::cout << "  --resolution <m>   : " << "quantize the points to this resolution"
+      << " (in meters)" << std::endl;
+  std::cout << "  --frames <n>       : " << "(loopback) the number of frames to stream"
+      << " (300 by default)" << std::endl;
+  std::cout << "  --port <port>      : " << "(loopback) the port to stream through"
+      << " (53260 by default)" << std::endl;
+  std::cout << "  --mode <mode>      : " << "(send) the mode of the sensor"
+      << " (qvga_30 by default)" << std::endl;
+}
+
+/**
+ * Counts the clouds that make it through the stream and their points.
+ */
+class StreamCounter : public VideoObserver<PointT> {
+public:
+  StreamCounter() : clouds_(0), points_(0), first_(0), last_(0) {}
+  void notifyNewFrame(
+      int idx,
+      const pcl::PointCloud<PointT>::ConstPtr& cloud) {
+    uint64_t const now = localTime();
+    boost::mutex::scoped_lock lock(mutex_);
+    if (clouds_ == 0) first_ = now;
+    last_ = now;
+    ++clouds_;
+    points_ += cloud->size();
+  }
+  void report(std::ostream& out, uint64_t bytes) {
+    boost::mutex::scoped_lock lock(mutex_);
+    double const elapsed = (last_ - first_) / 1e6;
+    out << "Received " << clouds_ << " clouds";
+    if (clouds_ != 0) out << " of " << points_ / clouds_ << " points on average";
+    if (clouds_ > 1 && elapsed > 0) {
+      out << " at " << (clouds_ - 1) / elapsed << " Hz, taking up "
+          << bytes * 8 / elapsed / 1e6 << " Mbit/s";
+    }
+    out << std::endl;
+  }
+private:
+  boost::mutex mutex_;
+  size_t clouds_;
+  uint64_t points_;
+  uint64_t first_;
+  uint64_t last_;
+};
+
+int runLoopback(
+    int port,
+    CloudStreamTransport transport,
+    float resolution,
+    size_t frames) {
+  CloudStreamSource<PointT> receiver(port, transport);
+  boost::shared_ptr<StreamCounter> counter(new StreamCounter);
+  receiver.attachObserver(counter);
+  receiver.open();
+
+  SyntheticScene scene;
+  scene.width = 320;
+  scene.height = 240;
+  scene.frames = frames;
+  boost::shared_ptr<CloudStreamPublisher<PointT> > publisher(
+      new CloudStreamPublisher<PointT>("127.0.0.1", port, transport, resolution));
+  {
+    SyntheticVideoSource<PointT> source(scene, FramePacer::ORIGINAL);
+    source.attachObserver(publisher);
+    source.open();
+    // Give the stream a second to drain after the last frame.
+    boost::this_thread::sleep(boost::posix_time::milliseconds(
+          static_cast<int64_t>(frames * 1000 / scene.frame_rate) + 1000));
+  }
+
+  CloudStreamPublisher<PointT>::Stats const stats = publisher->stats();
+  std::cout << "Sent " << stats.sent << " clouds ("
+            << stats.bytes / (stats.sent != 0 ? stats.sent : 1)
+            << " bytes each on average); " << stats.dropped
+            << " were dropped by the publisher" << std::endl;
+  counter->report(std::cout, stats.bytes);
+  std::cout << receiver.missed() << " clouds were lost on the way" << std::endl;
+  return 0;
+}
+
+int runSend(
+    std::string const& ip,
+    int port,
+    CloudStreamTransport transport,
+    float resolution,
+    std::string const& mode) {
+  LiveStreamSource<PointT> source(openNIMode<pcl::OpenNIGrabber>(mode));
+  boost::shared_ptr<CloudStreamPublisher<PointT> > publisher(
+      new CloudStreamPublisher<PointT>(ip, port, transport, resolution));
+  source.attachObserver(publisher);
+  source.open();
+  std::cout << "Streaming to " << ip << ":" << port << "..." << std::endl;
+  while (true) {
+    boost::this_thread::sleep(boost::posix_time::seconds(10));
+    CloudStreamPublisher<PointT>::Stats const stats = publisher->stats();
+    std::cout << "Sent " << stats.sent << " clouds (" << stats.bytes / 1e6
+              << " MB); dropped " << stats.dropped << std::endl;
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  _START_EASYLOGGINGPP(argc, argv);
+  if (argc < 2) {
+    PrintUsage();
+    return 1;
+  }
+  std::string const command = argv[1];
+  std::string ip;
+  int port = 53260;
+  int first = 2;
+  if (command == "send") {
+    if (argc < 4) {
+      PrintUsage();
+      return 1;
+    }
+    ip = argv[2];
+    port = atoi(argv[3]);
+    first = 4;
+  } else if (command != "loopback") {
+    PrintUsage();
+    return 1;
+  }
+
+  CloudStreamTransport transport = CLOUD_STREAM_TCP;
+  float resolution = 0;
+  size_t frames = 300;
+  std::string mode = "qvga_30";
+  for (int i = first; i < argc; ++i) {
+    std::string const option = argv[i];
+    if (option == "--udp") {
+      transport = CLOUD_STREAM_UDP;
+    } else if (option == "--resolution" && i + 1 < argc) {
+      resolution = atof(argv[++i]);
+    } else if (option == "--frames" && i + 1 < argc) {
+      frames = atoi(argv[++i]);
+    } else if (option == "--port" && i + 1 < argc) {
+      port = atoi(argv[++i]);
+    } else if (option == "--mode" && i + 1 < argc) {
+      mode = argv[++i];
+    } else {
+      PrintUsage();
+      return 1;
+    }
+  }
+
+  try {
+    if (command == "send") {
+      return runSend(ip, port, transport, resolution, mode);
+    }
+    return runLoopback(port, transport, resolution, frames);
+  } catch (char const* exc) {
+    std::cerr << exc << std::endl;
+    return 1;
+  } catch (std::exception const& exc) {
+    std::cerr << exc.what() << std::endl;
+    return 1;
+  }
+}
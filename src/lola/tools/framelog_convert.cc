@@ -0,0 +1,99 @@
+/**
+ * A program that converts recordings into a frame log (see
+ * `lepp::FrameLogWriter`), which the `framelog` VideoSource replays straight
+ * from a memory mapping.
+ *
+ * The input is either a session log (as written by the `[Recorder]` of the
+ * vision subsystem; only its clouds are converted) or any number of PCD files,
+ * each of which becomes a single frame.
+ */
+#include <iostream>
+
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <pcl/io/pcd_io.h>
+
+#include "lepp2/FrameLog.hpp"
+#include "lola/SessionCloud.hpp"
+#include "lola/SessionLog.h"
+
+#include "deps/easylogging++.h"
+_INITIALIZE_EASYLOGGINGPP
+
+using namespace lepp;
+
+/**
+ * Prints out the expected CLI usage of the program.
+ */
+void PrintUsage() {
+  std::cout << "usage: lola_framelog_convert <output> (<session-log> | <pcd-file>...)"
+      << std::endl;
+  std::cout << "output      : " << "the frame log to write" << std::endl;
+  std::cout << "session-log : " << "a session log whose clouds are converted"
+      << std::endl;
+  std::cout << "pcd-file    : " << "PCD files that are converted, one frame each,"
+      << " in the given order" << std::endl;
+}
+
+namespace {
+  /**
+   * Appends all clouds of the given session log to the frame log.
+   */
+  void convertSessionLog(
+      std::string const& file_path,
+      FrameLogWriter<SimplePoint>& writer) {
+    SessionLogReader reader(file_path);
+    std::vector<char> payload;
+    SimplePointCloud cloud;
+    for (size_t i = 0; i < reader.size(); ++i) {
+      SessionLogIndexEntry const& entry = reader.entry(i);
+      if (entry.type != SessionLogRecord::CLOUD &&
+          entry.type != SessionLogRecord::QUANTIZED_CLOUD) {
+        continue;
+      }
+      if (!reader.read(i, payload)) {
+        std::cerr << "Unable to read record " << i << std::endl;
+        continue;
+      }
+      if (!decodeSessionCloud(entry.type, payload, cloud)) {
+        std::cerr << "Malformed cloud in record " << i << std::endl;
+        continue;
+      }
+      writer.append(cloud, entry.time);
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  _START_EASYLOGGINGPP(argc, argv);
+  if (argc < 3) {
+    PrintUsage();
+    return 1;
+  }
+  try {
+    FrameLogWriter<SimplePoint> writer(argv[1]);
+    if (argc == 3 && !boost::algorithm::iends_with(argv[2], ".pcd")) {
+      convertSessionLog(argv[2], writer);
+    } else {
+      // Without any recorded times, the frames are spaced as by the PCD
+      // grabber (20 fps).
+      uint64_t const frame_time = 50000;
+      SimplePointCloud cloud;
+      for (int i = 2; i < argc; ++i) {
+        if (pcl::io::loadPCDFile(argv[i], cloud) < 0) {
+          std::cerr << "Unable to load " << argv[i] << std::endl;
+          return 1;
+        }
+        writer.append(cloud, (i - 2) * frame_time);
+      }
+    }
+    writer.close();
+    std::cout << "Wrote " << writer.size() << " frames to " << argv[1]
+              << std::endl;
+  } catch (char const* exc) {
+    std::cerr << exc << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
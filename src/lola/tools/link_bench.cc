@@ -0,0 +1,423 @@
+/**
+ * A benchmark of the links between the vision subsystem and LOLA.
+ *
+ * It drives a recorded (or synthetic) stream of obstacles through the
+ * `RobotAggregator` (backed by an `AsyncRobotService`) and the
+ * `LolaAggregator`, both of which are pointed at an in-process
+ * `MockLolaEndpoint` on the loopback interface. Once the whole stream has
+ * been delivered, it reports the achieved message rates, the time messages
+ * spent queued in the robot service and the end-to-end delivery latency.
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <numeric>
+#include <cstdlib>
+
+#include <boost/thread.hpp>
+
+#include "lola/tools/MockLolaEndpoint.h"
+#include "lola/LolaAggregator.h"
+#include "lola/NetworkReactor.h"
+#include "lola/RobotService.h"
+#include "lola/PoseService.h"
+#include "lola/Robot.h"
+
+#include "deps/easylogging++.h"
+_INITIALIZE_EASYLOGGINGPP
+
+using namespace lepp;
+
+namespace {
+
+typedef std::vector<ObjectModelPtr> ObstacleFrame;
+
+boost::posix_time::ptime now() {
+  return boost::posix_time::microsec_clock::universal_time();
+}
+
+/**
+ * Runs the given io service in the calling thread.
+ */
+void service_thread(boost::asio::io_service* io_service) {
+  io_service->run();
+}
+
+/**
+ * A `RobotService` decorator that remembers the time at which each message
+ * was handed to the service, so that it can later be matched to the time at
+ * which the message arrived at the endpoint.
+ */
+class TimestampingRobotService : public RobotService {
+public:
+  TimestampingRobotService(RobotService& service) : service_(service) {}
+  void sendMessage(VisionMessage const& msg) {
+    queued_.push_back(now());
+    service_.sendMessage(msg);
+  }
+  std::vector<boost::posix_time::ptime> const& queued() const { return queued_; }
+private:
+  RobotService& service_;
+  std::vector<boost::posix_time::ptime> queued_;
+};
+
+/**
+ * Reads a recorded obstacle stream from the given file.
+ *
+ * The file is a textual list of frames. Each frame starts with a line
+ * containing only `frame`, followed by one line per obstacle:
+ *
+ *   sphere <id> <radius> <x> <y> <z>
+ *   capsule <id> <radius> <x1> <y1> <z1> <x2> <y2> <z2>
+ *
+ * Obstacles with the same ID are considered to be the same object across
+ * frames. Empty lines and lines starting with `#` are ignored.
+ */
+std::vector<ObstacleFrame> loadObstacleStream(std::string const& file_path) {
+  std::ifstream fin(file_path.c_str());
+  if (!fin.is_open()) {
+    throw "Unable to open the obstacle stream";
+  }
+  std::vector<ObstacleFrame> frames;
+  std::string line;
+  while (std::getline(fin, line)) {
+    std::istringstream iss(line);
+    std::string type;
+    if (!(iss >> type) || type[0] == '#') continue;
+    if (type == "frame") {
+      frames.push_back(ObstacleFrame());
+      continue;
+    }
+    if (frames.empty()) {
+      throw "Obstacle found before the first frame";
+    }
+    int id;
+    double radius;
+    Coordinate first;
+    iss >> id >> radius >> first.x >> first.y >> first.z;
+    ObjectModelPtr model;
+    if (type == "sphere") {
+      model.reset(new SphereModel(radius, first));
+    } else if (type == "capsule") {
+      Coordinate second;
+      iss >> second.x >> second.y >> second.z;
+      model.reset(new CapsuleModel(radius, first, second));
+    } else {
+      throw "Unknown obstacle type in the obstacle stream";
+    }
+    if (!iss) {
+      throw "Malformed obstacle in the obstacle stream";
+    }
+    model->set_id(id);
+    frames.back().push_back(model);
+  }
+
+  return frames;
+}
+
+/**
+ * Generates a synthetic obstacle stream with the given number of frames and
+ * obstacles per frame. The obstacles jitter slightly from frame to frame and
+ * one of them is replaced by a brand new obstacle every 10 frames, so that
+ * the `RobotAggregator` sees new, modified and deleted obstacles.
+ */
+std::vector<ObstacleFrame> generateObstacleStream(int frame_count, int obstacles) {
+  std::vector<ObstacleFrame> frames(frame_count);
+  std::vector<int> ids(obstacles);
+  for (int i = 0; i < obstacles; ++i) ids[i] = i + 1;
+  int next_id = obstacles + 1;
+  for (int f = 0; f < frame_count; ++f) {
+    if (f > 0 && f % 10 == 0 && obstacles > 0) {
+      ids[(f / 10) % obstacles] = next_id++;
+    }
+    double const jitter = 0.005 * (f % 3);
+    for (int i = 0; i < obstacles; ++i) {
+      Coordinate const center(1 + 0.3 * i + jitter, 0.2 * (i % 5), 0.1);
+      ObjectModelPtr model;
+      if (i % 2 == 0) {
+        model.reset(new SphereModel(0.1, center));
+      } else {
+        Coordinate const top(center.x, center.y, center.z + 0.4);
+        model.reset(new CapsuleModel(0.05, center, top));
+      }
+      model->set_id(ids[i]);
+      frames[f].push_back(model);
+    }
+  }
+
+  return frames;
+}
+
+/**
+ * Prints the mean, median, 99th percentile and maximum of the given samples
+ * (in microseconds).
+ */
+void printDistribution(std::string const& name, std::vector<double> samples) {
+  std::cout << "  " << name << ": ";
+  if (samples.empty()) {
+    std::cout << "n/a" << std::endl;
+    return;
+  }
+  std::sort(samples.begin(), samples.end());
+  double const mean =
+      std::accumulate(samples.begin(), samples.end(), 0.) / samples.size();
+  std::cout << "mean " << mean
+            << " | p50 " << samples[samples.size() / 2]
+            << " | p99 " << samples[(samples.size() * 99) / 100]
+            << " | max " << samples.back()
+            << " [us]" << std::endl;
+}
+
+/**
+ * Computes the latency between each send and the arrival that corresponds to
+ * it. Messages are matched by their order, which both TCP and (on the
+ * loopback interface) UDP preserve.
+ */
+std::vector<double> latencies(
+    std::vector<boost::posix_time::ptime> const& sent,
+    std::vector<MockLolaEndpoint::Arrival> const& arrivals) {
+  std::vector<double> ret;
+  size_t const sz = std::min(sent.size(), arrivals.size());
+  for (size_t i = 0; i < sz; ++i) {
+    ret.push_back((arrivals[i].time - sent[i]).total_microseconds());
+  }
+  return ret;
+}
+
+/**
+ * Computes the latency of each scene sent to the viewer: the time between the
+ * send of the scene and the arrival of its last datagram. The scene sequence
+ * numbers start at 0, so they correspond to the indices in `sent`.
+ */
+std::vector<double> sceneLatencies(
+    std::vector<boost::posix_time::ptime> const& sent,
+    std::vector<MockLolaEndpoint::Arrival> const& arrivals) {
+  std::map<uint32_t, boost::posix_time::ptime> completed;
+  for (size_t i = 0; i < arrivals.size(); ++i) {
+    if (arrivals[i].scene >= sent.size()) continue;
+    boost::posix_time::ptime& last = completed[arrivals[i].scene];
+    if (last.is_not_a_date_time() || last < arrivals[i].time) {
+      last = arrivals[i].time;
+    }
+  }
+  std::vector<double> ret;
+  for (std::map<uint32_t, boost::posix_time::ptime>::const_iterator it = completed.begin();
+       it != completed.end();
+       ++it) {
+    ret.push_back((it->second - sent[it->first]).total_microseconds());
+  }
+  return ret;
+}
+
+/**
+ * Returns the number of messages per second delivered between the first send
+ * and the last arrival.
+ */
+double rate(
+    std::vector<boost::posix_time::ptime> const& sent,
+    std::vector<MockLolaEndpoint::Arrival> const& arrivals) {
+  if (sent.empty() || arrivals.empty()) return 0;
+  double const secs =
+      (arrivals.back().time - sent.front()).total_microseconds() / 1e6;
+  return secs > 0 ? arrivals.size() / secs : 0;
+}
+
+}  // namespace <anonymous>
+
+/**
+ * Prints out the expected CLI usage of the program.
+ */
+void PrintUsage() {
+  std::cout << "usage: lola_link_bench (--stream <file> | --synthetic <frames> <obstacles>)"
+      << " [--rate <fps>] [--freq <frames>] [--delay <ms>]"
+      << " [--tcp <port>] [--udp <port>] [--viewers <n>]" << std::endl;
+  std::cout << "--stream    : " << "read the obstacles from a recorded stream"
+      << std::endl;
+  std::cout << "--synthetic : " << "generate a synthetic obstacle stream"
+      << std::endl;
+  std::cout << "--rate      : " << "frames per second fed to the aggregators "
+      << "(default 30, 0 means as fast as possible)" << std::endl;
+  std::cout << "--freq      : " << "the RobotAggregator frame rate (default 30)"
+      << std::endl;
+  std::cout << "--delay     : " << "the RobotService delay between messages "
+      << "(default 10)" << std::endl;
+  std::cout << "--tcp/--udp : " << "loopback ports used by the mock endpoint "
+      << "(default 47001/47002)" << std::endl;
+  std::cout << "--viewers   : " << "the number of viewers the scenes are sent "
+      << "to, on consecutive ports from the UDP port (default 1)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  _START_EASYLOGGINGPP(argc, argv);
+  std::vector<ObstacleFrame> frames;
+  double fps = 30;
+  int freq = 30;
+  int delay = 10;
+  int tcp_port = 47001;
+  int udp_port = 47002;
+  int viewers = 1;
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string const option = argv[i];
+      if (option == "--stream" && i + 1 < argc) {
+        frames = loadObstacleStream(argv[++i]);
+      } else if (option == "--synthetic" && i + 2 < argc) {
+        int const frame_count = atoi(argv[++i]);
+        int const obstacles = atoi(argv[++i]);
+        frames = generateObstacleStream(frame_count, obstacles);
+      } else if (option == "--rate" && i + 1 < argc) {
+        fps = atof(argv[++i]);
+      } else if (option == "--freq" && i + 1 < argc) {
+        freq = atoi(argv[++i]);
+      } else if (option == "--delay" && i + 1 < argc) {
+        delay = atoi(argv[++i]);
+      } else if (option == "--tcp" && i + 1 < argc) {
+        tcp_port = atoi(argv[++i]);
+      } else if (option == "--udp" && i + 1 < argc) {
+        udp_port = atoi(argv[++i]);
+      } else if (option == "--viewers" && i + 1 < argc) {
+        viewers = atoi(argv[++i]);
+      } else {
+        throw "Unknown option";
+      }
+    }
+  } catch (char const* exc) {
+    std::cerr << exc << std::endl;
+    PrintUsage();
+    return 1;
+  }
+  if (frames.empty() || viewers < 1) {
+    PrintUsage();
+    return 1;
+  }
+
+  // Bring up the mock endpoint first, so that the services have something to
+  // connect to.
+  boost::asio::io_service endpoint_io;
+  MockLolaEndpoint endpoint(endpoint_io, "127.0.0.1", tcp_port, udp_port);
+  endpoint.start();
+  // Any additional viewers only need the UDP part of the endpoint.
+  std::vector<boost::shared_ptr<MockLolaEndpoint> > extra_viewers;
+  for (int i = 1; i < viewers; ++i) {
+    boost::shared_ptr<MockLolaEndpoint> viewer(
+        new MockLolaEndpoint(endpoint_io, "127.0.0.1", 0, udp_port + i));
+    viewer->start();
+    extra_viewers.push_back(viewer);
+  }
+  boost::thread endpoint_thread(boost::bind(service_thread, &endpoint_io));
+
+  // The services under test share a reactor, just as they do in the vision
+  // pipeline; the mock endpoint has its own, as the robot would.
+  NetworkReactor reactor;
+  reactor.start();
+  AsyncRobotService robot_service(reactor.io_service(), "127.0.0.1", tcp_port, delay);
+  robot_service.start();
+  if (!endpoint.waitForRobotConnection(boost::posix_time::seconds(5))) {
+    std::cerr << "The robot service failed to connect to the mock endpoint"
+              << std::endl;
+    return 1;
+  }
+  TimestampingRobotService timestamping_service(robot_service);
+  // The pose service is never started: the robot stays at the origin and,
+  // with an empty inner zone, never suppresses any of the messages.
+  PoseService pose_service(reactor.io_service(), "127.0.0.1", 0);
+  Robot robot(pose_service, 0.);
+  RobotAggregator robot_aggregator(timestamping_service, freq, robot);
+  LolaAggregator lola_aggregator(reactor.io_service(), "127.0.0.1", udp_port);
+  for (int i = 1; i < viewers; ++i) {
+    lola_aggregator.addEndpoint("127.0.0.1", udp_port + i);
+  }
+
+  std::cout << "Driving " << frames.size() << " frames through the aggregators..."
+            << std::endl;
+  std::vector<boost::posix_time::ptime> frame_sent;
+  std::vector<double> call_times;
+  boost::posix_time::time_duration const period =
+      boost::posix_time::microseconds(fps > 0 ? static_cast<long>(1e6 / fps) : 0);
+  boost::posix_time::ptime next_frame = now();
+  for (size_t i = 0; i < frames.size(); ++i) {
+    if (fps > 0) {
+      boost::this_thread::sleep(next_frame);
+      next_frame += period;
+    }
+    boost::posix_time::ptime const start = now();
+    frame_sent.push_back(start);
+    lola_aggregator.updateObstacles(frames[i]);
+    robot_aggregator.updateObstacles(frames[i]);
+    call_times.push_back((now() - start).total_microseconds());
+  }
+
+  // Each frame results in exactly one viewer scene, while the number of
+  // robot messages depends on the diffs found by the aggregator.
+  size_t const robot_messages = timestamping_service.queued().size();
+  // Allow each queued message its share of the service delay, plus a grace
+  // period.
+  boost::posix_time::time_duration const timeout =
+      boost::posix_time::milliseconds(2000 + robot_messages * (delay + 1));
+  bool complete =
+      endpoint.waitForCounts(robot_messages, frames.size(), timeout);
+  for (size_t i = 0; i < extra_viewers.size(); ++i) {
+    complete = extra_viewers[i]->waitForCounts(0, frames.size(), timeout)
+        && complete;
+  }
+
+  std::vector<MockLolaEndpoint::Arrival> const tcp = endpoint.tcpArrivals();
+  std::vector<MockLolaEndpoint::Arrival> const udp = endpoint.udpArrivals();
+  MockLolaEndpoint::Stats const endpoint_stats = endpoint.stats();
+  AsyncRobotService::Stats const service_stats = robot_service.stats();
+
+  std::cout << "Robot link (RobotAggregator -> AsyncRobotService -> TCP):" << std::endl;
+  std::cout << "  messages: " << robot_messages << " queued, "
+            << service_stats.sent << " sent, "
+            << service_stats.failed << " failed, "
+            << tcp.size() << " received ("
+            << endpoint_stats.tcp_invalid << " invalid)" << std::endl;
+  std::cout << "  throughput: " << rate(timestamping_service.queued(), tcp)
+            << " msg/s" << std::endl;
+  std::cout << "  queueing delay: mean "
+            << (service_stats.sent + service_stats.failed > 0
+                ? service_stats.total_queue_delay /
+                  (service_stats.sent + service_stats.failed)
+                : 0)
+            << " | max " << service_stats.max_queue_delay << " [us]" << std::endl;
+  printDistribution("delivery latency", latencies(timestamping_service.queued(), tcp));
+
+  std::cout << "Viewer link (LolaAggregator -> UDP):" << std::endl;
+  std::cout << "  scenes: " << frames.size() << " sent, "
+            << endpoint_stats.udp_scenes << " received complete" << std::endl;
+  std::cout << "  datagrams: " << udp.size() << " received ("
+            << endpoint_stats.udp_invalid << " invalid), "
+            << endpoint_stats.udp_obstacles << " obstacles" << std::endl;
+  std::cout << "  throughput: " << rate(frame_sent, udp)
+            << " datagrams/s" << std::endl;
+  printDistribution("delivery latency", sceneLatencies(frame_sent, udp));
+  std::vector<LolaAggregator::EndpointStats> const viewer_stats =
+      lola_aggregator.endpointStats();
+  for (size_t i = 0; i < viewer_stats.size(); ++i) {
+    std::cout << "  viewer " << viewer_stats[i].endpoint << ": "
+              << viewer_stats[i].sent << " datagrams sent, "
+              << viewer_stats[i].failed << " failed";
+    if (i > 0) {
+      MockLolaEndpoint::Stats const stats = extra_viewers[i - 1]->stats();
+      std::cout << ", " << stats.udp_scenes << " scenes received complete ("
+                << stats.udp_invalid << " invalid datagrams)";
+    }
+    std::cout << std::endl;
+  }
+
+  std::cout << "Aggregators:" << std::endl;
+  printDistribution("updateObstacles call time", call_times);
+
+  if (!complete) {
+    std::cout << "WARNING: not all messages arrived before the timeout."
+              << std::endl;
+  }
+  // Stop all I/O before the services and the endpoint go out of scope.
+  reactor.stop();
+  reactor.join();
+  endpoint_io.stop();
+  endpoint_thread.join();
+  return complete ? 0 : 2;
+}
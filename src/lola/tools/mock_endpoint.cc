@@ -0,0 +1,93 @@
+/**
+ * A program that impersonates the LOLA robot controller and viewer on the
+ * local machine, so that the vision subsystem (or the `lola_link_bench`) can
+ * be pointed at it instead of the real robot.
+ *
+ * Once per second it reports the rate at which messages arrive and how many
+ * of them did not conform to the expected wire formats.
+ */
+#include <iostream>
+#include <cstdlib>
+
+#include <boost/thread.hpp>
+
+#include "lola/tools/MockLolaEndpoint.h"
+
+#include "deps/easylogging++.h"
+_INITIALIZE_EASYLOGGINGPP
+
+namespace {
+  /**
+   * Runs the given io service in the calling thread.
+   */
+  void service_thread(boost::asio::io_service* io_service) {
+    io_service->run();
+  }
+}
+
+/**
+ * Prints out the expected CLI usage of the program.
+ */
+void PrintUsage() {
+  std::cout << "usage: lola_mock [--host <ip>] [--tcp <port>] [--udp <port>]"
+      << std::endl;
+  std::cout << "--host : " << "the local address to listen on "
+      << "(default 127.0.0.1)" << std::endl;
+  std::cout << "--tcp  : " << "the port on which robot messages are accepted "
+      << "(default 1337, 0 disables)" << std::endl;
+  std::cout << "--udp  : " << "the port on which viewer datagrams are accepted "
+      << "(default 53250, 0 disables)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  _START_EASYLOGGINGPP(argc, argv);
+  std::string host = "127.0.0.1";
+  int tcp_port = 1337;
+  int udp_port = 53250;
+  for (int i = 1; i < argc; ++i) {
+    std::string const option = argv[i];
+    if (i + 1 == argc) {
+      PrintUsage();
+      return 1;
+    }
+    if (option == "--host") {
+      host = argv[++i];
+    } else if (option == "--tcp") {
+      tcp_port = atoi(argv[++i]);
+    } else if (option == "--udp") {
+      udp_port = atoi(argv[++i]);
+    } else {
+      PrintUsage();
+      return 1;
+    }
+  }
+
+  boost::asio::io_service io_service;
+  MockLolaEndpoint endpoint(io_service, host, tcp_port, udp_port);
+  try {
+    endpoint.start();
+  } catch (std::exception const& exc) {
+    std::cerr << "Unable to start the mock endpoint: " << exc.what()
+              << std::endl;
+    return 1;
+  }
+  boost::thread io_thread(boost::bind(service_thread, &io_service));
+
+  std::cout << "Mock LOLA endpoint running..." << std::endl;
+  std::cout << "(^C to exit)" << std::endl;
+  MockLolaEndpoint::Stats previous;
+  while (true) {
+    boost::this_thread::sleep(boost::posix_time::seconds(1));
+    MockLolaEndpoint::Stats const current = endpoint.stats();
+    std::cout << "robot: " << current.tcp_messages - previous.tcp_messages
+              << " msg/s (" << current.tcp_invalid << " invalid total); "
+              << "viewer: " << current.udp_datagrams - previous.udp_datagrams
+              << " datagrams/s, "
+              << current.udp_obstacles - previous.udp_obstacles
+              << " obstacles/s (" << current.udp_invalid << " invalid total)"
+              << std::endl;
+    previous = current;
+  }
+
+  return 0;
+}
@@ -0,0 +1,330 @@
+/**
+ * An end-to-end benchmark of the vision pipeline.
+ *
+ * It builds the pipeline described by a config file, exactly as the vision
+ * subsystem does, but headless (see `FileConfigContext`): without a
+ * visualizer, without talking to the robot or the viewers and without
+ * recording, streaming or tracing anything (any such sections of the config
+ * are ignored), so that no I/O adds to the timings. The config is expected to
+ * use a video source that replays a recorded dataset (`replay`, `framelog` or
+ * `pcd_sequence`) or generates a synthetic scene of the given complexity
+ * (`synthetic`, with a limited number of `frames`), ideally with
+ * `pace = fast`, so that the frames are processed as fast as the pipeline
+ * allows.
+ *
+ * Once the source has gone idle, it writes a machine-readable (JSON) report:
+ * the overall throughput, the distribution of the time spent in each stage of
+ * the pipeline, the peak resident set size and, for each frame, the number of
+ * obstacles found.
+ */
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <numeric>
+#include <cstdlib>
+
+#include <sys/resource.h>
+
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+#include "lepp2/debug/trace.hpp"
+#include "lola/Context.hpp"
+
+#include "deps/easylogging++.h"
+_INITIALIZE_EASYLOGGINGPP
+
+using namespace lepp;
+
+namespace {
+
+typedef SimplePoint PointT;
+
+/**
+ * The stages of the pipeline that the time of each frame is broken down into.
+ */
+enum Stage {
+  /**
+   * The time between the end of the previous frame and the start of this one,
+   * i.e. the time that the pipeline was kept waiting by the source.
+   */
+  SOURCE_WAIT,
+  FILTER,
+  SEGMENTATION,
+  APPROXIMATION,
+  /**
+   * Everything else: smoothing out the obstacles and any other observers
+   * (e.g. a recorder).
+   */
+  OTHER,
+  TOTAL,
+  STAGE_COUNT
+};
+
+char const* const STAGE_NAMES[STAGE_COUNT] = {
+  "source_wait",
+  "filter",
+  "segmentation",
+  "approximation",
+  "other",
+  "total"
+};
+
+struct FrameRecord {
+  uint64_t times[STAGE_COUNT];
+  size_t points;
+  size_t obstacles;
+};
+
+/**
+ * A `VideoObserver` that calls the given function for each frame.
+ */
+class FrameProbe : public VideoObserver<PointT> {
+public:
+  typedef boost::function<void (pcl::PointCloud<PointT> const&)> Callback;
+  FrameProbe(Callback callback) : callback_(callback) {}
+  void notifyNewFrame(
+      int idx,
+      const pcl::PointCloud<PointT>::ConstPtr& cloud) {
+    callback_(*cloud);
+  }
+private:
+  Callback callback_;
+};
+
+/**
+ * Records the time that the pipeline spends on each frame.
+ *
+ * The pipeline processes a frame synchronously, on the thread of the source:
+ * the raw frame is given to the filtered source, which gives the filtered
+ * frame to the detector, which in turn gives the (smoothed out) obstacles to
+ * its aggregators. The recorder hooks into the start (as an observer of the
+ * raw source that comes before the filtered source) and the end (as the last
+ * observer of the filtered source) of this chain and reads the time spent on
+ * the stages in between from the stages themselves.
+ */
+class PipelineRecorder : public ObstacleAggregator {
+public:
+  PipelineRecorder(
+      boost::shared_ptr<FilteredVideoSource<PointT> > filtered_source,
+      boost::shared_ptr<BaseObstacleDetector<PointT> > detector)
+      : filtered_source_(filtered_source),
+        detector_(detector),
+        start_(0),
+        last_end_(0) {}
+
+  void frameStarted(pcl::PointCloud<PointT> const& cloud) {
+    uint64_t const now = localTime();
+    current_.times[SOURCE_WAIT] = last_end_ != 0 ? now - last_end_ : 0;
+    current_.points = cloud.size();
+    current_.obstacles = 0;
+    start_ = now;
+  }
+
+  void updateObstacles(std::vector<ObjectModelPtr> const& obstacles) {
+    current_.obstacles = obstacles.size();
+  }
+
+  void frameFinished(pcl::PointCloud<PointT> const&) {
+    uint64_t const now = localTime();
+    uint64_t const total = now - start_;
+    BaseObstacleDetector<PointT>::DetectionTimes const& detection =
+        detector_->lastTimes();
+    current_.times[FILTER] = filtered_source_->lastFilterTime();
+    current_.times[SEGMENTATION] = detection.segmentation;
+    current_.times[APPROXIMATION] = detection.approximation;
+    uint64_t const staged = current_.times[FILTER] +
+        current_.times[SEGMENTATION] + current_.times[APPROXIMATION];
+    current_.times[OTHER] = total > staged ? total - staged : 0;
+    current_.times[TOTAL] = total;
+
+    boost::mutex::scoped_lock lock(mutex_);
+    if (frames_.empty()) first_start_ = start_;
+    frames_.push_back(current_);
+    last_end_ = now;
+  }
+
+  /**
+   * The local time at which the last frame was finished (0 if no frame has
+   * been processed yet).
+   */
+  uint64_t lastEnd() const {
+    boost::mutex::scoped_lock lock(mutex_);
+    return last_end_;
+  }
+
+  /**
+   * The records of all frames processed so far, along with the time that was
+   * spent processing them.
+   */
+  std::vector<FrameRecord> frames(uint64_t& elapsed) const {
+    boost::mutex::scoped_lock lock(mutex_);
+    elapsed = frames_.empty() ? 0 : last_end_ - first_start_;
+    return frames_;
+  }
+private:
+  boost::shared_ptr<FilteredVideoSource<PointT> > filtered_source_;
+  boost::shared_ptr<BaseObstacleDetector<PointT> > detector_;
+  /**
+   * The frame currently being processed, which is only touched by the
+   * source's thread.
+   */
+  FrameRecord current_;
+  uint64_t start_;
+
+  mutable boost::mutex mutex_;
+  std::vector<FrameRecord> frames_;
+  uint64_t first_start_;
+  uint64_t last_end_;
+};
+
+/**
+ * Returns the peak resident set size of the process, in kB.
+ */
+long peakRss() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+  return usage.ru_maxrss;
+}
+
+/**
+ * Writes the distribution of the given samples (in microseconds) as a JSON
+ * object, in milliseconds.
+ */
+void writeDistribution(std::ostream& out, std::vector<double> samples) {
+  if (samples.empty()) {
+    out << "null";
+    return;
+  }
+  std::sort(samples.begin(), samples.end());
+  double const mean =
+      std::accumulate(samples.begin(), samples.end(), 0.) / samples.size();
+  out << "{\"mean_ms\": " << mean / 1e3
+      << ", \"p50_ms\": " << samples[samples.size() / 2] / 1e3
+      << ", \"p95_ms\": " << samples[(samples.size() * 95) / 100] / 1e3
+      << ", \"p99_ms\": " << samples[(samples.size() * 99) / 100] / 1e3
+      << ", \"max_ms\": " << samples.back() / 1e3
+      << "}";
+}
+
+/**
+ * Writes the report about the given frames as a JSON object.
+ */
+void writeReport(
+    std::ostream& out,
+    std::string const& config,
+    std::vector<FrameRecord> const& frames,
+    uint64_t elapsed) {
+  double const secs = elapsed / 1e6;
+  out << "{" << std::endl;
+  out << "  \"config\": \"" << lepp::jsonEscape(config) << "\"," << std::endl;
+  out << "  \"frames\": " << frames.size() << "," << std::endl;
+  out << "  \"elapsed_s\": " << secs << "," << std::endl;
+  out << "  \"fps\": " << (secs > 0 ? frames.size() / secs : 0) << "," << std::endl;
+  out << "  \"peak_rss_kb\": " << peakRss() << "," << std::endl;
+  out << "  \"stages\": {" << std::endl;
+  for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+    std::vector<double> samples;
+    for (size_t i = 0; i < frames.size(); ++i) {
+      samples.push_back(frames[i].times[stage]);
+    }
+    out << "    \"" << STAGE_NAMES[stage] << "\": ";
+    writeDistribution(out, samples);
+    out << (stage + 1 < STAGE_COUNT ? "," : "") << std::endl;
+  }
+  out << "  }," << std::endl;
+  out << "  \"points\": [";
+  for (size_t i = 0; i < frames.size(); ++i) {
+    out << (i > 0 ? ", " : "") << frames[i].points;
+  }
+  out << "]," << std::endl;
+  out << "  \"obstacles\": [";
+  for (size_t i = 0; i < frames.size(); ++i) {
+    out << (i > 0 ? ", " : "") << frames[i].obstacles;
+  }
+  out << "]" << std::endl;
+  out << "}" << std::endl;
+}
+
+}  // namespace <anonymous>
+
+/**
+ * Prints out the expected CLI usage of the program.
+ */
+void PrintUsage() {
+  std::cout << "usage: lola_pipeline_bench --cfg <cfg-file> [--report <file>]"
+      << " [--idle <seconds>]" << std::endl;
+  std::cout << "--cfg    : " << "the config of the pipeline, whose video source "
+      << "replays a recorded dataset or generates a synthetic scene" << std::endl;
+  std::cout << "--report : " << "where the JSON report is written "
+      << "(default pipeline_bench.json)" << std::endl;
+  std::cout << "--idle   : " << "the run ends once the source has not emitted "
+      << "a frame for this long (default 5)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  _START_EASYLOGGINGPP(argc, argv);
+  std::string config;
+  std::string report = "pipeline_bench.json";
+  double idle = 5;
+  for (int i = 1; i < argc; ++i) {
+    std::string const option = argv[i];
+    if (option == "--cfg" && i + 1 < argc) {
+      config = argv[++i];
+    } else if (option == "--report" && i + 1 < argc) {
+      report = argv[++i];
+    } else if (option == "--idle" && i + 1 < argc) {
+      idle = atof(argv[++i]);
+    } else {
+      PrintUsage();
+      return 1;
+    }
+  }
+  if (config.empty()) {
+    PrintUsage();
+    return 1;
+  }
+
+  boost::shared_ptr<FileConfigContext<PointT> > context;
+  try {
+    context.reset(new FileConfigContext<PointT>(config, true));
+  } catch (char const* exc) {
+    std::cerr << exc << std::endl;
+    return 1;
+  }
+
+  boost::shared_ptr<PipelineRecorder> recorder(new PipelineRecorder(
+      context->filtered_source(), context->base_detector()));
+  // The filtered source only attaches itself to the raw source once it is
+  // opened, so this probe sees each raw frame before the pipeline does...
+  context->raw_source()->attachObserver(boost::shared_ptr<FrameProbe>(
+      new FrameProbe(boost::bind(&PipelineRecorder::frameStarted, recorder, _1))));
+  // ...while these come after all parts of the pipeline.
+  context->detector()->attachObstacleAggregator(recorder);
+  context->source()->attachObserver(boost::shared_ptr<FrameProbe>(
+      new FrameProbe(boost::bind(&PipelineRecorder::frameFinished, recorder, _1))));
+
+  std::cout << "Running the pipeline of " << config << "..." << std::endl;
+  uint64_t const start = localTime();
+  context->source()->open();
+  uint64_t const idle_time = static_cast<uint64_t>(idle * 1e6);
+  while (true) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+    uint64_t const last = recorder->lastEnd();
+    if (localTime() - (last != 0 ? last : start) > idle_time) break;
+  }
+  context->shutdown();
+
+  uint64_t elapsed;
+  std::vector<FrameRecord> const frames = recorder->frames(elapsed);
+  std::ofstream fout(report.c_str());
+  if (!fout.is_open()) {
+    std::cerr << "Unable to open " << report << std::endl;
+    return 1;
+  }
+  writeReport(fout, config, frames, elapsed);
+  std::cout << "Processed " << frames.size() << " frames in " << elapsed / 1e6
+            << " s; the report is in " << report << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,347 @@
+/**
+ * A program that displays the live view of the vision subsystem streamed by
+ * its `[Telemetry]` (see `Telemetry.h`): the decimated cloud, the obstacles
+ * found in it and the time that each stage of the pipeline took.
+ *
+ * It runs on another computer, or on the robot's own with a lowered priority
+ * (see `--nice`), so that the rendering never competes with the detection.
+ * With `--print`, it only prints out the timings, without a display.
+ */
+#include <iostream>
+#include <iomanip>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include <unistd.h>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "lepp2/BaseVideoSource.hpp"
+#include "lepp2/models/ObjectModel.h"
+#include "lepp2/visualization/ObstacleVisualizer.hpp"
+
+#include "lola/DatagramChunks.h"
+#include "lola/SessionCloud.hpp"
+#include "lola/Telemetry.h"
+
+#include "deps/easylogging++.h"
+_INITIALIZE_EASYLOGGINGPP
+
+using namespace lepp;
+
+namespace {
+
+typedef SimplePoint PointT;
+typedef pcl::PointCloud<PointT> PointCloudT;
+
+/**
+ * Prints out the expected CLI usage of the program.
+ */
+void PrintUsage() {
+  std::cout << "usage: lola_telemetry_viewer [options]" << std::endl;
+  std::cout << "options:" << std::endl;
+  std::cout << "  --port <port>      : " << "receive over UDP on this port"
+      << " (53270 by default)" << std::endl;
+  std::cout << "  --socket <path>    : " << "receive on the local socket at this path"
+      << " instead" << std::endl;
+  std::cout << "  --nice <n>         : " << "lower the priority of the viewer by this much"
+      << " (10 by default)" << std::endl;
+  std::cout << "  --print            : " << "only print out the timings" << std::endl;
+}
+
+/**
+ * A single message of the telemetry stream.
+ */
+struct Telemetry {
+  Telemetry() : cloud(new PointCloudT()) {}
+  TelemetryHeader header;
+  std::vector<TelemetryObstacle> obstacles;
+  PointCloudT::Ptr cloud;
+};
+
+/**
+ * Receives the telemetry on a socket of the given (datagram) protocol, on a
+ * thread of its own, and keeps the newest message for the viewer to take.
+ */
+template<class Protocol>
+class TelemetryReceiver {
+public:
+  TelemetryReceiver(typename Protocol::endpoint const& endpoint)
+      : socket_(io_service_),
+        datagram_(sizeof(DatagramChunk) + DATAGRAM_CHUNK_SIZE),
+        assembler_(TELEMETRY_MAGIC, TELEMETRY_MAX_SIZE),
+        has_pending_(false),
+        session_(0),
+        last_seq_(0),
+        received_(0),
+        missed_(0) {
+    socket_.open(endpoint.protocol());
+    // A whole message arrives in a burst of datagrams, which need to fit in
+    // the socket's buffer until they are taken out.
+    boost::system::error_code ignored;
+    socket_.set_option(
+        boost::asio::socket_base::receive_buffer_size(8 * 1024 * 1024), ignored);
+    socket_.bind(endpoint);
+    receive();
+    thread_ = boost::thread(
+        boost::bind(&boost::asio::io_service::run, &io_service_));
+  }
+  ~TelemetryReceiver() {
+    io_service_.stop();
+    thread_.join();
+  }
+
+  /**
+   * Swaps the newest message received since the last call into the given
+   * one. Returns false if there is no such message.
+   */
+  bool take(Telemetry& telemetry) {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (!has_pending_) return false;
+    has_pending_ = false;
+    telemetry.header = pending_.header;
+    telemetry.obstacles.swap(pending_.obstacles);
+    telemetry.cloud.swap(pending_.cloud);
+    return true;
+  }
+
+  /**
+   * The number of messages that the publisher sent, but never made it.
+   */
+  size_t missed() const {
+    boost::mutex::scoped_lock lock(mutex_);
+    return missed_;
+  }
+private:
+  void receive() {
+    socket_.async_receive_from(
+        boost::asio::buffer(datagram_),
+        sender_,
+        boost::bind(&TelemetryReceiver::handleReceive, this,
+                    boost::asio::placeholders::error,
+                    boost::asio::placeholders::bytes_transferred));
+  }
+
+  void handleReceive(boost::system::error_code const& error, size_t bytes) {
+    if (error) {
+      LERROR << "TelemetryReceiver: Unable to receive: " << error.message();
+      return;
+    }
+    if (assembler_.add(&datagram_[0], bytes)) {
+      if (decode(assembler_.message(), current_)) {
+        boost::mutex::scoped_lock lock(mutex_);
+        uint32_t const seq = current_.header.seq;
+        if (received_ != 0 && assembler_.session() != session_) {
+          // The publisher was restarted (or replaced); its sequence numbers
+          // start over.
+          LINFO << "TelemetryReceiver: A new publisher session started";
+          received_ = 0;
+        }
+        session_ = assembler_.session();
+        if (received_ != 0 && static_cast<int32_t>(seq - last_seq_) > 1) {
+          missed_ += seq - last_seq_ - 1;
+        }
+        last_seq_ = seq;
+        ++received_;
+        // Swapping keeps the buffers of both messages around for reuse.
+        pending_.header = current_.header;
+        pending_.obstacles.swap(current_.obstacles);
+        pending_.cloud.swap(current_.cloud);
+        has_pending_ = true;
+      } else {
+        LWARNING << "TelemetryReceiver: Dropping a malformed message";
+      }
+    }
+    receive();
+  }
+
+  /**
+   * Puts the given message into `telemetry`. Returns false if it is
+   * malformed.
+   */
+  bool decode(std::vector<char> const& message, Telemetry& telemetry) {
+    TelemetryHeader& header = telemetry.header;
+    if (message.size() < sizeof header) return false;
+    memcpy(&header, &message[0], sizeof header);
+    size_t const records = header.obstacle_count * sizeof(TelemetryObstacle);
+    if (header.magic != TELEMETRY_MAGIC ||
+        header.obstacle_count > TELEMETRY_MAX_SIZE / sizeof(TelemetryObstacle) ||
+        message.size() < sizeof header + records) {
+      return false;
+    }
+    telemetry.obstacles.resize(header.obstacle_count);
+    if (records != 0) {
+      memcpy(&telemetry.obstacles[0], &message[sizeof header], records);
+    }
+    payload_.assign(message.begin() + sizeof header + records, message.end());
+    return decodeSessionCloud(header.cloud_type, payload_, *telemetry.cloud);
+  }
+
+  boost::asio::io_service io_service_;
+  typename Protocol::socket socket_;
+  typename Protocol::endpoint sender_;
+
+  /**
+   * The state of the reception, only touched by the receiver's thread.
+   */
+  std::vector<char> datagram_;
+  ChunkAssembler assembler_;
+  std::vector<char> payload_;
+  Telemetry current_;
+
+  /**
+   * The newest message, which the viewer is yet to take.
+   */
+  mutable boost::mutex mutex_;
+  Telemetry pending_;
+  bool has_pending_;
+  uint32_t session_;
+  uint32_t last_seq_;
+  size_t received_;
+  size_t missed_;
+
+  boost::thread thread_;
+};
+
+/**
+ * Returns a single line describing the timings of the given message.
+ */
+std::string describe(TelemetryHeader const& header, size_t missed) {
+  std::ostringstream ss;
+  ss << std::fixed << std::setprecision(1)
+     << "frame " << header.seq
+     << " | filter " << header.filter_time / 1e3 << " ms"
+     << " | segmentation " << header.segmentation_time / 1e3 << " ms"
+     << " | approximation " << header.approximation_time / 1e3 << " ms"
+     << " | latency " << header.latency / 1e3 << " ms"
+     << " | " << header.obstacle_count << " obstacle parts"
+     << " | " << missed << " missed";
+  return ss.str();
+}
+
+/**
+ * Draws the obstacles of the given message, reusing the shapes that the
+ * drawer already drew.
+ */
+void drawObstacles(
+    std::vector<TelemetryObstacle> const& obstacles,
+    ModelDrawer& drawer) {
+  drawer.beginFrame();
+  size_t const sz = obstacles.size();
+  for (size_t i = 0; i < sz; ++i) {
+    TelemetryObstacle const& record = obstacles[i];
+    // The parts of an obstacle follow each other.
+    if (i == 0 || record.id != obstacles[i - 1].id) {
+      drawer.setObstacle(record.id);
+    }
+    double const radius = record.radius / 1000.;
+    Coordinate const first(record.coords[0] / 1000.,
+                           record.coords[1] / 1000.,
+                           record.coords[2] / 1000.);
+    if (record.type == 0) {
+      SphereModel sphere(radius, first);
+      sphere.accept(drawer);
+    } else {
+      Coordinate const second(record.coords[3] / 1000.,
+                              record.coords[4] / 1000.,
+                              record.coords[5] / 1000.);
+      CapsuleModel capsule(radius, first, second);
+      capsule.accept(drawer);
+    }
+  }
+  drawer.endFrame();
+}
+
+template<class Protocol>
+int view(typename Protocol::endpoint const& endpoint, bool print) {
+  TelemetryReceiver<Protocol> receiver(endpoint);
+  Telemetry telemetry;
+  std::cout << "Waiting for the telemetry on " << endpoint << "..." << std::endl;
+
+  if (print) {
+    while (true) {
+      if (receiver.take(telemetry)) {
+        std::cout << describe(telemetry.header, receiver.missed()) << std::endl;
+      }
+      boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+    }
+  }
+
+  pcl::visualization::PCLVisualizer viewer("LOLA telemetry");
+  viewer.setBackgroundColor(0, 0, 0);
+  viewer.addCoordinateSystem(0.5);
+  viewer.initCameraParameters();
+  viewer.setCameraPosition(5, -5, 5, 0, 0, 1);
+  ModelDrawer drawer(viewer);
+  bool shown = false;
+  while (!viewer.wasStopped()) {
+    if (receiver.take(telemetry)) {
+      PointCloudT::ConstPtr const cloud = telemetry.cloud;
+      if (!shown) {
+        viewer.addPointCloud<PointT>(cloud, "cloud");
+        viewer.addText(describe(telemetry.header, receiver.missed()),
+                       10, 10, "timings");
+        shown = true;
+      } else {
+        viewer.updatePointCloud<PointT>(cloud, "cloud");
+        viewer.updateText(describe(telemetry.header, receiver.missed()),
+                          10, 10, "timings");
+      }
+      drawObstacles(telemetry.obstacles, drawer);
+    }
+    viewer.spinOnce(20);
+  }
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  _START_EASYLOGGINGPP(argc, argv);
+  int port = 53270;
+  std::string socket_path;
+  int niceness = 10;
+  bool print = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string const option = argv[i];
+    if (option == "--port" && i + 1 < argc) {
+      port = atoi(argv[++i]);
+    } else if (option == "--socket" && i + 1 < argc) {
+      socket_path = argv[++i];
+    } else if (option == "--nice" && i + 1 < argc) {
+      niceness = atoi(argv[++i]);
+    } else if (option == "--print") {
+      print = true;
+    } else {
+      PrintUsage();
+      return 1;
+    }
+  }
+
+  // On the robot's computer, the viewer only gets what the pipeline leaves.
+  errno = 0;
+  if (nice(niceness) == -1 && errno != 0) {
+    std::cerr << "Unable to lower the priority: " << strerror(errno) << std::endl;
+  }
+
+  try {
+    if (!socket_path.empty()) {
+      // A socket left behind by an earlier run would keep it from binding.
+      unlink(socket_path.c_str());
+      return view<boost::asio::local::datagram_protocol>(
+          boost::asio::local::datagram_protocol::endpoint(socket_path), print);
+    }
+    return view<boost::asio::ip::udp>(
+        boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), port), print);
+  } catch (char const* exc) {
+    std::cerr << exc << std::endl;
+    return 1;
+  } catch (std::exception const& exc) {
+    std::cerr << exc.what() << std::endl;
+    return 1;
+  }
+}